@@ -195,6 +195,8 @@ cbor_internal_read_object(CborValue *root_value,
                     err |= CborErrorDataTooLarge;
                     break;
                 }
+                /* Leave room for the terminating NUL. */
+                len = sizeof attrbuf;
                 err |= cbor_value_copy_text_string(&cur_value, attrbuf, &len,
                                                      NULL);
             }
@@ -264,6 +266,10 @@ cbor_internal_read_object(CborValue *root_value,
                 size_t len = cursor->len;
                 err |= cbor_value_copy_text_string(&cur_value, lptr,
                                                    &len, NULL);
+                if (len >= cursor->len) {
+                    /* No room for the terminating NUL. */
+                    err |= CborErrorOutOfMemory;
+                }
                 break;
             }
             case CborAttrArrayType:
@@ -293,6 +299,7 @@ cbor_read_array(struct CborValue *value, const struct cbor_array_t *arr)
     struct CborValue elem;
     int off, arrcount;
     size_t len;
+    size_t cap;
     void *lptr;
     char *tp;
 
@@ -324,8 +331,13 @@ cbor_read_array(struct CborValue *value, const struct cbor_array_t *arr)
             break;
 #endif
         case CborAttrTextStringType:
-            len = arr->arr.strings.storelen - (tp - arr->arr.strings.store);
+            cap = arr->arr.strings.storelen - (tp - arr->arr.strings.store);
+            len = cap;
             err |= cbor_value_copy_text_string(&elem, tp, &len, NULL);
+            if (len >= cap) {
+                /* No room for the terminating NUL. */
+                err |= CborErrorOutOfMemory;
+            }
             arr->arr.strings.ptrs[off] = tp;
             tp += len + 1;
             break;
@@ -31,7 +31,13 @@ extern "C" {
 
 /**
  * @brief Registers the file system management command handler group.
- */ 
+ *
+ * The group is defined with MGMT_GROUP_DEFINE() and registered at link time,
+ * so this function has no effect at runtime.  It serves as the anchor that
+ * links the group in when the group's library is linked as an ordinary
+ * archive.  On Mynewt, the package names it with -u in its pkg.lflags, so
+ * the application doesn't need to call it.
+ */
 void fs_mgmt_register_group(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,43 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_FS_MGMT_
+#define H_POSIX_FS_MGMT_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Serves file management requests from the specified directory.
+ *
+ * Request paths are interpreted relative to this directory.  Paths containing
+ * a ".." component are rejected.
+ *
+ * @param root                  The directory to serve files from.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int posix_fs_mgmt_init(const char *root);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mgmt/mgmt.h"
+#include "fs_mgmt/fs_mgmt_impl.h"
+#include "posix_fs_mgmt/posix_fs_mgmt.h"
+
+static char posix_fs_mgmt_root[PATH_MAX];
+
+/**
+ * Maps a request path onto the host filesystem.
+ */
+static int
+posix_fs_mgmt_path(const char *path, char *dst, size_t dst_len)
+{
+    const char *cur;
+    int rc;
+
+    /* Don't let a request escape the root directory. */
+    for (cur = strstr(path, ".."); cur != NULL; cur = strstr(cur + 2, "..")) {
+        if ((cur == path || cur[-1] == '/') &&
+            (cur[2] == '\0' || cur[2] == '/')) {
+
+            return MGMT_ERR_EINVAL;
+        }
+    }
+
+    while (*path == '/') {
+        path++;
+    }
+
+    rc = snprintf(dst, dst_len, "%s/%s", posix_fs_mgmt_root, path);
+    if (rc < 0 || rc >= dst_len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_filelen(const char *path, size_t *out_len)
+{
+    char host_path[PATH_MAX];
+    struct stat st;
+    int rc;
+
+    rc = posix_fs_mgmt_path(path, host_path, sizeof host_path);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = stat(host_path, &st);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_len = st.st_size;
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_read(const char *path, size_t offset, size_t len,
+                  void *out_data, size_t *out_len)
+{
+    char host_path[PATH_MAX];
+    ssize_t bytes_read;
+    int fd;
+    int rc;
+
+    rc = posix_fs_mgmt_path(path, host_path, sizeof host_path);
+    if (rc != 0) {
+        return rc;
+    }
+
+    fd = open(host_path, O_RDONLY);
+    if (fd < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    bytes_read = pread(fd, out_data, len, offset);
+    close(fd);
+
+    if (bytes_read < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_len = bytes_read;
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_write(const char *path, size_t offset, const void *data,
+                   size_t len)
+{
+    char host_path[PATH_MAX];
+    ssize_t bytes_written;
+    int flags;
+    int fd;
+    int rc;
+
+    rc = posix_fs_mgmt_path(path, host_path, sizeof host_path);
+    if (rc != 0) {
+        return rc;
+    }
+
+    /* Truncate the file before writing the first chunk.  This is done to
+     * properly handle an overwrite of an existing file.
+     */
+    flags = O_WRONLY | O_CREAT;
+    if (offset == 0) {
+        flags |= O_TRUNC;
+    }
+
+    fd = open(host_path, flags, 0644);
+    if (fd < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    bytes_written = pwrite(fd, data, len, offset);
+    close(fd);
+
+    if (bytes_written != len) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+posix_fs_mgmt_init(const char *root)
+{
+    if (strlen(root) >= sizeof posix_fs_mgmt_root) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    strcpy(posix_fs_mgmt_root, root);
+    return 0;
+}
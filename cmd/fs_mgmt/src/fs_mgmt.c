@@ -21,6 +21,7 @@
 #include <string.h>
 #include "cborattr/cborattr.h"
 #include "mgmt/mgmt.h"
+#include "mgmt/mgmt_trace.h"
 #include "fs_mgmt/fs_mgmt.h"
 #include "fs_mgmt/fs_mgmt_impl.h"
 #include "fs_mgmt_config.h"
@@ -28,7 +29,8 @@
 static mgmt_handler_fn fs_mgmt_file_download;
 static mgmt_handler_fn fs_mgmt_file_upload;
 
-static struct {
+/** The state of a file upload; one per session. */
+struct fs_mgmt_upload {
     /** Whether an upload is currently in progress. */
     bool uploading;
 
@@ -37,7 +39,27 @@ static struct {
 
     /** Total length of file currently being uploaded. */
     size_t len;
-} fs_mgmt_ctxt;
+
+    /** Path of the file being uploaded. */
+    char path[FS_MGMT_PATH_SIZE + 1];
+
+#if FS_MGMT_UL_REORDER_COUNT > 0
+    /** Upload chunks that arrived ahead of the expected offset. */
+    struct mgmt_reorder_buf reorder;
+    struct mgmt_reorder_slot reorder_slots[FS_MGMT_UL_REORDER_COUNT];
+    uint8_t reorder_data[FS_MGMT_UL_REORDER_COUNT][FS_MGMT_UL_CHUNK_SIZE];
+#endif
+};
+
+static struct fs_mgmt_upload fs_mgmt_uploads[FS_MGMT_UL_SESSIONS];
+
+/** Ties each entry in fs_mgmt_uploads to the peer performing the upload. */
+static struct mgmt_session fs_mgmt_sessions[FS_MGMT_UL_SESSIONS];
+static struct mgmt_session_pool fs_mgmt_session_pool = {
+    .msp_sessions = fs_mgmt_sessions,
+    .msp_num_sessions = FS_MGMT_UL_SESSIONS,
+    .msp_timeout_ms = FS_MGMT_UL_TIMEOUT_MS,
+};
 
 static const struct mgmt_handler fs_mgmt_handlers[] = {
     [FS_MGMT_ID_FILE] = {
@@ -46,14 +68,7 @@ static const struct mgmt_handler fs_mgmt_handlers[] = {
     },
 };
 
-#define FS_MGMT_HANDLER_CNT \
-    sizeof fs_mgmt_handlers / sizeof fs_mgmt_handlers[0]
-
-static struct mgmt_group fs_mgmt_group = {
-    .mg_handlers = fs_mgmt_handlers,
-    .mg_handlers_count = FS_MGMT_HANDLER_CNT,
-    .mg_group_id = MGMT_GROUP_ID_FS,
-};
+static MGMT_GROUP_DEFINE(fs_mgmt_group, MGMT_GROUP_ID_FS, fs_mgmt_handlers);
 
 /**
  * Command handler: fs file (read)
@@ -86,6 +101,7 @@ fs_mgmt_file_download(struct mgmt_ctxt *ctxt)
 
     off = ULLONG_MAX;
     rc = cbor_read_object(&ctxt->it, dload_attr);
+    MGMT_TRACE(MGMT_TRACE_DECODED, NULL, 0);
     if (rc != 0 || off == ULLONG_MAX) {
         return MGMT_ERR_EINVAL;
     }
@@ -101,8 +117,10 @@ fs_mgmt_file_download(struct mgmt_ctxt *ctxt)
     }
 
     /* Read the requested chunk from the file. */
+    MGMT_TRACE(MGMT_TRACE_IO, NULL, FS_MGMT_DL_CHUNK_SIZE);
     rc = fs_mgmt_impl_read(path, off, FS_MGMT_DL_CHUNK_SIZE,
                            file_data, &bytes_read);
+    MGMT_TRACE(MGMT_TRACE_IO_DONE, NULL, rc);
     if (rc != 0) {
         return rc;
     }
@@ -148,6 +166,84 @@ fs_mgmt_file_upload_rsp(struct mgmt_ctxt *ctxt, int rc, unsigned long long off)
     return 0;
 }
 
+/**
+ * Begins a new upload in the specified session.  Fails if another session is
+ * uploading the same file.
+ */
+static int
+fs_mgmt_file_upload_start(int idx, const char *file_name, size_t len)
+{
+    struct fs_mgmt_upload *upload;
+    int i;
+
+    for (i = 0; i < FS_MGMT_UL_SESSIONS; i++) {
+        if (i != idx && fs_mgmt_sessions[i].ms_used &&
+            strcmp(fs_mgmt_uploads[i].path, file_name) == 0) {
+
+            if (!mgmt_session_expired(&fs_mgmt_session_pool, i)) {
+                return MGMT_ERR_EBADSTATE;
+            }
+
+            /* Abandoned; the new upload takes over. */
+            fs_mgmt_uploads[i].uploading = false;
+            mgmt_session_close(&fs_mgmt_session_pool, i);
+        }
+    }
+
+    upload = &fs_mgmt_uploads[idx];
+    upload->uploading = true;
+    upload->off = 0;
+    upload->len = len;
+    strcpy(upload->path, file_name);
+
+#if FS_MGMT_UL_REORDER_COUNT > 0
+    upload->reorder = (struct mgmt_reorder_buf) {
+        .mrb_slots = upload->reorder_slots,
+        .mrb_data = &upload->reorder_data[0][0],
+        .mrb_slot_size = FS_MGMT_UL_CHUNK_SIZE,
+        .mrb_num_slots = FS_MGMT_UL_REORDER_COUNT,
+    };
+    mgmt_reorder_clear(&upload->reorder);
+#endif
+
+    return 0;
+}
+
+/**
+ * Writes a chunk of file data at the current upload offset.
+ */
+static int
+fs_mgmt_file_write_chunk(struct fs_mgmt_upload *upload, const uint8_t *data,
+                         size_t data_len)
+{
+    size_t new_off;
+    int rc;
+
+    new_off = upload->off + data_len;
+    if (new_off > upload->len) {
+        /* Data exceeds image length. */
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (data_len > 0) {
+        /* Write the data chunk to the file. */
+        MGMT_TRACE(MGMT_TRACE_IO, NULL, data_len);
+        rc = fs_mgmt_impl_write(upload->path, upload->off, data, data_len);
+        MGMT_TRACE(MGMT_TRACE_IO_DONE, NULL, rc);
+        if (rc != 0) {
+            return rc;
+        }
+        upload->off = new_off;
+    }
+
+    if (upload->off == upload->len) {
+        /* Upload complete. */
+        upload->uploading = false;
+    }
+
+    return 0;
+}
+
 /**
  * Command handler: fs file (write)
  */
@@ -156,10 +252,14 @@ fs_mgmt_file_upload(struct mgmt_ctxt *ctxt)
 {
     uint8_t file_data[FS_MGMT_UL_CHUNK_SIZE];
     char file_name[FS_MGMT_PATH_SIZE + 1];
+    struct fs_mgmt_upload *upload;
+#if FS_MGMT_UL_REORDER_COUNT > 0
+    const uint8_t *held;
+#endif
     unsigned long long len;
     unsigned long long off;
     size_t data_len;
-    size_t new_off;
+    int idx;
     int rc;
 
     const struct cbor_attr_t uload_attr[5] = {
@@ -191,9 +291,15 @@ fs_mgmt_file_upload(struct mgmt_ctxt *ctxt)
         [4] = { 0 },
     };
 
+    /* Rejected, held, and dropped chunks change nothing that a cached
+     * response depends on.
+     */
+    ctxt->unchanged = true;
+
     len = ULLONG_MAX;
     off = ULLONG_MAX;
     rc = cbor_read_object(&ctxt->it, uload_attr);
+    MGMT_TRACE(MGMT_TRACE_DECODED, NULL, 0);
     if (rc != 0 || off == ULLONG_MAX || file_name[0] == '\0') {
         return MGMT_ERR_EINVAL;
     }
@@ -204,47 +310,85 @@ fs_mgmt_file_upload(struct mgmt_ctxt *ctxt)
             return MGMT_ERR_EINVAL;
         }
 
-        fs_mgmt_ctxt.uploading = true;
-        fs_mgmt_ctxt.off = 0;
-        fs_mgmt_ctxt.len = len;
+        /* Each peer has its own upload; starting a new one abandons any
+         * that the peer already had in progress.
+         */
+        rc = mgmt_session_open(&fs_mgmt_session_pool, ctxt, &idx);
+        if (rc != 0) {
+            return rc;
+        }
+
+        ctxt->unchanged = false;
+
+        rc = fs_mgmt_file_upload_start(idx, file_name, len);
+        if (rc != 0) {
+            mgmt_session_close(&fs_mgmt_session_pool, idx);
+            return rc;
+        }
+        upload = &fs_mgmt_uploads[idx];
     } else {
-        if (!fs_mgmt_ctxt.uploading) {
+        idx = mgmt_session_find(&fs_mgmt_session_pool, ctxt);
+        if (idx == -1) {
             return MGMT_ERR_EINVAL;
         }
-        
-        if (off != fs_mgmt_ctxt.off) {
+
+        upload = &fs_mgmt_uploads[idx];
+        if (!upload->uploading || strcmp(upload->path, file_name) != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        if (off != upload->off) {
+#if FS_MGMT_UL_REORDER_COUNT > 0
+            /* Hold a chunk that arrived early; it gets written once the gap
+             * before it is filled.
+             */
+            rc = mgmt_reorder_hold(&upload->reorder, ctxt, upload->off, off,
+                                   file_data, data_len);
+            if (rc == 0) {
+                return fs_mgmt_file_upload_rsp(ctxt, 0, upload->off);
+            }
+#endif
             /* Invalid offset.  Drop the data and send the expected offset. */
             return fs_mgmt_file_upload_rsp(ctxt, MGMT_ERR_EINVAL,
-                                           fs_mgmt_ctxt.off);
+                                           upload->off);
         }
     }
 
-    new_off = fs_mgmt_ctxt.off + data_len;
-    if (new_off > fs_mgmt_ctxt.len) {
-        /* Data exceeds image length. */
-        return MGMT_ERR_EINVAL;
-    }
+    ctxt->unchanged = false;
+    rc = fs_mgmt_file_write_chunk(upload, file_data, data_len);
 
-    if (data_len > 0) {
-        /* Write the data chunk to the file. */
-        rc = fs_mgmt_impl_write(file_name, off, file_data, data_len);
-        if (rc != 0) {
-            return rc;
+#if FS_MGMT_UL_REORDER_COUNT > 0
+    /* Write any held chunks that are now contiguous. */
+    while (rc == 0 && upload->uploading) {
+        held = mgmt_reorder_take(&upload->reorder, upload->off, &data_len);
+        if (held == NULL) {
+            break;
         }
-        fs_mgmt_ctxt.off = new_off;
+
+        rc = fs_mgmt_file_write_chunk(upload, held, data_len);
     }
+#endif
 
-    if (fs_mgmt_ctxt.off == fs_mgmt_ctxt.len) {
-        /* Upload complete. */
-        fs_mgmt_ctxt.uploading = false;
+    if (rc != 0) {
+        return rc;
     }
 
-    /* Send the response. */
-    return fs_mgmt_file_upload_rsp(ctxt, 0, fs_mgmt_ctxt.off);
+    if (!upload->uploading) {
+        /* Upload complete; free the session for another one. */
+        mgmt_session_close(&fs_mgmt_session_pool, idx);
+    }
+
+    /* A retransmission of this chunk gets the same answer. */
+    ctxt->replayable = true;
+
+    /* Send the response.  The offset acknowledges all data written so far. */
+    return fs_mgmt_file_upload_rsp(ctxt, 0, upload->off);
 }
 
 void
 fs_mgmt_register_group(void)
 {
-    mgmt_register_group(&fs_mgmt_group);
+    /* The group is registered at link time; a reference to this function
+     * keeps it in the image.
+     */
 }
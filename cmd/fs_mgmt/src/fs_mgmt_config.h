@@ -8,12 +8,18 @@
 #define FS_MGMT_DL_CHUNK_SIZE   MYNEWT_VAL(FS_MGMT_DL_CHUNK_SIZE)
 #define FS_MGMT_PATH_SIZE       MYNEWT_VAL(FS_MGMT_PATH_SIZE)
 #define FS_MGMT_UL_CHUNK_SIZE   MYNEWT_VAL(FS_MGMT_UL_CHUNK_SIZE)
+#define FS_MGMT_UL_REORDER_COUNT    MYNEWT_VAL(FS_MGMT_UL_REORDER_COUNT)
+#define FS_MGMT_UL_SESSIONS     MYNEWT_VAL(FS_MGMT_UL_SESSIONS)
+#define FS_MGMT_UL_TIMEOUT_MS   MYNEWT_VAL(FS_MGMT_UL_TIMEOUT_MS)
 
 #elif defined __ZEPHYR__
 
 #define FS_MGMT_DL_CHUNK_SIZE   CONFIG_FS_MGMT_DL_CHUNK_SIZE
 #define FS_MGMT_PATH_SIZE       CONFIG_FS_MGMT_PATH_SIZE
 #define FS_MGMT_UL_CHUNK_SIZE   CONFIG_FS_MGMT_UL_CHUNK_SIZE
+#define FS_MGMT_UL_REORDER_COUNT    CONFIG_FS_MGMT_UL_REORDER_COUNT
+#define FS_MGMT_UL_SESSIONS     CONFIG_FS_MGMT_UL_SESSIONS
+#define FS_MGMT_UL_TIMEOUT_MS   CONFIG_FS_MGMT_UL_TIMEOUT_MS
 
 #else
 
@@ -39,9 +39,26 @@ extern "C" {
 
 /**
  * @brief Registers the image management command handler group.
- */ 
+ *
+ * The group is defined with MGMT_GROUP_DEFINE() and registered at link time,
+ * so this function has no effect at runtime.  It serves as the anchor that
+ * links the group in when the group's library is linked as an ordinary
+ * archive.  On Mynewt, the package names it with -u in its pkg.lflags, so
+ * the application doesn't need to call it.
+ */
 void img_mgmt_register_group(void);
 
+/**
+ * @brief Discards the cached image slot metadata and boot state.
+ *
+ * The image management group caches the version and hash of each image slot,
+ * and the swap type, until it modifies a slot or the boot state itself.  An
+ * application that writes to the image slots or changes the boot state by
+ * other means (e.g., confirming the running image at startup) must call this
+ * function afterwards.  It may be called from any task.
+ */
+void img_mgmt_cache_invalidate(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,23 @@
 extern "C" {
 #endif
 
+/** @typedef img_mgmt_impl_erase_done_fn
+ * @brief Indicates that a background erase of the spare slot has finished.
+ *
+ * @param status                0 on success, MGMT_ERR_[...] code on failure.
+ * @param arg                   The argument passed to
+ *                                  img_mgmt_impl_erase_slot_async().
+ */
+typedef void img_mgmt_impl_erase_done_fn(int status, void *arg);
+
+/** @typedef img_mgmt_impl_bg_fn
+ * @brief Performs one step of a background operation.
+ *
+ * @return                      true if the function is to be called again;
+ *                              false if the operation is complete.
+ */
+typedef bool img_mgmt_impl_bg_fn(void);
+
 /**
  * @brief Ensures the spare slot (slot 1) is fully erased.
  *
@@ -38,6 +55,85 @@ extern "C" {
  */
 int img_mgmt_impl_erase_slot(void);
 
+/**
+ * @brief Starts erasing the spare slot (slot 1) in the background.
+ *
+ * The callback is executed in an implementation-defined task when the erase
+ * finishes, possibly before this function returns.
+ *
+ * @param cb                    The callback to execute when the erase
+ *                                  finishes.
+ * @param arg                   Optional argument to pass to the callback.
+ *
+ * @return                      0 if the erase was started;
+ *                              MGMT_ERR_ENOTSUP if background erase is not
+ *                                  supported;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_erase_slot_async(img_mgmt_impl_erase_done_fn *cb,
+                                   void *arg);
+
+/**
+ * @brief Starts calling the specified function repeatedly in a low-priority
+ * background task, until it returns false.
+ *
+ * Requests continue to be processed between calls.  Each call performs a
+ * bounded amount of work, e.g., erasing a single flash sector.
+ *
+ * @param fn                    The function to call.
+ *
+ * @return                      0 if the operation was started;
+ *                              MGMT_ERR_ENOTSUP if background operations are
+ *                                  not supported;
+ *                              MGMT_ERR_EBADSTATE if a background operation
+ *                                  is already in progress;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_run_bg(img_mgmt_impl_bg_fn *fn);
+
+/**
+ * @brief Retrieves the flash sector of the spare slot (slot 1) that contains
+ * the specified offset.
+ *
+ * @param offset                The offset within slot 1.
+ * @param out_idx               On success, the index of the sector within
+ *                                  slot 1, counting from 0.
+ * @param out_start             On success, the offset of the sector within
+ *                                  slot 1.
+ * @param out_size              On success, the size of the sector, in bytes.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if sectors cannot be erased
+ *                                  individually;
+ *                              MGMT_ERR_EINVAL if the offset is beyond the
+ *                                  end of the slot;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_sector_info(unsigned int offset, int *out_idx,
+                              unsigned int *out_start,
+                              unsigned int *out_size);
+
+/**
+ * @brief Erases a flash sector of the spare slot (slot 1).
+ *
+ * @param start                 The offset of the sector within slot 1, as
+ *                                  reported by img_mgmt_impl_sector_info().
+ * @param size                  The size of the sector, in bytes.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_erase_sector(unsigned int start, unsigned int size);
+
+/**
+ * @brief Erases the boot trailer of the spare slot (slot 1), such that the
+ * boot loader sees no request to swap to it.
+ *
+ * Called when an upload starts without erasing the whole slot.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_erase_trailer(void);
+
 /**
  * @brief Marks the image in the specified slot as pending. On the next reboot,
  * the system will perform a boot of the specified image.
@@ -18,11 +18,30 @@
  */
 
 #include "sysinit/sysinit.h"
+#include "os/os.h"
 #include "mgmt/mgmt.h"
+#include "mynewt_mgmt/mynewt_mgmt.h"
 #include "img_mgmt/img_mgmt_impl.h"
 #include "img_mgmt/img_mgmt.h"
 #include "img_mgmt_priv.h"
 
+/* Background operations run a step at a time on the mgmt event queue. */
+static struct {
+    struct os_event ev;
+    img_mgmt_impl_bg_fn *fn;
+} mynewt_img_mgmt_bg_op;
+
+static void
+mynewt_img_mgmt_bg_ev(struct os_event *ev)
+{
+    if (mynewt_img_mgmt_bg_op.fn()) {
+        /* Requeue behind any requests that arrived in the meantime. */
+        os_eventq_put(mgmt_evq_get(), &mynewt_img_mgmt_bg_op.ev);
+    } else {
+        mynewt_img_mgmt_bg_op.fn = NULL;
+    }
+}
+
 int
 img_mgmt_impl_erase_slot(void)
 {
@@ -50,6 +69,190 @@ img_mgmt_impl_erase_slot(void)
     return 0;
 }
 
+int
+img_mgmt_impl_run_bg(img_mgmt_impl_bg_fn *fn)
+{
+    if (mynewt_img_mgmt_bg_op.fn != NULL) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    mynewt_img_mgmt_bg_op.fn = fn;
+    mynewt_img_mgmt_bg_op.ev.ev_cb = mynewt_img_mgmt_bg_ev;
+    os_eventq_put(mgmt_evq_get(), &mynewt_img_mgmt_bg_op.ev);
+
+    return 0;
+}
+
+#if MYNEWT_VAL(IMG_MGMT_ERASE_ASYNC)
+/* A background erase of slot 1.  One sector is erased per event, so requests
+ * from other transports are processed in between.
+ */
+static struct {
+    struct os_event ev;
+    img_mgmt_impl_erase_done_fn *cb;
+    void *arg;
+
+    /* The sector most recently erased; -1 before the first. */
+    int sec_id;
+} mynewt_img_mgmt_erase_op;
+
+/**
+ * Erases the next sector of slot 1.
+ */
+static int
+mynewt_img_mgmt_erase_step(bool *out_done)
+{
+    const struct flash_area *fa;
+    struct flash_area sector;
+    bool empty;
+    int rc;
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    if (mynewt_img_mgmt_erase_op.sec_id == -1) {
+        /* Nothing to do if the slot is already erased. */
+        rc = flash_area_is_empty(fa, &empty);
+        if (rc != 0) {
+            return MGMT_ERR_EUNKNOWN;
+        }
+        if (empty) {
+            *out_done = true;
+            return 0;
+        }
+    }
+
+    rc = flash_area_getnext_sector(FLASH_AREA_IMAGE_1,
+                                   &mynewt_img_mgmt_erase_op.sec_id, &sector);
+    if (rc != 0) {
+        /* Past the last sector. */
+        *out_done = true;
+        return 0;
+    }
+
+    rc = flash_area_erase(fa, sector.fa_off - fa->fa_off, sector.fa_size);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_done = false;
+    return 0;
+}
+
+static void
+mynewt_img_mgmt_erase_ev(struct os_event *ev)
+{
+    img_mgmt_impl_erase_done_fn *cb;
+    bool done;
+    int rc;
+
+    rc = mynewt_img_mgmt_erase_step(&done);
+    if (rc == 0 && !done) {
+        /* Requeue behind any requests that arrived in the meantime. */
+        os_eventq_put(mgmt_evq_get(), &mynewt_img_mgmt_erase_op.ev);
+        return;
+    }
+
+    cb = mynewt_img_mgmt_erase_op.cb;
+    mynewt_img_mgmt_erase_op.cb = NULL;
+
+    cb(rc, mynewt_img_mgmt_erase_op.arg);
+}
+
+int
+img_mgmt_impl_erase_slot_async(img_mgmt_impl_erase_done_fn *cb, void *arg)
+{
+    if (mynewt_img_mgmt_erase_op.cb != NULL) {
+        /* Erase already in progress. */
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    mynewt_img_mgmt_erase_op.cb = cb;
+    mynewt_img_mgmt_erase_op.arg = arg;
+    mynewt_img_mgmt_erase_op.sec_id = -1;
+    mynewt_img_mgmt_erase_op.ev.ev_cb = mynewt_img_mgmt_erase_ev;
+    os_eventq_put(mgmt_evq_get(), &mynewt_img_mgmt_erase_op.ev);
+
+    return 0;
+}
+#endif
+
+int
+img_mgmt_impl_sector_info(unsigned int offset, int *out_idx,
+                          unsigned int *out_start, unsigned int *out_size)
+{
+    const struct flash_area *fa;
+    struct flash_area sector;
+    int sec_id;
+    int rc;
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    if (offset >= fa->fa_size) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    sec_id = -1;
+    while (flash_area_getnext_sector(FLASH_AREA_IMAGE_1, &sec_id,
+                                     &sector) == 0) {
+        if (sector.fa_off - fa->fa_off + sector.fa_size > offset) {
+            *out_idx = sec_id;
+            *out_start = sector.fa_off - fa->fa_off;
+            *out_size = sector.fa_size;
+            return 0;
+        }
+    }
+
+    return MGMT_ERR_EINVAL;
+}
+
+int
+img_mgmt_impl_erase_sector(unsigned int start, unsigned int size)
+{
+    const struct flash_area *fa;
+    int rc;
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = flash_area_erase(fa, start, size);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_erase_trailer(void)
+{
+    const struct flash_area *fa;
+    unsigned int start;
+    unsigned int size;
+    int idx;
+    int rc;
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    /* The trailer lives in the last sector of the slot. */
+    rc = img_mgmt_impl_sector_info(fa->fa_size - 1, &idx, &start, &size);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return img_mgmt_impl_erase_sector(start, size);
+}
+
 int
 img_mgmt_impl_write_pending(int slot, bool permanent)
 {
@@ -199,13 +402,14 @@ img_mgmt_impl_swap_type(void)
 void
 img_mgmt_module_init(void)
 {
+#if MYNEWT_VAL(IMGMGR_CLI)
     int rc;
+#endif
 
     /* Ensure this function only gets called by sysinit. */
     SYSINIT_ASSERT_ACTIVE();
 
-    rc = img_mgmt_register_group();
-    SYSINIT_PANIC_ASSERT(rc == 0);
+    /* The command group is registered at link time; see pkg.lflags. */
 
 #if MYNEWT_VAL(IMGMGR_CLI)
     rc = imgr_cli_register();
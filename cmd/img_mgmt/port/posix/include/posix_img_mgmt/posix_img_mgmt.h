@@ -0,0 +1,58 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_IMG_MGMT_
+#define H_POSIX_IMG_MGMT_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Backs the image slots with files in the specified directory.
+ *
+ * Slot 0 is read from "slot0" and slot 1 from "slot1".  Missing files and
+ * reads past the end of a file behave like erased flash.
+ *
+ * @param dir                   The directory holding the slot files.
+ * @param slot_size             The size of each slot, in bytes.  Uploads
+ *                                  beyond this size are rejected.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int posix_img_mgmt_init(const char *dir, size_t slot_size);
+
+/**
+ * @brief Retrieves the number of slot reads performed so far.
+ *
+ * Each img_mgmt_impl_read() call counts as one read, regardless of its size.
+ * On a device, each read carries a fixed cost (e.g., opening the flash area)
+ * on top of the transfer itself.
+ *
+ * @return                      The number of reads.
+ */
+unsigned long posix_img_mgmt_num_reads(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mgmt/mgmt.h"
+#include "img_mgmt/img_mgmt_impl.h"
+#include "img_mgmt/img_mgmt.h"
+#include "../../../src/img_mgmt_priv.h"
+#include "posix_img_mgmt/posix_img_mgmt.h"
+
+static char posix_img_mgmt_paths[2][PATH_MAX];
+static size_t posix_img_mgmt_slot_size;
+
+/* There is no boot loader; the swap type only records what was requested. */
+static int posix_img_mgmt_swap_type = IMG_MGMT_SWAP_TYPE_NONE;
+
+/* The slot file is treated as flash with uniformly sized sectors. */
+#define POSIX_IMG_MGMT_SECTOR_SIZE  4096
+
+/* Number of img_mgmt_impl_read() calls; see posix_img_mgmt_num_reads(). */
+static unsigned long posix_img_mgmt_reads;
+
+/* Function being run by the background thread; NULL if none. */
+static img_mgmt_impl_bg_fn * volatile posix_img_mgmt_bg_fn;
+
+static void *
+posix_img_mgmt_bg_thread(void *arg)
+{
+    /* Let request processing run between steps. */
+    while (posix_img_mgmt_bg_fn()) {
+        sched_yield();
+    }
+
+    posix_img_mgmt_bg_fn = NULL;
+    return NULL;
+}
+
+int
+img_mgmt_impl_erase_slot(void)
+{
+    int rc;
+
+    /* A missing slot file is already erased. */
+    rc = truncate(posix_img_mgmt_paths[1], 0);
+    if (rc != 0 && errno != ENOENT) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_run_bg(img_mgmt_impl_bg_fn *fn)
+{
+    pthread_t thread;
+    int rc;
+
+    if (posix_img_mgmt_bg_fn != NULL) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    posix_img_mgmt_bg_fn = fn;
+    rc = pthread_create(&thread, NULL, posix_img_mgmt_bg_thread, NULL);
+    if (rc != 0) {
+        posix_img_mgmt_bg_fn = NULL;
+        return MGMT_ERR_ENOMEM;
+    }
+    pthread_detach(thread);
+
+    return 0;
+}
+
+int
+img_mgmt_impl_sector_info(unsigned int offset, int *out_idx,
+                          unsigned int *out_start, unsigned int *out_size)
+{
+    if (offset >= posix_img_mgmt_slot_size) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    *out_idx = offset / POSIX_IMG_MGMT_SECTOR_SIZE;
+    *out_start = *out_idx * POSIX_IMG_MGMT_SECTOR_SIZE;
+    *out_size = POSIX_IMG_MGMT_SECTOR_SIZE;
+
+    return 0;
+}
+
+int
+img_mgmt_impl_erase_sector(unsigned int start, unsigned int size)
+{
+    static uint8_t erased[POSIX_IMG_MGMT_SECTOR_SIZE];
+    struct stat st;
+    ssize_t bytes_written;
+    unsigned int chunk_sz;
+    int rc;
+    int fd;
+
+    /* Only the extent of the slot file needs erasing; the rest of the slot
+     * already reads back as erased flash.
+     */
+    rc = stat(posix_img_mgmt_paths[1], &st);
+    if (rc != 0) {
+        return errno == ENOENT ? 0 : MGMT_ERR_EUNKNOWN;
+    }
+    if (st.st_size <= start) {
+        return 0;
+    }
+    if (size > st.st_size - start) {
+        size = st.st_size - start;
+    }
+
+    fd = open(posix_img_mgmt_paths[1], O_WRONLY);
+    if (fd < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    memset(erased, 0xff, sizeof erased);
+
+    rc = 0;
+    while (size > 0) {
+        chunk_sz = size < sizeof erased ? size : sizeof erased;
+        bytes_written = pwrite(fd, erased, chunk_sz, start);
+        if (bytes_written != chunk_sz) {
+            rc = MGMT_ERR_EUNKNOWN;
+            break;
+        }
+        start += chunk_sz;
+        size -= chunk_sz;
+    }
+    close(fd);
+
+    return rc;
+}
+
+int
+img_mgmt_impl_erase_trailer(void)
+{
+    /* The swap request is not kept in the slot; there is nothing to erase. */
+    return 0;
+}
+
+int
+img_mgmt_impl_write_pending(int slot, bool permanent)
+{
+    if (slot != 1) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (permanent) {
+        posix_img_mgmt_swap_type = IMG_MGMT_SWAP_TYPE_PERM;
+    } else {
+        posix_img_mgmt_swap_type = IMG_MGMT_SWAP_TYPE_TEST;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_write_confirmed(void)
+{
+    posix_img_mgmt_swap_type = IMG_MGMT_SWAP_TYPE_NONE;
+    return 0;
+}
+
+int
+img_mgmt_impl_read(int slot, unsigned int offset, void *dst,
+                   unsigned int num_bytes)
+{
+    ssize_t bytes_read;
+    int fd;
+
+    if (slot < 0 || slot > 1) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    posix_img_mgmt_reads++;
+
+    /* Unwritten regions read back as erased flash. */
+    memset(dst, 0xff, num_bytes);
+
+    fd = open(posix_img_mgmt_paths[slot], O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    bytes_read = pread(fd, dst, num_bytes, offset);
+    close(fd);
+
+    if (bytes_read < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_write_image_data(unsigned int offset, const void *data,
+                               unsigned int num_bytes, bool last)
+{
+    ssize_t bytes_written;
+    int fd;
+
+    if (offset + num_bytes > posix_img_mgmt_slot_size) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    fd = open(posix_img_mgmt_paths[1], O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    bytes_written = pwrite(fd, data, num_bytes, offset);
+    close(fd);
+
+    if (bytes_written != num_bytes) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_swap_type(void)
+{
+    return posix_img_mgmt_swap_type;
+}
+
+unsigned long
+posix_img_mgmt_num_reads(void)
+{
+    return posix_img_mgmt_reads;
+}
+
+int
+posix_img_mgmt_init(const char *dir, size_t slot_size)
+{
+    int rc;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        rc = snprintf(posix_img_mgmt_paths[i], sizeof posix_img_mgmt_paths[i],
+                      "%s/slot%d", dir, i);
+        if (rc < 0 || rc >= sizeof posix_img_mgmt_paths[i]) {
+            return MGMT_ERR_EINVAL;
+        }
+    }
+
+    posix_img_mgmt_slot_size = slot_size;
+
+    return 0;
+}
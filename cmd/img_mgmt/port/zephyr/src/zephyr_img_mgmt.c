@@ -32,6 +32,30 @@
 static struct device *zephyr_img_flash_dev;
 static struct flash_img_context zephyr_img_flash_ctxt;
 
+#if defined(CONFIG_IMG_MGMT_ERASE_ASYNC) || defined(CONFIG_IMG_MGMT_PREPARE)
+/* Erases run in their own thread so that they don't block the system work
+ * queue.
+ */
+static K_THREAD_STACK_DEFINE(zephyr_img_erase_stack,
+                             CONFIG_IMG_MGMT_ERASE_STACK_SIZE);
+static struct k_work_q zephyr_img_erase_wq;
+#endif
+
+#ifdef CONFIG_IMG_MGMT_ERASE_ASYNC
+static struct {
+    struct k_work work;
+    img_mgmt_impl_erase_done_fn *cb;
+    void *arg;
+} zephyr_img_erase_op;
+#endif
+
+#ifdef CONFIG_IMG_MGMT_PREPARE
+static struct {
+    struct k_work work;
+    img_mgmt_impl_bg_fn *fn;
+} zephyr_img_bg_op;
+#endif
+
 /**
  * Determines if the specified area of flash is completely unwritten.
  */
@@ -121,6 +145,144 @@ img_mgmt_impl_erase_slot(void)
     return 0;
 }
 
+#ifdef CONFIG_IMG_MGMT_ERASE_ASYNC
+static void
+img_mgmt_impl_erase_work(struct k_work *work)
+{
+    img_mgmt_impl_erase_done_fn *cb;
+    void *arg;
+    int rc;
+
+    rc = img_mgmt_impl_erase_slot();
+
+    cb = zephyr_img_erase_op.cb;
+    arg = zephyr_img_erase_op.arg;
+    zephyr_img_erase_op.cb = NULL;
+
+    cb(rc, arg);
+}
+
+int
+img_mgmt_impl_erase_slot_async(img_mgmt_impl_erase_done_fn *cb, void *arg)
+{
+    if (zephyr_img_erase_op.cb != NULL) {
+        /* Erase already in progress. */
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    zephyr_img_erase_op.cb = cb;
+    zephyr_img_erase_op.arg = arg;
+    k_work_submit_to_queue(&zephyr_img_erase_wq, &zephyr_img_erase_op.work);
+
+    return 0;
+}
+#endif
+
+#ifdef CONFIG_IMG_MGMT_PREPARE
+static void
+img_mgmt_impl_bg_work(struct k_work *work)
+{
+    if (zephyr_img_bg_op.fn()) {
+        /* Requeue rather than loop, so other erase work can run too. */
+        k_work_submit_to_queue(&zephyr_img_erase_wq, &zephyr_img_bg_op.work);
+    } else {
+        zephyr_img_bg_op.fn = NULL;
+    }
+}
+
+int
+img_mgmt_impl_run_bg(img_mgmt_impl_bg_fn *fn)
+{
+    if (zephyr_img_bg_op.fn != NULL) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    zephyr_img_bg_op.fn = fn;
+    k_work_submit_to_queue(&zephyr_img_erase_wq, &zephyr_img_bg_op.work);
+
+    return 0;
+}
+#endif
+
+#if defined(CONFIG_IMG_MGMT_LAZY_ERASE) || defined(CONFIG_IMG_MGMT_PREPARE)
+int
+img_mgmt_impl_sector_info(unsigned int offset, int *out_idx,
+                          unsigned int *out_start, unsigned int *out_size)
+{
+    struct flash_pages_info slot_info;
+    struct flash_pages_info info;
+    int rc;
+
+    if (offset >= FLASH_AREA_IMAGE_1_SIZE) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    rc = flash_get_page_info_by_offs(zephyr_img_flash_dev,
+                                     FLASH_AREA_IMAGE_1_OFFSET, &slot_info);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = flash_get_page_info_by_offs(zephyr_img_flash_dev,
+                                     FLASH_AREA_IMAGE_1_OFFSET + offset,
+                                     &info);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_idx = info.index - slot_info.index;
+    *out_start = info.start_offset - FLASH_AREA_IMAGE_1_OFFSET;
+    *out_size = info.size;
+
+    return 0;
+}
+
+int
+img_mgmt_impl_erase_sector(unsigned int start, unsigned int size)
+{
+    int rc;
+
+    flash_write_protection_set(zephyr_img_flash_dev, false);
+    rc = flash_erase(zephyr_img_flash_dev, FLASH_AREA_IMAGE_1_OFFSET + start,
+                     size);
+    flash_write_protection_set(zephyr_img_flash_dev, true);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_erase_trailer(void)
+{
+    unsigned int start;
+    unsigned int size;
+    bool empty;
+    int idx;
+    int rc;
+
+    /* The trailer lives in the last sector of the slot. */
+    rc = img_mgmt_impl_sector_info(FLASH_AREA_IMAGE_1_SIZE - 1, &idx, &start,
+                                   &size);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = img_mgmt_impl_flash_check_empty(FLASH_AREA_IMAGE_1_OFFSET + start,
+                                         size, &empty);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (empty) {
+        return 0;
+    }
+
+    return img_mgmt_impl_erase_sector(start, size);
+}
+#endif
+
 int
 img_mgmt_impl_write_pending(int slot, bool permanent)
 {
@@ -221,6 +383,19 @@ img_mgmt_impl_init(struct device *dev)
     if (zephyr_img_flash_dev == NULL) {
         return -ENODEV;
     }
+
+#ifdef CONFIG_IMG_MGMT_ERASE_ASYNC
+    k_work_init(&zephyr_img_erase_op.work, img_mgmt_impl_erase_work);
+#endif
+#ifdef CONFIG_IMG_MGMT_PREPARE
+    k_work_init(&zephyr_img_bg_op.work, img_mgmt_impl_bg_work);
+#endif
+#if defined(CONFIG_IMG_MGMT_ERASE_ASYNC) || defined(CONFIG_IMG_MGMT_PREPARE)
+    k_work_q_start(&zephyr_img_erase_wq, zephyr_img_erase_stack,
+                   K_THREAD_STACK_SIZEOF(zephyr_img_erase_stack),
+                   CONFIG_IMG_MGMT_ERASE_THREAD_PRIO);
+#endif
+
     return 0;
 }
 
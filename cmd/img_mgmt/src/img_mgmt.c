@@ -23,6 +23,8 @@
 
 #include "cborattr/cborattr.h"
 #include "mgmt/mgmt.h"
+#include "mgmt/mgmt_stats.h"
+#include "mgmt/mgmt_trace.h"
 
 #include "img_mgmt/image.h"
 #include "img_mgmt/img_mgmt.h"
@@ -30,6 +32,10 @@
 #include "img_mgmt_priv.h"
 #include "img_mgmt_config.h"
 
+#if IMG_MGMT_UL_VERIFY
+#include "sha256/sha256.h"
+#endif
+
 static mgmt_handler_fn img_mgmt_upload;
 static mgmt_handler_fn img_mgmt_erase;
 
@@ -48,15 +54,38 @@ static const struct mgmt_handler img_mgmt_handlers[] = {
     },
 };
 
-#define IMG_MGMT_HANDLER_CNT \
-    sizeof(img_mgmt_handlers) / sizeof(img_mgmt_handlers[0])
+static MGMT_GROUP_DEFINE(img_mgmt_group, MGMT_GROUP_ID_IMAGE,
+                        img_mgmt_handlers);
+
+/** Counters in the "img" stats group. */
+#define IMG_MGMT_STAT_UL_CHUNKS     0   /* Upload chunks written. */
+#define IMG_MGMT_STAT_UL_BYTES      1   /* Upload bytes written. */
+#define IMG_MGMT_STAT_UL_DONE       2   /* Uploads completed. */
+#define IMG_MGMT_STAT_WRITE_ERRS    3   /* Failed flash writes. */
+#define IMG_MGMT_STAT_ERASES        4   /* Slot erases. */
+#define IMG_MGMT_STAT_ERASE_ERRS    5   /* Failed slot erases. */
+#define IMG_MGMT_STAT_UL_CORRUPT    6   /* Uploads that failed verification. */
+#define IMG_MGMT_STAT_SECTOR_ERASES 7   /* Sectors erased on demand. */
+#define IMG_MGMT_STAT_UL_DROPPED    8   /* Upload chunks at a bad offset. */
+#define IMG_MGMT_STAT_COUNT         9
 
-static struct mgmt_group img_mgmt_group = {
-    .mg_handlers = (struct mgmt_handler *)img_mgmt_handlers,
-    .mg_handlers_count = IMG_MGMT_HANDLER_CNT,
-    .mg_group_id = MGMT_GROUP_ID_IMAGE,
+static uint32_t img_mgmt_stats[IMG_MGMT_STAT_COUNT];
+
+static const char * const img_mgmt_stat_names[IMG_MGMT_STAT_COUNT] = {
+    [IMG_MGMT_STAT_UL_CHUNKS] = "ul_chunks",
+    [IMG_MGMT_STAT_UL_BYTES] = "ul_bytes",
+    [IMG_MGMT_STAT_UL_DONE] = "ul_done",
+    [IMG_MGMT_STAT_WRITE_ERRS] = "write_errs",
+    [IMG_MGMT_STAT_ERASES] = "erases",
+    [IMG_MGMT_STAT_ERASE_ERRS] = "erase_errs",
+    [IMG_MGMT_STAT_UL_CORRUPT] = "ul_corrupt",
+    [IMG_MGMT_STAT_SECTOR_ERASES] = "sector_erases",
+    [IMG_MGMT_STAT_UL_DROPPED] = "ul_dropped",
 };
 
+static MGMT_STATS_DEFINE(img_mgmt_stat_group, "img", img_mgmt_stat_names,
+                         img_mgmt_stats);
+
 static struct {
     /* Whether an upload is currently in progress. */
     bool uploading;
@@ -68,6 +97,185 @@ static struct {
     size_t len;
 } img_mgmt_ctxt;
 
+/**
+ * Ties the upload to the peer performing it.  There is a single spare slot,
+ * so there is only one session; another peer can start an upload once this
+ * one finishes or goes idle.
+ */
+static struct mgmt_session img_mgmt_session;
+static struct mgmt_session_pool img_mgmt_session_pool = {
+    .msp_sessions = &img_mgmt_session,
+    .msp_num_sessions = 1,
+    .msp_timeout_ms = IMG_MGMT_UL_TIMEOUT_MS,
+};
+
+static bool img_mgmt_session_reclaim(const struct mgmt_ctxt *ctxt);
+
+#if IMG_MGMT_UL_REORDER_COUNT > 0
+/** Upload chunks that arrived ahead of the expected offset. */
+static struct mgmt_reorder_slot
+    img_mgmt_reorder_slots[IMG_MGMT_UL_REORDER_COUNT];
+static uint8_t
+    img_mgmt_reorder_data[IMG_MGMT_UL_REORDER_COUNT][IMG_MGMT_UL_CHUNK_SIZE];
+static struct mgmt_reorder_buf img_mgmt_reorder = {
+    .mrb_slots = img_mgmt_reorder_slots,
+    .mrb_data = &img_mgmt_reorder_data[0][0],
+    .mrb_slot_size = IMG_MGMT_UL_CHUNK_SIZE,
+    .mrb_num_slots = IMG_MGMT_UL_REORDER_COUNT,
+};
+#endif
+
+#if IMG_MGMT_ERASE_ASYNC
+/** State of a request waiting for a background erase of slot 1. */
+static struct {
+    /** Whether a background erase is in progress. */
+    volatile bool busy;
+
+    /** First chunk of an upload; written once the slot has been erased. */
+    uint8_t data[IMG_MGMT_UL_CHUNK_SIZE];
+    size_t data_len;
+
+    /** Total length of the image being uploaded. */
+    size_t img_len;
+} img_mgmt_erase_op;
+#endif
+
+/** Metadata read from an image slot; see img_mgmt_read_info(). */
+struct img_mgmt_slot_info {
+    /** Cache generation the entry was read in; stale if not current. */
+    uint32_t gen;
+
+    /** Result of reading the slot: 0 or MGMT_ERR_[...] code. */
+    int rc;
+
+    struct image_version ver;
+    uint8_t hash[IMAGE_HASH_LEN];
+    uint32_t flags;
+};
+
+/**
+ * Slot metadata and swap type, read from flash when first needed and kept
+ * until a slot or the boot state is modified.  Invalidating the cache
+ * advances the generation, so an entry that was being read while a slot was
+ * erased or written is never used.  The generation is advanced by the
+ * background erase as well as by the request handlers, so it is only
+ * accessed atomically.
+ */
+static struct {
+    uint32_t gen;
+    struct img_mgmt_slot_info slots[2];
+    uint32_t swap_type_gen;
+    int swap_type;
+} img_mgmt_cache = {
+    .gen = 1,
+};
+
+#if IMG_MGMT_PREPARE
+/**
+ * State of a background erase of slot 1 started by a prepare request.  The
+ * erase runs in a separate task; the request handlers only read this state
+ * while it is in progress.
+ */
+static struct {
+    /** Whether a prepare has been requested since startup. */
+    bool started;
+
+    /** Whether the background erase is in progress. */
+    volatile bool busy;
+
+    /** Offset up to which slot 1 has been erased. */
+    volatile unsigned int off;
+
+    /** Result of the most recent prepare: 0 or MGMT_ERR_[...] code. */
+    volatile int rc;
+
+    /**
+     * Cache generation in which slot 1 was last known to be fully erased.
+     * The slot is only clean while this is the current generation, so any
+     * later invalidation, from whichever task, marks it as possibly modified
+     * without writing to this field.  Accessed atomically.
+     */
+    uint32_t clean_gen;
+
+    /**
+     * Generation produced by the background erase's most recent
+     * invalidation.  Only used by the task running the erase.
+     */
+    uint32_t step_gen;
+} img_mgmt_prepare;
+#endif
+
+/**
+ * Invalidates the cache and returns the new generation.
+ */
+static uint32_t
+img_mgmt_cache_advance(void)
+{
+    return __atomic_add_fetch(&img_mgmt_cache.gen, 1, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * Returns the current cache generation.
+ */
+static uint32_t
+img_mgmt_cache_gen(void)
+{
+    return __atomic_load_n(&img_mgmt_cache.gen, __ATOMIC_ACQUIRE);
+}
+
+void
+img_mgmt_cache_invalidate(void)
+{
+    img_mgmt_cache_advance();
+}
+
+#if IMG_MGMT_PREPARE
+/**
+ * Marks slot 1 as fully erased as of the specified cache generation.
+ */
+static void
+img_mgmt_prepare_set_clean(uint32_t gen)
+{
+    __atomic_store_n(&img_mgmt_prepare.clean_gen, gen, __ATOMIC_RELEASE);
+}
+
+/**
+ * Determines if slot 1 is known to be fully erased, i.e., it has not been
+ * modified since an erase of the whole slot completed.
+ */
+static bool
+img_mgmt_prepare_clean(void)
+{
+    return __atomic_load_n(&img_mgmt_prepare.clean_gen, __ATOMIC_ACQUIRE) ==
+           img_mgmt_cache_gen();
+}
+#endif
+
+/** Size of the buffer that the TLV area is read into. */
+#define IMG_MGMT_TLV_BUF_SIZE       128
+
+/**
+ * A buffered view of an image's TLV area.  Reads that fall within the buffer
+ * are served from memory; any other read refills the buffer with a single
+ * flash read of as much of the remaining area as fits.  The TLV areas of
+ * typical images (a hash, a key hash, and an ECDSA signature) fit in one
+ * buffer.
+ */
+struct img_mgmt_tlv_buf {
+    uint8_t data[IMG_MGMT_TLV_BUF_SIZE];
+
+    /** Slot offset of the first buffered byte. */
+    size_t off;
+
+    /** Number of bytes in the buffer. */
+    size_t len;
+
+    /** Slot offset of the end of the TLV area. */
+    size_t end;
+
+    int slot;
+};
+
 /**
  * Finds the TLVs in the specified image slot, if any.
  */
@@ -89,23 +297,59 @@ img_mgmt_find_tlvs(const struct image_header *hdr,
         return MGMT_ERR_ENOENT;
     }
 
-    *start_off += sizeof tlv_info;
+    /* The total includes the TLV info header. */
     *end_off = *start_off + tlv_info.it_tlv_tot;
+    *start_off += sizeof tlv_info;
+
+    return 0;
+}
+
+/**
+ * Reads from an image's TLV area, refilling the buffer if the requested bytes
+ * aren't in it.
+ */
+static int
+img_mgmt_tlv_read(struct img_mgmt_tlv_buf *tb, size_t off, void *dst,
+                  size_t num_bytes)
+{
+    size_t read_len;
+    int rc;
+
+    if (num_bytes > sizeof tb->data || off + num_bytes > tb->end) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    if (off < tb->off || off + num_bytes > tb->off + tb->len) {
+        read_len = tb->end - off;
+        if (read_len > sizeof tb->data) {
+            read_len = sizeof tb->data;
+        }
+
+        tb->len = 0;
+        rc = img_mgmt_impl_read(tb->slot, off, tb->data, read_len);
+        if (rc != 0) {
+            return MGMT_ERR_EUNKNOWN;
+        }
+        tb->off = off;
+        tb->len = read_len;
+    }
+
+    memcpy(dst, tb->data + (off - tb->off), num_bytes);
 
     return 0;
 }
 
 /*
- * Reads the version and build hash from the specified image slot.
+ * Reads the version and build hash from the specified image slot in flash.
  */
-int
-img_mgmt_read_info(int image_slot, struct image_version *ver, uint8_t *hash,
-                   uint32_t *flags)
+static int
+img_mgmt_read_slot_info(int image_slot, struct image_version *ver,
+                        uint8_t *hash, uint32_t *flags)
 {
+    struct img_mgmt_tlv_buf tb;
     struct image_header hdr;
     struct image_tlv tlv;
     size_t data_off;
-    size_t data_end;
     bool hash_found;
     int rc;
 
@@ -132,17 +376,22 @@ img_mgmt_read_info(int image_slot, struct image_version *ver, uint8_t *hash,
     }
 
     /* Read the image's TLVs.  All images are required to have a hash TLV.  If
-     * the hash is missing, the image is considered invalid.
+     * the hash is missing, the image is considered invalid.  Rather than
+     * reading each TLV separately, the area is read in bulk and parsed in
+     * memory.
      */
     data_off = hdr.ih_hdr_size + hdr.ih_img_size;
-    rc = img_mgmt_find_tlvs(&hdr, image_slot, &data_off, &data_end);
+    rc = img_mgmt_find_tlvs(&hdr, image_slot, &data_off, &tb.end);
     if (rc != 0) {
         return MGMT_ERR_EUNKNOWN;
     }
+    tb.slot = image_slot;
+    tb.off = 0;
+    tb.len = 0;
 
     hash_found = false;
-    while (data_off + sizeof tlv <= data_end) {
-        rc = img_mgmt_impl_read(image_slot, data_off, &tlv, sizeof tlv);
+    while (data_off + sizeof tlv <= tb.end) {
+        rc = img_mgmt_tlv_read(&tb, data_off, &tlv, sizeof tlv);
         if (rc != 0) {
             return MGMT_ERR_EUNKNOWN;
         }
@@ -163,15 +412,12 @@ img_mgmt_read_info(int image_slot, struct image_version *ver, uint8_t *hash,
 
         data_off += sizeof tlv;
         if (hash != NULL) {
-            if (data_off + IMAGE_HASH_LEN > data_end) {
-                return MGMT_ERR_EUNKNOWN;
-            }
-            rc = img_mgmt_impl_read(image_slot, data_off, hash,
-                                    IMAGE_HASH_LEN);
+            rc = img_mgmt_tlv_read(&tb, data_off, hash, IMAGE_HASH_LEN);
             if (rc != 0) {
                 return MGMT_ERR_EUNKNOWN;
             }
         }
+        data_off += IMAGE_HASH_LEN;
     }
 
     if (!hash_found) {
@@ -181,6 +427,71 @@ img_mgmt_read_info(int image_slot, struct image_version *ver, uint8_t *hash,
     return 0;
 }
 
+/*
+ * Reads the version and build hash from the specified image slot.  The slot
+ * is only read from flash if it has been modified since it was last read.
+ */
+int
+img_mgmt_read_info(int image_slot, struct image_version *ver, uint8_t *hash,
+                   uint32_t *flags)
+{
+    struct img_mgmt_slot_info *info;
+    uint32_t gen;
+
+    if (image_slot < 0 || image_slot > 1) {
+        return MGMT_ERR_EINVAL;
+    }
+
+#if IMG_MGMT_PREPARE
+    /* Whatever slot 1 held is being erased. */
+    if (image_slot == 1 && img_mgmt_prepare.busy) {
+        return MGMT_ERR_ENOENT;
+    }
+#endif
+
+    info = &img_mgmt_cache.slots[image_slot];
+    gen = img_mgmt_cache_gen();
+    if (info->gen != gen) {
+        info->rc = img_mgmt_read_slot_info(image_slot, &info->ver, info->hash,
+                                           &info->flags);
+        info->gen = gen;
+    }
+
+    if (info->rc != 0) {
+        return info->rc;
+    }
+
+    if (ver != NULL) {
+        *ver = info->ver;
+    }
+    if (hash != NULL) {
+        memcpy(hash, info->hash, IMAGE_HASH_LEN);
+    }
+    if (flags != NULL) {
+        *flags = info->flags;
+    }
+
+    return 0;
+}
+
+/*
+ * Retrieves the swap that will occur on the next reboot.  Like the slot
+ * metadata, the swap type is cached until a slot or the boot state changes.
+ */
+int
+img_mgmt_swap_type(void)
+{
+    uint32_t gen;
+
+    gen = img_mgmt_cache_gen();
+    if (img_mgmt_cache.swap_type_gen != gen) {
+        img_mgmt_cache.swap_type = img_mgmt_impl_swap_type();
+        img_mgmt_cache.swap_type_gen = gen;
+    }
+
+    return img_mgmt_cache.swap_type;
+}
+
 /*
  * Finds image given version number. Returns the slot number image is in,
  * or -1 if not found.
@@ -224,177 +535,1144 @@ img_mgmt_find_by_hash(uint8_t *find, struct image_version *ver)
 }
 
 /**
- * Command handler: image erase
+ * Accounts for a completed erase of slot 1.
  */
-static int
-img_mgmt_erase(struct mgmt_ctxt *ctxt)
+static void
+img_mgmt_erase_finish(int status)
 {
-    CborError err;
-    int rc;
-
-    rc = img_mgmt_impl_erase_slot();
+    uint32_t gen;
 
-    err = 0;
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
-    err |= cbor_encode_int(&ctxt->encoder, rc);
+    gen = img_mgmt_cache_advance();
 
-    if (err != 0) {
-        return MGMT_ERR_ENOMEM;
+    MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_ERASES);
+    if (status != 0) {
+        MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_ERASE_ERRS);
     }
 
-    return 0;
+#if IMG_MGMT_PREPARE
+    if (status == 0) {
+        img_mgmt_prepare_set_clean(gen);
+    }
+#else
+    (void)gen;
+#endif
 }
 
 /**
- * Encodes an image upload response.
+ * Erases slot 1 synchronously.
  */
 static int
-img_mgmt_encode_upload_rsp(struct mgmt_ctxt *ctxt, int status)
+img_mgmt_erase_slot(void)
 {
-    CborError err;
+    int rc;
 
-    err = 0;
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
-    err |= cbor_encode_int(&ctxt->encoder, status);
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
-    err |= cbor_encode_int(&ctxt->encoder, img_mgmt_ctxt.off);
+    MGMT_TRACE(MGMT_TRACE_IO, NULL, 0);
+    rc = img_mgmt_impl_erase_slot();
+    MGMT_TRACE(MGMT_TRACE_IO_DONE, NULL, rc);
+    img_mgmt_erase_finish(rc);
 
-    if (err != 0) {
-        return MGMT_ERR_ENOMEM;
-    }
-    return 0;
+    return rc;
 }
 
+#if IMG_MGMT_LAZY_ERASE
 /**
- * Processes an upload request specifying an offset of 0 (i.e., the first image
- * chunk).  The caller is responsible for encoding the response.
+ * State of an upload that erases slot 1 a sector at a time, just ahead of the
+ * data written into it.
+ */
+static struct {
+    /** One bit per sector of slot 1, set once the sector has been erased. */
+    uint32_t erased[(IMG_MGMT_LAZY_ERASE_SECTORS + 31) / 32];
+
+    /** Whether the current upload erases sectors on demand. */
+    bool active;
+
+    /** The sector most recently looked up; -1 if none. */
+    int idx;
+    unsigned int start;
+    unsigned int size;
+} img_mgmt_lazy;
+
+/**
+ * Prepares slot 1 for an upload that erases sectors on demand.  Only the boot
+ * trailer is erased now; every sector up to the image length is erased when
+ * it is first written to.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_[...] code if the whole slot needs to
+ *                                  be erased instead.
  */
 static int
-img_mgmt_upload_first_chunk(struct mgmt_ctxt *ctxt, const uint8_t *req_data,
-                            size_t len)
+img_mgmt_lazy_start(size_t img_len)
 {
-    struct image_header hdr;
+    unsigned int start;
+    unsigned int size;
+    int idx;
     int rc;
 
-    if (len < sizeof hdr) {
+    if (img_len == 0) {
         return MGMT_ERR_EINVAL;
     }
 
-    memcpy(&hdr, req_data, sizeof hdr);
-    if (hdr.ih_magic != IMAGE_MAGIC) {
-        return MGMT_ERR_EINVAL;
+    /* The bitmap must cover every sector the image touches. */
+    rc = img_mgmt_impl_sector_info(img_len - 1, &idx, &start, &size);
+    if (rc != 0) {
+        return rc;
     }
-
-    if (img_mgmt_slot_in_use(1)) {
-        /* No free slot. */
+    if (idx >= IMG_MGMT_LAZY_ERASE_SECTORS) {
         return MGMT_ERR_ENOMEM;
     }
 
-    rc = img_mgmt_impl_erase_slot();
+    /* A stale trailer could otherwise be mistaken for a swap request. */
+    MGMT_TRACE(MGMT_TRACE_IO, NULL, 0);
+    rc = img_mgmt_impl_erase_trailer();
+    MGMT_TRACE(MGMT_TRACE_IO_DONE, NULL, rc);
+    img_mgmt_cache_invalidate();
     if (rc != 0) {
         return rc;
     }
 
-    img_mgmt_ctxt.uploading = true;
-    img_mgmt_ctxt.off = 0;
-    img_mgmt_ctxt.len = 0;
+    memset(img_mgmt_lazy.erased, 0, sizeof img_mgmt_lazy.erased);
+    img_mgmt_lazy.idx = -1;
+    img_mgmt_lazy.active = true;
 
     return 0;
 }
 
 /**
- * Command handler: image upload
+ * Erases each sector of slot 1 overlapping the specified range that has not
+ * been erased since the upload started.
  */
 static int
-img_mgmt_upload(struct mgmt_ctxt *ctxt)
+img_mgmt_lazy_erase(size_t off, size_t len)
 {
-    uint8_t img_mgmt_data[IMG_MGMT_UL_CHUNK_SIZE];
-    unsigned long long len;
-    unsigned long long off;
-    size_t data_len;
-    size_t new_off;
-    bool last;
+    uint32_t bit;
+    size_t end;
+    int word;
     int rc;
 
-    const struct cbor_attr_t off_attr[4] = {
-        [0] = {
-            .attribute = "data",
-            .type = CborAttrByteStringType,
-            .addr.bytestring.data = img_mgmt_data,
-            .addr.bytestring.len = &data_len,
-            .len = sizeof(img_mgmt_data)
-        },
-        [1] = {
-            .attribute = "len",
-            .type = CborAttrUnsignedIntegerType,
-            .addr.uinteger = &len,
-            .nodefault = true
-        },
-        [2] = {
-            .attribute = "off",
-            .type = CborAttrUnsignedIntegerType,
-            .addr.uinteger = &off,
-            .nodefault = true
-        },
-        [3] = { 0 },
-    };
+    end = off + len;
+    while (off < end) {
+        /* Chunks are written in order, so usually land in the same sector as
+         * the previous one.
+         */
+        if (img_mgmt_lazy.idx < 0 ||
+            off < img_mgmt_lazy.start ||
+            off - img_mgmt_lazy.start >= img_mgmt_lazy.size) {
 
-    len = ULLONG_MAX;
-    off = ULLONG_MAX;
-    data_len = 0;
-    rc = cbor_read_object(&ctxt->it, off_attr);
-    if (rc || off == ULLONG_MAX) {
-        return MGMT_ERR_EINVAL;
+            rc = img_mgmt_impl_sector_info(off, &img_mgmt_lazy.idx,
+                                           &img_mgmt_lazy.start,
+                                           &img_mgmt_lazy.size);
+            if (rc != 0) {
+                img_mgmt_lazy.idx = -1;
+                return rc;
+            }
+        }
+        assert(img_mgmt_lazy.idx < IMG_MGMT_LAZY_ERASE_SECTORS);
+
+        word = img_mgmt_lazy.idx / 32;
+        bit = 1UL << (img_mgmt_lazy.idx % 32);
+        if (!(img_mgmt_lazy.erased[word] & bit)) {
+            MGMT_TRACE(MGMT_TRACE_IO, NULL, img_mgmt_lazy.size);
+            rc = img_mgmt_impl_erase_sector(img_mgmt_lazy.start,
+                                            img_mgmt_lazy.size);
+            MGMT_TRACE(MGMT_TRACE_IO_DONE, NULL, rc);
+            img_mgmt_cache_invalidate();
+            if (rc != 0) {
+                MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_ERASE_ERRS);
+                return rc;
+            }
+            MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_SECTOR_ERASES);
+            img_mgmt_lazy.erased[word] |= bit;
+        }
+
+        off = img_mgmt_lazy.start + img_mgmt_lazy.size;
     }
 
-    if (off == 0) {
-        /* Total image length is a required field in the first request. */
-        if (len == ULLONG_MAX) {
-            return MGMT_ERR_EINVAL;
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_PREPARE
+/**
+ * Determines if the specified region of slot 1 is completely erased.
+ */
+static int
+img_mgmt_prepare_check_empty(unsigned int off, unsigned int len,
+                             bool *out_empty)
+{
+    uint32_t data[16];
+    unsigned int end;
+    unsigned int chunk_sz;
+    int rc;
+    int i;
+
+    end = off + len;
+    while (off < end) {
+        chunk_sz = end - off;
+        if (chunk_sz > sizeof data) {
+            chunk_sz = sizeof data;
         }
 
-        rc = img_mgmt_upload_first_chunk(ctxt, img_mgmt_data, data_len);
+        rc = img_mgmt_impl_read(1, off, data, chunk_sz);
         if (rc != 0) {
             return rc;
         }
-        img_mgmt_ctxt.len = len;
-    } else {
-        if (!img_mgmt_ctxt.uploading) {
-            return MGMT_ERR_EINVAL;
-        }
 
-        if (off != img_mgmt_ctxt.off) {
-            /* Invalid offset.  Drop the data and send the expected offset. */
-            return img_mgmt_encode_upload_rsp(ctxt, 0);
+        for (i = 0; i < chunk_sz / 4; i++) {
+            if (data[i] != 0xffffffff) {
+                *out_empty = false;
+                return 0;
+            }
         }
-    }
 
-    new_off = img_mgmt_ctxt.off + data_len;
-    if (new_off > img_mgmt_ctxt.len) {
-        /* Data exceeds image length. */
-        return MGMT_ERR_EINVAL;
+        off += chunk_sz;
     }
-    last = new_off == img_mgmt_ctxt.len;
+
+    *out_empty = true;
+    return 0;
+}
+
+/**
+ * Erases the next sector of slot 1, unless it is already erased.  Called
+ * repeatedly in the background until the whole slot has been erased.
+ */
+static bool
+img_mgmt_prepare_step(void)
+{
+    unsigned int start;
+    unsigned int size;
+    bool empty;
+    int idx;
+    int rc;
+
+    rc = img_mgmt_impl_sector_info(img_mgmt_prepare.off, &idx, &start,
+                                   &size);
+    if (rc == MGMT_ERR_EINVAL && img_mgmt_prepare.off > 0) {
+        /* Past the end of the slot.  If a request handler invalidated the
+         * cache since the last sector was checked, the generation has moved
+         * on and the slot is not reported clean.
+         */
+        img_mgmt_prepare.rc = 0;
+        img_mgmt_prepare_set_clean(img_mgmt_prepare.step_gen);
+        __atomic_store_n(&img_mgmt_prepare.busy, false, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    if (rc == 0) {
+        rc = img_mgmt_prepare_check_empty(start, size, &empty);
+    }
+
+    if (rc == 0 && !empty) {
+        MGMT_TRACE(MGMT_TRACE_IO, NULL, size);
+        rc = img_mgmt_impl_erase_sector(start, size);
+        MGMT_TRACE(MGMT_TRACE_IO_DONE, NULL, rc);
+        img_mgmt_prepare.step_gen = img_mgmt_cache_advance();
+        if (rc != 0) {
+            MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_ERASE_ERRS);
+        } else {
+            MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_SECTOR_ERASES);
+        }
+    }
+
+    if (rc != 0) {
+        img_mgmt_prepare.rc = rc;
+        __atomic_store_n(&img_mgmt_prepare.busy, false, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    img_mgmt_prepare.off = start + size;
+    return true;
+}
+
+/**
+ * Starts erasing slot 1 in the background, ahead of an upload.  Nothing is
+ * done if the slot is already erased or being erased.  An upload in progress
+ * is abandoned, unless it belongs to another peer and has not gone idle.
+ */
+static int
+img_mgmt_prepare_start(const struct mgmt_ctxt *ctxt)
+{
+    int rc;
+
+    if (__atomic_load_n(&img_mgmt_prepare.busy, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    img_mgmt_prepare.started = true;
+    if (img_mgmt_prepare_clean()) {
+        img_mgmt_prepare.rc = 0;
+        return 0;
+    }
+
+#if IMG_MGMT_ERASE_ASYNC
+    if (img_mgmt_erase_op.busy) {
+        return MGMT_ERR_EBADSTATE;
+    }
+#endif
+
+    img_mgmt_session_reclaim(ctxt);
+    if (img_mgmt_session.ms_used &&
+        mgmt_session_find(&img_mgmt_session_pool, ctxt) == -1 &&
+        !mgmt_session_expired(&img_mgmt_session_pool, 0)) {
+
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    /* Abandon any upload in progress; the slot is about to be erased. */
+    img_mgmt_ctxt.uploading = false;
+#if IMG_MGMT_LAZY_ERASE
+    img_mgmt_lazy.active = false;
+#endif
+    mgmt_session_close(&img_mgmt_session_pool, 0);
+
+    img_mgmt_prepare.off = 0;
+    img_mgmt_prepare.rc = 0;
+    img_mgmt_prepare.step_gen = img_mgmt_cache_advance();
+    __atomic_store_n(&img_mgmt_prepare.busy, true, __ATOMIC_RELEASE);
+
+    rc = img_mgmt_impl_run_bg(img_mgmt_prepare_step);
+    if (rc != 0) {
+        img_mgmt_prepare.rc = rc;
+        img_mgmt_prepare.busy = false;
+    }
+
+    return rc;
+}
+
+/**
+ * Encodes the progress of the most recent prepare request, if any, into a
+ * state read response.
+ */
+int
+img_mgmt_prepare_encode(struct mgmt_ctxt *ctxt)
+{
+    CborEncoder prep;
+    CborError err;
+
+    if (!img_mgmt_prepare.started) {
+        return 0;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "prepare");
+    err |= cbor_encoder_create_map(&ctxt->encoder, &prep,
+                                   CborIndefiniteLength);
+
+    err |= cbor_encode_text_stringz(&prep, "busy");
+    err |= cbor_encode_boolean(&prep, img_mgmt_prepare.busy);
+
+    err |= cbor_encode_text_stringz(&prep, "off");
+    err |= cbor_encode_uint(&prep, img_mgmt_prepare.off);
+
+    err |= cbor_encode_text_stringz(&prep, "rc");
+    err |= cbor_encode_int(&prep, img_mgmt_prepare.rc);
+
+    err |= cbor_encode_text_stringz(&prep, "clean");
+    err |= cbor_encode_boolean(&prep, img_mgmt_prepare_clean());
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &prep);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+#endif
+
+/**
+ * Command handler: image erase
+ */
+static int
+img_mgmt_encode_erase_rsp(struct mgmt_ctxt *ctxt, int status)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, status);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+#if IMG_MGMT_ERASE_ASYNC
+/**
+ * Completes the request that is waiting for the background erase.  Called in
+ * the task that performed the erase; everything else happens in the finish
+ * callback, in the SMP task.
+ */
+static void
+img_mgmt_erase_done(int status, void *arg)
+{
+    mgmt_ctxt_complete(arg, status);
+}
+
+/**
+ * Defers the request being handled and starts erasing slot 1 in the
+ * background.  Once the erase completes, the supplied function finishes the
+ * response in the SMP task.
+ *
+ * @return                      0 if the request was deferred;
+ *                              MGMT_ERR_ENOTSUP if the caller needs to erase
+ *                                  the slot synchronously;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+static int
+img_mgmt_erase_start(struct mgmt_ctxt *ctxt, mgmt_finish_fn *finish)
+{
+    struct mgmt_ctxt *deferred;
+    int rc;
+
+    deferred = mgmt_ctxt_defer(ctxt);
+    if (deferred == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+    deferred->finish = finish;
+
+    /* The slot is read from flash while the erase is in progress. */
+    img_mgmt_cache_invalidate();
+
+    img_mgmt_erase_op.busy = true;
+    rc = img_mgmt_impl_erase_slot_async(img_mgmt_erase_done, deferred);
+    if (rc != 0) {
+        img_mgmt_erase_op.busy = false;
+    }
+
+    return rc;
+}
+
+static int
+img_mgmt_erase_finish_rsp(struct mgmt_ctxt *ctxt, int status)
+{
+    img_mgmt_erase_finish(status);
+    img_mgmt_erase_op.busy = false;
+
+    return img_mgmt_encode_erase_rsp(ctxt, status);
+}
+#endif
+
+/**
+ * Command handler: image erase
+ */
+static int
+img_mgmt_erase(struct mgmt_ctxt *ctxt)
+{
+#if IMG_MGMT_PREPARE
+    bool prepare;
+
+    const struct cbor_attr_t erase_attr[] = {
+        [0] = {
+            .attribute = "prepare",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &prepare,
+            .dflt.boolean = false,
+        },
+        [1] = { 0 },
+    };
+#endif
+    int rc;
+
+#if IMG_MGMT_PREPARE
+    rc = cbor_read_object(&ctxt->it, erase_attr);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (prepare) {
+        /* Respond right away; progress is reported by the state read. */
+        rc = img_mgmt_prepare_start(ctxt);
+        return img_mgmt_encode_erase_rsp(ctxt, rc);
+    }
+
+    if (img_mgmt_prepare.busy) {
+        return MGMT_ERR_EBADSTATE;
+    }
+#endif
+
+#if IMG_MGMT_ERASE_ASYNC
+    if (img_mgmt_erase_op.busy) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    rc = img_mgmt_erase_start(ctxt, img_mgmt_erase_finish_rsp);
+    if (rc == 0) {
+        return MGMT_DEFERRED;
+    }
+    if (rc != MGMT_ERR_ENOTSUP) {
+        return img_mgmt_encode_erase_rsp(ctxt, rc);
+    }
+#endif
+
+    rc = img_mgmt_erase_slot();
+    return img_mgmt_encode_erase_rsp(ctxt, rc);
+}
+
+/**
+ * Encodes an image upload response.
+ */
+static int
+img_mgmt_encode_upload_rsp(struct mgmt_ctxt *ctxt, int status)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, status);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_int(&ctxt->encoder, img_mgmt_ctxt.off);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+    return 0;
+}
+
+#if IMG_MGMT_UL_VERIFY
+/** Parts of an image, in upload order, as seen by the upload verifier. */
+#define IMG_MGMT_VERIFY_HDR         0   /* Image header; hashed. */
+#define IMG_MGMT_VERIFY_BODY        1   /* Header padding and body; hashed. */
+#define IMG_MGMT_VERIFY_TLV_INFO    2
+#define IMG_MGMT_VERIFY_TLV         3   /* TLV type and length. */
+#define IMG_MGMT_VERIFY_HASH        4   /* Value of the SHA256 TLV. */
+#define IMG_MGMT_VERIFY_SKIP        5   /* Value of any other TLV. */
+#define IMG_MGMT_VERIFY_DONE        6   /* Past the TLVs, or unparseable. */
+
+/**
+ * Verifies the hash of the image being uploaded.  The header and body are
+ * hashed, and the expected hash is picked out of the TLV area, as each chunk
+ * is written, so the image never needs to be read back from flash.
+ */
+static struct {
+    struct sha256_ctx sha;
+
+    /** Part of the image the next byte belongs to (IMG_MGMT_VERIFY_[...]). */
+    uint8_t part;
+
+    /** Number of bytes remaining in the current part. */
+    size_t part_left;
+
+    /** The current part, for those that are parsed. */
+    union {
+        struct image_header hdr;
+        struct image_tlv_info tlv_info;
+        struct image_tlv tlv;
+        uint8_t hash[IMAGE_HASH_LEN];
+    } buf;
+    size_t buf_len;
+
+    /** Number of bytes in the TLV area after the current part. */
+    size_t tlv_left;
+
+    /** The hash from the image's SHA256 TLV. */
+    uint8_t hash[IMAGE_HASH_LEN];
+    bool hash_found;
+} img_mgmt_verify;
+
+static void
+img_mgmt_verify_enter(uint8_t part, size_t len)
+{
+    img_mgmt_verify.part = part;
+    img_mgmt_verify.part_left = len;
+    img_mgmt_verify.buf_len = 0;
+}
+
+/**
+ * Moves on to the next TLV, if the TLV area has room for one.
+ */
+static void
+img_mgmt_verify_next_tlv(void)
+{
+    if (img_mgmt_verify.tlv_left >= sizeof (struct image_tlv)) {
+        img_mgmt_verify_enter(IMG_MGMT_VERIFY_TLV, sizeof (struct image_tlv));
+    } else {
+        img_mgmt_verify_enter(IMG_MGMT_VERIFY_DONE, 0);
+    }
+}
+
+/**
+ * Processes the part of the image that has just been received in full, and
+ * determines which part comes next.
+ */
+static void
+img_mgmt_verify_next(void)
+{
+    const struct image_tlv_info *tlv_info;
+    const struct image_header *hdr;
+    const struct image_tlv *tlv;
+
+    switch (img_mgmt_verify.part) {
+    case IMG_MGMT_VERIFY_HDR:
+        hdr = &img_mgmt_verify.buf.hdr;
+        if (hdr->ih_hdr_size < sizeof *hdr) {
+            img_mgmt_verify_enter(IMG_MGMT_VERIFY_DONE, 0);
+        } else {
+            img_mgmt_verify_enter(IMG_MGMT_VERIFY_BODY,
+                                  hdr->ih_hdr_size - sizeof *hdr +
+                                  hdr->ih_img_size);
+        }
+        break;
+
+    case IMG_MGMT_VERIFY_BODY:
+        img_mgmt_verify_enter(IMG_MGMT_VERIFY_TLV_INFO,
+                              sizeof (struct image_tlv_info));
+        break;
+
+    case IMG_MGMT_VERIFY_TLV_INFO:
+        tlv_info = &img_mgmt_verify.buf.tlv_info;
+        if (tlv_info->it_magic != IMAGE_TLV_INFO_MAGIC ||
+            tlv_info->it_tlv_tot < sizeof *tlv_info) {
+
+            img_mgmt_verify_enter(IMG_MGMT_VERIFY_DONE, 0);
+        } else {
+            /* The total includes the TLV info header. */
+            img_mgmt_verify.tlv_left = tlv_info->it_tlv_tot - sizeof *tlv_info;
+            img_mgmt_verify_next_tlv();
+        }
+        break;
+
+    case IMG_MGMT_VERIFY_TLV:
+        tlv = &img_mgmt_verify.buf.tlv;
+        img_mgmt_verify.tlv_left -= sizeof *tlv;
+        if (tlv->it_len > img_mgmt_verify.tlv_left) {
+            img_mgmt_verify_enter(IMG_MGMT_VERIFY_DONE, 0);
+            break;
+        }
+        img_mgmt_verify.tlv_left -= tlv->it_len;
+
+        if (tlv->it_type == IMAGE_TLV_SHA256 &&
+            tlv->it_len == IMAGE_HASH_LEN) {
+
+            img_mgmt_verify_enter(IMG_MGMT_VERIFY_HASH, tlv->it_len);
+        } else {
+            img_mgmt_verify_enter(IMG_MGMT_VERIFY_SKIP, tlv->it_len);
+        }
+        break;
+
+    case IMG_MGMT_VERIFY_HASH:
+        if (img_mgmt_verify.hash_found) {
+            /* More than one hash; the image is invalid. */
+            img_mgmt_verify.hash_found = false;
+            img_mgmt_verify_enter(IMG_MGMT_VERIFY_DONE, 0);
+            break;
+        }
+        memcpy(img_mgmt_verify.hash, img_mgmt_verify.buf.hash,
+               IMAGE_HASH_LEN);
+        img_mgmt_verify.hash_found = true;
+        img_mgmt_verify_next_tlv();
+        break;
+
+    case IMG_MGMT_VERIFY_SKIP:
+        img_mgmt_verify_next_tlv();
+        break;
+    }
+}
+
+static void
+img_mgmt_verify_start(void)
+{
+    sha256_init(&img_mgmt_verify.sha);
+    img_mgmt_verify.hash_found = false;
+    img_mgmt_verify_enter(IMG_MGMT_VERIFY_HDR, sizeof (struct image_header));
+}
+
+/**
+ * Feeds the next piece of the image to the verifier.
+ */
+static void
+img_mgmt_verify_feed(const uint8_t *data, size_t len)
+{
+    uint8_t part;
+    size_t n;
+
+    while (img_mgmt_verify.part != IMG_MGMT_VERIFY_DONE) {
+        if (img_mgmt_verify.part_left == 0) {
+            img_mgmt_verify_next();
+            continue;
+        }
+        if (len == 0) {
+            break;
+        }
+
+        n = img_mgmt_verify.part_left;
+        if (n > len) {
+            n = len;
+        }
+
+        part = img_mgmt_verify.part;
+        if (part == IMG_MGMT_VERIFY_HDR || part == IMG_MGMT_VERIFY_BODY) {
+            sha256_update(&img_mgmt_verify.sha, data, n);
+        }
+        if (part != IMG_MGMT_VERIFY_BODY && part != IMG_MGMT_VERIFY_SKIP) {
+            memcpy((uint8_t *)&img_mgmt_verify.buf + img_mgmt_verify.buf_len,
+                   data, n);
+            img_mgmt_verify.buf_len += n;
+        }
+
+        img_mgmt_verify.part_left -= n;
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * Compares the hash of the uploaded image with the one in its hash TLV.
+ *
+ * @return                      0 if the hashes match;
+ *                              MGMT_ERR_ECORRUPT if they don't, or if the
+ *                                  image has no hash TLV.
+ */
+static int
+img_mgmt_verify_finish(void)
+{
+    uint8_t hash[IMAGE_HASH_LEN];
+
+    if (!img_mgmt_verify.hash_found) {
+        return MGMT_ERR_ECORRUPT;
+    }
+
+    sha256_final(&img_mgmt_verify.sha, hash);
+    if (memcmp(hash, img_mgmt_verify.hash, IMAGE_HASH_LEN) != 0) {
+        return MGMT_ERR_ECORRUPT;
+    }
+
+    return 0;
+}
+
+/**
+ * Erases the image header of an upload that failed verification, so that
+ * slot 1 is no longer listed and cannot be marked as pending.  Only the first
+ * sector of the slot is erased, unless the port can't erase individual
+ * sectors.
+ */
+static int
+img_mgmt_verify_discard(void)
+{
+    unsigned int start;
+    unsigned int size;
+    int idx;
+    int rc;
+
+    rc = img_mgmt_impl_sector_info(0, &idx, &start, &size);
+    if (rc == MGMT_ERR_ENOTSUP) {
+        return img_mgmt_erase_slot();
+    }
+
+    if (rc == 0) {
+        MGMT_TRACE(MGMT_TRACE_IO, NULL, size);
+        rc = img_mgmt_impl_erase_sector(start, size);
+        MGMT_TRACE(MGMT_TRACE_IO_DONE, NULL, rc);
+        img_mgmt_cache_invalidate();
+    }
+
+    if (rc != 0) {
+        MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_ERASE_ERRS);
+    } else {
+        MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_SECTOR_ERASES);
+    }
+
+    return rc;
+}
+#endif
+
+/**
+ * Writes a chunk of image data at the current upload offset.  Once the last
+ * chunk has been written, the image's hash is verified.
+ */
+static int
+img_mgmt_upload_write_chunk(const uint8_t *data, size_t data_len)
+{
+    size_t new_off;
+    bool last;
+    int rc;
+
+    new_off = img_mgmt_ctxt.off + data_len;
+    if (new_off > img_mgmt_ctxt.len) {
+        /* Data exceeds image length. */
+        return MGMT_ERR_EINVAL;
+    }
+    last = new_off == img_mgmt_ctxt.len;
 
     if (data_len > 0) {
-        rc = img_mgmt_impl_write_image_data(off, img_mgmt_data, data_len,
-                                            last);
+#if IMG_MGMT_LAZY_ERASE
+        if (img_mgmt_lazy.active) {
+            rc = img_mgmt_lazy_erase(img_mgmt_ctxt.off, data_len);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+#endif
+
+        MGMT_TRACE(MGMT_TRACE_IO, NULL, data_len);
+        rc = img_mgmt_impl_write_image_data(img_mgmt_ctxt.off, data,
+                                            data_len, last);
+        MGMT_TRACE(MGMT_TRACE_IO_DONE, NULL, rc);
+        img_mgmt_cache_invalidate();
         if (rc != 0) {
+            MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_WRITE_ERRS);
             return rc;
         }
+        MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_UL_CHUNKS);
+        MGMT_STATS_ADD(img_mgmt_stats, IMG_MGMT_STAT_UL_BYTES, data_len);
+
+#if IMG_MGMT_UL_VERIFY
+        /* Hash only written data; a chunk that failed to be written gets
+         * resent.
+         */
+        img_mgmt_verify_feed(data, data_len);
+#endif
     }
 
     img_mgmt_ctxt.off = new_off;
     if (last) {
         /* Upload complete. */
+        MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_UL_DONE);
         img_mgmt_ctxt.uploading = false;
+        mgmt_session_close(&img_mgmt_session_pool, 0);
+
+#if IMG_MGMT_UL_VERIFY
+        rc = img_mgmt_verify_finish();
+        if (rc != 0) {
+            MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_UL_CORRUPT);
+            img_mgmt_verify_discard();
+            return rc;
+        }
+#endif
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a chunk of image data at the current upload offset, followed by any
+ * held chunks that it makes contiguous, and encodes the response.  The
+ * response offset acknowledges all data written so far.
+ */
+static int
+img_mgmt_upload_write(struct mgmt_ctxt *ctxt, const uint8_t *data,
+                      size_t data_len)
+{
+    int rc;
+
+    rc = img_mgmt_upload_write_chunk(data, data_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+#if IMG_MGMT_UL_REORDER_COUNT > 0
+    while (img_mgmt_ctxt.uploading) {
+        data = mgmt_reorder_take(&img_mgmt_reorder, img_mgmt_ctxt.off,
+                                 &data_len);
+        if (data == NULL) {
+            break;
+        }
+
+        rc = img_mgmt_upload_write_chunk(data, data_len);
+        if (rc != 0) {
+            return rc;
+        }
     }
+#endif
 
     return img_mgmt_encode_upload_rsp(ctxt, 0);
 }
 
+/**
+ * Begins a new upload into the freshly-erased slot 1.
+ */
+static void
+img_mgmt_upload_start(size_t img_len)
+{
+    img_mgmt_ctxt.uploading = true;
+    img_mgmt_ctxt.off = 0;
+    img_mgmt_ctxt.len = img_len;
+
+#if IMG_MGMT_UL_REORDER_COUNT > 0
+    mgmt_reorder_clear(&img_mgmt_reorder);
+#endif
+
+#if IMG_MGMT_UL_VERIFY
+    img_mgmt_verify_start();
+#endif
+}
+
+#if IMG_MGMT_ERASE_ASYNC
+/**
+ * Writes the retained first chunk once the background erase has completed.
+ * Runs in the SMP task, like the rest of the upload.
+ */
+static int
+img_mgmt_upload_erase_finish(struct mgmt_ctxt *ctxt, int status)
+{
+    int rc;
+
+    img_mgmt_erase_finish(status);
+    img_mgmt_erase_op.busy = false;
+
+    rc = status;
+    if (rc == 0) {
+        img_mgmt_upload_start(img_mgmt_erase_op.img_len);
+        rc = img_mgmt_upload_write(ctxt, img_mgmt_erase_op.data,
+                                   img_mgmt_erase_op.data_len);
+    } else {
+        mgmt_session_close(&img_mgmt_session_pool, 0);
+    }
+
+    return rc;
+}
+#endif
+
+/**
+ * Processes an upload request specifying an offset of 0 (i.e., the first image
+ * chunk).  On success, the caller is responsible for writing the chunk and
+ * encoding the response.  If the slot is being erased in the background,
+ * MGMT_DEFERRED is returned; the chunk is then written and the response
+ * encoded when the erase completes.
+ */
+static int
+img_mgmt_upload_first_chunk(struct mgmt_ctxt *ctxt, const uint8_t *req_data,
+                            size_t len, size_t img_len)
+{
+    struct image_header hdr;
+    int rc;
+
+    if (len < sizeof hdr) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    memcpy(&hdr, req_data, sizeof hdr);
+    if (hdr.ih_magic != IMAGE_MAGIC) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (img_mgmt_slot_in_use(1)) {
+        /* No free slot. */
+        return MGMT_ERR_ENOMEM;
+    }
+
+#if IMG_MGMT_ERASE_ASYNC
+    if (img_mgmt_erase_op.busy) {
+        return MGMT_ERR_EBADSTATE;
+    }
+#endif
+
+#if IMG_MGMT_PREPARE
+    if (img_mgmt_prepare.busy) {
+        return MGMT_ERR_EBADSTATE;
+    }
+#endif
+
+    /* Abandon any upload in progress; the slot is about to be erased.  The
+     * caller has verified that it belongs to this peer or has gone idle.
+     */
+    img_mgmt_ctxt.uploading = false;
+#if IMG_MGMT_LAZY_ERASE
+    img_mgmt_lazy.active = false;
+#endif
+
+#if IMG_MGMT_PREPARE
+    if (img_mgmt_prepare_clean()) {
+        /* Erased by an earlier request and not written to since. */
+        img_mgmt_upload_start(img_len);
+        return 0;
+    }
+#endif
+
+#if IMG_MGMT_LAZY_ERASE
+    /* Fall back to erasing the whole slot if the port can't erase individual
+     * sectors or the image spans too many of them.
+     */
+    if (img_mgmt_lazy_start(img_len) == 0) {
+        img_mgmt_upload_start(img_len);
+        return 0;
+    }
+#endif
+
+#if IMG_MGMT_ERASE_ASYNC
+    /* Retain the chunk; the request buffer is gone by the time the erase
+     * completes.
+     */
+    memcpy(img_mgmt_erase_op.data, req_data, len);
+    img_mgmt_erase_op.data_len = len;
+    img_mgmt_erase_op.img_len = img_len;
+
+    rc = img_mgmt_erase_start(ctxt, img_mgmt_upload_erase_finish);
+    if (rc == 0) {
+        return MGMT_DEFERRED;
+    }
+    if (rc != MGMT_ERR_ENOTSUP) {
+        return rc;
+    }
+#endif
+
+    rc = img_mgmt_erase_slot();
+    if (rc != 0) {
+        return rc;
+    }
+
+    img_mgmt_upload_start(img_len);
+
+    return 0;
+}
+
+/**
+ * Frees the upload session of another peer that has sent no request for
+ * IMG_MGMT_UL_TAKEOVER_MS, so that the peer that sent a request can take the
+ * upload over.  This lets a client that reconnects, e.g., over a new BLE
+ * connection with a new session key, restart or continue its upload without
+ * waiting for IMG_MGMT_UL_TIMEOUT_MS.  The session is kept while an erase
+ * started for it is in progress.
+ *
+ * @return                      true if a session was freed.
+ */
+static bool
+img_mgmt_session_reclaim(const struct mgmt_ctxt *ctxt)
+{
+    if (IMG_MGMT_UL_TAKEOVER_MS == 0 || !img_mgmt_session.ms_used) {
+        return false;
+    }
+
+#if IMG_MGMT_ERASE_ASYNC
+    if (img_mgmt_erase_op.busy) {
+        return false;
+    }
+#endif
+
+    if (mgmt_session_find(&img_mgmt_session_pool, ctxt) != -1 ||
+        mgmt_session_idle_ms(&img_mgmt_session_pool, 0) <
+            IMG_MGMT_UL_TAKEOVER_MS) {
+
+        return false;
+    }
+
+    mgmt_session_close(&img_mgmt_session_pool, 0);
+    return true;
+}
+
+/**
+ * Command handler: image upload
+ */
+static int
+img_mgmt_upload(struct mgmt_ctxt *ctxt)
+{
+    uint8_t img_mgmt_data[IMG_MGMT_UL_CHUNK_SIZE];
+    unsigned long long len;
+    unsigned long long off;
+    size_t data_len;
+    int idx;
+    int rc;
+
+    const struct cbor_attr_t off_attr[4] = {
+        [0] = {
+            .attribute = "data",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = img_mgmt_data,
+            .addr.bytestring.len = &data_len,
+            .len = sizeof(img_mgmt_data)
+        },
+        [1] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &len,
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+            .nodefault = true
+        },
+        [3] = { 0 },
+    };
+
+    /* Rejected, held, and dropped chunks change nothing that a cached
+     * response depends on.
+     */
+    ctxt->unchanged = true;
+
+    len = ULLONG_MAX;
+    off = ULLONG_MAX;
+    data_len = 0;
+    rc = cbor_read_object(&ctxt->it, off_attr);
+    MGMT_TRACE(MGMT_TRACE_DECODED, NULL, 0);
+    if (rc || off == ULLONG_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (off == 0) {
+        /* Total image length is a required field in the first request. */
+        if (len == ULLONG_MAX) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        /* Another peer's upload can only be replaced once it goes idle. */
+        img_mgmt_session_reclaim(ctxt);
+        rc = mgmt_session_open(&img_mgmt_session_pool, ctxt, &idx);
+        if (rc != 0) {
+            return MGMT_ERR_EBADSTATE;
+        }
+
+        ctxt->unchanged = false;
+        rc = img_mgmt_upload_first_chunk(ctxt, img_mgmt_data, data_len, len);
+        if (rc == MGMT_DEFERRED) {
+            return rc;
+        }
+        if (rc != 0) {
+            mgmt_session_close(&img_mgmt_session_pool, idx);
+            return rc;
+        }
+    } else {
+        idx = mgmt_session_find(&img_mgmt_session_pool, ctxt);
+        if (idx == -1 && img_mgmt_ctxt.uploading &&
+            img_mgmt_session_reclaim(ctxt)) {
+
+            /* Continue the idle upload; a chunk at the wrong offset gets the
+             * expected one back.
+             */
+            ctxt->unchanged = false;
+            mgmt_session_open(&img_mgmt_session_pool, ctxt, &idx);
+        }
+        if (idx == -1 || !img_mgmt_ctxt.uploading) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        if (off != img_mgmt_ctxt.off) {
+#if IMG_MGMT_UL_REORDER_COUNT > 0
+            /* Hold a chunk that arrived early; it gets written once the gap
+             * before it is filled.
+             */
+            rc = mgmt_reorder_hold(&img_mgmt_reorder, ctxt, img_mgmt_ctxt.off,
+                                   off, img_mgmt_data, data_len);
+            if (rc == 0) {
+                return img_mgmt_encode_upload_rsp(ctxt, 0);
+            }
+#endif
+            /* Invalid offset.  Drop the data and send the expected offset;
+             * unlike fs uploads, image uploads have always reported success
+             * here, and clients rely on it to resynchronize.
+             */
+            MGMT_STATS_INC(img_mgmt_stats, IMG_MGMT_STAT_UL_DROPPED);
+            return img_mgmt_encode_upload_rsp(ctxt, 0);
+        }
+    }
+
+    ctxt->unchanged = false;
+    rc = img_mgmt_upload_write(ctxt, img_mgmt_data, data_len);
+    if (rc == 0) {
+        /* A retransmission of this chunk gets the same answer. */
+        ctxt->replayable = true;
+    }
+
+    return rc;
+}
+
 void
 img_mgmt_register_group(void)
 {
-    mgmt_register_group(&img_mgmt_group);
+    /* The group is registered at link time; a reference to this function
+     * keeps it in the image.
+     */
 }
@@ -6,10 +6,46 @@
 #include "syscfg/syscfg.h"
 
 #define IMG_MGMT_UL_CHUNK_SIZE  MYNEWT_VAL(IMG_MGMT_UL_CHUNK_SIZE)
+#define IMG_MGMT_ERASE_ASYNC    MYNEWT_VAL(IMG_MGMT_ERASE_ASYNC)
+#define IMG_MGMT_UL_REORDER_COUNT   MYNEWT_VAL(IMG_MGMT_UL_REORDER_COUNT)
+#define IMG_MGMT_UL_TIMEOUT_MS  MYNEWT_VAL(IMG_MGMT_UL_TIMEOUT_MS)
+#define IMG_MGMT_UL_TAKEOVER_MS MYNEWT_VAL(IMG_MGMT_UL_TAKEOVER_MS)
+#define IMG_MGMT_UL_VERIFY      MYNEWT_VAL(IMG_MGMT_UL_VERIFY)
+#define IMG_MGMT_LAZY_ERASE     MYNEWT_VAL(IMG_MGMT_LAZY_ERASE)
+#define IMG_MGMT_LAZY_ERASE_SECTORS MYNEWT_VAL(IMG_MGMT_LAZY_ERASE_SECTORS)
+#define IMG_MGMT_PREPARE        MYNEWT_VAL(IMG_MGMT_PREPARE)
 
 #elif defined __ZEPHYR__
 
 #define IMG_MGMT_UL_CHUNK_SIZE  CONFIG_IMG_MGMT_UL_CHUNK_SIZE
+#define IMG_MGMT_UL_REORDER_COUNT   CONFIG_IMG_MGMT_UL_REORDER_COUNT
+#define IMG_MGMT_UL_TIMEOUT_MS  CONFIG_IMG_MGMT_UL_TIMEOUT_MS
+#define IMG_MGMT_UL_TAKEOVER_MS CONFIG_IMG_MGMT_UL_TAKEOVER_MS
+
+#ifdef CONFIG_IMG_MGMT_ERASE_ASYNC
+#define IMG_MGMT_ERASE_ASYNC    1
+#else
+#define IMG_MGMT_ERASE_ASYNC    0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_UL_VERIFY
+#define IMG_MGMT_UL_VERIFY      1
+#else
+#define IMG_MGMT_UL_VERIFY      0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_LAZY_ERASE
+#define IMG_MGMT_LAZY_ERASE     1
+#define IMG_MGMT_LAZY_ERASE_SECTORS CONFIG_IMG_MGMT_LAZY_ERASE_SECTORS
+#else
+#define IMG_MGMT_LAZY_ERASE     0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_PREPARE
+#define IMG_MGMT_PREPARE        1
+#else
+#define IMG_MGMT_PREPARE        0
+#endif
 
 #else
 
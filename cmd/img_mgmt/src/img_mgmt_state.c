@@ -25,6 +25,7 @@
 #include "img_mgmt/image.h"
 #include "img_mgmt_priv.h"
 #include "img_mgmt/img_mgmt_impl.h"
+#include "img_mgmt_config.h"
 
 #define IMG_MGMT_STATE_F_PENDING    0x01
 #define IMG_MGMT_STATE_F_CONFIRMED  0x02
@@ -49,7 +50,7 @@ img_mgmt_state_flags(int query_slot)
     /* Determine if this is is pending or confirmed (only applicable for
      * unified images and loaders.
      */
-    swap_type = img_mgmt_impl_swap_type();
+    swap_type = img_mgmt_swap_type();
     switch (swap_type) {
     case IMG_MGMT_SWAP_TYPE_NONE:
         if (query_slot == 0) {
@@ -140,6 +141,7 @@ img_mgmt_state_set_pending(int slot, int permanent)
     }
 
     rc = img_mgmt_impl_write_pending(slot, permanent);
+    img_mgmt_cache_invalidate();
     if (rc != 0) {
         return MGMT_ERR_EUNKNOWN;
     }
@@ -162,6 +164,7 @@ img_mgmt_state_confirm(void)
     }
 
     rc = img_mgmt_impl_write_confirmed();
+    img_mgmt_cache_invalidate();
     if (rc != 0) {
         return MGMT_ERR_EUNKNOWN;
     }
@@ -242,6 +245,13 @@ img_mgmt_state_read(struct mgmt_ctxt *ctxt)
         return MGMT_ERR_ENOMEM;
     }
 
+#if IMG_MGMT_PREPARE
+    rc = img_mgmt_prepare_encode(ctxt);
+    if (rc != 0) {
+        return rc;
+    }
+#endif
+
     return 0;
 }
 
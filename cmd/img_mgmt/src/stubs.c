@@ -31,6 +31,37 @@ img_mgmt_impl_erase_slot(void)
     return MGMT_ERR_ENOTSUP;
 }
 
+int __attribute__((weak))
+img_mgmt_impl_erase_slot_async(img_mgmt_impl_erase_done_fn *cb, void *arg)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+img_mgmt_impl_run_bg(img_mgmt_impl_bg_fn *fn)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+img_mgmt_impl_sector_info(unsigned int offset, int *out_idx,
+                          unsigned int *out_start, unsigned int *out_size)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+img_mgmt_impl_erase_sector(unsigned int start, unsigned int size)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+img_mgmt_impl_erase_trailer(void)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
 int __attribute__((weak))
 img_mgmt_impl_write_pending(int slot, bool permanent)
 {
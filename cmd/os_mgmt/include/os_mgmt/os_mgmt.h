@@ -35,6 +35,8 @@ struct mgmt_ctxt;
 #define OS_MGMT_ID_MPSTAT           3
 #define OS_MGMT_ID_DATETIME_STR     4
 #define OS_MGMT_ID_RESET            5
+#define OS_MGMT_ID_MCUMGR_PARAMS    6
+#define OS_MGMT_ID_TRACE            7
 
 #define OS_MGMT_TASK_NAME_LEN       32
 
@@ -54,7 +56,13 @@ struct os_mgmt_task_info {
 
 /**
  * @brief Registers the OS management command handler group.
- */ 
+ *
+ * The group is defined with MGMT_GROUP_DEFINE() and registered at link time,
+ * so this function has no effect at runtime.  It serves as the anchor that
+ * links the group in when the group's library is linked as an ordinary
+ * archive.  On Mynewt, the package names it with -u in its pkg.lflags, so
+ * the application doesn't need to call it.
+ */
 void os_mgmt_register_group(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,189 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mgmt/mgmt.h"
+#include "os_mgmt/os_mgmt.h"
+#include "os_mgmt/os_mgmt_impl.h"
+
+#ifdef __linux__
+/**
+ * Retrieves the ID of the thread at the specified index within this process.
+ */
+static int
+posix_os_mgmt_tid_at(int idx, long *out_tid)
+{
+    struct dirent *ent;
+    DIR *dir;
+    int i;
+
+    dir = opendir("/proc/self/task");
+    if (dir == NULL) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    i = 0;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        if (i == idx) {
+            *out_tid = strtol(ent->d_name, NULL, 10);
+            closedir(dir);
+            return 0;
+        }
+        i++;
+    }
+
+    closedir(dir);
+    return MGMT_ERR_ENOENT;
+}
+
+/**
+ * Reads the total number of context switches a thread has undergone.
+ */
+static uint32_t
+posix_os_mgmt_cswcnt(long tid)
+{
+    unsigned long num;
+    uint32_t total;
+    char path[64];
+    char line[128];
+    FILE *fp;
+
+    snprintf(path, sizeof path, "/proc/self/task/%ld/status", tid);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+
+    total = 0;
+    while (fgets(line, sizeof line, fp) != NULL) {
+        if (sscanf(line, "voluntary_ctxt_switches: %lu", &num) == 1 ||
+            sscanf(line, "nonvoluntary_ctxt_switches: %lu", &num) == 1) {
+
+            total += num;
+        }
+    }
+
+    fclose(fp);
+    return total;
+}
+
+int
+os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
+{
+    unsigned long utime;
+    unsigned long stime;
+    char path[64];
+    char buf[512];
+    char *fields;
+    char *name;
+    char *end;
+    FILE *fp;
+    long prio;
+    long tid;
+    char state;
+    size_t len;
+    int rc;
+
+    rc = posix_os_mgmt_tid_at(idx, &tid);
+    if (rc != 0) {
+        return rc;
+    }
+
+    snprintf(path, sizeof path, "/proc/self/task/%ld/stat", tid);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        /* The thread exited in the meantime. */
+        return MGMT_ERR_ENOENT;
+    }
+    len = fread(buf, 1, sizeof buf - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+
+    /* The thread name is parenthesized and may itself contain parentheses
+     * or spaces, so the remaining fields start after the last ')'.
+     */
+    name = strchr(buf, '(');
+    end = strrchr(buf, ')');
+    if (name == NULL || end == NULL || end < name) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+    *end = '\0';
+    fields = end + 2;
+
+    /* Fields 3, 14, 15, and 18 of proc(5). */
+    rc = sscanf(fields, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu "
+                        "%*d %*d %ld", &state, &utime, &stime, &prio);
+    if (rc != 4) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_info = (struct os_mgmt_task_info){ 0 };
+
+    strncpy(out_info->oti_name, name + 1, sizeof out_info->oti_name - 1);
+    out_info->oti_prio = prio;
+    out_info->oti_taskid = idx;
+
+    /* Report running threads as ready and all others as sleeping. */
+    out_info->oti_state = state == 'R' ? 1 : 2;
+
+    out_info->oti_cswcnt = posix_os_mgmt_cswcnt(tid);
+    out_info->oti_runtime = (utime + stime) * 1000 / sysconf(_SC_CLK_TCK);
+
+    return 0;
+}
+#endif /* __linux__ */
+
+static void *
+posix_os_mgmt_reset_thread(void *arg)
+{
+    usleep((uintptr_t)arg * 1000);
+
+    /* A host process has no board to reset; ask the application to shut
+     * down instead.
+     */
+    kill(getpid(), SIGTERM);
+
+    return NULL;
+}
+
+int
+os_mgmt_impl_reset(unsigned int delay_ms)
+{
+    pthread_t thread;
+    int rc;
+
+    rc = pthread_create(&thread, NULL, posix_os_mgmt_reset_thread,
+                        (void *)(uintptr_t)delay_ms);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+    pthread_detach(thread);
+
+    return 0;
+}
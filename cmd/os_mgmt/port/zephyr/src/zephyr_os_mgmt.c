@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include <string.h>
 #include <zephyr.h>
 #include <misc/reboot.h>
 #include <debug/object_tracing.h>
@@ -48,10 +49,37 @@ zephyr_os_mgmt_task_at(int idx)
     return thread;
 }
 
+#ifdef CONFIG_INIT_STACKS
+/**
+ * Calculates the high-water mark of a thread's stack, in bytes.  Stacks are
+ * filled with 0xaa at creation and grow downward, so the untouched region is
+ * the run of fill bytes at the low end.
+ */
+static uint32_t
+zephyr_os_mgmt_stack_used(const struct k_thread *thread)
+{
+    const uint8_t *stack;
+    size_t unused;
+    size_t size;
+
+    stack = (const uint8_t *)thread->stack_info.start;
+    size = thread->stack_info.size;
+
+    for (unused = 0; unused < size; unused++) {
+        if (stack[unused] != 0xaa) {
+            break;
+        }
+    }
+
+    return size - unused;
+}
+#endif
+
 int
 os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
 {
     const struct k_thread *thread;
+    const char *name;
 
     thread = zephyr_os_mgmt_task_at(idx);
     if (thread == NULL) {
@@ -60,12 +88,24 @@ os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
 
     *out_info = (struct os_mgmt_task_info){ 0 };
 
-    snprintf(out_info->oti_name, sizeof out_info->oti_name, "%d",
-             thread->base.prio);
+    /* Unnamed threads are identified by their priority. */
+    name = NULL;
+#ifdef CONFIG_THREAD_NAME
+    name = k_thread_name_get((k_tid_t)thread);
+#endif
+    if (name != NULL && name[0] != '\0') {
+        strncpy(out_info->oti_name, name, sizeof out_info->oti_name - 1);
+    } else {
+        snprintf(out_info->oti_name, sizeof out_info->oti_name, "%d",
+                 thread->base.prio);
+    }
     out_info->oti_prio = thread->base.prio;
     out_info->oti_taskid = idx;
     out_info->oti_state = thread->base.thread_state;
     out_info->oti_stksize = thread->stack_info.size / 4;
+#ifdef CONFIG_INIT_STACKS
+    out_info->oti_stkusage = zephyr_os_mgmt_stack_used(thread) / 4;
+#endif
 
     return 0;
 }
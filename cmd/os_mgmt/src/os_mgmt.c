@@ -18,10 +18,13 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 #include "cbor.h"
 #include "cborattr/cborattr.h"
 #include "mgmt/mgmt.h"
+#include "mgmt/mgmt_impl.h"
+#include "mgmt/mgmt_trace.h"
 #include "os_mgmt/os_mgmt.h"
 #include "os_mgmt/os_mgmt_impl.h"
 #include "os_mgmt_config.h"
@@ -29,6 +32,14 @@
 static mgmt_handler_fn os_mgmt_echo;
 static mgmt_handler_fn os_mgmt_reset;
 static mgmt_handler_fn os_mgmt_taskstat_read;
+static mgmt_handler_fn os_mgmt_mcumgr_params_read;
+static mgmt_handler_fn os_mgmt_mcumgr_params_write;
+#if MGMT_TRACE_COUNT > 0
+static mgmt_handler_fn os_mgmt_trace_read;
+
+/** Number of trace records returned per trace read request. */
+#define OS_MGMT_TRACE_PAGE_RECS     32
+#endif
 
 static const struct mgmt_handler os_mgmt_group_handlers[] = {
     [OS_MGMT_ID_ECHO] = {
@@ -40,16 +51,18 @@ static const struct mgmt_handler os_mgmt_group_handlers[] = {
     [OS_MGMT_ID_RESET] = {
         NULL, os_mgmt_reset
     },
+    [OS_MGMT_ID_MCUMGR_PARAMS] = {
+        os_mgmt_mcumgr_params_read, os_mgmt_mcumgr_params_write
+    },
+#if MGMT_TRACE_COUNT > 0
+    [OS_MGMT_ID_TRACE] = {
+        os_mgmt_trace_read, NULL
+    },
+#endif
 };
 
-#define OS_MGMT_GROUP_SZ    \
-    (sizeof os_mgmt_group_handlers / sizeof os_mgmt_group_handlers[0])
-
-static struct mgmt_group os_mgmt_group = {
-    .mg_handlers = os_mgmt_group_handlers,
-    .mg_handlers_count = OS_MGMT_GROUP_SZ,
-    .mg_group_id = MGMT_GROUP_ID_OS,
-};
+static MGMT_GROUP_DEFINE(os_mgmt_group, MGMT_GROUP_ID_OS,
+                        os_mgmt_group_handlers);
 
 /**
  * Command handler: os echo
@@ -74,6 +87,7 @@ os_mgmt_echo(struct mgmt_ctxt *ctxt)
     };
 
     echo_buf[0] = '\0';
+    ctxt->unchanged = true;
 
     err = cbor_read_object(&ctxt->it, attrs);
     if (err != 0) {
@@ -183,8 +197,140 @@ os_mgmt_reset(struct mgmt_ctxt *ctxt)
     return os_mgmt_impl_reset(OS_MGMT_RESET_MS);
 }
 
+/**
+ * Encodes the mcumgr parameters response.
+ */
+static int
+os_mgmt_mcumgr_params_encode(struct mgmt_ctxt *ctxt)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, 0);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "win");
+    err |= cbor_encode_uint(&ctxt->encoder, mgmt_get_window(ctxt));
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: os mcumgr parameters (read)
+ */
+static int
+os_mgmt_mcumgr_params_read(struct mgmt_ctxt *ctxt)
+{
+    return os_mgmt_mcumgr_params_encode(ctxt);
+}
+
+/**
+ * Command handler: os mcumgr parameters (write)
+ *
+ * Negotiates the number of requests the client may keep in flight.  The
+ * response indicates the accepted window, which may be smaller than
+ * requested.
+ */
+static int
+os_mgmt_mcumgr_params_write(struct mgmt_ctxt *ctxt)
+{
+    unsigned long long win;
+    int rc;
+
+    const struct cbor_attr_t attrs[2] = {
+        [0] = {
+            .attribute = "win",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &win,
+            .nodefault = true,
+        },
+        [1] = {
+            .attribute = NULL
+        }
+    };
+
+    win = ULLONG_MAX;
+    rc = cbor_read_object(&ctxt->it, attrs);
+    if (rc != 0 || win == ULLONG_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (win > INT_MAX) {
+        win = INT_MAX;
+    }
+    mgmt_set_window(ctxt, win);
+
+    return os_mgmt_mcumgr_params_encode(ctxt);
+}
+
 void
 os_mgmt_register_group(void)
 {
-    mgmt_register_group(&os_mgmt_group);
+    /* The group is registered at link time; a reference to this function
+     * keeps it in the image.
+     */
+}
+
+#if MGMT_TRACE_COUNT > 0
+/**
+ * Command handler: os trace (read)
+ *
+ * Returns a page of trace records, starting at the requested index ("idx"),
+ * or at the oldest retained record if none is specified.  The records are
+ * packed into a byte string in the format described in mgmt/mgmt_trace.h.
+ * The response also indicates the index to request next ("next") and the
+ * rate of the records' cycle counter ("hz").
+ */
+static int
+os_mgmt_trace_read(struct mgmt_ctxt *ctxt)
+{
+    uint8_t data[OS_MGMT_TRACE_PAGE_RECS * MGMT_TRACE_REC_SIZE];
+    unsigned long long idx;
+    uint32_t next;
+    CborError err;
+    int num_recs;
+    int rc;
+
+    const struct cbor_attr_t attrs[2] = {
+        [0] = {
+            .attribute = "idx",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &idx,
+            .nodefault = true,
+        },
+        [1] = {
+            .attribute = NULL
+        }
+    };
+
+    idx = ULLONG_MAX;
+    rc = cbor_read_object(&ctxt->it, attrs);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (idx == ULLONG_MAX) {
+        idx = mgmt_trace_next_idx() - MGMT_TRACE_COUNT;
+    }
+
+    num_recs = mgmt_trace_export(idx, data, OS_MGMT_TRACE_PAGE_RECS, &next);
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "hz");
+    err |= cbor_encode_uint(&ctxt->encoder, mgmt_impl_cycles_hz());
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "next");
+    err |= cbor_encode_uint(&ctxt->encoder, next);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "data");
+    err |= cbor_encode_byte_string(&ctxt->encoder, data,
+                                   num_recs * MGMT_TRACE_REC_SIZE);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
 }
+#endif
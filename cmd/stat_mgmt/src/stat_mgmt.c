@@ -0,0 +1,312 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "cbor.h"
+#include "cborattr/cborattr.h"
+#include "mgmt/mgmt.h"
+#include "mgmt/mgmt_handler_stats.h"
+#include "mgmt/mgmt_stats.h"
+#include "stat_mgmt/stat_mgmt.h"
+#include "stat_mgmt_config.h"
+
+/** Maximum length of a counter group name in a request, including NUL. */
+#define STAT_MGMT_NAME_SIZE     32
+
+static mgmt_handler_fn stat_mgmt_show;
+static mgmt_handler_fn stat_mgmt_list;
+#if MGMT_HANDLER_STATS_COUNT > 0
+static mgmt_handler_fn stat_mgmt_handlers_read;
+
+/** Number of commands described per handler statistics response. */
+#define STAT_MGMT_HANDLERS_PAGE 4
+#endif
+
+static const struct mgmt_handler stat_mgmt_group_handlers[] = {
+    [STAT_MGMT_ID_SHOW] = {
+        stat_mgmt_show, NULL
+    },
+    [STAT_MGMT_ID_LIST] = {
+        stat_mgmt_list, NULL
+    },
+#if MGMT_HANDLER_STATS_COUNT > 0
+    [STAT_MGMT_ID_HANDLERS] = {
+        stat_mgmt_handlers_read, NULL
+    },
+#endif
+};
+
+static MGMT_GROUP_DEFINE(stat_mgmt_group, MGMT_GROUP_ID_STATS,
+                        stat_mgmt_group_handlers);
+
+/**
+ * Command handler: stat show
+ *
+ * Encodes the counters of the named group ("name").  Counters are encoded
+ * straight from the group's array as the response is built, so no copy of
+ * the group is made.  At most STAT_MGMT_MAX_FIELDS counters are returned,
+ * starting at the optional "off" index; if more remain, the response
+ * indicates the index to request next ("next").
+ */
+static int
+stat_mgmt_show(struct mgmt_ctxt *ctxt)
+{
+    const struct mgmt_stats_group *group;
+    char name[STAT_MGMT_NAME_SIZE];
+    unsigned long long off;
+    CborEncoder fields;
+    CborError err;
+    int end;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t attrs[3] = {
+        [0] = {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = name,
+            .len = sizeof name,
+        },
+        [1] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+        },
+        [2] = {
+            .attribute = NULL
+        }
+    };
+
+    name[0] = '\0';
+    off = 0;
+
+    rc = cbor_read_object(&ctxt->it, attrs);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    group = mgmt_stats_group_find(name);
+    if (group == NULL) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    if (off > group->msg_count) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    end = group->msg_count;
+    if (end - (int)off > STAT_MGMT_MAX_FIELDS) {
+        end = off + STAT_MGMT_MAX_FIELDS;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, 0);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "name");
+    err |= cbor_encode_text_stringz(&ctxt->encoder, group->msg_name);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "fields");
+    err |= cbor_encoder_create_map(&ctxt->encoder, &fields,
+                                   CborIndefiniteLength);
+
+    for (i = off; i < end; i++) {
+        err |= cbor_encode_text_stringz(&fields, group->msg_names[i]);
+        err |= cbor_encode_uint(&fields, group->msg_counters[i]);
+    }
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &fields);
+
+    if (end < group->msg_count) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "next");
+        err |= cbor_encode_uint(&ctxt->encoder, end);
+    }
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: stat list
+ */
+static int
+stat_mgmt_list(struct mgmt_ctxt *ctxt)
+{
+    const struct mgmt_stats_group *group;
+    CborEncoder names;
+    CborError err;
+    int idx;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, 0);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "stat_list");
+    err |= cbor_encoder_create_array(&ctxt->encoder, &names,
+                                     CborIndefiniteLength);
+
+    for (idx = 0; ; idx++) {
+        group = mgmt_stats_group_at(idx);
+        if (group == NULL) {
+            break;
+        }
+
+        err |= cbor_encode_text_stringz(&names, group->msg_name);
+    }
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &names);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+#if MGMT_HANDLER_STATS_COUNT > 0
+/**
+ * Encodes the statistics of a single command.
+ */
+static int
+stat_mgmt_handlers_encode_one(struct CborEncoder *encoder,
+                              const struct mgmt_handler_stats *mhs)
+{
+    CborEncoder entry_map;
+    CborEncoder lat_array;
+    CborError err;
+    int num_buckets;
+    int i;
+
+    /* Omit the histogram's trailing empty buckets. */
+    num_buckets = MGMT_HANDLER_STATS_BUCKETS;
+    while (num_buckets > 0 && mhs->mhs_lat[num_buckets - 1] == 0) {
+        num_buckets--;
+    }
+
+    err = 0;
+    err |= cbor_encoder_create_map(encoder, &entry_map,
+                                   CborIndefiniteLength);
+    err |= cbor_encode_text_stringz(&entry_map, "group");
+    err |= cbor_encode_uint(&entry_map, mhs->mhs_key >> 16);
+    err |= cbor_encode_text_stringz(&entry_map, "id");
+    err |= cbor_encode_uint(&entry_map, (mhs->mhs_key >> 8) & 0xff);
+    err |= cbor_encode_text_stringz(&entry_map, "op");
+    err |= cbor_encode_uint(&entry_map, (mhs->mhs_key & 0xff) - 1);
+    err |= cbor_encode_text_stringz(&entry_map, "count");
+    err |= cbor_encode_uint(&entry_map, mhs->mhs_count);
+    err |= cbor_encode_text_stringz(&entry_map, "errs");
+    err |= cbor_encode_uint(&entry_map, mhs->mhs_errs);
+    err |= cbor_encode_text_stringz(&entry_map, "req_bytes");
+    err |= cbor_encode_uint(&entry_map, mhs->mhs_req_bytes);
+    err |= cbor_encode_text_stringz(&entry_map, "rsp_bytes");
+    err |= cbor_encode_uint(&entry_map, mhs->mhs_rsp_bytes);
+    err |= cbor_encode_text_stringz(&entry_map, "lat_us_log2");
+    err |= cbor_encoder_create_array(&entry_map, &lat_array,
+                                     CborIndefiniteLength);
+    for (i = 0; i < num_buckets; i++) {
+        err |= cbor_encode_uint(&lat_array, mhs->mhs_lat[i]);
+    }
+    err |= cbor_encoder_close_container(&entry_map, &lat_array);
+    err |= cbor_encoder_close_container(encoder, &entry_map);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: stat handlers (read)
+ *
+ * Describes the commands handled so far, STAT_MGMT_HANDLERS_PAGE at a time,
+ * starting at the optional "off" table index.  If more remain, the response
+ * indicates the index to request next ("next").  Element n of a command's
+ * "lat_us_log2" array counts latencies from 2^n up to 2^(n+1) microseconds
+ * (element 0 also counts anything shorter); see mgmt/mgmt_handler_stats.h.
+ */
+static int
+stat_mgmt_handlers_read(struct mgmt_ctxt *ctxt)
+{
+    const struct mgmt_handler_stats *mhs;
+    unsigned long long off;
+    CborEncoder cmds_array;
+    CborError err;
+    int num_cmds;
+    int idx;
+    int rc;
+
+    const struct cbor_attr_t attrs[2] = {
+        [0] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+        },
+        [1] = {
+            .attribute = NULL
+        }
+    };
+
+    off = 0;
+    rc = cbor_read_object(&ctxt->it, attrs);
+    if (rc != 0 || off > MGMT_HANDLER_STATS_COUNT) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, 0);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "cmds");
+    err |= cbor_encoder_create_array(&ctxt->encoder, &cmds_array,
+                                     CborIndefiniteLength);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    num_cmds = 0;
+    for (idx = off; idx < MGMT_HANDLER_STATS_COUNT; idx++) {
+        mhs = mgmt_handler_stats_at(idx);
+        if (mhs->mhs_key == 0) {
+            continue;
+        }
+
+        if (num_cmds >= STAT_MGMT_HANDLERS_PAGE) {
+            break;
+        }
+
+        rc = stat_mgmt_handlers_encode_one(&cmds_array, mhs);
+        if (rc != 0) {
+            return rc;
+        }
+        num_cmds++;
+    }
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &cmds_array);
+
+    if (idx < MGMT_HANDLER_STATS_COUNT) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "next");
+        err |= cbor_encode_uint(&ctxt->encoder, idx);
+    }
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,22 @@
+#ifndef H_STAT_MGMT_CONFIG_
+#define H_STAT_MGMT_CONFIG_
+
+#if defined MYNEWT
+
+#include "syscfg/syscfg.h"
+
+#define STAT_MGMT_MAX_FIELDS    MYNEWT_VAL(STAT_MGMT_MAX_FIELDS)
+
+#elif defined __ZEPHYR__
+
+#define STAT_MGMT_MAX_FIELDS    CONFIG_STAT_MGMT_MAX_FIELDS
+
+#else
+
+/* No direct support for this OS.  The application needs to define the above
+ * settings itself.
+ */
+
+#endif
+
+#endif
@@ -33,6 +33,26 @@ int base64_decode_len(const char *str);
 
 #define BASE64_ENCODE_SIZE(__size) (((((__size) - 1) / 3) * 4) + 4)
 
+/* Maximum number of bytes that base64_decoder_feed() writes for the given
+ * number of input characters.
+ */
+#define BASE64_DECODE_MAX(__len) ((((__len) + 3) / 4) * 3)
+
+/*
+ * Incremental decoder.  Input can be supplied in pieces of any size, down to
+ * a single character, so it can decode straight out of a receive path.
+ */
+struct base64_decoder {
+    uint32_t val;   /* Sextets of the current group. */
+    uint8_t num;    /* Number of characters in the current group. */
+    uint8_t pad;    /* Number of '=' characters in the current group. */
+};
+
+void base64_decoder_init(struct base64_decoder *dec);
+int base64_decoder_feed(struct base64_decoder *dec, const char *src, int len,
+                        void *dst);
+int base64_decoder_done(const struct base64_decoder *dec);
+
 #ifdef __cplusplus
 }
 #endif
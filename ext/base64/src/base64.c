@@ -179,3 +179,83 @@ base64_decode_len(const char *str)
     }
     return len * 3 / 4;
 }
+
+/*
+ * Returns the value of a base64 character, or -1 if it isn't one.
+ */
+static int
+base64_char_val(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+void
+base64_decoder_init(struct base64_decoder *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+}
+
+/*
+ * Decodes the next len characters of a base64 stream.  Each complete group of
+ * four characters produces up to three bytes at dst, which must have room for
+ * BASE64_DECODE_MAX(len) bytes.  Characters of an incomplete group are
+ * retained until the rest of the group arrives.  A padded group ends the
+ * current group; decoding may continue with a new one.
+ *
+ * Returns the number of bytes written, or -1 if the input isn't valid base64.
+ */
+int
+base64_decoder_feed(struct base64_decoder *dec, const char *src, int len,
+                    void *dst)
+{
+    unsigned char *q;
+    int val;
+    int i;
+
+    q = dst;
+    for (i = 0; i < len; i++) {
+        if (src[i] == '=') {
+            /* Padding may only replace the last one or two characters. */
+            if (dec->num < 2)
+                return -1;
+            dec->pad++;
+            val = 0;
+        } else {
+            val = base64_char_val(src[i]);
+            if (val < 0 || dec->pad > 0)
+                return -1;
+        }
+
+        dec->val = (dec->val << 6) | val;
+        if (++dec->num == 4) {
+            *q++ = (dec->val >> 16) & 0xff;
+            if (dec->pad < 2)
+                *q++ = (dec->val >> 8) & 0xff;
+            if (dec->pad < 1)
+                *q++ = dec->val & 0xff;
+            base64_decoder_init(dec);
+        }
+    }
+
+    return q - (unsigned char *) dst;
+}
+
+/*
+ * Indicates whether the decoder is between groups, i.e., whether the input so
+ * far was a whole number of groups.
+ */
+int
+base64_decoder_done(const struct base64_decoder *dec)
+{
+    return dec->num == 0;
+}
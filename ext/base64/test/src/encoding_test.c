@@ -25,6 +25,7 @@
 
 TEST_CASE_DECL(hex2str)
 TEST_CASE_DECL(str2hex)
+TEST_CASE_DECL(base64_decoder)
 
 int
 hex_fmt_test_all(void)
@@ -37,6 +38,7 @@ TEST_SUITE(hex_fmt_test_suite)
 {
     hex2str();
     str2hex();
+    base64_decoder();
 }
 
 #if MYNEWT_VAL(SELFTEST)
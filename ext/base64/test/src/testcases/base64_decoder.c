@@ -0,0 +1,72 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <string.h>
+#include "encoding_test_priv.h"
+
+TEST_CASE(base64_decoder)
+{
+    struct base64_decoder dec;
+    const char *enc;
+    uint8_t buf[32];
+    int len;
+    int rc;
+    int i;
+
+    /* Whole string at once. */
+    base64_decoder_init(&dec);
+    enc = "aGVsbG8gd29ybGQ=";
+    rc = base64_decoder_feed(&dec, enc, strlen(enc), buf);
+    TEST_ASSERT(rc == 11);
+    TEST_ASSERT(memcmp(buf, "hello world", 11) == 0);
+    TEST_ASSERT(base64_decoder_done(&dec));
+
+    /* One character at a time. */
+    base64_decoder_init(&dec);
+    enc = "AAECAwQFBgc=";
+    len = 0;
+    for (i = 0; i < strlen(enc); i++) {
+        rc = base64_decoder_feed(&dec, enc + i, 1, buf + len);
+        TEST_ASSERT(rc >= 0 && rc <= 3);
+        len += rc;
+        TEST_ASSERT(base64_decoder_done(&dec) == ((i + 1) % 4 == 0));
+    }
+    TEST_ASSERT(len == 8);
+    TEST_ASSERT(memcmp(buf, "\x00\x01\x02\x03\x04\x05\x06\x07", 8) == 0);
+
+    /* Padded groups may be concatenated. */
+    base64_decoder_init(&dec);
+    enc = "YQ==Yg==";
+    rc = base64_decoder_feed(&dec, enc, strlen(enc), buf);
+    TEST_ASSERT(rc == 2);
+    TEST_ASSERT(memcmp(buf, "ab", 2) == 0);
+
+    /* Incomplete group. */
+    base64_decoder_init(&dec);
+    rc = base64_decoder_feed(&dec, "YWJj", 3, buf);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(!base64_decoder_done(&dec));
+
+    /* Invalid input. */
+    base64_decoder_init(&dec);
+    TEST_ASSERT(base64_decoder_feed(&dec, "YW*j", 4, buf) < 0);
+    base64_decoder_init(&dec);
+    TEST_ASSERT(base64_decoder_feed(&dec, "Y===", 4, buf) < 0);
+    base64_decoder_init(&dec);
+    TEST_ASSERT(base64_decoder_feed(&dec, "YW=j", 4, buf) < 0);
+}
@@ -0,0 +1,60 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <string.h>
+#include "sha256_test_priv.h"
+
+/*
+ * Input supplied in pieces of any size, crossing block boundaries at every
+ * offset, yields the same digest as input supplied all at once.
+ */
+TEST_CASE(sha256_pieces)
+{
+    struct sha256_ctx ctx;
+    uint8_t expected[SHA256_DIGEST_LEN];
+    uint8_t digest[SHA256_DIGEST_LEN];
+    uint8_t data[3 * SHA256_BLOCK_LEN + 7];
+    int piece_len;
+    int off;
+    int len;
+    int n;
+    int i;
+
+    for (i = 0; i < sizeof data; i++) {
+        data[i] = i * 37 + 11;
+    }
+
+    for (len = 0; len <= sizeof data; len += 13) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, data, len);
+        sha256_final(&ctx, expected);
+
+        for (piece_len = 1; piece_len <= SHA256_BLOCK_LEN + 1; piece_len++) {
+            sha256_init(&ctx);
+            for (off = 0; off < len; off += n) {
+                n = len - off;
+                if (n > piece_len) {
+                    n = piece_len;
+                }
+                sha256_update(&ctx, data + off, n);
+            }
+            sha256_final(&ctx, digest);
+            TEST_ASSERT(memcmp(digest, expected, sizeof digest) == 0);
+        }
+    }
+}
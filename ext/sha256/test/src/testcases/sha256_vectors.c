@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <string.h>
+#include "sha256_test_priv.h"
+
+/* FIPS 180-4 example messages. */
+TEST_CASE(sha256_vectors)
+{
+    struct sha256_ctx ctx;
+    uint8_t digest[SHA256_DIGEST_LEN];
+    uint8_t block[1000];
+    int i;
+
+    struct {
+        const char *in;
+        const char *out;
+    } test_data[] = {
+        [0] = {
+            .in = "",
+            .out = "\xe3\xb0\xc4\x42\x98\xfc\x1c\x14\x9a\xfb\xf4\xc8\x99\x6f"
+                   "\xb9\x24\x27\xae\x41\xe4\x64\x9b\x93\x4c\xa4\x95\x99\x1b"
+                   "\x78\x52\xb8\x55",
+        },
+        [1] = {
+            .in = "abc",
+            .out = "\xba\x78\x16\xbf\x8f\x01\xcf\xea\x41\x41\x40\xde\x5d\xae"
+                   "\x22\x23\xb0\x03\x61\xa3\x96\x17\x7a\x9c\xb4\x10\xff\x61"
+                   "\xf2\x00\x15\xad",
+        },
+        [2] = {
+            .in = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+            .out = "\x24\x8d\x6a\x61\xd2\x06\x38\xb8\xe5\xc0\x26\x93\x0c\x3e"
+                   "\x60\x39\xa3\x3c\xe4\x59\x64\xff\x21\x67\xf6\xec\xed\xd4"
+                   "\x19\xdb\x06\xc1",
+        },
+    };
+
+    for (i = 0; i < sizeof(test_data) / sizeof(test_data[0]); i++) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, test_data[i].in, strlen(test_data[i].in));
+        sha256_final(&ctx, digest);
+        TEST_ASSERT(memcmp(digest, test_data[i].out, sizeof digest) == 0);
+    }
+
+    /* One million repetitions of 'a'. */
+    memset(block, 'a', sizeof block);
+    sha256_init(&ctx);
+    for (i = 0; i < 1000; i++) {
+        sha256_update(&ctx, block, sizeof block);
+    }
+    sha256_final(&ctx, digest);
+    TEST_ASSERT(memcmp(digest,
+                       "\xcd\xc7\x6e\x5c\x99\x14\xfb\x92\x81\xa1\xc7\xe2\x84"
+                       "\xd7\x3e\x67\xf1\x80\x9a\x48\xa4\x97\x20\x0e\x04\x6d"
+                       "\x39\xcc\xc7\x11\x2c\xd0",
+                       sizeof digest) == 0);
+}
@@ -21,6 +21,8 @@
 #define H_MGMT_MGMT_
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "cbor.h"
 
 #ifdef __cplusplus
@@ -60,8 +62,16 @@ extern "C" {
 #define MGMT_ERR_EBADSTATE      6       /* Current state disallows command. */
 #define MGMT_ERR_EMSGSIZE       7       /* Response too large. */
 #define MGMT_ERR_ENOTSUP        8       /* Command not supported. */
+#define MGMT_ERR_ECORRUPT       9       /* Data failed verification. */
 #define MGMT_ERR_EPERUSER       256
 
+/**
+ * Returned by a command handler that has parked its request with
+ * mgmt_ctxt_defer().  The request gets completed later with
+ * mgmt_ctxt_complete().  This code is never sent to a peer.
+ */
+#define MGMT_DEFERRED           (-1)
+
 #define MGMT_HDR_SIZE           8
 
 struct mgmt_hdr {
@@ -157,6 +167,25 @@ typedef int mgmt_init_reader_fn(struct cbor_decoder_reader *reader, void *buf,
 typedef int mgmt_init_writer_fn(struct cbor_encoder_writer *writer, void *buf,
                                 void *arg);
 
+/** @typedef mgmt_session_key_fn
+ * @brief Retrieves the key that identifies the peer that sent a request.
+ *
+ * Transports record the peer in each buffer's user data, so the user data
+ * serves as the key.  Requests with equal keys belong to the same session.
+ *
+ * @param req                   The buffer holding the request.
+ * @param out_len               On success, the length of the key gets
+ *                                  written here.
+ * @param arg                   Optional streamer argument.
+ *
+ * @return                      The key, valid for as long as the request
+ *                                  buffer;
+ *                              NULL if the transport does not distinguish
+ *                                  peers.
+ */
+typedef const void *mgmt_session_key_fn(const void *req, size_t *out_len,
+                                        void *arg);
+
 /** @typedef mgmt_init_writer_fn
  * @brief Frees the specified buffer.
  *
@@ -176,6 +205,9 @@ struct mgmt_streamer_cfg {
     mgmt_init_reader_fn *init_reader;
     mgmt_init_writer_fn *init_writer;
     mgmt_free_buf_fn *free_buf;
+
+    /** Optional; if NULL, all requests belong to a single session. */
+    mgmt_session_key_fn *session_key;
 };
 
 /**
@@ -188,6 +220,52 @@ struct mgmt_streamer {
     struct cbor_encoder_writer *writer;
 };
 
+struct mgmt_ctxt;
+
+/** @typedef mgmt_defer_fn
+ * @brief Retains the state of a request so that its response can be completed
+ *        after its handler returns.
+ *
+ * @param ctxt                  The context of the request being handled.
+ * @param arg                   Optional protocol-layer argument.
+ *
+ * @return                      The retained context on success;
+ *                              NULL if the request cannot be deferred.
+ */
+typedef struct mgmt_ctxt *mgmt_defer_fn(struct mgmt_ctxt *ctxt, void *arg);
+
+/** @typedef mgmt_complete_fn
+ * @brief Completes a deferred request and sends its response.
+ *
+ * @param ctxt                  The retained context of the deferred request.
+ * @param status                0 if the response was successfully encoded;
+ *                                  MGMT_ERR_[...] code to send an error
+ *                                  response instead.
+ * @param arg                   Optional protocol-layer argument.
+ */
+typedef void mgmt_complete_fn(struct mgmt_ctxt *ctxt, int status, void *arg);
+
+/** @typedef mgmt_finish_fn
+ * @brief Finishes the response to a deferred request in the protocol layer's
+ *        task.
+ *
+ * @param ctxt                  The retained context of the deferred request.
+ * @param status                The status passed to mgmt_ctxt_complete().
+ *
+ * @return                      0 if the response was successfully encoded;
+ *                              MGMT_ERR_[...] code to send an error response
+ *                                  instead.
+ */
+typedef int mgmt_finish_fn(struct mgmt_ctxt *ctxt, int status);
+
+/**
+ * @brief Protocol-layer callbacks that allow handlers to defer completion.
+ */
+struct mgmt_defer_cfg {
+    mgmt_defer_fn *defer;
+    mgmt_complete_fn *complete;
+};
+
 /**
  * @brief Context required by command handlers for parsing requests and writing
  *        responses.
@@ -196,6 +274,38 @@ struct mgmt_ctxt {
     struct CborEncoder encoder;
     struct CborParser parser;
     struct CborValue it;
+
+    /** Set by the protocol layer if requests can be deferred; else NULL. */
+    const struct mgmt_defer_cfg *defer_cfg;
+    void *defer_arg;
+
+    /**
+     * Optional; set by a handler on its retained context.  See
+     * mgmt_ctxt_complete().
+     */
+    mgmt_finish_fn *finish;
+
+    /**
+     * Set by a write handler whose response may be resent, without running
+     * the handler again, in answer to a retransmission of the same request;
+     * e.g., the response to an upload chunk that was written at the expected
+     * offset.  Any other write is assumed to change state.
+     */
+    bool replayable;
+
+    /**
+     * Set by a write handler, whether or not it succeeds, if it changed no
+     * state; e.g., an echo, or a request rejected before it did anything.
+     * Cached responses then remain valid.
+     */
+    bool unchanged;
+
+    /**
+     * Identifies the peer that sent the request; see mgmt_session_key_fn.
+     * NULL if unknown.  Only valid while the handler runs.
+     */
+    const void *session_key;
+    size_t session_key_len;
 };
 
 /** @typedef mgmt_handler_fn
@@ -206,6 +316,7 @@ struct mgmt_ctxt {
  * @param cbuf                  The mcumgr context to use.
  *
  * @return                      0 if a response was successfully encoded,
+ *                                 MGMT_DEFERRED if the request was deferred,
  *                                 MGMT_ERR_[...] code on failure.
  */
 typedef int mgmt_handler_fn(struct mgmt_ctxt *cbuf);
@@ -222,7 +333,11 @@ struct mgmt_handler {
  * @brief A collection of handlers for an entire command group.
  */
 struct mgmt_group {
-    /** Points to the next group in the list. */
+    /**
+     * Points to the next group in the same chain of the dispatch index.  Only
+     * used by per-user groups registered at runtime with
+     * mgmt_register_group().
+     */
     struct mgmt_group *mg_next;
 
     /** Array of handlers; one entry per command ID. */
@@ -233,6 +348,128 @@ struct mgmt_group {
     uint16_t mg_group_id;
 };
 
+/**
+ * @brief An upload chunk held by a reorder buffer.
+ */
+struct mgmt_reorder_slot {
+    size_t mrs_off;
+    uint16_t mrs_len;
+    bool mrs_used;
+};
+
+/**
+ * @brief Holds upload chunks that arrive ahead of the expected offset, so
+ *        that a client pipelining its requests can have them written in order.
+ *
+ * The command group provides the storage, zeroed.  At most one fewer chunk
+ * than the sending peer's request window is held at a time.
+ */
+struct mgmt_reorder_buf {
+    /** Array of num_slots slots. */
+    struct mgmt_reorder_slot *mrb_slots;
+
+    /** Chunk data; slot_size bytes per slot. */
+    uint8_t *mrb_data;
+
+    uint16_t mrb_slot_size;
+    uint8_t mrb_num_slots;
+};
+
+/** Number of key bytes that identify a session; longer keys are truncated. */
+#ifndef MGMT_SESSION_KEY_MAX
+#define MGMT_SESSION_KEY_MAX    24
+#endif
+
+/**
+ * @brief The state that ties a long-running operation, such as an upload, to
+ *        the peer that started it.
+ */
+struct mgmt_session {
+    uint8_t ms_key[MGMT_SESSION_KEY_MAX];
+    uint8_t ms_key_len;
+    bool ms_used;
+
+    /** Uptime, in milliseconds, of the session's most recent request. */
+    uint32_t ms_last_ms;
+};
+
+/**
+ * @brief A fixed set of sessions.
+ *
+ * The command group provides the storage, zeroed, and keeps its per-session
+ * state in a parallel array indexed the same way.  A session that has been
+ * idle for longer than the timeout may be taken over by another peer.
+ */
+struct mgmt_session_pool {
+    /** Array of num_sessions sessions. */
+    struct mgmt_session *msp_sessions;
+    uint8_t msp_num_sessions;
+
+    /** Idle time after which a session can be reclaimed; 0 for never. */
+    uint32_t msp_timeout_ms;
+};
+
+/**
+ * @brief Names the linker section that holds an entry of a link-time table.
+ *
+ * On Zephyr, each table is an iterable section: the linker snippets
+ * mgmt/port/zephyr/mcumgr.ld (ROM) and mcumgr_data.ld (RAM), which the build
+ * adds with zephyr_linker_sources(), keep every entry, place the table, and
+ * bound it with _<table>_list_start and _<table>_list_end.  Elsewhere, the
+ * table is a section of its own, named after the table, which GNU ld places
+ * with the read-only or writable data and bounds with __start_<table> and
+ * __stop_<table>.
+ *
+ * @param table_                The name of the table.
+ * @param name_                 The name of the entry's variable.
+ */
+#ifdef __ZEPHYR__
+#define MGMT_LINK_SECTION(table_, name_)    "._" #table_ ".static." #name_
+#else
+#define MGMT_LINK_SECTION(table_, name_)    #table_
+#endif
+
+/**
+ * @brief Defines a command group that is registered at link time.
+ *
+ * The group descriptor is const and gets placed in the "mcumgr_group"
+ * link-time table (see MGMT_LINK_SECTION()), so it, and the handler array it
+ * refers to, can remain in flash.  The dispatcher indexes every group in the
+ * table the first time a handler is looked up; no registration call is
+ * required.  Each definition also places one pointer in the
+ * "mcumgr_group_slot" table, in RAM, which the dispatcher uses as storage for
+ * its sorted index of per-user groups; that index is thus sized by the number
+ * of groups linked in.
+ *
+ * The object file containing the definition must still be linked into the
+ * image.  Zephyr links its libraries with --whole-archive, so this happens
+ * there by itself.  Mynewt links packages as ordinary archives, from which
+ * the linker only extracts objects that something references; each built-in
+ * group's package therefore names a global symbol of the group's file with
+ * -u in its pkg.lflags.  An application group in a Mynewt library package
+ * needs the same.
+ *
+ * The alignment is pinned so that the compiler does not pad descriptors
+ * apart within the table.  The slot is declared last so that a storage class
+ * written before the macro applies to the descriptor.
+ *
+ * @param name_                 The name of the group descriptor variable.
+ * @param group_id_             The numeric ID of the group.
+ * @param handlers_             The group's handler array.  This must be an
+ *                                  array, not a pointer.
+ */
+#define MGMT_GROUP_DEFINE(name_, group_id_, handlers_)                      \
+    const struct mgmt_group name_                                           \
+    __attribute__((section(MGMT_LINK_SECTION(mcumgr_group, name_)), used,   \
+                   aligned(__alignof__(struct mgmt_group)))) = {            \
+        .mg_handlers = (handlers_),                                         \
+        .mg_handlers_count = sizeof (handlers_) / sizeof (handlers_)[0],    \
+        .mg_group_id = (group_id_),                                         \
+    };                                                                      \
+    static const struct mgmt_group *name_ ## _slot                          \
+    __attribute__((section(MGMT_LINK_SECTION(mcumgr_group_slot, name_)),    \
+                   used, aligned(__alignof__(struct mgmt_group *))))
+
 /**
  * @brief Uses the specified streamer to allocates a response buffer.
  *
@@ -310,6 +547,21 @@ int mgmt_streamer_init_reader(struct mgmt_streamer *streamer, void *buf);
  */
 int mgmt_streamer_init_writer(struct mgmt_streamer *streamer, void *buf);
 
+/**
+ * @brief Uses the specified streamer to retrieve a request's session key.
+ *
+ * @param streamer              The streamer providing the callback.
+ * @param req                   The buffer holding the request.
+ * @param out_len               On success, the length of the key gets
+ *                                  written here.
+ *
+ * @return                      The key on success;
+ *                              NULL if the transport does not distinguish
+ *                                  peers.
+ */
+const void *mgmt_streamer_session_key(struct mgmt_streamer *streamer,
+                                      const void *req, size_t *out_len);
+
 /**
  * @brief Uses the specified streamer to free a buffer.
  *
@@ -319,7 +571,15 @@ int mgmt_streamer_init_writer(struct mgmt_streamer *streamer, void *buf);
 void mgmt_streamer_free_buf(struct mgmt_streamer *streamer, void *buf);
 
 /**
- * @brief Registers a full command group.
+ * @brief Registers a full command group at runtime.
+ *
+ * Groups with a fixed set of handlers should be defined with
+ * MGMT_GROUP_DEFINE() instead.  A group can be registered while transports
+ * are processing requests: per-user groups are added to a hash table with
+ * MGMT_PERUSER_GROUP_BUCKETS chains, and a lookup sees either all of a new
+ * group or none of it.  If a group with the same ID is already registered,
+ * it is retained and the new one is ignored.  A registered group must remain
+ * valid and unmodified.
  *
  * @param group                 The group to register.
  */
@@ -358,6 +618,187 @@ int mgmt_write_rsp_status(struct mgmt_ctxt *cbuf, int status);
  */
 int mgmt_ctxt_init(struct mgmt_ctxt *cbuf, struct mgmt_streamer *streamer);
 
+/**
+ * @brief Defers completion of the request being handled.
+ *
+ * A handler that performs a long-running operation calls this function to
+ * obtain a retained copy of its context, starts the operation, and returns
+ * MGMT_DEFERRED.  When the operation finishes, the remainder of the response
+ * is encoded into the retained context, and the request is completed with
+ * mgmt_ctxt_complete().  Only the retained context's encoder may be used; the
+ * request payload is no longer available.  The original context remains
+ * usable if the handler decides not to defer after all, i.e., if it returns
+ * anything other than MGMT_DEFERRED.
+ *
+ * Whether mgmt_ctxt_complete() may be called from a different task, or before
+ * the handler returns, depends on the protocol layer; SMP transports that
+ * provide a resume callback allow both.
+ *
+ * @param cbuf                  The context passed to the handler.
+ *
+ * @return                      The retained context on success;
+ *                              NULL if the transport does not support
+ *                                  deferral.  In this case, the handler must
+ *                                  complete the request synchronously.
+ */
+struct mgmt_ctxt *mgmt_ctxt_defer(struct mgmt_ctxt *cbuf);
+
+/**
+ * @brief Completes a deferred request and sends its response.
+ *
+ * If the handler set a finish callback on the retained context, the response
+ * is not encoded by the caller.  Instead, the callback is passed the status
+ * and encodes the response in the protocol layer's task, which lets an
+ * operation that completes in another task hand its result back to the task
+ * that owns the group's state.
+ *
+ * @param cbuf                  The retained context returned by
+ *                                  mgmt_ctxt_defer().
+ * @param status                0 if the response was successfully encoded;
+ *                                  MGMT_ERR_[...] code to send an error
+ *                                  response instead.  With a finish
+ *                                  callback, the value it receives.
+ */
+void mgmt_ctxt_complete(struct mgmt_ctxt *cbuf, int status);
+
+/**
+ * @brief Retrieves the request window negotiated by the peer that sent a
+ *        request.
+ *
+ * Each peer negotiates its own window; see mgmt_set_window().
+ *
+ * @param ctxt                  The context of the request being handled.
+ *
+ * @return                      The number of requests the peer may keep in
+ *                                  flight; 1 if it is not pipelining.
+ */
+int mgmt_get_window(const struct mgmt_ctxt *ctxt);
+
+/**
+ * @brief Negotiates the request window of the peer that sent a request.
+ *
+ * The window applies only to that peer, as identified by the request's
+ * session key; other peers keep theirs.  Up to MGMT_WINDOW_SESSIONS peers
+ * can have a window larger than 1 at once.  An entry idle for a minute can
+ * be taken over by another peer, which returns the first peer to a window
+ * of 1.
+ *
+ * @param ctxt                  The context of the request being handled.
+ * @param window                The number of requests the peer wants to
+ *                                  keep in flight.
+ *
+ * @return                      The accepted window; this is the requested
+ *                                  window clamped to the supported range, or
+ *                                  1 if no entry is available for the peer.
+ */
+int mgmt_set_window(const struct mgmt_ctxt *ctxt, int window);
+
+/**
+ * @brief Holds an upload chunk that arrived ahead of the expected offset.
+ *
+ * A chunk that is already held is ignored.
+ *
+ * @param mrb                   The reorder buffer to hold the chunk in.
+ * @param ctxt                  The context of the request carrying the
+ *                                  chunk; the sending peer's window limits
+ *                                  how far ahead the chunk may be.
+ * @param next_off              The offset of the next chunk to write.
+ * @param off                   The offset of the early chunk.
+ * @param data                  The chunk data.
+ * @param len                   The length of the chunk data.
+ *
+ * @return                      0 if the chunk is held;
+ *                              MGMT_ERR_EINVAL if the chunk is not within the
+ *                                  window;
+ *                              MGMT_ERR_ENOMEM if no slot is free.
+ */
+int mgmt_reorder_hold(struct mgmt_reorder_buf *mrb,
+                      const struct mgmt_ctxt *ctxt, size_t next_off,
+                      size_t off, const void *data, size_t len);
+
+/**
+ * @brief Removes the held chunk that starts at the specified offset, if any.
+ *
+ * @param mrb                   The reorder buffer to search.
+ * @param off                   The offset of the chunk to remove.
+ * @param out_len               On success, the length of the chunk gets
+ *                                  written here.
+ *
+ * @return                      The chunk data, valid until the next call to
+ *                                  mgmt_reorder_hold();
+ *                              NULL if no such chunk is held.
+ */
+const uint8_t *mgmt_reorder_take(struct mgmt_reorder_buf *mrb, size_t off,
+                                 size_t *out_len);
+
+/**
+ * @brief Discards all held chunks.
+ *
+ * @param mrb                   The reorder buffer to clear.
+ */
+void mgmt_reorder_clear(struct mgmt_reorder_buf *mrb);
+
+/**
+ * @brief Finds the session belonging to the peer that sent a request, and
+ *        records the request's time.
+ *
+ * @param msp                   The pool to search.
+ * @param ctxt                  The context of the request being handled.
+ *
+ * @return                      The index of the session on success;
+ *                              -1 if the peer has no session.
+ */
+int mgmt_session_find(struct mgmt_session_pool *msp,
+                      const struct mgmt_ctxt *ctxt);
+
+/**
+ * @brief Retrieves or creates the session belonging to the peer that sent a
+ *        request.
+ *
+ * A new session takes a free entry or, failing that, one that has been idle
+ * for longer than the pool's timeout.  The group must reinitialize its state
+ * for the returned index unless the session already existed.
+ *
+ * @param msp                   The pool to allocate from.
+ * @param ctxt                  The context of the request being handled.
+ * @param out_idx               On success, the index of the session gets
+ *                                  written here.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOMEM if every session is in use.
+ */
+int mgmt_session_open(struct mgmt_session_pool *msp,
+                      const struct mgmt_ctxt *ctxt, int *out_idx);
+
+/**
+ * @brief Indicates whether a session has been idle for longer than the
+ *        pool's timeout.
+ *
+ * @param msp                   The pool containing the session.
+ * @param idx                   The index of the session.
+ *
+ * @return                      true if the session can be reclaimed.
+ */
+bool mgmt_session_expired(const struct mgmt_session_pool *msp, int idx);
+
+/**
+ * @brief Indicates how long a session has gone without a request.
+ *
+ * @param msp                   The pool containing the session.
+ * @param idx                   The index of the session.
+ *
+ * @return                      The session's idle time, in milliseconds.
+ */
+uint32_t mgmt_session_idle_ms(const struct mgmt_session_pool *msp, int idx);
+
+/**
+ * @brief Frees a session.
+ *
+ * @param msp                   The pool containing the session.
+ * @param idx                   The index of the session to free.
+ */
+void mgmt_session_close(struct mgmt_session_pool *msp, int idx);
+
 /**
  * @brief Converts a CBOR status code to a MGMT_ERR_[...] code.
  *
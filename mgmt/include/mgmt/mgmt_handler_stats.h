@@ -0,0 +1,136 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Optional per-command statistics, kept by the SMP dispatcher.
+ *
+ * For each command (group, command ID, and opcode), the dispatcher counts
+ * invocations, failures, and request and response payload bytes, and keeps
+ * a histogram of handler latencies.  Latency is measured on the device, from
+ * handler entry until the response is complete, so it excludes link
+ * latency.  The statistics can be read with the stats group's handler
+ * command.
+ *
+ * Statistics are enabled by setting MGMT_HANDLER_STATS_COUNT to the number of
+ * commands to track.  When it is 0, the dispatcher's calls expand to
+ * nothing.
+ */
+
+#ifndef H_MGMT_HANDLER_STATS_
+#define H_MGMT_HANDLER_STATS_
+
+#include <inttypes.h>
+#include "mgmt/mgmt_impl.h"
+
+#if defined MYNEWT
+
+#include "syscfg/syscfg.h"
+#define MGMT_HANDLER_STATS_COUNT    MYNEWT_VAL(MGMT_HANDLER_STATS_COUNT)
+
+#elif defined __ZEPHYR__
+
+#ifdef CONFIG_MCUMGR_HANDLER_STATS
+#define MGMT_HANDLER_STATS_COUNT    CONFIG_MCUMGR_HANDLER_STATS_COUNT
+#endif
+
+#endif
+
+#ifndef MGMT_HANDLER_STATS_COUNT
+#define MGMT_HANDLER_STATS_COUNT    0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mgmt_hdr;
+
+/**
+ * Number of latency histogram buckets.  Bucket 0 counts latencies below
+ * 2 us; bucket n counts latencies from 2^n up to 2^(n+1) us; the last bucket
+ * also counts anything longer.
+ */
+#define MGMT_HANDLER_STATS_BUCKETS  20
+
+/**
+ * @brief Statistics for a single command.
+ */
+struct mgmt_handler_stats {
+    /**
+     * (group << 16) | (command ID << 8) | (opcode + 1); 0 if the entry is
+     * unused.
+     */
+    uint32_t mhs_key;
+
+    /** Number of requests handled. */
+    uint32_t mhs_count;
+
+    /** Number of requests that failed. */
+    uint32_t mhs_errs;
+
+    /** Total request and response payload sizes, in bytes. */
+    uint32_t mhs_req_bytes;
+    uint32_t mhs_rsp_bytes;
+
+    /** Latency histogram; see MGMT_HANDLER_STATS_BUCKETS. */
+    uint32_t mhs_lat[MGMT_HANDLER_STATS_BUCKETS];
+};
+
+#if MGMT_HANDLER_STATS_COUNT > 0
+#define MGMT_HANDLER_STATS_NOW()    mgmt_impl_cycles()
+#define MGMT_HANDLER_STATS_REC(hdr, status, rsp_len, start)                 \
+    mgmt_handler_stats_rec((hdr), (status), (rsp_len), (start))
+#else
+#define MGMT_HANDLER_STATS_NOW()    0
+#define MGMT_HANDLER_STATS_REC(hdr, status, rsp_len, start) ((void)(start))
+#endif
+
+/**
+ * @brief Records a handled command.  Use MGMT_HANDLER_STATS_REC() instead,
+ *        so that the call disappears when statistics are disabled.
+ *
+ * If the table is full, commands not already in it are not tracked.
+ *
+ * @param hdr                   The request's header, in host byte order.
+ * @param status                0 if the command succeeded;
+ *                                  MGMT_ERR_[...] code on failure.
+ * @param rsp_len               The length of the response payload.
+ * @param start_cycles          The value of mgmt_impl_cycles() when the
+ *                                  handler was invoked.
+ */
+void mgmt_handler_stats_rec(const struct mgmt_hdr *hdr, int status,
+                            uint32_t rsp_len, uint32_t start_cycles);
+
+/**
+ * @brief Retrieves an entry of the statistics table.
+ *
+ * @param idx                   The index of the entry to retrieve.
+ *
+ * @return                      The requested entry, which may be unused
+ *                                  (mhs_key of 0);
+ *                              NULL if idx is out of range.
+ */
+const struct mgmt_handler_stats *mgmt_handler_stats_at(int idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
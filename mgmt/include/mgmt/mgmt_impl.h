@@ -0,0 +1,65 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Declares implementation-specific functions required by the mcumgr
+ *        core.  The default stubs can be overridden with functions that are
+ *        compatible with the host OS.
+ */
+
+#ifndef H_MGMT_IMPL_
+#define H_MGMT_IMPL_
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Retrieves the time since boot, used to expire idle sessions.
+ *
+ * The value may wrap.
+ *
+ * @return                      The uptime, in milliseconds.
+ */
+uint32_t mgmt_impl_uptime_ms(void);
+
+/**
+ * @brief Reads a free-running counter, used to timestamp trace records.
+ *
+ * The value may wrap.
+ *
+ * @return                      The counter value.
+ */
+uint32_t mgmt_impl_cycles(void);
+
+/**
+ * @brief Indicates the rate at which the mgmt_impl_cycles() counter runs.
+ *
+ * @return                      Counts per second; 0 if unknown.
+ */
+uint32_t mgmt_impl_cycles_hz(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
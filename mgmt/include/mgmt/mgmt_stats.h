@@ -0,0 +1,116 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Lightweight counters, readable with the stats command group.
+ *
+ * A module declares its counters as a plain array of uint32_t, with a
+ * parallel array of names, and describes them with MGMT_STATS_DEFINE().  The
+ * descriptor is const and is collected at link time, so there is no
+ * registration call and no per-counter allocation.  Incrementing a counter
+ * is a single increment of a static variable.
+ *
+ * Counters are not updated atomically.  A counter bumped from several
+ * threads at once may miss an occasional increment, which is acceptable for
+ * diagnostics.
+ */
+
+#ifndef H_MGMT_STATS_
+#define H_MGMT_STATS_
+
+#include <inttypes.h>
+#include "mgmt/mgmt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Describes a named group of counters.
+ */
+struct mgmt_stats_group {
+    /** The name that the group is read by. */
+    const char *msg_name;
+
+    /** Array of msg_count counter names; parallel to msg_counters. */
+    const char * const *msg_names;
+
+    /** Array of msg_count counters. */
+    uint32_t *msg_counters;
+    uint16_t msg_count;
+};
+
+/**
+ * @brief Defines a group of counters that can be read with the stats command
+ *        group.
+ *
+ * The descriptor is placed in the "mcumgr_stats" link-time table, in the same
+ * way that MGMT_GROUP_DEFINE() places command groups.  The object file
+ * containing the definition must be linked into the image.
+ *
+ * @param name_                 The name of the descriptor variable.
+ * @param group_name_           The name that the group is read by.
+ * @param names_                The counter names.  This array must have at
+ *                                  least as many entries as counters_.
+ * @param counters_             The counters.  This must be an array, not a
+ *                                  pointer.
+ */
+#define MGMT_STATS_DEFINE(name_, group_name_, names_, counters_)            \
+    const struct mgmt_stats_group name_                                     \
+    __attribute__((section(MGMT_LINK_SECTION(mcumgr_stats, name_)), used,   \
+                   aligned(__alignof__(struct mgmt_stats_group)))) = {      \
+        .msg_name = (group_name_),                                          \
+        .msg_names = (names_),                                              \
+        .msg_counters = (counters_),                                        \
+        .msg_count = sizeof (counters_) / sizeof (counters_)[0],            \
+    }
+
+/** Increments a counter. */
+#define MGMT_STATS_INC(counters_, idx_)         ((counters_)[idx_]++)
+
+/** Adds to a counter. */
+#define MGMT_STATS_ADD(counters_, idx_, n_)     ((counters_)[idx_] += (n_))
+
+/**
+ * @brief Retrieves a counter group by its position in the table of defined
+ *        groups.  Used to iterate the groups.
+ *
+ * @param idx                   The position of the group to retrieve.
+ *
+ * @return                      The requested group on success;
+ *                              NULL if idx is out of range.
+ */
+const struct mgmt_stats_group *mgmt_stats_group_at(int idx);
+
+/**
+ * @brief Finds a counter group by name.
+ *
+ * @param name                  The name of the group to find.
+ *
+ * @return                      The requested group on success;
+ *                              NULL if there is no such group.
+ */
+const struct mgmt_stats_group *mgmt_stats_group_find(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
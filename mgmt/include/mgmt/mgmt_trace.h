@@ -0,0 +1,141 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Optional trace points on the request and response paths.
+ *
+ * Each trace point stores a small timestamped record in a ring buffer, so
+ * that the time spent decoding, in handlers, on flash I/O, and handing
+ * responses to the transport can be told apart.  The ring can be read back
+ * with mgmt_trace_export(), e.g., by the OS group's trace command.
+ *
+ * Tracing is enabled by setting MGMT_TRACE_COUNT to the number of records to
+ * retain (a power of two).  When it is 0, MGMT_TRACE() expands to nothing.
+ */
+
+#ifndef H_MGMT_TRACE_
+#define H_MGMT_TRACE_
+
+#include <inttypes.h>
+
+#if defined MYNEWT
+
+#include "syscfg/syscfg.h"
+#define MGMT_TRACE_COUNT            MYNEWT_VAL(MGMT_TRACE_COUNT)
+
+#elif defined __ZEPHYR__
+
+#ifdef CONFIG_MCUMGR_TRACE
+#define MGMT_TRACE_COUNT            CONFIG_MCUMGR_TRACE_COUNT
+#endif
+
+#endif
+
+#ifndef MGMT_TRACE_COUNT
+#define MGMT_TRACE_COUNT            0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mgmt_hdr;
+
+/** Trace points. */
+#define MGMT_TRACE_PKT              1   /* Arg: packet length. */
+#define MGMT_TRACE_REQ              2   /* Arg: payload length. */
+#define MGMT_TRACE_HANDLER          3   /* Arg: 0. */
+#define MGMT_TRACE_DECODED          4   /* Arg: 0. */
+#define MGMT_TRACE_IO               5   /* Arg: byte count. */
+#define MGMT_TRACE_IO_DONE          6   /* Arg: MGMT_ERR_[...] code. */
+#define MGMT_TRACE_HANDLER_DONE     7   /* Arg: MGMT_ERR_[...] code. */
+#define MGMT_TRACE_TX               8   /* Arg: response length. */
+#define MGMT_TRACE_TX_DONE          9   /* Arg: MGMT_ERR_[...] code. */
+#define MGMT_TRACE_PKT_DONE         10  /* Arg: MGMT_ERR_[...] code. */
+#define MGMT_TRACE_ALLOC            11  /* Arg: 1 on success, 0 on failure. */
+#define MGMT_TRACE_FREE             12  /* Arg: 0. */
+
+/**
+ * Size of an exported trace record, in bytes.  All fields are little endian:
+ *
+ *     Offset  Size  Field
+ *     0       4     Index (position in the trace; consecutive)
+ *     4       4     Cycle counter (see mgmt_impl_cycles())
+ *     8       2     Group ID
+ *     10      2     Argument (meaning depends on the trace point)
+ *     12      1     Command ID
+ *     13      1     Sequence number
+ *     14      1     Trace point (MGMT_TRACE_[...])
+ *     15      1     Opcode
+ *
+ * Group, command, sequence number, and opcode are 0 for trace points not
+ * tied to a particular request.
+ */
+#define MGMT_TRACE_REC_SIZE         16
+
+#if MGMT_TRACE_COUNT > 0
+#define MGMT_TRACE(point, hdr, arg) mgmt_trace_rec((point), (hdr), (arg))
+#else
+#define MGMT_TRACE(point, hdr, arg)
+#endif
+
+/**
+ * @brief Records a trace point.  Use MGMT_TRACE() instead, so that the call
+ *        disappears when tracing is disabled.
+ *
+ * Safe to call from any thread or interrupt handler.
+ *
+ * @param point                 The trace point (MGMT_TRACE_[...]).
+ * @param hdr                   The request being processed, in host byte
+ *                                  order; NULL if none.
+ * @param arg                   A value associated with the trace point;
+ *                                  truncated to 16 bits.
+ */
+void mgmt_trace_rec(uint8_t point, const struct mgmt_hdr *hdr, uint32_t arg);
+
+/**
+ * @brief Indicates the index that the next trace record will get.
+ */
+uint32_t mgmt_trace_next_idx(void);
+
+/**
+ * @brief Copies trace records, oldest first, in the export format.
+ *
+ * Records that have been overwritten are skipped, as are any being written
+ * while they are copied.
+ *
+ * @param idx                   The index of the first record to copy.  If it
+ *                                  has been overwritten, copying starts
+ *                                  at the oldest record still retained.
+ * @param dst                   The buffer to copy into.
+ * @param max_recs              The number of records that fit in the buffer.
+ * @param out_next_idx          On success, the index to resume copying from
+ *                                  gets written here.
+ *
+ * @return                      The number of records copied.
+ */
+int mgmt_trace_export(uint32_t idx, uint8_t *dst, int max_recs,
+                      uint32_t *out_next_idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
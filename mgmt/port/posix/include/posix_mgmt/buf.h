@@ -0,0 +1,175 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_MGMT_BUF_
+#define H_POSIX_MGMT_BUF_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "cbor_encoder_writer.h"
+#include "cbor_decoder_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The application can override these settings at build time. */
+
+/** Size of each buffer, in bytes. */
+#ifndef MCUMGR_BUF_SIZE
+#define MCUMGR_BUF_SIZE             1024
+#endif
+
+/** Number of buffers in the pool. */
+#ifndef MCUMGR_BUF_COUNT
+#define MCUMGR_BUF_COUNT            16
+#endif
+
+/** Size of the transport-specific data carried by each buffer, in bytes. */
+#ifndef MCUMGR_BUF_USER_DATA_SIZE
+#define MCUMGR_BUF_USER_DATA_SIZE   16
+#endif
+
+/**
+ * @brief A buffer holding an mcumgr request or response.
+ *
+ * Buffers come from a fixed pool, such that a host build runs out of them the
+ * same way an embedded build does.
+ */
+struct mcumgr_buf {
+    /** Start of the buffer's contents; advanced by mcumgr_buf_pull(). */
+    uint8_t *data;
+
+    /** Length of the buffer's contents, in bytes. */
+    size_t len;
+
+    /** Transport-specific data (e.g., where to send the response). */
+    uint8_t user_data[MCUMGR_BUF_USER_DATA_SIZE];
+
+    uint8_t storage[MCUMGR_BUF_SIZE];
+};
+
+/** @brief Usage statistics for the buffer pool. */
+struct mcumgr_buf_stats {
+    /** Number of successful allocations. */
+    uint32_t allocs;
+
+    /** Number of allocations that failed because the pool was empty. */
+    uint32_t alloc_fails;
+
+    /** Fewest buffers that have been available at once. */
+    int min_free;
+};
+
+struct cbor_mb_reader {
+    struct cbor_decoder_reader r;
+    struct mcumgr_buf *mb;
+};
+
+struct cbor_mb_writer {
+    struct cbor_encoder_writer enc;
+    struct mcumgr_buf *mb;
+};
+
+/**
+ * @brief Allocates a buffer for holding an mcumgr request or response.
+ *
+ * This function is thread-safe.
+ *
+ * @return                      An empty buffer on success;
+ *                              NULL if the pool is exhausted.
+ */
+struct mcumgr_buf *mcumgr_buf_alloc(void);
+
+/**
+ * @brief Returns an mcumgr buffer to the pool.
+ *
+ * This function is thread-safe.
+ *
+ * @param mb                    The buffer to free; may be NULL.
+ */
+void mcumgr_buf_free(struct mcumgr_buf *mb);
+
+/**
+ * @brief Indicates the number of buffers currently available in the pool.
+ */
+int mcumgr_buf_num_free(void);
+
+/**
+ * @brief Retrieves the pool's usage statistics.
+ *
+ * This function is thread-safe.
+ *
+ * @param out_stats             On success, the statistics get written here.
+ */
+void mcumgr_buf_get_stats(struct mcumgr_buf_stats *out_stats);
+
+/**
+ * @brief Empties an mcumgr buffer.
+ */
+void mcumgr_buf_reset(struct mcumgr_buf *mb);
+
+/**
+ * @brief Indicates the number of bytes that can be appended to a buffer.
+ */
+size_t mcumgr_buf_tailroom(const struct mcumgr_buf *mb);
+
+/**
+ * @brief Appends data to an mcumgr buffer.
+ *
+ * @param mb                    The buffer to append to.
+ * @param data                  The data to append.
+ * @param len                   The number of bytes to append.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOMEM if the data doesn't fit.
+ */
+int mcumgr_buf_add(struct mcumgr_buf *mb, const void *data, size_t len);
+
+/**
+ * @brief Removes data from the front of an mcumgr buffer.
+ *
+ * @param mb                    The buffer to trim.
+ * @param len                   The number of bytes to remove.  If this
+ *                                  exceeds the buffer's length, the buffer
+ *                                  is emptied.
+ */
+void mcumgr_buf_pull(struct mcumgr_buf *mb, size_t len);
+
+/**
+ * @brief Initializes a CBOR writer with the specified buffer.
+ *
+ * @param cmw                   The writer to initialize.
+ * @param mb                    The buffer that the writer will append to.
+ */
+void cbor_mb_writer_init(struct cbor_mb_writer *cmw, struct mcumgr_buf *mb);
+
+/**
+ * @brief Initializes a CBOR reader with the specified buffer.
+ *
+ * @param cmr                   The reader to initialize.
+ * @param mb                    The buffer that the reader will read from.
+ */
+void cbor_mb_reader_init(struct cbor_mb_reader *cmr, struct mcumgr_buf *mb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include "mgmt/mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "compilersupport_p.h"
+
+static struct mcumgr_buf mcumgr_buf_pool[MCUMGR_BUF_COUNT];
+
+/* Stack of free buffers; entries [0, mcumgr_buf_free_count) are free. */
+static struct mcumgr_buf *mcumgr_buf_free_list[MCUMGR_BUF_COUNT];
+static int mcumgr_buf_free_count = -1;
+static pthread_mutex_t mcumgr_buf_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static struct mcumgr_buf_stats mcumgr_buf_stats = {
+    .min_free = MCUMGR_BUF_COUNT,
+};
+
+struct mcumgr_buf *
+mcumgr_buf_alloc(void)
+{
+    struct mcumgr_buf *mb;
+    int i;
+
+    pthread_mutex_lock(&mcumgr_buf_mtx);
+
+    /* Populate the free list on first use. */
+    if (mcumgr_buf_free_count == -1) {
+        for (i = 0; i < MCUMGR_BUF_COUNT; i++) {
+            mcumgr_buf_free_list[i] = &mcumgr_buf_pool[i];
+        }
+        mcumgr_buf_free_count = MCUMGR_BUF_COUNT;
+    }
+
+    if (mcumgr_buf_free_count == 0) {
+        mb = NULL;
+        mcumgr_buf_stats.alloc_fails++;
+    } else {
+        mb = mcumgr_buf_free_list[--mcumgr_buf_free_count];
+        mcumgr_buf_stats.allocs++;
+        if (mcumgr_buf_free_count < mcumgr_buf_stats.min_free) {
+            mcumgr_buf_stats.min_free = mcumgr_buf_free_count;
+        }
+    }
+
+    pthread_mutex_unlock(&mcumgr_buf_mtx);
+
+    if (mb != NULL) {
+        mcumgr_buf_reset(mb);
+        memset(mb->user_data, 0, sizeof mb->user_data);
+    }
+
+    return mb;
+}
+
+void
+mcumgr_buf_free(struct mcumgr_buf *mb)
+{
+    if (mb == NULL) {
+        return;
+    }
+
+    assert(mb >= mcumgr_buf_pool &&
+           mb < mcumgr_buf_pool + MCUMGR_BUF_COUNT);
+
+    pthread_mutex_lock(&mcumgr_buf_mtx);
+    assert(mcumgr_buf_free_count < MCUMGR_BUF_COUNT);
+    mcumgr_buf_free_list[mcumgr_buf_free_count++] = mb;
+    pthread_mutex_unlock(&mcumgr_buf_mtx);
+}
+
+int
+mcumgr_buf_num_free(void)
+{
+    int count;
+
+    pthread_mutex_lock(&mcumgr_buf_mtx);
+    count = mcumgr_buf_free_count;
+    pthread_mutex_unlock(&mcumgr_buf_mtx);
+
+    if (count == -1) {
+        count = MCUMGR_BUF_COUNT;
+    }
+    return count;
+}
+
+void
+mcumgr_buf_get_stats(struct mcumgr_buf_stats *out_stats)
+{
+    pthread_mutex_lock(&mcumgr_buf_mtx);
+    *out_stats = mcumgr_buf_stats;
+    pthread_mutex_unlock(&mcumgr_buf_mtx);
+}
+
+void
+mcumgr_buf_reset(struct mcumgr_buf *mb)
+{
+    mb->data = mb->storage;
+    mb->len = 0;
+}
+
+size_t
+mcumgr_buf_tailroom(const struct mcumgr_buf *mb)
+{
+    return mb->storage + sizeof mb->storage - (mb->data + mb->len);
+}
+
+int
+mcumgr_buf_add(struct mcumgr_buf *mb, const void *data, size_t len)
+{
+    if (len > mcumgr_buf_tailroom(mb)) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    memcpy(mb->data + mb->len, data, len);
+    mb->len += len;
+
+    return 0;
+}
+
+void
+mcumgr_buf_pull(struct mcumgr_buf *mb, size_t len)
+{
+    if (len > mb->len) {
+        len = mb->len;
+    }
+
+    mb->data += len;
+    mb->len -= len;
+}
+
+static uint8_t
+cbor_mb_reader_get8(struct cbor_decoder_reader *d, int offset)
+{
+    struct cbor_mb_reader *cmr;
+
+    cmr = (struct cbor_mb_reader *) d;
+
+    if (offset < 0 || offset >= cmr->mb->len) {
+        return UINT8_MAX;
+    }
+
+    return cmr->mb->data[offset];
+}
+
+static uint16_t
+cbor_mb_reader_get16(struct cbor_decoder_reader *d, int offset)
+{
+    struct cbor_mb_reader *cmr;
+    uint16_t val;
+
+    cmr = (struct cbor_mb_reader *) d;
+
+    if (offset < 0 || offset > (int)cmr->mb->len - (int)sizeof val) {
+        return UINT16_MAX;
+    }
+
+    memcpy(&val, cmr->mb->data + offset, sizeof val);
+    return cbor_ntohs(val);
+}
+
+static uint32_t
+cbor_mb_reader_get32(struct cbor_decoder_reader *d, int offset)
+{
+    struct cbor_mb_reader *cmr;
+    uint32_t val;
+
+    cmr = (struct cbor_mb_reader *) d;
+
+    if (offset < 0 || offset > (int)cmr->mb->len - (int)sizeof val) {
+        return UINT32_MAX;
+    }
+
+    memcpy(&val, cmr->mb->data + offset, sizeof val);
+    return cbor_ntohl(val);
+}
+
+static uint64_t
+cbor_mb_reader_get64(struct cbor_decoder_reader *d, int offset)
+{
+    struct cbor_mb_reader *cmr;
+    uint64_t val;
+
+    cmr = (struct cbor_mb_reader *) d;
+
+    if (offset < 0 || offset > (int)cmr->mb->len - (int)sizeof val) {
+        return UINT64_MAX;
+    }
+
+    memcpy(&val, cmr->mb->data + offset, sizeof val);
+    return cbor_ntohll(val);
+}
+
+static uintptr_t
+cbor_mb_reader_cmp(struct cbor_decoder_reader *d, char *buf, int offset,
+                   size_t len)
+{
+    struct cbor_mb_reader *cmr;
+
+    cmr = (struct cbor_mb_reader *) d;
+
+    if (offset < 0 || offset > (int)cmr->mb->len - (int)len) {
+        return -1;
+    }
+
+    return memcmp(cmr->mb->data + offset, buf, len);
+}
+
+static uintptr_t
+cbor_mb_reader_cpy(struct cbor_decoder_reader *d, char *dst, int offset,
+                   size_t len)
+{
+    struct cbor_mb_reader *cmr;
+
+    cmr = (struct cbor_mb_reader *) d;
+
+    if (offset < 0 || offset > (int)cmr->mb->len - (int)len) {
+        return -1;
+    }
+
+    return (uintptr_t)memcpy(dst, cmr->mb->data + offset, len);
+}
+
+static uintptr_t
+cbor_mb_get_string_chunk(struct cbor_decoder_reader *d, int offset,
+                         size_t *len)
+{
+    struct cbor_mb_reader *cmr;
+
+    cmr = (struct cbor_mb_reader *) d;
+    return (uintptr_t)cmr->mb->data + offset;
+}
+
+void
+cbor_mb_reader_init(struct cbor_mb_reader *cmr, struct mcumgr_buf *mb)
+{
+    cmr->r.get8 = &cbor_mb_reader_get8;
+    cmr->r.get16 = &cbor_mb_reader_get16;
+    cmr->r.get32 = &cbor_mb_reader_get32;
+    cmr->r.get64 = &cbor_mb_reader_get64;
+    cmr->r.cmp = &cbor_mb_reader_cmp;
+    cmr->r.cpy = &cbor_mb_reader_cpy;
+    cmr->r.get_string_chunk = &cbor_mb_get_string_chunk;
+
+    cmr->mb = mb;
+    cmr->r.message_size = mb->len;
+}
+
+static int
+cbor_mb_write(struct cbor_encoder_writer *writer, const char *data, int len)
+{
+    struct cbor_mb_writer *cmw;
+
+    cmw = (struct cbor_mb_writer *) writer;
+    if (mcumgr_buf_add(cmw->mb, data, len) != 0) {
+        return CborErrorOutOfMemory;
+    }
+
+    cmw->enc.bytes_written += len;
+
+    return CborNoError;
+}
+
+void
+cbor_mb_writer_init(struct cbor_mb_writer *cmw, struct mcumgr_buf *mb)
+{
+    cmw->mb = mb;
+    cmw->enc.bytes_written = 0;
+    cmw->enc.write = &cbor_mb_write;
+}
@@ -50,6 +50,24 @@ struct net_buf *mcumgr_buf_alloc(void);
  */
 void mcumgr_buf_free(struct net_buf *nb);
 
+/**
+ * @brief Allocates a net_buf that refers to the front of an mcumgr buffer
+ *        without copying it.
+ *
+ * The slice holds a reference to the source buffer until the slice is freed.
+ * The source's user data is copied into the slice.  The source buffer must
+ * not be written to while the slice exists, but it can be trimmed with
+ * net_buf_pull().
+ *
+ * @param nb                    The buffer to refer to.
+ * @param len                   The number of bytes at the front of the
+ *                                  buffer that the slice covers.
+ *
+ * @return                      A newly-allocated slice on success;
+ *                              NULL if no slices are available.
+ */
+struct net_buf *mcumgr_buf_slice(struct net_buf *nb, uint16_t len);
+
 /**
  * @brief Initializes a CBOR writer with the specified net_buf.
  *
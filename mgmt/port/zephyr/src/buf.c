@@ -23,13 +23,33 @@
 #include "zephyr_mgmt/buf.h"
 #include "compilersupport_p.h"
 
+static void mcumgr_buf_slice_destroy(struct net_buf *slice);
+
 NET_BUF_POOL_DEFINE(pkt_pool, CONFIG_MCUMGR_BUF_COUNT, CONFIG_MCUMGR_BUF_SIZE,
                     CONFIG_MCUMGR_BUF_USER_DATA_SIZE, NULL);
 
+/* Slices carry no data of their own; they point into a pkt_pool buffer. */
+NET_BUF_POOL_DEFINE(slice_pool, CONFIG_MCUMGR_BUF_SLICE_COUNT, 0,
+                    CONFIG_MCUMGR_BUF_USER_DATA_SIZE,
+                    mcumgr_buf_slice_destroy);
+
+/* The buffer that each slice refers to, indexed by slice ID. */
+static struct net_buf *slice_srcs[CONFIG_MCUMGR_BUF_SLICE_COUNT];
+
 struct net_buf *
 mcumgr_buf_alloc(void)
 {
-    return net_buf_alloc(&pkt_pool, K_NO_WAIT);
+    struct net_buf *nb;
+
+    nb = net_buf_alloc(&pkt_pool, K_NO_WAIT);
+    if (nb != NULL) {
+        /* Bytes that the transport leaves unset are part of the session
+         * key, so they must not carry over from a previous use.
+         */
+        memset(net_buf_user_data(nb), 0, CONFIG_MCUMGR_BUF_USER_DATA_SIZE);
+    }
+
+    return nb;
 }
 
 void
@@ -38,6 +58,52 @@ mcumgr_buf_free(struct net_buf *nb)
     net_buf_unref(nb);
 }
 
+static void
+mcumgr_buf_slice_destroy(struct net_buf *slice)
+{
+    struct net_buf **src;
+
+    src = &slice_srcs[net_buf_id(slice)];
+    net_buf_unref(*src);
+    *src = NULL;
+
+    net_buf_destroy(slice);
+}
+
+struct net_buf *
+mcumgr_buf_slice(struct net_buf *nb, uint16_t len)
+{
+    const struct net_buf_pool *pool;
+    struct net_buf *slice;
+    size_t user_data_size;
+
+    assert(len <= nb->len);
+
+    slice = net_buf_alloc(&slice_pool, K_NO_WAIT);
+    if (slice == NULL) {
+        return NULL;
+    }
+
+    /* Fixed pools don't free data on unref, so the slice can safely point
+     * at memory it doesn't own.
+     */
+    slice->__buf = nb->data;
+    slice->data = nb->data;
+    slice->size = len;
+    slice->len = len;
+
+    slice_srcs[net_buf_id(slice)] = net_buf_ref(nb);
+
+    pool = net_buf_pool_get(nb->pool_id);
+    user_data_size = pool->user_data_size;
+    if (user_data_size > slice_pool.user_data_size) {
+        user_data_size = slice_pool.user_data_size;
+    }
+    memcpy(net_buf_user_data(slice), net_buf_user_data(nb), user_data_size);
+
+    return slice;
+}
+
 static uint8_t
 cbor_nb_reader_get8(struct cbor_decoder_reader *d, int offset)
 {
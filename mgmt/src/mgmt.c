@@ -17,18 +17,101 @@
  * under the License.
  */
 
+#include <stdbool.h>
 #include <string.h>
 #include "cbor.h"
 #include "mgmt/endian.h"
 #include "mgmt/mgmt.h"
+#include "mgmt/mgmt_impl.h"
+#include "mgmt/mgmt_trace.h"
+#include "mgmt_config.h"
 
-static struct mgmt_group *mgmt_group_list;
-static struct mgmt_group *mgmt_group_list_end;
+/**
+ * Dense index of system groups; indexed by group ID.  Entries are set with an
+ * atomic compare-and-swap and read with acquire loads, as runtime
+ * registrations can race with lookups.
+ */
+static const struct mgmt_group *mgmt_group_sys[MGMT_GROUP_ID_PERUSER];
+
+/**
+ * Index of per-user groups registered at runtime: a hash table, chained
+ * through mg_next.  A group is pushed onto the head of its chain with a
+ * release compare-and-swap once its mg_next is set, and is never moved or
+ * removed, so lookups can walk a chain while registrations proceed.
+ */
+static struct mgmt_group *mgmt_group_buckets[MGMT_PERUSER_GROUP_BUCKETS];
+
+#define MGMT_GROUP_BUCKET(group_id_) \
+    (&mgmt_group_buckets[(group_id_) % MGMT_PERUSER_GROUP_BUCKETS])
+
+/* Bounds of the table of groups defined with MGMT_GROUP_DEFINE(), and of the
+ * table of index slots defined alongside them; see MGMT_LINK_SECTION().
+ * Zephyr's linker snippets always define them.  GNU ld only provides the
+ * others if any such group exists; if none does, both are NULL and the table
+ * is empty.
+ */
+#ifdef __ZEPHYR__
+extern const struct mgmt_group _mcumgr_group_list_start[];
+extern const struct mgmt_group _mcumgr_group_list_end[];
+extern const struct mgmt_group *_mcumgr_group_slot_list_start[];
+extern const struct mgmt_group *_mcumgr_group_slot_list_end[];
+#define MGMT_GROUP_TABLE_START  _mcumgr_group_list_start
+#define MGMT_GROUP_TABLE_END    _mcumgr_group_list_end
+#define MGMT_GROUP_SLOTS        _mcumgr_group_slot_list_start
+#else
+extern const struct mgmt_group __start_mcumgr_group[] __attribute__((weak));
+extern const struct mgmt_group __stop_mcumgr_group[] __attribute__((weak));
+extern const struct mgmt_group *__start_mcumgr_group_slot[]
+    __attribute__((weak));
+#define MGMT_GROUP_TABLE_START  __start_mcumgr_group
+#define MGMT_GROUP_TABLE_END    __stop_mcumgr_group
+#define MGMT_GROUP_SLOTS        __start_mcumgr_group_slot
+#endif
+
+/**
+ * Index of per-user groups defined with MGMT_GROUP_DEFINE(); sorted by group
+ * ID.  Each definition brings one slot, so the index can hold every link-time
+ * group.  Built once; see mgmt_index_static_groups().
+ */
+static int mgmt_group_peruser_cnt;
+
+/* States of the link-time group table's index. */
+#define MGMT_STATIC_UNINDEXED   0
+#define MGMT_STATIC_INDEXING    1
+#define MGMT_STATIC_INDEXED     2
+
+/**
+ * Whether the link-time group table has been indexed.  Accessed atomically;
+ * the index is published with a release store of MGMT_STATIC_INDEXED.
+ */
+static uint8_t mgmt_static_state;
+
+#if MGMT_WINDOW_MAX > 1
+/** Idle time after which another peer can take over a window entry. */
+#define MGMT_WINDOW_TIMEOUT_MS  60000
+
+/**
+ * Peers that have negotiated a request window, and the window of each,
+ * indexed like the sessions.  A peer without an entry has a window of 1.
+ */
+static struct mgmt_session mgmt_window_sessions[MGMT_WINDOW_SESSIONS];
+static uint8_t mgmt_windows[MGMT_WINDOW_SESSIONS];
+static struct mgmt_session_pool mgmt_window_pool = {
+    .msp_sessions = mgmt_window_sessions,
+    .msp_num_sessions = MGMT_WINDOW_SESSIONS,
+    .msp_timeout_ms = MGMT_WINDOW_TIMEOUT_MS,
+};
+#endif
 
 void *
 mgmt_streamer_alloc_rsp(struct mgmt_streamer *streamer, const void *req)
 {
-    return streamer->cfg->alloc_rsp(req, streamer->cb_arg);
+    void *rsp;
+
+    rsp = streamer->cfg->alloc_rsp(req, streamer->cb_arg);
+    MGMT_TRACE(MGMT_TRACE_ALLOC, NULL, rsp != NULL);
+
+    return rsp;
 }
 
 void
@@ -66,26 +149,142 @@ mgmt_streamer_init_writer(struct mgmt_streamer *streamer, void *buf)
 void
 mgmt_streamer_free_buf(struct mgmt_streamer *streamer, void *buf)
 {
+#if MGMT_TRACE_COUNT > 0
+    if (buf != NULL) {
+        MGMT_TRACE(MGMT_TRACE_FREE, NULL, 0);
+    }
+#endif
+
     streamer->cfg->free_buf(buf, streamer->cb_arg);
 }
 
-void
-mgmt_register_group(struct mgmt_group *group)
+const void *
+mgmt_streamer_session_key(struct mgmt_streamer *streamer, const void *req,
+                          size_t *out_len)
 {
-    if (mgmt_group_list_end == NULL) {
-        mgmt_group_list = group;
-    } else {
-        mgmt_group_list_end->mg_next = group;
+    if (streamer->cfg->session_key == NULL) {
+        *out_len = 0;
+        return NULL;
     }
-    mgmt_group_list_end = group;
+
+    return streamer->cfg->session_key(req, out_len, streamer->cb_arg);
 }
 
-static struct mgmt_group *
-mgmt_find_group(uint16_t group_id)
+/**
+ * Searches the index of link-time per-user groups for the specified group ID.
+ *
+ * @return                      The index of the matching entry, if found;
+ *                              otherwise, the index at which an entry with the
+ *                              specified ID would be inserted.
+ */
+static int
+mgmt_peruser_search(uint16_t group_id, bool *out_found)
+{
+    int lo;
+    int hi;
+    int mid;
+
+    lo = 0;
+    hi = mgmt_group_peruser_cnt;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (MGMT_GROUP_SLOTS[mid]->mg_group_id < group_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *out_found = lo < mgmt_group_peruser_cnt &&
+                 MGMT_GROUP_SLOTS[lo]->mg_group_id == group_id;
+    return lo;
+}
+
+/**
+ * Adds a group defined with MGMT_GROUP_DEFINE() to the dispatch index.  If a
+ * group with the same ID is already indexed, the existing entry is retained.
+ */
+static void
+mgmt_index_static_group(const struct mgmt_group *group)
+{
+    const struct mgmt_group *expected;
+    bool found;
+    int idx;
+
+    if (group->mg_group_id < MGMT_GROUP_ID_PERUSER) {
+        expected = NULL;
+        __atomic_compare_exchange_n(&mgmt_group_sys[group->mg_group_id],
+                                    &expected, group, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        return;
+    }
+
+    idx = mgmt_peruser_search(group->mg_group_id, &found);
+    if (found) {
+        return;
+    }
+
+    /* There is a slot for every link-time group, so this can't overflow.
+     * Nothing reads the slots until the index is published.
+     */
+    memmove(&MGMT_GROUP_SLOTS[idx + 1], &MGMT_GROUP_SLOTS[idx],
+            (mgmt_group_peruser_cnt - idx) * sizeof MGMT_GROUP_SLOTS[0]);
+    MGMT_GROUP_SLOTS[idx] = group;
+    mgmt_group_peruser_cnt++;
+}
+
+/**
+ * Indexes all groups defined with MGMT_GROUP_DEFINE().  This happens once, on
+ * the first registration or lookup.  Transports may dispatch concurrently, so
+ * only the caller that claims the index builds it; a caller that arrives
+ * while it is being built doesn't wait for it.
+ *
+ * @return                      true if the index is ready;
+ *                              false if another thread is building it.
+ */
+static bool
+mgmt_index_static_groups(void)
+{
+    const struct mgmt_group *group;
+    uint8_t state;
+
+    state = __atomic_load_n(&mgmt_static_state, __ATOMIC_ACQUIRE);
+    if (state == MGMT_STATIC_INDEXED) {
+        return true;
+    }
+
+    if (state != MGMT_STATIC_UNINDEXED ||
+        !__atomic_compare_exchange_n(&mgmt_static_state, &state,
+                                     MGMT_STATIC_INDEXING, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+
+        return state == MGMT_STATIC_INDEXED;
+    }
+
+    for (group = MGMT_GROUP_TABLE_START;
+         group < MGMT_GROUP_TABLE_END;
+         group++) {
+
+        mgmt_index_static_group(group);
+    }
+
+    __atomic_store_n(&mgmt_static_state, MGMT_STATIC_INDEXED,
+                     __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Searches the link-time group table without the index.
+ */
+static const struct mgmt_group *
+mgmt_search_static_group(uint16_t group_id)
 {
-    struct mgmt_group *group;
+    const struct mgmt_group *group;
+
+    for (group = MGMT_GROUP_TABLE_START;
+         group < MGMT_GROUP_TABLE_END;
+         group++) {
 
-    for (group = mgmt_group_list; group != NULL; group = group->mg_next) {
         if (group->mg_group_id == group_id) {
             return group;
         }
@@ -94,6 +293,67 @@ mgmt_find_group(uint16_t group_id)
     return NULL;
 }
 
+static const struct mgmt_group *
+mgmt_find_group(uint16_t group_id)
+{
+    const struct mgmt_group *group;
+    bool found;
+    int idx;
+
+    if (!mgmt_index_static_groups()) {
+        /* Another thread is still building the index. */
+        group = mgmt_search_static_group(group_id);
+        if (group != NULL) {
+            return group;
+        }
+    } else if (group_id >= MGMT_GROUP_ID_PERUSER) {
+        idx = mgmt_peruser_search(group_id, &found);
+        if (found) {
+            return MGMT_GROUP_SLOTS[idx];
+        }
+    }
+
+    if (group_id < MGMT_GROUP_ID_PERUSER) {
+        return __atomic_load_n(&mgmt_group_sys[group_id], __ATOMIC_ACQUIRE);
+    }
+
+    group = __atomic_load_n(MGMT_GROUP_BUCKET(group_id), __ATOMIC_ACQUIRE);
+    while (group != NULL && group->mg_group_id != group_id) {
+        group = group->mg_next;
+    }
+
+    return group;
+}
+
+void
+mgmt_register_group(struct mgmt_group *group)
+{
+    const struct mgmt_group *expected;
+    struct mgmt_group **bucket;
+    struct mgmt_group *head;
+
+    /* If a group with the same ID is already registered, it is retained. */
+    if (mgmt_find_group(group->mg_group_id) != NULL) {
+        return;
+    }
+
+    if (group->mg_group_id < MGMT_GROUP_ID_PERUSER) {
+        expected = NULL;
+        __atomic_compare_exchange_n(&mgmt_group_sys[group->mg_group_id],
+                                    &expected, group, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        return;
+    }
+
+    bucket = MGMT_GROUP_BUCKET(group->mg_group_id);
+    head = __atomic_load_n(bucket, __ATOMIC_RELAXED);
+    do {
+        group->mg_next = head;
+    } while (!__atomic_compare_exchange_n(bucket, &head, group, true,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
 const struct mgmt_handler *
 mgmt_find_handler(uint16_t group_id, uint16_t command_id)
 {
@@ -151,10 +411,254 @@ mgmt_ctxt_init(struct mgmt_ctxt *cbuf, struct mgmt_streamer *streamer)
     }
 
     cbor_encoder_cust_writer_init(&cbuf->encoder, streamer->writer, 0);
+    cbuf->defer_cfg = NULL;
+    cbuf->defer_arg = NULL;
+    cbuf->finish = NULL;
+    cbuf->replayable = false;
+    cbuf->unchanged = false;
+    cbuf->session_key = NULL;
+    cbuf->session_key_len = 0;
 
     return 0;
 }
 
+struct mgmt_ctxt *
+mgmt_ctxt_defer(struct mgmt_ctxt *cbuf)
+{
+    if (cbuf->defer_cfg == NULL) {
+        return NULL;
+    }
+
+    return cbuf->defer_cfg->defer(cbuf, cbuf->defer_arg);
+}
+
+void
+mgmt_ctxt_complete(struct mgmt_ctxt *cbuf, int status)
+{
+    cbuf->defer_cfg->complete(cbuf, status, cbuf->defer_arg);
+}
+
+int
+mgmt_get_window(const struct mgmt_ctxt *ctxt)
+{
+#if MGMT_WINDOW_MAX > 1
+    int idx;
+
+    idx = mgmt_session_find(&mgmt_window_pool, ctxt);
+    if (idx != -1) {
+        return mgmt_windows[idx];
+    }
+#endif
+
+    return 1;
+}
+
+int
+mgmt_set_window(const struct mgmt_ctxt *ctxt, int window)
+{
+#if MGMT_WINDOW_MAX > 1
+    int idx;
+    int rc;
+
+    if (window > MGMT_WINDOW_MAX) {
+        window = MGMT_WINDOW_MAX;
+    }
+
+    if (window <= 1) {
+        /* Back to the default; free the peer's entry, if any. */
+        idx = mgmt_session_find(&mgmt_window_pool, ctxt);
+        if (idx != -1) {
+            mgmt_session_close(&mgmt_window_pool, idx);
+        }
+        return 1;
+    }
+
+    rc = mgmt_session_open(&mgmt_window_pool, ctxt, &idx);
+    if (rc != 0) {
+        /* Too many peers pipelining at once. */
+        return 1;
+    }
+
+    mgmt_windows[idx] = window;
+    return window;
+#else
+    return 1;
+#endif
+}
+
+int
+mgmt_reorder_hold(struct mgmt_reorder_buf *mrb, const struct mgmt_ctxt *ctxt,
+                  size_t next_off, size_t off, const void *data, size_t len)
+{
+    struct mgmt_reorder_slot *slot;
+    struct mgmt_reorder_slot *free_slot;
+    int num_used;
+    int limit;
+    int i;
+
+    limit = mgmt_get_window(ctxt) - 1;
+    if (limit > mrb->mrb_num_slots) {
+        limit = mrb->mrb_num_slots;
+    }
+
+    if (off <= next_off || len == 0 || len > mrb->mrb_slot_size) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (off - next_off > (size_t)limit * mrb->mrb_slot_size) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    free_slot = NULL;
+    num_used = 0;
+    for (i = 0; i < mrb->mrb_num_slots; i++) {
+        slot = &mrb->mrb_slots[i];
+        if (slot->mrs_used) {
+            if (slot->mrs_off == off) {
+                /* Retransmit of a held chunk. */
+                return 0;
+            }
+            num_used++;
+        } else if (free_slot == NULL) {
+            free_slot = slot;
+        }
+    }
+
+    if (free_slot == NULL || num_used >= limit) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    i = free_slot - mrb->mrb_slots;
+    memcpy(mrb->mrb_data + i * mrb->mrb_slot_size, data, len);
+    free_slot->mrs_off = off;
+    free_slot->mrs_len = len;
+    free_slot->mrs_used = true;
+
+    return 0;
+}
+
+const uint8_t *
+mgmt_reorder_take(struct mgmt_reorder_buf *mrb, size_t off, size_t *out_len)
+{
+    struct mgmt_reorder_slot *slot;
+    int i;
+
+    for (i = 0; i < mrb->mrb_num_slots; i++) {
+        slot = &mrb->mrb_slots[i];
+        if (slot->mrs_used && slot->mrs_off == off) {
+            slot->mrs_used = false;
+            *out_len = slot->mrs_len;
+            return mrb->mrb_data + i * mrb->mrb_slot_size;
+        }
+    }
+
+    return NULL;
+}
+
+void
+mgmt_reorder_clear(struct mgmt_reorder_buf *mrb)
+{
+    int i;
+
+    for (i = 0; i < mrb->mrb_num_slots; i++) {
+        mrb->mrb_slots[i].mrs_used = false;
+    }
+}
+
+static size_t
+mgmt_session_key_len(const struct mgmt_ctxt *ctxt)
+{
+    if (ctxt->session_key == NULL) {
+        return 0;
+    }
+    if (ctxt->session_key_len > MGMT_SESSION_KEY_MAX) {
+        return MGMT_SESSION_KEY_MAX;
+    }
+    return ctxt->session_key_len;
+}
+
+int
+mgmt_session_find(struct mgmt_session_pool *msp, const struct mgmt_ctxt *ctxt)
+{
+    struct mgmt_session *ms;
+    size_t key_len;
+    int i;
+
+    key_len = mgmt_session_key_len(ctxt);
+
+    for (i = 0; i < msp->msp_num_sessions; i++) {
+        ms = &msp->msp_sessions[i];
+        if (ms->ms_used && ms->ms_key_len == key_len &&
+            (key_len == 0 ||
+             memcmp(ms->ms_key, ctxt->session_key, key_len) == 0)) {
+
+            ms->ms_last_ms = mgmt_impl_uptime_ms();
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+uint32_t
+mgmt_session_idle_ms(const struct mgmt_session_pool *msp, int idx)
+{
+    return mgmt_impl_uptime_ms() - msp->msp_sessions[idx].ms_last_ms;
+}
+
+bool
+mgmt_session_expired(const struct mgmt_session_pool *msp, int idx)
+{
+    return msp->msp_timeout_ms != 0 &&
+           mgmt_session_idle_ms(msp, idx) > msp->msp_timeout_ms;
+}
+
+int
+mgmt_session_open(struct mgmt_session_pool *msp,
+                  const struct mgmt_ctxt *ctxt, int *out_idx)
+{
+    struct mgmt_session *ms;
+    int idx;
+    int i;
+
+    idx = mgmt_session_find(msp, ctxt);
+    if (idx != -1) {
+        *out_idx = idx;
+        return 0;
+    }
+
+    /* Prefer a free entry to an expired one. */
+    for (i = 0; i < msp->msp_num_sessions; i++) {
+        if (!msp->msp_sessions[i].ms_used) {
+            idx = i;
+            break;
+        }
+        if (idx == -1 && mgmt_session_expired(msp, i)) {
+            idx = i;
+        }
+    }
+
+    if (idx == -1) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    ms = &msp->msp_sessions[idx];
+    ms->ms_key_len = mgmt_session_key_len(ctxt);
+    if (ms->ms_key_len > 0) {
+        memcpy(ms->ms_key, ctxt->session_key, ms->ms_key_len);
+    }
+    ms->ms_used = true;
+    ms->ms_last_ms = mgmt_impl_uptime_ms();
+
+    *out_idx = idx;
+    return 0;
+}
+
+void
+mgmt_session_close(struct mgmt_session_pool *msp, int idx)
+{
+    msp->msp_sessions[idx].ms_used = false;
+}
+
 void
 mgmt_ntoh_hdr(struct mgmt_hdr *hdr)
 {
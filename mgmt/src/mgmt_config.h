@@ -0,0 +1,26 @@
+#ifndef H_MGMT_CONFIG_
+#define H_MGMT_CONFIG_
+
+#if defined MYNEWT
+
+#include "syscfg/syscfg.h"
+
+#define MGMT_PERUSER_GROUP_BUCKETS  MYNEWT_VAL(MGMT_PERUSER_GROUP_BUCKETS)
+#define MGMT_WINDOW_MAX         MYNEWT_VAL(MGMT_WINDOW_MAX)
+#define MGMT_WINDOW_SESSIONS    MYNEWT_VAL(MGMT_WINDOW_SESSIONS)
+
+#elif defined __ZEPHYR__
+
+#define MGMT_PERUSER_GROUP_BUCKETS  CONFIG_MCUMGR_PERUSER_GROUP_BUCKETS
+#define MGMT_WINDOW_MAX         CONFIG_MCUMGR_WINDOW_MAX
+#define MGMT_WINDOW_SESSIONS    CONFIG_MCUMGR_WINDOW_SESSIONS
+
+#else
+
+/* No direct support for this OS.  The application needs to define the above
+ * settings itself.
+ */
+
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "mgmt/mgmt.h"
+#include "mgmt/mgmt_impl.h"
+#include "mgmt/mgmt_handler_stats.h"
+
+#if MGMT_HANDLER_STATS_COUNT > 0
+
+static struct mgmt_handler_stats
+    mgmt_handler_stats_table[MGMT_HANDLER_STATS_COUNT];
+
+/**
+ * Finds the entry for the specified key, claiming an unused one if the key
+ * is not in the table yet.  Entries are never released, so a claim is a
+ * single compare-and-swap, and concurrent dispatchers cannot claim two
+ * entries for the same key.
+ */
+static struct mgmt_handler_stats *
+mgmt_handler_stats_find(uint32_t key)
+{
+    struct mgmt_handler_stats *entry;
+    uint32_t cur;
+    int idx;
+    int i;
+
+    idx = (key * 2654435761u) % MGMT_HANDLER_STATS_COUNT;
+    for (i = 0; i < MGMT_HANDLER_STATS_COUNT; i++) {
+        entry = &mgmt_handler_stats_table[idx];
+
+        cur = __atomic_load_n(&entry->mhs_key, __ATOMIC_RELAXED);
+        if (cur == 0) {
+            if (__atomic_compare_exchange_n(&entry->mhs_key, &cur, key, false,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                return entry;
+            }
+            /* Lost the race; cur now holds the winner's key. */
+        }
+        if (cur == key) {
+            return entry;
+        }
+
+        idx = (idx + 1) % MGMT_HANDLER_STATS_COUNT;
+    }
+
+    return NULL;
+}
+
+/**
+ * Converts a latency to its histogram bucket.
+ */
+static int
+mgmt_handler_stats_bucket(uint32_t cycles)
+{
+    uint32_t hz;
+    uint32_t us;
+    int bucket;
+
+    hz = mgmt_impl_cycles_hz();
+    if (hz == 0) {
+        return 0;
+    }
+
+    us = (uint64_t)cycles * 1000000 / hz;
+    if (us < 2) {
+        return 0;
+    }
+
+    /* Index of the most significant set bit. */
+    bucket = 31 - __builtin_clz(us);
+    if (bucket >= MGMT_HANDLER_STATS_BUCKETS) {
+        bucket = MGMT_HANDLER_STATS_BUCKETS - 1;
+    }
+
+    return bucket;
+}
+
+void
+mgmt_handler_stats_rec(const struct mgmt_hdr *hdr, int status,
+                       uint32_t rsp_len, uint32_t start_cycles)
+{
+    struct mgmt_handler_stats *entry;
+    uint32_t key;
+
+    key = ((uint32_t)hdr->nh_group << 16) |
+          ((uint32_t)hdr->nh_id << 8) |
+          (hdr->nh_op + 1);
+
+    entry = mgmt_handler_stats_find(key);
+    if (entry == NULL) {
+        return;
+    }
+
+    /* Counters are updated without atomics; a concurrent update may
+     * occasionally be lost.
+     */
+    entry->mhs_count++;
+    if (status != 0) {
+        entry->mhs_errs++;
+    }
+    entry->mhs_req_bytes += hdr->nh_len;
+    entry->mhs_rsp_bytes += rsp_len;
+    entry->mhs_lat[mgmt_handler_stats_bucket(mgmt_impl_cycles() -
+                                             start_cycles)]++;
+}
+
+const struct mgmt_handler_stats *
+mgmt_handler_stats_at(int idx)
+{
+    if (idx < 0 || idx >= MGMT_HANDLER_STATS_COUNT) {
+        return NULL;
+    }
+
+    return &mgmt_handler_stats_table[idx];
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "mgmt/mgmt_stats.h"
+
+/* Bounds of the table of groups defined with MGMT_STATS_DEFINE(); see
+ * MGMT_LINK_SECTION().  GNU ld only provides the non-Zephyr symbols if any
+ * such group exists; if none does, both are NULL and the table is empty.
+ */
+#ifdef __ZEPHYR__
+extern const struct mgmt_stats_group _mcumgr_stats_list_start[];
+extern const struct mgmt_stats_group _mcumgr_stats_list_end[];
+#define MGMT_STATS_TABLE_START  _mcumgr_stats_list_start
+#define MGMT_STATS_TABLE_END    _mcumgr_stats_list_end
+#else
+extern const struct mgmt_stats_group __start_mcumgr_stats[]
+    __attribute__((weak));
+extern const struct mgmt_stats_group __stop_mcumgr_stats[]
+    __attribute__((weak));
+#define MGMT_STATS_TABLE_START  __start_mcumgr_stats
+#define MGMT_STATS_TABLE_END    __stop_mcumgr_stats
+#endif
+
+const struct mgmt_stats_group *
+mgmt_stats_group_at(int idx)
+{
+    if (idx < 0 || idx >= MGMT_STATS_TABLE_END - MGMT_STATS_TABLE_START) {
+        return NULL;
+    }
+
+    return &MGMT_STATS_TABLE_START[idx];
+}
+
+const struct mgmt_stats_group *
+mgmt_stats_group_find(const char *name)
+{
+    const struct mgmt_stats_group *group;
+    int idx;
+
+    for (idx = 0; ; idx++) {
+        group = mgmt_stats_group_at(idx);
+        if (group == NULL || strcmp(group->msg_name, name) == 0) {
+            return group;
+        }
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+#include "mgmt/mgmt.h"
+#include "mgmt/mgmt_impl.h"
+#include "mgmt/mgmt_trace.h"
+
+#if MGMT_TRACE_COUNT > 0
+
+_Static_assert((MGMT_TRACE_COUNT & (MGMT_TRACE_COUNT - 1)) == 0,
+               "MGMT_TRACE_COUNT must be a power of two");
+
+/** Marks a record that is being written. */
+#define MGMT_TRACE_IDX_BUSY     UINT32_MAX
+
+struct mgmt_trace_rec {
+    /* Written last, so that a reader can tell whether it copied the whole
+     * record.
+     */
+    uint32_t mtr_idx;
+
+    uint32_t mtr_cycles;
+    uint16_t mtr_group;
+    uint16_t mtr_arg;
+    uint8_t mtr_id;
+    uint8_t mtr_seq;
+    uint8_t mtr_point;
+    uint8_t mtr_op;
+};
+
+static struct mgmt_trace_rec mgmt_trace_ring[MGMT_TRACE_COUNT];
+static uint32_t mgmt_trace_idx;
+
+/**
+ * Writers claim a slot with a single atomic increment and never wait for
+ * each other.  A slow writer can be lapped by faster ones; readers detect
+ * this from the record's index.
+ */
+void
+mgmt_trace_rec(uint8_t point, const struct mgmt_hdr *hdr, uint32_t arg)
+{
+    struct mgmt_trace_rec *rec;
+    uint32_t idx;
+
+    idx = __atomic_fetch_add(&mgmt_trace_idx, 1, __ATOMIC_RELAXED);
+    rec = &mgmt_trace_ring[idx & (MGMT_TRACE_COUNT - 1)];
+
+    __atomic_store_n(&rec->mtr_idx, MGMT_TRACE_IDX_BUSY, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    rec->mtr_cycles = mgmt_impl_cycles();
+    rec->mtr_arg = arg;
+    rec->mtr_point = point;
+    if (hdr != NULL) {
+        rec->mtr_group = hdr->nh_group;
+        rec->mtr_id = hdr->nh_id;
+        rec->mtr_seq = hdr->nh_seq;
+        rec->mtr_op = hdr->nh_op;
+    } else {
+        rec->mtr_group = 0;
+        rec->mtr_id = 0;
+        rec->mtr_seq = 0;
+        rec->mtr_op = 0;
+    }
+
+    __atomic_store_n(&rec->mtr_idx, idx, __ATOMIC_RELEASE);
+}
+
+uint32_t
+mgmt_trace_next_idx(void)
+{
+    return __atomic_load_n(&mgmt_trace_idx, __ATOMIC_ACQUIRE);
+}
+
+static void
+mgmt_trace_put16(uint8_t *dst, uint16_t val)
+{
+    dst[0] = val;
+    dst[1] = val >> 8;
+}
+
+static void
+mgmt_trace_put32(uint8_t *dst, uint32_t val)
+{
+    mgmt_trace_put16(dst, val);
+    mgmt_trace_put16(dst + 2, val >> 16);
+}
+
+int
+mgmt_trace_export(uint32_t idx, uint8_t *dst, int max_recs,
+                  uint32_t *out_next_idx)
+{
+    const struct mgmt_trace_rec *rec;
+    struct mgmt_trace_rec copy;
+    uint32_t next;
+    int num_recs;
+
+    next = mgmt_trace_next_idx();
+
+    /* Skip records that have been overwritten. */
+    if (next - idx > MGMT_TRACE_COUNT) {
+        idx = next - MGMT_TRACE_COUNT;
+    }
+
+    num_recs = 0;
+    for (; idx != next && num_recs < max_recs; idx++) {
+        rec = &mgmt_trace_ring[idx & (MGMT_TRACE_COUNT - 1)];
+
+        if (__atomic_load_n(&rec->mtr_idx, __ATOMIC_ACQUIRE) != idx) {
+            continue;
+        }
+        copy = *rec;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&rec->mtr_idx, __ATOMIC_RELAXED) != idx) {
+            continue;
+        }
+
+        mgmt_trace_put32(dst + 0, idx);
+        mgmt_trace_put32(dst + 4, copy.mtr_cycles);
+        mgmt_trace_put16(dst + 8, copy.mtr_group);
+        mgmt_trace_put16(dst + 10, copy.mtr_arg);
+        dst[12] = copy.mtr_id;
+        dst[13] = copy.mtr_seq;
+        dst[14] = copy.mtr_point;
+        dst[15] = copy.mtr_op;
+
+        dst += MGMT_TRACE_REC_SIZE;
+        num_recs++;
+    }
+
+    *out_next_idx = idx;
+    return num_recs;
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * These stubs get linked in when there is no equivalent OS-specific
+ * implementation.
+ */
+
+#include "mgmt/mgmt.h"
+#include "mgmt/mgmt_impl.h"
+
+/* Without a clock, idle sessions never expire. */
+uint32_t __attribute__((weak))
+mgmt_impl_uptime_ms(void)
+{
+    return 0;
+}
+
+/* Without a counter, trace records are ordered but not timed. */
+uint32_t __attribute__((weak))
+mgmt_impl_cycles(void)
+{
+    return 0;
+}
+
+uint32_t __attribute__((weak))
+mgmt_impl_cycles_hz(void)
+{
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <time.h>
+#include "mgmt/mgmt.h"
+#include "bench_link.h"
+
+/** Give up on a request after this many transmissions. */
+#define BENCH_LINK_MAX_TRIES    16
+
+static posix_smp_loopback_rsp_fn bench_link_rsp;
+
+static uint64_t
+bench_link_wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Decides whether the next packet gets lost.  A private xorshift generator
+ * keeps the loss pattern independent of the C library.
+ */
+static bool
+bench_link_drop(struct bench_link *bl)
+{
+    uint32_t x;
+
+    if (bl->bl_cfg.loss_pct <= 0) {
+        return false;
+    }
+
+    x = bl->bl_rand;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    bl->bl_rand = x;
+
+    if (x / 4294967296.0 * 100.0 < bl->bl_cfg.loss_pct) {
+        bl->bl_stats.lost_packets++;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Indicates how long a packet of the specified size occupies the link.
+ */
+static uint64_t
+bench_link_wire_ns(const struct bench_link *bl, size_t len)
+{
+    if (bl->bl_cfg.bandwidth_bps == 0) {
+        return 0;
+    }
+
+    return (uint64_t)len * 8 * 1000000000 / bl->bl_cfg.bandwidth_bps;
+}
+
+/**
+ * Receives a response fragment from the server.  Called in the loopback
+ * transport's thread while the client waits in bench_link_xchg().
+ */
+static void
+bench_link_rsp(const void *data, size_t len, void *arg)
+{
+    struct bench_link *bl;
+    size_t wire_len;
+
+    bl = arg;
+
+    wire_len = len + bl->bl_cfg.overhead;
+    bl->bl_stats.rx_bytes += wire_len;
+    bl->bl_stats.rx_packets++;
+    bl->bl_rsp_wire_ns += bench_link_wire_ns(bl, wire_len);
+
+    if (bench_link_drop(bl)) {
+        bl->bl_rsp_lost = true;
+    }
+
+    if (bl->bl_rsp_len + len > sizeof bl->bl_rsp) {
+        bl->bl_rsp_overflow = true;
+    } else {
+        memcpy(bl->bl_rsp + bl->bl_rsp_len, data, len);
+        bl->bl_rsp_len += len;
+    }
+}
+
+/**
+ * Indicates whether the reassembled response is a complete SMP packet.
+ */
+static bool
+bench_link_rsp_complete(const struct bench_link *bl)
+{
+    struct mgmt_hdr hdr;
+
+    if (bl->bl_rsp_len < sizeof hdr) {
+        return false;
+    }
+
+    memcpy(&hdr, bl->bl_rsp, sizeof hdr);
+    return bl->bl_rsp_len >= sizeof hdr + ntohs(hdr.nh_len);
+}
+
+int
+bench_link_init(struct bench_link *bl, const struct bench_link_cfg *cfg)
+{
+    memset(bl, 0, sizeof *bl);
+    bl->bl_cfg = *cfg;
+
+    /* Xorshift gets stuck at 0. */
+    bl->bl_rand = cfg->seed != 0 ? cfg->seed : 1;
+
+    return posix_smp_loopback_init(&bl->bl_loopback, cfg->mtu,
+                                   bench_link_rsp, bl);
+}
+
+void
+bench_link_stop(struct bench_link *bl)
+{
+    posix_smp_transport_stop(&bl->bl_loopback.psl_transport);
+}
+
+int
+bench_link_xchg(struct bench_link *bl, const void *req, size_t req_len,
+                const uint8_t **out_rsp, size_t *out_rsp_len)
+{
+    uint64_t latency_ns;
+    uint64_t arrival_ns;
+    uint64_t start_ns;
+    uint64_t sent_ns;
+    size_t wire_len;
+    int tries;
+    int rc;
+
+    if (req_len > bl->bl_cfg.mtu) {
+        return MGMT_ERR_EMSGSIZE;
+    }
+
+    latency_ns = (uint64_t)bl->bl_cfg.latency_us * 1000;
+    wire_len = req_len + bl->bl_cfg.overhead;
+
+    for (tries = 0; tries < BENCH_LINK_MAX_TRIES; tries++) {
+        if (tries > 0) {
+            bl->bl_stats.retransmits++;
+        }
+
+        sent_ns = bl->bl_now_ns;
+        arrival_ns = sent_ns + bench_link_wire_ns(bl, wire_len) + latency_ns;
+        bl->bl_stats.tx_bytes += wire_len;
+        bl->bl_stats.tx_packets++;
+
+        if (!bench_link_drop(bl)) {
+            bl->bl_rsp_len = 0;
+            bl->bl_rsp_wire_ns = 0;
+            bl->bl_rsp_lost = false;
+            bl->bl_rsp_overflow = false;
+
+            /* The server processes the request for real; that much time
+             * passes before its first response fragment goes out.
+             */
+            start_ns = bench_link_wall_ns();
+            rc = posix_smp_loopback_send(&bl->bl_loopback, req, req_len);
+            if (rc != 0) {
+                return rc;
+            }
+            posix_smp_transport_flush(&bl->bl_loopback.psl_transport);
+            bl->bl_service_ns = bench_link_wall_ns() - start_ns;
+
+            if (bl->bl_rsp_overflow) {
+                return MGMT_ERR_EMSGSIZE;
+            }
+
+            if (!bl->bl_rsp_lost && bench_link_rsp_complete(bl)) {
+                bl->bl_now_ns = arrival_ns + bl->bl_service_ns +
+                                bl->bl_rsp_wire_ns + latency_ns;
+
+                *out_rsp = bl->bl_rsp;
+                *out_rsp_len = bl->bl_rsp_len;
+                return 0;
+            }
+        }
+
+        /* Nothing usable came back; the client times out and resends. */
+        bl->bl_now_ns = sent_ns + (uint64_t)bl->bl_cfg.rto_ms * 1000000;
+    }
+
+    return MGMT_ERR_ETIMEOUT;
+}
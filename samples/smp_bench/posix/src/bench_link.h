@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_BENCH_LINK_
+#define H_BENCH_LINK_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include "posix_smp/posix_smp_loopback.h"
+
+/** Largest response the link reassembles, in bytes. */
+#define BENCH_LINK_RSP_MAX      4096
+
+/**
+ * @brief Properties of a simulated link.
+ */
+struct bench_link_cfg {
+    /** Largest packet in either direction, in bytes. */
+    uint16_t mtu;
+
+    /** Per-packet framing added by the link layer, in bytes. */
+    uint16_t overhead;
+
+    /** One-way propagation delay, in microseconds. */
+    uint32_t latency_us;
+
+    /** Link rate in each direction, in bits per second; 0 = unlimited. */
+    uint32_t bandwidth_bps;
+
+    /** Probability that a packet gets lost, in percent. */
+    double loss_pct;
+
+    /** How long the client waits for a response before resending. */
+    uint32_t rto_ms;
+
+    /** Seeds the loss pattern, so that runs are repeatable. */
+    uint32_t seed;
+};
+
+/**
+ * @brief Counters for traffic over a simulated link.
+ */
+struct bench_link_stats {
+    uint64_t tx_bytes;          /* Client to server, including overhead. */
+    uint64_t rx_bytes;          /* Server to client, including overhead. */
+    uint32_t tx_packets;
+    uint32_t rx_packets;
+    uint32_t lost_packets;
+    uint32_t retransmits;
+};
+
+/**
+ * @brief A simulated link between a client and the SMP server.
+ *
+ * Requests are processed by the real SMP stack over a loopback transport; the
+ * link only decides when packets would have arrived.  Time is simulated:
+ * each exchange advances the link's clock by the time the packets spend on
+ * the wire plus the time the server actually took to process the request.
+ * Only one request is outstanding at a time, as with the mcumgr CLI.
+ */
+struct bench_link {
+    struct posix_smp_loopback bl_loopback;
+    struct bench_link_cfg bl_cfg;
+    struct bench_link_stats bl_stats;
+
+    /** Simulated time, in nanoseconds. */
+    uint64_t bl_now_ns;
+
+    /** Server processing time for the most recent exchange. */
+    uint64_t bl_service_ns;
+
+    /** State of the loss generator. */
+    uint32_t bl_rand;
+
+    /* The response to the most recent transmission, reassembled from the
+     * fragments the server sent.
+     */
+    uint8_t bl_rsp[BENCH_LINK_RSP_MAX];
+    size_t bl_rsp_len;
+    uint64_t bl_rsp_wire_ns;
+    bool bl_rsp_lost;
+    bool bl_rsp_overflow;
+};
+
+/**
+ * @brief Initializes a simulated link and starts its server thread.
+ *
+ * @param bl                    The link to initialize.
+ * @param cfg                   The link's properties.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int bench_link_init(struct bench_link *bl, const struct bench_link_cfg *cfg);
+
+/**
+ * @brief Stops a simulated link's server thread.
+ *
+ * @param bl                    The link to stop.
+ */
+void bench_link_stop(struct bench_link *bl);
+
+/**
+ * @brief Sends a request and waits for the complete response, resending as
+ *        needed when packets get lost.
+ *
+ * @param bl                    The link to send over.
+ * @param req                   The request packet, header included.  It must
+ *                                  fit in the link's MTU.
+ * @param req_len               The length of the request packet, in bytes.
+ * @param out_rsp               On success, points to the response packet.  It
+ *                                  remains valid until the next exchange.
+ * @param out_rsp_len           On success, the response length gets written
+ *                                  here.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int bench_link_xchg(struct bench_link *bl, const void *req, size_t req_len,
+                    const uint8_t **out_rsp, size_t *out_rsp_len);
+
+#endif
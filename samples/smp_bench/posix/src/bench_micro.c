@@ -0,0 +1,524 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * Microbenchmarks of individual mechanisms that the SMP workloads can't
+ * isolate: command dispatch and the receive queue.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mgmt/mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "posix_smp/posix_smp_ring.h"
+#include "bench_micro.h"
+
+#define BENCH_DISPATCH_MAX_GROUPS   100
+
+/**
+ * Groups alternately take system group IDs that no command group uses,
+ * starting here, and per-user IDs.
+ */
+#define BENCH_DISPATCH_SYS_ID_MIN   10
+
+/** Number of group IDs in the lookup sequence; a power of two. */
+#define BENCH_DISPATCH_NUM_IDS      1024
+
+/**
+ * Times each measurement is repeated; the fastest repetition is reported, as
+ * the one least disturbed by other activity on the host.
+ */
+#define BENCH_MICRO_REPS            5
+
+/** Put/get pairs timed for the uncontended cost of each queue. */
+#define BENCH_RING_PAIRS            1000000
+
+/** Group counts at which the dispatch benchmark measures. */
+static const int bench_dispatch_counts[] = { 3, 10, 25, 50, 100 };
+
+#define BENCH_DISPATCH_NUM_COUNTS \
+    (sizeof bench_dispatch_counts / sizeof bench_dispatch_counts[0])
+
+static const struct mgmt_handler bench_dispatch_handlers[1];
+static struct mgmt_group bench_dispatch_groups[BENCH_DISPATCH_MAX_GROUPS];
+static uint16_t bench_dispatch_ids[BENCH_DISPATCH_NUM_IDS];
+
+/** Keeps the compiler from discarding lookups whose results go unused. */
+static volatile uintptr_t bench_micro_sink;
+
+static uint64_t
+bench_micro_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t
+bench_micro_rand(uint32_t *state)
+{
+    /* xorshift32. */
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * Looks up a command handler by searching the registered groups in turn, as
+ * mgmt_find_handler() did before groups were indexed.  It is kept out of line
+ * so that it pays for a call, as mgmt_find_handler() does.
+ */
+static __attribute__((noinline)) const struct mgmt_handler *
+bench_dispatch_list_find(const struct mgmt_group *groups, int count,
+                         uint16_t group_id, uint16_t command_id)
+{
+    const struct mgmt_group *group;
+
+    for (group = groups; group < groups + count; group++) {
+        if (group->mg_group_id == group_id) {
+            if (command_id >= group->mg_handlers_count) {
+                return NULL;
+            }
+            return &group->mg_handlers[command_id];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Times lookups of the IDs in bench_dispatch_ids, in nanoseconds per lookup.
+ * The lookups go through mgmt_find_handler() if count is 0; otherwise, they
+ * search the first count groups.
+ */
+static double
+bench_dispatch_time(int count, uint32_t lookups)
+{
+    const struct mgmt_handler *handler;
+    uintptr_t acc;
+    uint64_t start;
+    uint64_t best;
+    uint64_t ns;
+    uint16_t id;
+    uint32_t i;
+    int rep;
+
+    best = UINT64_MAX;
+    for (rep = 0; rep < BENCH_MICRO_REPS; rep++) {
+        acc = 0;
+        start = bench_micro_now_ns();
+        for (i = 0; i < lookups; i++) {
+            id = bench_dispatch_ids[i & (BENCH_DISPATCH_NUM_IDS - 1)];
+            if (count != 0) {
+                handler = bench_dispatch_list_find(bench_dispatch_groups,
+                                                   count, id, 0);
+            } else {
+                handler = mgmt_find_handler(id, 0);
+            }
+            acc ^= (uintptr_t)handler;
+        }
+        bench_micro_sink = acc;
+
+        ns = bench_micro_now_ns() - start;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+
+    return (double)best / lookups;
+}
+
+int
+bench_micro_dispatch(const struct bench_micro_cfg *cfg)
+{
+    double index_ns[BENCH_DISPATCH_NUM_COUNTS];
+    double list_ns[BENCH_DISPATCH_NUM_COUNTS];
+    struct mgmt_group *group;
+    uint32_t seed;
+    int registered;
+    int count;
+    int rc;
+    int i;
+    int j;
+
+    rc = 0;
+    registered = 0;
+    seed = 1;
+    for (i = 0; i < BENCH_DISPATCH_NUM_COUNTS && rc == 0; i++) {
+        count = bench_dispatch_counts[i];
+
+        /* Every count has the same mix of system and per-user groups.
+         * Spread the per-user IDs out so that they aren't simply
+         * consecutive.
+         */
+        for (; registered < count; registered++) {
+            group = &bench_dispatch_groups[registered];
+            group->mg_handlers = bench_dispatch_handlers;
+            group->mg_handlers_count = 1;
+            if (registered % 2 == 0) {
+                group->mg_group_id = BENCH_DISPATCH_SYS_ID_MIN +
+                                     registered / 2;
+            } else {
+                group->mg_group_id = MGMT_GROUP_ID_PERUSER + 1 +
+                                     registered / 2 * 3;
+            }
+            mgmt_register_group(group);
+        }
+
+        /* Look the groups up in a random order; each one must be found. */
+        for (j = 0; j < BENCH_DISPATCH_NUM_IDS; j++) {
+            group = &bench_dispatch_groups[bench_micro_rand(&seed) % count];
+            bench_dispatch_ids[j] = group->mg_group_id;
+            if (mgmt_find_handler(group->mg_group_id, 0) !=
+                bench_dispatch_handlers) {
+
+                rc = MGMT_ERR_EUNKNOWN;
+                break;
+            }
+        }
+
+        index_ns[i] = bench_dispatch_time(0, cfg->dispatch_lookups);
+        list_ns[i] = bench_dispatch_time(count, cfg->dispatch_lookups);
+    }
+
+    printf("    {\n");
+    printf("      \"name\": \"dispatch\",\n");
+    printf("      \"rc\": %d,\n", rc);
+    printf("      \"peruser_group_buckets\": %d,\n",
+           MGMT_PERUSER_GROUP_BUCKETS);
+    printf("      \"lookups\": %" PRIu32 ",\n", cfg->dispatch_lookups);
+    printf("      \"points\": [\n");
+    for (j = 0; j < i; j++) {
+        printf("        { \"groups\": %d, \"index_ns\": %.1f, "
+               "\"list_ns\": %.1f }%s\n",
+               bench_dispatch_counts[j], index_ns[j], list_ns[j],
+               j == i - 1 ? "" : ",");
+    }
+    printf("      ]\n");
+    printf("    }");
+
+    return rc;
+}
+
+/**
+ * A handoff queue between a producer thread and a consumer thread that
+ * sleeps when the queue is empty, modelled on the POSIX SMP transport.
+ */
+static struct {
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+
+    /** Whether the ring is used; else, the mutex-protected queue. */
+    bool use_ring;
+
+    /* Mutex-protected queue. */
+    struct mcumgr_buf *queue[MCUMGR_BUF_COUNT];
+    int queue_head;
+    int queue_len;
+
+    /* Lock-free ring. */
+    struct posix_smp_ring ring;
+    atomic_bool waiting;
+
+    /** Buffers handed over and not yet taken. */
+    atomic_int in_flight;
+
+    /** Time at which each buffer was handed over. */
+    uint64_t stamp_ns[MCUMGR_BUF_COUNT];
+
+    uint32_t num_packets;
+    uint64_t *enq_ns;
+    uint64_t *deq_ns;
+    uint64_t *handoff_ns;
+} bench_ring;
+
+static struct mcumgr_buf bench_ring_bufs[MCUMGR_BUF_COUNT];
+
+static void
+bench_ring_put(struct mcumgr_buf *mb)
+{
+    if (!bench_ring.use_ring) {
+        pthread_mutex_lock(&bench_ring.mtx);
+        bench_ring.queue[(bench_ring.queue_head + bench_ring.queue_len) %
+                         MCUMGR_BUF_COUNT] = mb;
+        bench_ring.queue_len++;
+        pthread_cond_broadcast(&bench_ring.cond);
+        pthread_mutex_unlock(&bench_ring.mtx);
+        return;
+    }
+
+    posix_smp_ring_put(&bench_ring.ring, mb);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&bench_ring.waiting)) {
+        pthread_mutex_lock(&bench_ring.mtx);
+        pthread_cond_broadcast(&bench_ring.cond);
+        pthread_mutex_unlock(&bench_ring.mtx);
+    }
+}
+
+/**
+ * Takes the next buffer from the queue.  Only the mutex-protected queue
+ * takes the mutex; the ring is read without it, as the SMP worker reads it.
+ */
+static struct mcumgr_buf *
+bench_ring_get(void)
+{
+    struct mcumgr_buf *mb;
+
+    if (bench_ring.use_ring) {
+        return posix_smp_ring_get(&bench_ring.ring);
+    }
+
+    pthread_mutex_lock(&bench_ring.mtx);
+    if (bench_ring.queue_len == 0) {
+        mb = NULL;
+    } else {
+        mb = bench_ring.queue[bench_ring.queue_head];
+        bench_ring.queue_head =
+            (bench_ring.queue_head + 1) % MCUMGR_BUF_COUNT;
+        bench_ring.queue_len--;
+    }
+    pthread_mutex_unlock(&bench_ring.mtx);
+
+    return mb;
+}
+
+/**
+ * Waits for a buffer to be handed over.  This is the only place the
+ * consumer takes the mutex when the ring is used.
+ */
+static void
+bench_ring_wait(void)
+{
+    pthread_mutex_lock(&bench_ring.mtx);
+    if (!bench_ring.use_ring) {
+        if (bench_ring.queue_len == 0) {
+            pthread_cond_wait(&bench_ring.cond, &bench_ring.mtx);
+        }
+    } else {
+        atomic_store(&bench_ring.waiting, true);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (posix_smp_ring_is_empty(&bench_ring.ring)) {
+            pthread_cond_wait(&bench_ring.cond, &bench_ring.mtx);
+        }
+        atomic_store(&bench_ring.waiting, false);
+    }
+    pthread_mutex_unlock(&bench_ring.mtx);
+}
+
+static void *
+bench_ring_consumer(void *arg)
+{
+    struct mcumgr_buf *mb;
+    uint64_t start;
+    uint64_t end;
+    uint32_t got;
+
+    got = 0;
+    while (got < bench_ring.num_packets) {
+        start = bench_micro_now_ns();
+        mb = bench_ring_get();
+        if (mb == NULL) {
+            bench_ring_wait();
+            continue;
+        }
+        end = bench_micro_now_ns();
+
+        bench_ring.deq_ns[got] = end - start;
+        bench_ring.handoff_ns[got] =
+            end - bench_ring.stamp_ns[mb - bench_ring_bufs];
+        atomic_fetch_sub(&bench_ring.in_flight, 1);
+        got++;
+    }
+
+    return NULL;
+}
+
+/**
+ * Times uncontended put/get pairs, in nanoseconds per pair.
+ */
+static double
+bench_ring_pairs(void)
+{
+    struct mcumgr_buf *mb;
+    uintptr_t acc;
+    uint64_t start;
+    uint64_t best;
+    uint64_t ns;
+    int rep;
+    int i;
+
+    best = UINT64_MAX;
+    for (rep = 0; rep < BENCH_MICRO_REPS; rep++) {
+        acc = 0;
+        start = bench_micro_now_ns();
+        for (i = 0; i < BENCH_RING_PAIRS; i++) {
+            bench_ring_put(&bench_ring_bufs[0]);
+            mb = bench_ring_get();
+            acc ^= (uintptr_t)mb;
+        }
+        bench_micro_sink = acc;
+
+        ns = bench_micro_now_ns() - start;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+
+    return (double)best / BENCH_RING_PAIRS;
+}
+
+static int
+bench_ring_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x;
+    uint64_t y;
+
+    x = *(const uint64_t *)a;
+    y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+bench_ring_print_pctiles(const char *name, uint64_t *samples, uint32_t n,
+                         bool last)
+{
+    qsort(samples, n, sizeof *samples, bench_ring_cmp_u64);
+    printf("\"%s\": { \"p50\": %" PRIu64 ", \"p99\": %" PRIu64 " }%s",
+           name, samples[n / 2], samples[(uint64_t)n * 99 / 100],
+           last ? "" : ", ");
+}
+
+/**
+ * Hands packets over at the configured rate and prints the results for one
+ * queue.
+ */
+static int
+bench_ring_run(const struct bench_micro_cfg *cfg, bool use_ring, bool last)
+{
+    struct timespec ts;
+    struct mcumgr_buf *mb;
+    pthread_t consumer;
+    uint64_t period_ns;
+    uint64_t next_ns;
+    uint64_t start;
+    double pair_ns;
+    uint32_t i;
+    int rc;
+
+    bench_ring.use_ring = use_ring;
+    bench_ring.queue_head = 0;
+    bench_ring.queue_len = 0;
+    posix_smp_ring_init(&bench_ring.ring);
+    atomic_store(&bench_ring.waiting, false);
+    atomic_store(&bench_ring.in_flight, 0);
+
+    pair_ns = bench_ring_pairs();
+
+    rc = pthread_create(&consumer, NULL, bench_ring_consumer, NULL);
+    if (rc != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    period_ns = 1000000000 / cfg->ring_rate;
+    next_ns = bench_micro_now_ns();
+    for (i = 0; i < bench_ring.num_packets; i++) {
+        next_ns += period_ns;
+        ts.tv_sec = next_ns / 1000000000;
+        ts.tv_nsec = next_ns % 1000000000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+        /* Every buffer comes from the pool; wait for one to be returned. */
+        while (atomic_load(&bench_ring.in_flight) >= MCUMGR_BUF_COUNT) {
+            sched_yield();
+        }
+        atomic_fetch_add(&bench_ring.in_flight, 1);
+
+        mb = &bench_ring_bufs[i % MCUMGR_BUF_COUNT];
+        start = bench_micro_now_ns();
+        bench_ring.stamp_ns[mb - bench_ring_bufs] = start;
+        bench_ring_put(mb);
+        bench_ring.enq_ns[i] = bench_micro_now_ns() - start;
+    }
+
+    pthread_join(consumer, NULL);
+
+    printf("        { \"queue\": \"%s\", ", use_ring ? "ring" : "mutex");
+    bench_ring_print_pctiles("enqueue_ns", bench_ring.enq_ns,
+                             bench_ring.num_packets, false);
+    bench_ring_print_pctiles("dequeue_ns", bench_ring.deq_ns,
+                             bench_ring.num_packets, false);
+    bench_ring_print_pctiles("handoff_ns", bench_ring.handoff_ns,
+                             bench_ring.num_packets, false);
+    printf("\"pair_ns\": %.1f }%s\n", pair_ns, last ? "" : ",");
+
+    return 0;
+}
+
+int
+bench_micro_ring(const struct bench_micro_cfg *cfg)
+{
+    int rc;
+
+    bench_ring.num_packets = cfg->ring_packets;
+    bench_ring.enq_ns = calloc(cfg->ring_packets, sizeof (uint64_t));
+    bench_ring.deq_ns = calloc(cfg->ring_packets, sizeof (uint64_t));
+    bench_ring.handoff_ns = calloc(cfg->ring_packets, sizeof (uint64_t));
+    pthread_mutex_init(&bench_ring.mtx, NULL);
+    pthread_cond_init(&bench_ring.cond, NULL);
+
+    printf("    {\n");
+    printf("      \"name\": \"ring\",\n");
+
+    if (cfg->ring_packets == 0 || cfg->ring_rate == 0 ||
+        bench_ring.enq_ns == NULL || bench_ring.deq_ns == NULL ||
+        bench_ring.handoff_ns == NULL) {
+
+        rc = MGMT_ERR_EINVAL;
+    } else {
+        printf("      \"rate_pps\": %" PRIu32 ",\n", cfg->ring_rate);
+        printf("      \"packets\": %" PRIu32 ",\n", cfg->ring_packets);
+        printf("      \"queues\": [\n");
+        rc = bench_ring_run(cfg, false, false);
+        if (rc == 0) {
+            rc = bench_ring_run(cfg, true, true);
+        }
+        printf("      ],\n");
+    }
+
+    printf("      \"rc\": %d\n", rc);
+    printf("    }");
+
+    pthread_cond_destroy(&bench_ring.cond);
+    pthread_mutex_destroy(&bench_ring.mtx);
+    free(bench_ring.enq_ns);
+    free(bench_ring.deq_ns);
+    free(bench_ring.handoff_ns);
+
+    return rc;
+}
@@ -0,0 +1,71 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_BENCH_MICRO_
+#define H_BENCH_MICRO_
+
+#include <stdint.h>
+
+/**
+ * @brief Settings for the microbenchmarks.
+ */
+struct bench_micro_cfg {
+    /** Lookups timed at each group count of the dispatch benchmark. */
+    uint32_t dispatch_lookups;
+
+    /** Packets handed over by each queue of the ring benchmark. */
+    uint32_t ring_packets;
+
+    /** Rate at which the ring benchmark's producer sends, in packets/s. */
+    uint32_t ring_rate;
+};
+
+/**
+ * @brief Measures the cost of looking up a command handler as the number of
+ * registered groups grows from 3 to 100, with the dispatch index and with a
+ * search of the groups in turn.
+ *
+ * The groups are registered at runtime, and remain registered afterwards.
+ * They alternately take unused system group IDs (10-59) and per-user IDs,
+ * which are hashed into MGMT_PERUSER_GROUP_BUCKETS chains.  The
+ * results are printed as a JSON object.
+ *
+ * @param cfg                   The benchmark settings.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int bench_micro_dispatch(const struct bench_micro_cfg *cfg);
+
+/**
+ * @brief Compares handing received packets from a transport thread to the
+ * SMP worker through a mutex-protected queue and through posix_smp_ring.
+ *
+ * The producer sends at a fixed rate; the consumer sleeps on a condition
+ * variable whenever the queue is empty, as the SMP worker does.  Enqueue,
+ * dequeue, and handoff (enqueue to dequeue) times are reported for each
+ * queue, along with the cost of an uncontended put/get pair.  The results are
+ * printed as a JSON object.
+ *
+ * @param cfg                   The benchmark settings.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int bench_micro_ring(const struct bench_micro_cfg *cfg);
+
+#endif
@@ -0,0 +1,583 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * Serial transport test: real console framing over a pseudo-terminal, with
+ * the client on the master side and the POSIX serial transport on the slave.
+ */
+
+/* For posix_openpt(), grantpt(), unlockpt(), and ptsname(). */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "cbor.h"
+#include "cbor_buf_writer.h"
+#include "cborattr/cborattr.h"
+#include "mgmt/mgmt.h"
+#include "os_mgmt/os_mgmt.h"
+#include "img_mgmt/img_mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "posix_smp/posix_smp_serial.h"
+#include "bench_pty.h"
+
+#define BENCH_PTY_BAUD          1000000
+
+/** Characters per second at BENCH_PTY_BAUD; 8N1 takes 10 bits each. */
+#define BENCH_PTY_CPS           (BENCH_PTY_BAUD / 10)
+
+#define BENCH_PTY_NUM_ECHOES    1000
+#define BENCH_PTY_ECHO_LEN      32
+
+/** How long the client waits for a response; a pty doesn't lose data. */
+#define BENCH_PTY_TIMEOUT_MS    5000
+
+static struct posix_smp_serial bench_pty_server;
+
+/** The client, on the master side of the pty. */
+static struct {
+    int fd;
+    struct smp_serial_rx rx;
+    uint8_t rsp[MCUMGR_BUF_SIZE];
+
+    /** Characters written and read. */
+    uint64_t tx_chars;
+    uint64_t rx_chars;
+
+    /** Whether the line is paced to BENCH_PTY_BAUD. */
+    bool paced;
+
+    uint8_t seq;
+} bench_pty_client;
+
+static uint64_t
+bench_pty_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * If the line is paced, waits until the specified number of characters,
+ * starting at the specified time, would have crossed it.
+ */
+static void
+bench_pty_pace(uint64_t start_ns, size_t chars)
+{
+    struct timespec ts;
+    uint64_t due_ns;
+    uint64_t now_ns;
+
+    if (!bench_pty_client.paced) {
+        return;
+    }
+
+    due_ns = start_ns + (uint64_t)chars * 1000000000 / BENCH_PTY_CPS;
+    now_ns = bench_pty_now_ns();
+    if (due_ns > now_ns) {
+        ts.tv_sec = (due_ns - now_ns) / 1000000000;
+        ts.tv_nsec = (due_ns - now_ns) % 1000000000;
+        nanosleep(&ts, NULL);
+    }
+}
+
+/**
+ * Writes one frame to the master.  Called by smp_serial_tx_pkt().
+ */
+static int
+bench_pty_write(const void *data, int len, void *arg)
+{
+    const uint8_t *u8p;
+    uint64_t start_ns;
+    ssize_t rc;
+    int left;
+
+    start_ns = bench_pty_now_ns();
+
+    u8p = data;
+    left = len;
+    while (left > 0) {
+        rc = write(bench_pty_client.fd, u8p, left);
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return -1;
+        }
+
+        u8p += rc;
+        left -= rc;
+    }
+
+    bench_pty_client.tx_chars += len;
+    bench_pty_pace(start_ns, len);
+
+    return 0;
+}
+
+/**
+ * Sends a request and decodes the response from the master.
+ */
+static int
+bench_pty_xchg(const void *req, size_t req_len, size_t *out_rsp_len)
+{
+    uint8_t chunk[512];
+    struct pollfd pfd;
+    uint64_t start_ns;
+    size_t rsp_chars;
+    ssize_t len;
+    int pkt_len;
+    int rc;
+    int i;
+
+    rc = smp_serial_tx_pkt(req, req_len, bench_pty_write, NULL);
+    if (rc != 0) {
+        return rc;
+    }
+
+    smp_serial_rx_set_buf(&bench_pty_client.rx, bench_pty_client.rsp,
+                          sizeof bench_pty_client.rsp);
+
+    pfd = (struct pollfd) {
+        .fd = bench_pty_client.fd,
+        .events = POLLIN,
+    };
+
+    start_ns = bench_pty_now_ns();
+    rsp_chars = 0;
+    while (1) {
+        rc = poll(&pfd, 1, BENCH_PTY_TIMEOUT_MS);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return MGMT_ERR_EUNKNOWN;
+        }
+        if (rc == 0) {
+            return MGMT_ERR_ETIMEOUT;
+        }
+
+        len = read(bench_pty_client.fd, chunk, sizeof chunk);
+        if (len < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return MGMT_ERR_EUNKNOWN;
+        }
+
+        /* Only one request is outstanding, so nothing but the rest of this
+         * response can follow it.
+         */
+        rsp_chars += len;
+        bench_pty_client.rx_chars += len;
+
+        for (i = 0; i < len; i++) {
+            pkt_len = smp_serial_rx_byte(&bench_pty_client.rx, chunk[i]);
+            if (pkt_len > 0) {
+                /* The response takes as long to arrive as its frames
+                 * occupy the line.
+                 */
+                bench_pty_pace(start_ns, rsp_chars);
+                *out_rsp_len = pkt_len;
+                return 0;
+            }
+        }
+    }
+}
+
+/**
+ * Closes a request's body and prepends the SMP header.
+ */
+static int
+bench_pty_finish_req(uint8_t *pkt, struct cbor_buf_writer *writer,
+                     CborEncoder *enc, CborEncoder *map, CborError err,
+                     uint8_t op, uint16_t group, uint8_t id, size_t *out_len)
+{
+    struct mgmt_hdr hdr;
+    size_t body_len;
+
+    err |= cbor_encoder_close_container(enc, map);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    body_len = cbor_buf_writer_buffer_size(writer, pkt + sizeof hdr);
+
+    hdr = (struct mgmt_hdr) {
+        .nh_op = op,
+        .nh_len = body_len,
+        .nh_group = group,
+        .nh_seq = bench_pty_client.seq++,
+        .nh_id = id,
+    };
+    mgmt_hton_hdr(&hdr);
+    memcpy(pkt, &hdr, sizeof hdr);
+
+    *out_len = sizeof hdr + body_len;
+    return 0;
+}
+
+/**
+ * Sends one upload request and checks that the server took the whole chunk.
+ */
+static int
+bench_pty_upload_chunk(const uint8_t *img, size_t img_len, size_t off,
+                       size_t chunk_len)
+{
+    uint8_t req[MCUMGR_BUF_SIZE];
+    struct cbor_buf_writer writer;
+    unsigned long long rsp_off;
+    struct mgmt_hdr hdr;
+    long long int rsp_rc;
+    CborEncoder enc;
+    CborEncoder map;
+    CborError err;
+    size_t req_len;
+    size_t rsp_len;
+    int rc;
+
+    const struct cbor_attr_t rsp_attrs[] = {
+        [0] = {
+            .attribute = "rc",
+            .type = CborAttrIntegerType,
+            .addr.integer = &rsp_rc,
+        },
+        [1] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &rsp_off,
+            .nodefault = true,
+        },
+        [2] = { 0 },
+    };
+
+    cbor_buf_writer_init(&writer, req + sizeof hdr, sizeof req - sizeof hdr);
+    cbor_encoder_cust_writer_init(&enc, &writer.enc, 0);
+    err = cbor_encoder_create_map(&enc, &map, off == 0 ? 3 : 2);
+    err |= cbor_encode_text_stringz(&map, "data");
+    err |= cbor_encode_byte_string(&map, img + off, chunk_len);
+    err |= cbor_encode_text_stringz(&map, "off");
+    err |= cbor_encode_uint(&map, off);
+    if (off == 0) {
+        err |= cbor_encode_text_stringz(&map, "len");
+        err |= cbor_encode_uint(&map, img_len);
+    }
+    rc = bench_pty_finish_req(req, &writer, &enc, &map, err, MGMT_OP_WRITE,
+                              MGMT_GROUP_ID_IMAGE, IMG_MGMT_ID_UPLOAD,
+                              &req_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = bench_pty_xchg(req, req_len, &rsp_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    memcpy(&hdr, bench_pty_client.rsp, sizeof hdr);
+    mgmt_ntoh_hdr(&hdr);
+    if (sizeof hdr + hdr.nh_len > rsp_len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    rsp_off = ULLONG_MAX;
+    rc = cbor_read_flat_attrs(bench_pty_client.rsp + sizeof hdr, hdr.nh_len,
+                              rsp_attrs);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (rsp_rc != 0) {
+        return rsp_rc;
+    }
+
+    /* Nothing gets lost on a pty; every chunk must be taken as sent. */
+    if (rsp_off != off + chunk_len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    return 0;
+}
+
+/**
+ * Uploads the image and reports how long it took.
+ */
+static int
+bench_pty_upload(const uint8_t *img, size_t img_len, uint64_t *out_ns)
+{
+    uint64_t start_ns;
+    size_t chunk_len;
+    size_t off;
+    int rc;
+
+    start_ns = bench_pty_now_ns();
+
+    for (off = 0; off < img_len; off += chunk_len) {
+        chunk_len = img_len - off;
+        if (chunk_len > IMG_MGMT_UL_CHUNK_SIZE) {
+            chunk_len = IMG_MGMT_UL_CHUNK_SIZE;
+        }
+
+        rc = bench_pty_upload_chunk(img, img_len, off, chunk_len);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    *out_ns = bench_pty_now_ns() - start_ns;
+    return 0;
+}
+
+static int
+bench_pty_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x;
+    uint64_t y;
+
+    x = *(const uint64_t *)a;
+    y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Measures echo round trips; the results are sorted.
+ */
+static int
+bench_pty_echo(uint64_t *rtt_ns, int num_echoes)
+{
+    char echo[BENCH_PTY_ECHO_LEN + 1];
+    char rsp_echo[BENCH_PTY_ECHO_LEN + 1];
+    uint8_t req[MCUMGR_BUF_SIZE];
+    struct cbor_buf_writer writer;
+    struct mgmt_hdr hdr;
+    long long int rsp_rc;
+    CborEncoder enc;
+    CborEncoder map;
+    CborError err;
+    uint64_t start_ns;
+    size_t req_len;
+    size_t rsp_len;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t rsp_attrs[] = {
+        [0] = {
+            .attribute = "rc",
+            .type = CborAttrIntegerType,
+            .addr.integer = &rsp_rc,
+        },
+        [1] = {
+            .attribute = "r",
+            .type = CborAttrTextStringType,
+            .addr.string = rsp_echo,
+            .len = sizeof rsp_echo,
+        },
+        [2] = { 0 },
+    };
+
+    for (i = 0; i < BENCH_PTY_ECHO_LEN; i++) {
+        echo[i] = 'a' + i % 26;
+    }
+    echo[i] = '\0';
+
+    for (i = 0; i < num_echoes; i++) {
+        cbor_buf_writer_init(&writer, req + sizeof hdr,
+                             sizeof req - sizeof hdr);
+        cbor_encoder_cust_writer_init(&enc, &writer.enc, 0);
+        err = cbor_encoder_create_map(&enc, &map, 1);
+        err |= cbor_encode_text_stringz(&map, "d");
+        err |= cbor_encode_text_stringz(&map, echo);
+        rc = bench_pty_finish_req(req, &writer, &enc, &map, err,
+                                  MGMT_OP_WRITE, MGMT_GROUP_ID_OS,
+                                  OS_MGMT_ID_ECHO, &req_len);
+        if (rc != 0) {
+            return rc;
+        }
+
+        start_ns = bench_pty_now_ns();
+        rc = bench_pty_xchg(req, req_len, &rsp_len);
+        if (rc != 0) {
+            return rc;
+        }
+        rtt_ns[i] = bench_pty_now_ns() - start_ns;
+
+        memcpy(&hdr, bench_pty_client.rsp, sizeof hdr);
+        mgmt_ntoh_hdr(&hdr);
+        if (sizeof hdr + hdr.nh_len > rsp_len) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        rsp_echo[0] = '\0';
+        rc = cbor_read_flat_attrs(bench_pty_client.rsp + sizeof hdr,
+                                  hdr.nh_len, rsp_attrs);
+        if (rc != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+        if (rsp_rc != 0) {
+            return rsp_rc;
+        }
+        if (strcmp(rsp_echo, echo) != 0) {
+            return MGMT_ERR_EUNKNOWN;
+        }
+    }
+
+    qsort(rtt_ns, num_echoes, sizeof *rtt_ns, bench_pty_cmp_u64);
+    return 0;
+}
+
+/**
+ * Opens a pty and starts the serial transport on its slave side.
+ */
+static int
+bench_pty_open(void)
+{
+    struct termios tio;
+    const char *name;
+    int rc;
+
+    bench_pty_client.fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (bench_pty_client.fd < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    if (grantpt(bench_pty_client.fd) != 0 ||
+        unlockpt(bench_pty_client.fd) != 0 ||
+        tcgetattr(bench_pty_client.fd, &tio) != 0) {
+
+        rc = MGMT_ERR_EUNKNOWN;
+        goto err;
+    }
+
+    cfmakeraw(&tio);
+    if (tcsetattr(bench_pty_client.fd, TCSANOW, &tio) != 0) {
+        rc = MGMT_ERR_EUNKNOWN;
+        goto err;
+    }
+
+    name = ptsname(bench_pty_client.fd);
+    if (name == NULL) {
+        rc = MGMT_ERR_EUNKNOWN;
+        goto err;
+    }
+
+    rc = posix_smp_serial_init(&bench_pty_server, name, BENCH_PTY_BAUD);
+    if (rc != 0) {
+        goto err;
+    }
+
+    smp_serial_rx_init(&bench_pty_client.rx);
+    return 0;
+
+err:
+    close(bench_pty_client.fd);
+    return rc;
+}
+
+int
+bench_pty(const uint8_t *img, size_t img_len)
+{
+    const struct smp_serial_rx_stats *cs;
+    const struct smp_serial_rx_stats *ss;
+    uint64_t rtt_ns[BENCH_PTY_NUM_ECHOES];
+    uint64_t unpaced_ns;
+    uint64_t paced_ns;
+    uint64_t wire_chars;
+    uint32_t crc_errs;
+    uint32_t frame_errs;
+    uint32_t overflows;
+    bool opened;
+    int rc;
+
+    unpaced_ns = 0;
+    paced_ns = 0;
+    wire_chars = 0;
+    crc_errs = 0;
+    frame_errs = 0;
+    overflows = 0;
+    opened = false;
+    memset(rtt_ns, 0, sizeof rtt_ns);
+
+    bench_pty_client.tx_chars = 0;
+    bench_pty_client.rx_chars = 0;
+    bench_pty_client.paced = false;
+
+    rc = img != NULL ? bench_pty_open() : MGMT_ERR_ENOMEM;
+    if (rc == 0) {
+        opened = true;
+        rc = bench_pty_upload(img, img_len, &unpaced_ns);
+    }
+    if (rc == 0) {
+        /* Both uploads put the same characters on the line. */
+        wire_chars = bench_pty_client.tx_chars + bench_pty_client.rx_chars;
+
+        bench_pty_client.paced = true;
+        rc = bench_pty_upload(img, img_len, &paced_ns);
+        bench_pty_client.paced = false;
+    }
+    if (rc == 0) {
+        rc = bench_pty_echo(rtt_ns, BENCH_PTY_NUM_ECHOES);
+    }
+
+    if (opened) {
+        posix_smp_serial_stop(&bench_pty_server);
+        close(bench_pty_client.fd);
+
+        cs = &bench_pty_client.rx.ssr_stats;
+        ss = &bench_pty_server.pss_rx.ssr_stats;
+        crc_errs = cs->crc_errs + ss->crc_errs;
+        frame_errs = cs->frame_errs + ss->frame_errs;
+        overflows = cs->overflows + ss->overflows;
+        if (rc == 0 && crc_errs + frame_errs + overflows != 0) {
+            rc = MGMT_ERR_EUNKNOWN;
+        }
+    }
+
+    printf("    {\n");
+    printf("      \"name\": \"pty\",\n");
+    printf("      \"rc\": %d,\n", rc);
+    printf("      \"baud\": %d,\n", BENCH_PTY_BAUD);
+    printf("      \"image_bytes\": %zu,\n", img_len);
+    printf("      \"chunk_bytes\": %d,\n", IMG_MGMT_UL_CHUNK_SIZE);
+    printf("      \"wire_chars\": %" PRIu64 ",\n", wire_chars);
+    printf("      \"wire_chars_per_byte\": %.2f,\n",
+           img_len > 0 ? (double)wire_chars / img_len : 0);
+    printf("      \"unpaced_Bps\": %.0f,\n",
+           unpaced_ns > 0 ? img_len * 1e9 / unpaced_ns : 0);
+    printf("      \"paced_Bps\": %.0f,\n",
+           paced_ns > 0 ? img_len * 1e9 / paced_ns : 0);
+    printf("      \"echo_rtt_us\": { \"p50\": %.1f, \"p99\": %.1f },\n",
+           rtt_ns[BENCH_PTY_NUM_ECHOES / 2 - 1] / 1000.0,
+           rtt_ns[BENCH_PTY_NUM_ECHOES * 99 / 100 - 1] / 1000.0);
+    printf("      \"serial_errs\": { \"crc\": %" PRIu32 ", "
+           "\"frame\": %" PRIu32 ", \"overflow\": %" PRIu32 " }\n",
+           crc_errs, frame_errs, overflows);
+    printf("    }");
+
+    return rc;
+}
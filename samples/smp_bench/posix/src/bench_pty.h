@@ -0,0 +1,49 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_BENCH_PTY_
+#define H_BENCH_PTY_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * @brief Uploads an image over the serial transport, through a
+ *        pseudo-terminal.
+ *
+ * The server side of the serial transport opens the pty's slave at 1 Mbaud,
+ * as the smp_svr sample does for a tty.  The client writes and reads
+ * console-framed packets on the master.  The image is uploaded twice: once
+ * as fast as the pty allows, and once with the client's output paced to
+ * 1 Mbaud (100,000 characters per second, 8N1).  Each upload must complete
+ * with rc 0, which includes the server's hash check when
+ * IMG_MGMT_UL_VERIFY is enabled.  An echo ping-pong then measures the round
+ * trip time over the pty.
+ *
+ * The results, including the characters on the wire per image byte and the
+ * decoder's error counters, are printed as a JSON object.
+ *
+ * @param img                   The image to upload, TLVs included.
+ * @param img_len               The length of the image, in bytes.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int bench_pty(const uint8_t *img, size_t img_len);
+
+#endif
@@ -0,0 +1,897 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * Tests of SMP packet handling.  Unlike the workloads, these send several
+ * requests in one packet and check every response packet that comes back.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cbor.h"
+#include "cbor_buf_writer.h"
+#include "cborattr/cborattr.h"
+#include "mgmt/mgmt.h"
+#include "os_mgmt/os_mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "posix_smp/posix_smp.h"
+#include "posix_smp/posix_smp_loopback.h"
+#include "bench_smp.h"
+
+#define BENCH_SMP_MAX_PKTS      16
+#define BENCH_SMP_MAX_RSPS      16
+#define BENCH_SMP_STR_MAX       32
+
+/** An OS command ID that no handler implements. */
+#define BENCH_SMP_BAD_ID        200
+
+/** A response packet as it was sent by the server. */
+struct bench_smp_pkt {
+    uint8_t data[MCUMGR_BUF_SIZE];
+    size_t len;
+};
+
+/** A single response, decoded from a response packet. */
+struct bench_smp_rsp {
+    /** Response header (host-byte order). */
+    struct mgmt_hdr hdr;
+
+    /** Index of the packet that carried the response. */
+    int pkt;
+
+    long long int rc;
+    char r[BENCH_SMP_STR_MAX];
+};
+
+/** A packet of requests being built. */
+struct bench_smp_req {
+    uint8_t data[MCUMGR_BUF_SIZE];
+    size_t len;
+
+    /** Sequence numbers of the requests in the packet. */
+    uint8_t seqs[BENCH_SMP_MAX_RSPS];
+    int num_reqs;
+};
+
+static struct {
+    struct posix_smp_loopback psl;
+    struct bench_smp_pkt pkts[BENCH_SMP_MAX_PKTS];
+    int num_pkts;
+    bool overflow;
+    uint8_t seq;
+} bench_smp;
+
+/**
+ * Records a response packet.  Called in the loopback transport's thread.
+ */
+static void
+bench_smp_rsp_cb(const void *data, size_t len, void *arg)
+{
+    struct bench_smp_pkt *pkt;
+
+    if (bench_smp.num_pkts >= BENCH_SMP_MAX_PKTS ||
+        len > sizeof bench_smp.pkts[0].data) {
+
+        bench_smp.overflow = true;
+        return;
+    }
+
+    pkt = &bench_smp.pkts[bench_smp.num_pkts++];
+    memcpy(pkt->data, data, len);
+    pkt->len = len;
+}
+
+/**
+ * Appends a request to a packet, padded to a 4-byte boundary.  If echo is not
+ * NULL, the request body is {"d": echo}; otherwise, it is an empty map.
+ */
+static int
+bench_smp_add_req(struct bench_smp_req *req, uint8_t op, uint16_t group,
+                  uint8_t id, const char *echo)
+{
+    struct cbor_buf_writer writer;
+    struct mgmt_hdr hdr;
+    CborEncoder enc;
+    CborEncoder map;
+    CborError err;
+    size_t body_len;
+    uint8_t *body;
+
+    while (req->len % 4 != 0) {
+        req->data[req->len++] = 0;
+    }
+
+    if (req->num_reqs >= BENCH_SMP_MAX_RSPS ||
+        req->len + sizeof hdr > sizeof req->data) {
+
+        return MGMT_ERR_ENOMEM;
+    }
+
+    body = req->data + req->len + sizeof hdr;
+    cbor_buf_writer_init(&writer, body,
+                         sizeof req->data - req->len - sizeof hdr);
+    cbor_encoder_cust_writer_init(&enc, &writer.enc, 0);
+    err = cbor_encoder_create_map(&enc, &map, echo != NULL ? 1 : 0);
+    if (echo != NULL) {
+        err |= cbor_encode_text_stringz(&map, "d");
+        err |= cbor_encode_text_stringz(&map, echo);
+    }
+    err |= cbor_encoder_close_container(&enc, &map);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+    body_len = cbor_buf_writer_buffer_size(&writer, body);
+
+    hdr = (struct mgmt_hdr) {
+        .nh_op = op,
+        .nh_len = body_len,
+        .nh_group = group,
+        .nh_seq = bench_smp.seq,
+        .nh_id = id,
+    };
+    mgmt_hton_hdr(&hdr);
+    memcpy(req->data + req->len, &hdr, sizeof hdr);
+
+    req->len += sizeof hdr + body_len;
+    req->seqs[req->num_reqs++] = bench_smp.seq++;
+
+    return 0;
+}
+
+/**
+ * Splits the recorded response packets into individual responses.
+ */
+static int
+bench_smp_parse(struct bench_smp_rsp *rsps, int max_rsps, int *out_num_rsps)
+{
+    const struct bench_smp_pkt *pkt;
+    struct bench_smp_rsp *rsp;
+    long long int rsp_rc;
+    char rsp_r[BENCH_SMP_STR_MAX];
+    size_t off;
+    int num_rsps;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t attrs[] = {
+        [0] = {
+            .attribute = "rc",
+            .type = CborAttrIntegerType,
+            .addr.integer = &rsp_rc,
+        },
+        [1] = {
+            .attribute = "r",
+            .type = CborAttrTextStringType,
+            .addr.string = rsp_r,
+            .len = sizeof rsp_r,
+        },
+        [2] = { 0 },
+    };
+
+    num_rsps = 0;
+    for (i = 0; i < bench_smp.num_pkts; i++) {
+        pkt = &bench_smp.pkts[i];
+
+        off = 0;
+        while (off < pkt->len) {
+            if (num_rsps >= max_rsps || off + MGMT_HDR_SIZE > pkt->len) {
+                return MGMT_ERR_EINVAL;
+            }
+
+            rsp = &rsps[num_rsps++];
+            memcpy(&rsp->hdr, pkt->data + off, sizeof rsp->hdr);
+            mgmt_ntoh_hdr(&rsp->hdr);
+            rsp->pkt = i;
+            off += MGMT_HDR_SIZE;
+
+            if (off + rsp->hdr.nh_len > pkt->len) {
+                return MGMT_ERR_EINVAL;
+            }
+
+            rsp_r[0] = '\0';
+            rc = cbor_read_flat_attrs(pkt->data + off, rsp->hdr.nh_len, attrs);
+            if (rc != 0) {
+                return MGMT_ERR_EINVAL;
+            }
+            rsp->rc = rsp_rc;
+            strcpy(rsp->r, rsp_r);
+
+            /* Coalesced responses are padded like packed requests. */
+            off += rsp->hdr.nh_len;
+            off = (off + 3) & ~(size_t)3;
+        }
+    }
+
+    *out_num_rsps = num_rsps;
+    return 0;
+}
+
+/**
+ * Sends a request packet, waits for the server to finish with it, and decodes
+ * the responses.  The number of buffers allocated in the meantime, including
+ * the one that carries the request, is reported.
+ */
+static int
+bench_smp_xchg(const struct bench_smp_req *req, struct bench_smp_rsp *rsps,
+               int max_rsps, int *out_num_rsps, uint32_t *out_allocs)
+{
+    struct mcumgr_buf_stats start;
+    struct mcumgr_buf_stats end;
+    int rc;
+
+    bench_smp.num_pkts = 0;
+    bench_smp.overflow = false;
+
+    mcumgr_buf_get_stats(&start);
+    rc = posix_smp_loopback_send(&bench_smp.psl, req->data, req->len);
+    if (rc != 0) {
+        return rc;
+    }
+    posix_smp_transport_flush(&bench_smp.psl.psl_transport);
+    mcumgr_buf_get_stats(&end);
+
+    *out_allocs = end.allocs - start.allocs;
+
+    if (bench_smp.overflow) {
+        return MGMT_ERR_EMSGSIZE;
+    }
+
+    return bench_smp_parse(rsps, max_rsps, out_num_rsps);
+}
+
+static const struct {
+    const char *name;
+
+    /** Largest response packet the transport sends. */
+    uint16_t mtu;
+
+    bool coalesce;
+
+    /** Index of the unsupported request; -1 for none. */
+    int bad_idx;
+
+    int exp_pkts;
+    int exp_rsps;
+} bench_coalesce_cases[] = {
+    { "separate",   256,    false,  -1, 3, 3 },
+    { "packed",     256,    true,   -1, 1, 3 },
+    { "split",      48,     true,   -1, 2, 3 },
+    { "error",      256,    true,   1,  2, 2 },
+};
+
+#define BENCH_COALESCE_NUM_CASES \
+    (sizeof bench_coalesce_cases / sizeof bench_coalesce_cases[0])
+
+/** Echo strings; each response is 23 bytes, so 48 bytes only fit two. */
+static const char * const bench_coalesce_echoes[] = {
+    "aaaaaaaaaa", "bbbbbbbbbb", "cccccccccc",
+};
+
+#define BENCH_COALESCE_NUM_REQS \
+    (sizeof bench_coalesce_echoes / sizeof bench_coalesce_echoes[0])
+
+/**
+ * Runs one case of the coalescing test and prints its results.
+ */
+static int
+bench_coalesce_case(int idx, bool last)
+{
+    struct bench_smp_rsp rsps[BENCH_SMP_MAX_RSPS];
+    struct bench_smp_req req;
+    smp_rsp_max_fn *rsp_max_cb;
+    uint32_t allocs;
+    int num_rsps;
+    int rc;
+    int i;
+
+    num_rsps = 0;
+    allocs = 0;
+    bench_smp.num_pkts = 0;
+
+    rc = posix_smp_loopback_init(&bench_smp.psl,
+                                 bench_coalesce_cases[idx].mtu,
+                                 bench_smp_rsp_cb, NULL);
+    if (rc != 0) {
+        goto done;
+    }
+
+    /* The transport thread is idle until a request arrives. */
+    rsp_max_cb = bench_smp.psl.psl_transport.pst_streamer.rsp_max_cb;
+    if (!bench_coalesce_cases[idx].coalesce) {
+        bench_smp.psl.psl_transport.pst_streamer.rsp_max_cb = NULL;
+    } else if (rsp_max_cb == NULL) {
+        rc = MGMT_ERR_ENOTSUP;
+        goto stop;
+    }
+
+    memset(&req, 0, sizeof req);
+    for (i = 0; i < BENCH_COALESCE_NUM_REQS && rc == 0; i++) {
+        if (i == bench_coalesce_cases[idx].bad_idx) {
+            rc = bench_smp_add_req(&req, MGMT_OP_READ, MGMT_GROUP_ID_OS,
+                                   BENCH_SMP_BAD_ID, NULL);
+        } else {
+            rc = bench_smp_add_req(&req, MGMT_OP_WRITE, MGMT_GROUP_ID_OS,
+                                   OS_MGMT_ID_ECHO, bench_coalesce_echoes[i]);
+        }
+    }
+    if (rc != 0) {
+        goto stop;
+    }
+
+    rc = bench_smp_xchg(&req, rsps, BENCH_SMP_MAX_RSPS, &num_rsps, &allocs);
+    if (rc != 0) {
+        goto stop;
+    }
+
+    if (bench_smp.num_pkts != bench_coalesce_cases[idx].exp_pkts ||
+        num_rsps != bench_coalesce_cases[idx].exp_rsps) {
+
+        rc = MGMT_ERR_EUNKNOWN;
+        goto stop;
+    }
+
+    /* Responses must arrive in request order, each with the right contents;
+     * only the unsupported request gets an error.
+     */
+    for (i = 0; i < num_rsps; i++) {
+        if (rsps[i].hdr.nh_seq != req.seqs[i] ||
+            (i > 0 && rsps[i].pkt < rsps[i - 1].pkt)) {
+
+            rc = MGMT_ERR_EUNKNOWN;
+        } else if (i == bench_coalesce_cases[idx].bad_idx) {
+            if (rsps[i].rc != MGMT_ERR_ENOTSUP) {
+                rc = MGMT_ERR_EUNKNOWN;
+            }
+        } else if (rsps[i].rc != 0 ||
+                   strcmp(rsps[i].r, bench_coalesce_echoes[i]) != 0) {
+
+            rc = MGMT_ERR_EUNKNOWN;
+        }
+    }
+
+stop:
+    bench_smp.psl.psl_transport.pst_streamer.rsp_max_cb = rsp_max_cb;
+    posix_smp_transport_stop(&bench_smp.psl.psl_transport);
+
+done:
+    printf("        { \"case\": \"%s\", \"rc\": %d, \"mtu\": %d, "
+           "\"requests\": %d, \"responses\": %d, \"packets\": %d, "
+           "\"allocs\": %" PRIu32 " }%s\n",
+           bench_coalesce_cases[idx].name, rc, bench_coalesce_cases[idx].mtu,
+           (int)BENCH_COALESCE_NUM_REQS, num_rsps, bench_smp.num_pkts, allocs,
+           last ? "" : ",");
+
+    return rc;
+}
+
+int
+bench_smp_coalesce(void)
+{
+    int case_rc;
+    int rc;
+    int i;
+
+    printf("    {\n");
+    printf("      \"name\": \"coalesce\",\n");
+    printf("      \"cases\": [\n");
+
+    rc = 0;
+    for (i = 0; i < BENCH_COALESCE_NUM_CASES; i++) {
+        case_rc = bench_coalesce_case(i, i == BENCH_COALESCE_NUM_CASES - 1);
+        if (rc == 0) {
+            rc = case_rc;
+        }
+    }
+
+    printf("      ],\n");
+    printf("      \"rc\": %d\n", rc);
+    printf("    }");
+
+    return rc;
+}
+
+/** Command IDs of the deferring test group. */
+#define BENCH_DEFER_ID_LATER    0   /* Completes later via a finish cb. */
+#define BENCH_DEFER_ID_FAIL     1   /* Completes later with an error. */
+#define BENCH_DEFER_ID_MIND     2   /* Defers, then responds right away. */
+
+/** How long a deferred request waits before it gets completed. */
+#define BENCH_DEFER_DELAY_NS    1000000
+
+static struct {
+    /** The retained context and status of the request being completed. */
+    struct mgmt_ctxt *ctxt;
+    int status;
+
+    /** The thread that invoked the most recent handler. */
+    pthread_t handler_thread;
+
+    /** Whether every finish callback ran in the handler's thread. */
+    bool finish_ok;
+} bench_defer;
+
+/**
+ * Completes the deferred request from a thread other than the transport's,
+ * after a delay.
+ */
+static void *
+bench_defer_completer(void *arg)
+{
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = BENCH_DEFER_DELAY_NS;
+    nanosleep(&ts, NULL);
+
+    mgmt_ctxt_complete(bench_defer.ctxt, bench_defer.status);
+
+    return NULL;
+}
+
+static int
+bench_defer_finish(struct mgmt_ctxt *ctxt, int status)
+{
+    CborError err;
+
+    if (!pthread_equal(pthread_self(), bench_defer.handler_thread)) {
+        bench_defer.finish_ok = false;
+    }
+    if (status != 0) {
+        return status;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "r");
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "later");
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Defers the request being handled and starts a thread that completes it.
+ */
+static int
+bench_defer_start(struct mgmt_ctxt *ctxt, mgmt_finish_fn *finish, int status)
+{
+    pthread_t thread;
+    int rc;
+
+    bench_defer.handler_thread = pthread_self();
+    bench_defer.ctxt = mgmt_ctxt_defer(ctxt);
+    if (bench_defer.ctxt == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+    bench_defer.ctxt->finish = finish;
+    bench_defer.status = status;
+
+    rc = pthread_create(&thread, NULL, bench_defer_completer, NULL);
+    if (rc != 0) {
+        /* Respond right away instead. */
+        return MGMT_ERR_ENOMEM;
+    }
+    pthread_detach(thread);
+
+    return MGMT_DEFERRED;
+}
+
+static int
+bench_defer_later(struct mgmt_ctxt *ctxt)
+{
+    return bench_defer_start(ctxt, bench_defer_finish, 0);
+}
+
+static int
+bench_defer_fail(struct mgmt_ctxt *ctxt)
+{
+    return bench_defer_start(ctxt, NULL, MGMT_ERR_ENOENT);
+}
+
+static int
+bench_defer_mind(struct mgmt_ctxt *ctxt)
+{
+    CborError err;
+
+    if (mgmt_ctxt_defer(ctxt) == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    /* The original context remains usable. */
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "r");
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "mind");
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+static const struct mgmt_handler bench_defer_handlers[] = {
+    [BENCH_DEFER_ID_LATER] = { NULL, bench_defer_later },
+    [BENCH_DEFER_ID_FAIL] = { NULL, bench_defer_fail },
+    [BENCH_DEFER_ID_MIND] = { NULL, bench_defer_mind },
+};
+
+static MGMT_GROUP_DEFINE(bench_defer_group, MGMT_GROUP_ID_PERUSER,
+                         bench_defer_handlers);
+
+/** An echo request; any other value is a deferring group command ID. */
+#define BENCH_DEFER_ECHO        (-1)
+
+#define BENCH_DEFER_MAX_REQS    3
+
+static const struct {
+    const char *name;
+    int reqs[BENCH_DEFER_MAX_REQS];
+    int num_reqs;
+
+    /** Expected rc and "r" of each response; fewer if one fails. */
+    int exp_rc[BENCH_DEFER_MAX_REQS];
+    const char *exp_r[BENCH_DEFER_MAX_REQS];
+    int exp_rsps;
+} bench_defer_cases[] = {
+    {
+        /* The echo is processed once the deferred request completes. */
+        "resume",
+        { BENCH_DEFER_ID_LATER, BENCH_DEFER_ECHO }, 2,
+        { 0, 0 }, { "later", "echo" }, 2,
+    },
+    {
+        /* A handler that changes its mind leaves nothing deferred, so the
+         * next handler can defer.
+         */
+        "mind",
+        { BENCH_DEFER_ID_MIND, BENCH_DEFER_ID_LATER }, 2,
+        { 0, 0 }, { "mind", "later" }, 2,
+    },
+    {
+        /* The error aborts the rest of the packet. */
+        "error",
+        { BENCH_DEFER_ECHO, BENCH_DEFER_ID_FAIL, BENCH_DEFER_ECHO }, 3,
+        { 0, MGMT_ERR_ENOENT }, { "echo", "" }, 2,
+    },
+};
+
+#define BENCH_DEFER_NUM_CASES \
+    (sizeof bench_defer_cases / sizeof bench_defer_cases[0])
+
+/**
+ * Runs one case of the deferral test and prints its results.
+ */
+static int
+bench_defer_case(int idx, bool last)
+{
+    struct bench_smp_rsp rsps[BENCH_SMP_MAX_RSPS];
+    struct bench_smp_req req;
+    uint32_t allocs;
+    int num_free;
+    int leaked;
+    int num_rsps;
+    int rc;
+    int i;
+
+    num_rsps = 0;
+    allocs = 0;
+    leaked = 0;
+    bench_defer.finish_ok = true;
+
+    rc = posix_smp_loopback_init(&bench_smp.psl, MCUMGR_BUF_SIZE,
+                                 bench_smp_rsp_cb, NULL);
+    if (rc != 0) {
+        goto done;
+    }
+
+    memset(&req, 0, sizeof req);
+    for (i = 0; i < bench_defer_cases[idx].num_reqs && rc == 0; i++) {
+        if (bench_defer_cases[idx].reqs[i] == BENCH_DEFER_ECHO) {
+            rc = bench_smp_add_req(&req, MGMT_OP_WRITE, MGMT_GROUP_ID_OS,
+                                   OS_MGMT_ID_ECHO, "echo");
+        } else {
+            rc = bench_smp_add_req(&req, MGMT_OP_WRITE, MGMT_GROUP_ID_PERUSER,
+                                   bench_defer_cases[idx].reqs[i], NULL);
+        }
+    }
+    if (rc != 0) {
+        goto stop;
+    }
+
+    num_free = mcumgr_buf_num_free();
+    rc = bench_smp_xchg(&req, rsps, BENCH_SMP_MAX_RSPS, &num_rsps, &allocs);
+    leaked = num_free - mcumgr_buf_num_free();
+    if (rc != 0) {
+        goto stop;
+    }
+
+    /* Every buffer, including the retained request and response, must have
+     * been returned to the pool.
+     */
+    if (num_rsps != bench_defer_cases[idx].exp_rsps || leaked != 0 ||
+        !bench_defer.finish_ok) {
+
+        rc = MGMT_ERR_EUNKNOWN;
+        goto stop;
+    }
+
+    for (i = 0; i < num_rsps; i++) {
+        if (rsps[i].hdr.nh_seq != req.seqs[i] ||
+            rsps[i].rc != bench_defer_cases[idx].exp_rc[i] ||
+            strcmp(rsps[i].r, bench_defer_cases[idx].exp_r[i]) != 0) {
+
+            rc = MGMT_ERR_EUNKNOWN;
+        }
+    }
+
+stop:
+    posix_smp_transport_stop(&bench_smp.psl.psl_transport);
+
+done:
+    printf("        { \"case\": \"%s\", \"rc\": %d, \"requests\": %d, "
+           "\"responses\": %d, \"allocs\": %" PRIu32 ", "
+           "\"leaked\": %d }%s\n",
+           bench_defer_cases[idx].name, rc, bench_defer_cases[idx].num_reqs,
+           num_rsps, allocs, leaked, last ? "" : ",");
+
+    return rc;
+}
+
+int
+bench_smp_defer(void)
+{
+    int case_rc;
+    int rc;
+    int i;
+
+    printf("    {\n");
+    printf("      \"name\": \"defer\",\n");
+    printf("      \"cases\": [\n");
+
+    rc = 0;
+    for (i = 0; i < BENCH_DEFER_NUM_CASES; i++) {
+        case_rc = bench_defer_case(i, i == BENCH_DEFER_NUM_CASES - 1);
+        if (rc == 0) {
+            rc = case_rc;
+        }
+    }
+
+    printf("      ],\n");
+    printf("      \"rc\": %d\n", rc);
+    printf("    }");
+
+    return rc;
+}
+
+/**
+ * The caching test group's ID.  Groups defined here are registered for the
+ * whole run, so this must stay clear of the per-user IDs that the dispatch
+ * test registers (PERUSER + 1, + 4, + 7, ...).
+ */
+#define BENCH_CACHE_GROUP_ID    (MGMT_GROUP_ID_PERUSER + 2)
+
+/** Command IDs of the caching test group. */
+#define BENCH_CACHE_ID_COUNT    0   /* Counts calls; replayable. */
+#define BENCH_CACHE_ID_BUMP     1   /* Changes state; not replayable. */
+
+/** Cache lifetime used by the "expire" case. */
+#define BENCH_CACHE_TIMEOUT_MS  20
+
+/** Number of times the counting handler has run. */
+static int bench_cache_calls;
+
+static int
+bench_cache_count(struct mgmt_ctxt *ctxt)
+{
+    char buf[16];
+    CborError err;
+
+    bench_cache_calls++;
+    snprintf(buf, sizeof buf, "%d", bench_cache_calls);
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "r");
+    err |= cbor_encode_text_stringz(&ctxt->encoder, buf);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    ctxt->replayable = true;
+    return 0;
+}
+
+static int
+bench_cache_bump(struct mgmt_ctxt *ctxt)
+{
+    return 0;
+}
+
+static const struct mgmt_handler bench_cache_handlers[] = {
+    [BENCH_CACHE_ID_COUNT] = { NULL, bench_cache_count },
+    [BENCH_CACHE_ID_BUMP] = { NULL, bench_cache_bump },
+};
+
+static MGMT_GROUP_DEFINE(bench_cache_group, BENCH_CACHE_GROUP_ID,
+                         bench_cache_handlers);
+
+static const struct {
+    const char *name;
+
+    /** Whether a state-changing request is sent before the retransmit. */
+    bool bump;
+
+    /** Whether an echo, which changes no state, is sent before it. */
+    bool echo;
+
+    /** Whether the retransmit is sent after the cached response expires. */
+    bool expire;
+
+    /** Expected number of times the counting handler runs. */
+    int exp_calls;
+} bench_cache_cases[] = {
+    { "replay",     false,  false,  false,  1 },
+    { "invalidate", true,   false,  false,  2 },
+    { "echo",       false,  true,   false,  1 },
+    { "expire",     false,  false,  true,   2 },
+};
+
+#define BENCH_CACHE_NUM_CASES \
+    (sizeof bench_cache_cases / sizeof bench_cache_cases[0])
+
+/**
+ * Runs one case of the caching test and prints its results.
+ */
+static int
+bench_cache_case(int idx, bool last)
+{
+    struct bench_smp_rsp rsps[BENCH_SMP_MAX_RSPS];
+    struct bench_smp_req bump;
+    struct bench_smp_req echo;
+    struct bench_smp_req req;
+    struct timespec ts;
+    char first_r[BENCH_SMP_STR_MAX];
+    uint32_t allocs;
+    int num_rsps;
+    int rc;
+
+    bench_cache_calls = 0;
+    first_r[0] = '\0';
+
+    rc = posix_smp_loopback_init(&bench_smp.psl, MCUMGR_BUF_SIZE,
+                                 bench_smp_rsp_cb, NULL);
+    if (rc != 0) {
+        goto done;
+    }
+
+#if POSIX_SMP_RSP_CACHE_COUNT > 0
+    if (bench_cache_cases[idx].expire) {
+        /* The transport thread is idle until a request arrives. */
+        bench_smp.psl.psl_transport.pst_rsp_cache.src_timeout_ms =
+            BENCH_CACHE_TIMEOUT_MS;
+    }
+#else
+    rc = MGMT_ERR_ENOTSUP;
+    goto stop;
+#endif
+
+    memset(&req, 0, sizeof req);
+    memset(&bump, 0, sizeof bump);
+    memset(&echo, 0, sizeof echo);
+    rc = bench_smp_add_req(&req, MGMT_OP_WRITE, BENCH_CACHE_GROUP_ID,
+                           BENCH_CACHE_ID_COUNT, NULL);
+    if (rc == 0) {
+        rc = bench_smp_add_req(&bump, MGMT_OP_WRITE, BENCH_CACHE_GROUP_ID,
+                               BENCH_CACHE_ID_BUMP, NULL);
+    }
+    if (rc == 0) {
+        rc = bench_smp_add_req(&echo, MGMT_OP_WRITE, MGMT_GROUP_ID_OS,
+                               OS_MGMT_ID_ECHO, "echo");
+    }
+    if (rc != 0) {
+        goto stop;
+    }
+
+    rc = bench_smp_xchg(&req, rsps, BENCH_SMP_MAX_RSPS, &num_rsps, &allocs);
+    if (rc != 0) {
+        goto stop;
+    }
+    if (num_rsps != 1 || rsps[0].rc != 0) {
+        rc = MGMT_ERR_EUNKNOWN;
+        goto stop;
+    }
+    strcpy(first_r, rsps[0].r);
+
+    if (bench_cache_cases[idx].bump) {
+        rc = bench_smp_xchg(&bump, rsps, BENCH_SMP_MAX_RSPS, &num_rsps,
+                            &allocs);
+        if (rc != 0) {
+            goto stop;
+        }
+    }
+    if (bench_cache_cases[idx].echo) {
+        rc = bench_smp_xchg(&echo, rsps, BENCH_SMP_MAX_RSPS, &num_rsps,
+                            &allocs);
+        if (rc != 0) {
+            goto stop;
+        }
+    }
+    if (bench_cache_cases[idx].expire) {
+        ts.tv_sec = 0;
+        ts.tv_nsec = BENCH_CACHE_TIMEOUT_MS * 2 * 1000000L;
+        nanosleep(&ts, NULL);
+    }
+
+    /* Retransmit the first request, sequence number and all. */
+    rc = bench_smp_xchg(&req, rsps, BENCH_SMP_MAX_RSPS, &num_rsps, &allocs);
+    if (rc != 0) {
+        goto stop;
+    }
+
+    /* A replayed response is identical to the original; a fresh one
+     * carries the new call count.
+     */
+    if (num_rsps != 1 || rsps[0].rc != 0 ||
+        rsps[0].hdr.nh_seq != req.seqs[0] ||
+        bench_cache_calls != bench_cache_cases[idx].exp_calls ||
+        (strcmp(rsps[0].r, first_r) == 0) !=
+            (bench_cache_cases[idx].exp_calls == 1)) {
+
+        rc = MGMT_ERR_EUNKNOWN;
+    }
+
+stop:
+    posix_smp_transport_stop(&bench_smp.psl.psl_transport);
+
+done:
+    printf("        { \"case\": \"%s\", \"rc\": %d, \"calls\": %d }%s\n",
+           bench_cache_cases[idx].name, rc, bench_cache_calls,
+           last ? "" : ",");
+
+    return rc;
+}
+
+int
+bench_smp_cache(void)
+{
+    int case_rc;
+    int rc;
+    int i;
+
+    printf("    {\n");
+    printf("      \"name\": \"cache\",\n");
+    printf("      \"cases\": [\n");
+
+    rc = 0;
+    for (i = 0; i < BENCH_CACHE_NUM_CASES; i++) {
+        case_rc = bench_cache_case(i, i == BENCH_CACHE_NUM_CASES - 1);
+        if (rc == 0) {
+            rc = case_rc;
+        }
+    }
+
+    printf("      ],\n");
+    printf("      \"rc\": %d\n", rc);
+    printf("    }");
+
+    return rc;
+}
@@ -0,0 +1,78 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_BENCH_SMP_
+#define H_BENCH_SMP_
+
+/**
+ * @brief Checks that responses to packed requests get coalesced.
+ *
+ * Each case sends three echo requests in a single packet over a loopback
+ * transport and checks the response packets that come back.  With coalescing
+ * disabled, each response gets its own packet ("separate").  With it
+ * enabled, all three share one packet ("packed"), unless the MTU only fits
+ * two, in which case the third starts a new packet ("split").  If the second
+ * request is unsupported, the first response is sent ahead of the error
+ * response and the third request is not processed ("error").
+ *
+ * Requires a build with POSIX_SMP_COALESCE_RSP.  The results, including the
+ * number of buffer allocations in each case, are printed as a JSON object.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int bench_smp_coalesce(void);
+
+/**
+ * @brief Checks that handlers can defer their responses.
+ *
+ * A test command group defers requests and completes them from another
+ * thread after a short delay.  Each case sends a packet of requests to it
+ * over a loopback transport and checks that every response comes back in
+ * request order with the right contents.  A response finished by a finish
+ * callback must be encoded in the transport's thread ("resume"); a handler
+ * that defers and then responds right away must leave nothing deferred
+ * ("mind"); and a request completed with an error must abort the rest of the
+ * packet ("error").  Every buffer must be back in the pool afterwards.
+ *
+ * The results are printed as a JSON object.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int bench_smp_defer(void);
+
+/**
+ * @brief Checks that retransmitted requests are answered from the response
+ *        cache only while that is safe.
+ *
+ * A test command group provides a replayable command that counts its calls
+ * and a command that is assumed to change state.  Each case sends the
+ * counting request and later retransmits it, sequence number and all.  The
+ * retransmit must be answered from the cache ("replay"), also after an echo,
+ * which changes no state ("echo"), unless a state-changing request came in
+ * between ("invalidate") or the cached response has expired ("expire"), in
+ * which case the handler runs again.
+ *
+ * Requires a build with POSIX_SMP_RSP_CACHE_COUNT.  The results are printed
+ * as a JSON object.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int bench_smp_cache(void);
+
+#endif
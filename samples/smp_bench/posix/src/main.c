@@ -0,0 +1,1146 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * SMP benchmark: runs scripted workloads against the SMP server stack over a
+ * simulated link and reports the results as JSON.
+ */
+
+#include <arpa/inet.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cbor.h"
+#include "cbor_buf_writer.h"
+#include "cborattr/cborattr.h"
+#include "mgmt/mgmt.h"
+#include "os_mgmt/os_mgmt.h"
+#include "img_mgmt/img_mgmt.h"
+#include "img_mgmt/image.h"
+#include "fs_mgmt/fs_mgmt.h"
+#include "posix_img_mgmt/posix_img_mgmt.h"
+#include "posix_fs_mgmt/posix_fs_mgmt.h"
+#include "sha256/sha256.h"
+#include "bench_link.h"
+#include "bench_micro.h"
+#include "bench_pty.h"
+#include "bench_smp.h"
+
+#define BENCH_FILE_NAME         "bench.bin"
+#define BENCH_ECHO_MAX          512
+
+/** Largest image the pty test uploads; paced, it takes about 2 s. */
+#define BENCH_PTY_IMG_MAX       (128 * 1024)
+
+/* TLVs that imgtool adds to an image signed with an ECDSA P-256 key. */
+#define BENCH_TLV_KEYHASH       0x01
+#define BENCH_TLV_ECDSA256      0x22
+#define BENCH_KEYHASH_LEN       32
+#define BENCH_ECDSA256_LEN      72
+
+/**
+ * A request being encoded.  The CBOR body is written directly after the space
+ * reserved for the SMP header.
+ */
+struct bench_enc {
+    uint8_t *pkt;
+    struct cbor_buf_writer writer;
+    CborEncoder enc;
+    CborEncoder map;
+    CborError err;
+};
+
+/**
+ * The state and results of one workload.
+ */
+struct bench_run {
+    const char *name;
+    struct bench_link link;
+
+    /* Per-request simulated latency and server processing time. */
+    uint64_t *lat_ns;
+    uint64_t *svc_ns;
+    int num_reqs;
+    int max_reqs;
+
+    /** Payload bytes moved by the workload (image or file contents). */
+    uint64_t payload_bytes;
+
+    /** Image slot reads performed by the server. */
+    unsigned long flash_reads;
+
+    uint64_t cpu_ns;
+    struct mcumgr_buf_stats buf_start;
+    struct mcumgr_buf_stats buf_end;
+    int rc;
+};
+
+/** Command line settings. */
+static struct bench_link_cfg bench_link_cfg = {
+    .mtu = 256,
+    .overhead = 0,
+    .latency_us = 10000,
+    .bandwidth_bps = 1000000,
+    .loss_pct = 0,
+    .rto_ms = 1000,
+    .seed = 1,
+};
+static size_t bench_img_size = 1024 * 1024;
+static size_t bench_file_size = 256 * 1024;
+static int bench_num_polls = 1000;
+static size_t bench_echo_len = 32;
+static struct bench_micro_cfg bench_micro_cfg = {
+    .dispatch_lookups = 1000000,
+    .ring_packets = 20000,
+    .ring_rate = 10000,
+};
+
+static char bench_dir[PATH_MAX];
+static uint8_t bench_seq;
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options] [workload...]\n"
+        "workloads: upload download echo taskstat state (default: all)\n"
+        "  -t <test>      run a test; repeatable, and no workloads run by\n"
+        "                 default when given\n"
+        "                 (tests: dispatch coalesce defer cache ring pty)\n"
+        "  -m <bytes>     link MTU (%d)\n"
+        "  -o <bytes>     per-packet link overhead (%d)\n"
+        "  -l <us>        one-way latency (%" PRIu32 ")\n"
+        "  -b <bps>       bandwidth, 0 = unlimited (%" PRIu32 ")\n"
+        "  -p <percent>   packet loss (%g)\n"
+        "  -r <ms>        retransmit timeout (%" PRIu32 ")\n"
+        "  -s <seed>      loss pattern seed (%" PRIu32 ")\n"
+        "  -i <KiB>       image size for upload (%zu)\n"
+        "  -f <KiB>       file size for download (%zu)\n"
+        "  -n <count>     requests for echo, taskstat, and state (%d)\n"
+        "  -e <bytes>     echo string length (%zu)\n"
+        "  -d <dir>       data directory (default: a temporary directory)\n",
+        prog, bench_link_cfg.mtu, bench_link_cfg.overhead,
+        bench_link_cfg.latency_us, bench_link_cfg.bandwidth_bps,
+        bench_link_cfg.loss_pct, bench_link_cfg.rto_ms, bench_link_cfg.seed,
+        bench_img_size / 1024, bench_file_size / 1024, bench_num_polls,
+        bench_echo_len);
+    exit(1);
+}
+
+static uint64_t
+bench_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Fills a buffer with a repeatable pseudo-random pattern.
+ */
+static void
+bench_fill(uint8_t *dst, size_t len, uint32_t seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        dst[i] = seed >> 16;
+    }
+}
+
+static void
+bench_enc_start(struct bench_enc *be, uint8_t *pkt, size_t pkt_size,
+                size_t num_entries)
+{
+    be->pkt = pkt;
+    cbor_buf_writer_init(&be->writer, pkt + sizeof (struct mgmt_hdr),
+                         pkt_size - sizeof (struct mgmt_hdr));
+    cbor_encoder_cust_writer_init(&be->enc, &be->writer.enc, 0);
+    be->err = cbor_encoder_create_map(&be->enc, &be->map, num_entries);
+}
+
+/**
+ * Closes a request's body and prepends the SMP header.
+ */
+static int
+bench_enc_finish(struct bench_enc *be, uint8_t op, uint16_t group,
+                 uint8_t id, size_t *out_len)
+{
+    struct mgmt_hdr hdr;
+    size_t body_len;
+
+    be->err |= cbor_encoder_close_container(&be->enc, &be->map);
+    if (be->err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    body_len = cbor_buf_writer_buffer_size(&be->writer,
+                                           be->pkt + sizeof hdr);
+
+    hdr = (struct mgmt_hdr) {
+        .nh_op = op,
+        .nh_len = body_len,
+        .nh_group = group,
+        .nh_seq = bench_seq++,
+        .nh_id = id,
+    };
+    mgmt_hton_hdr(&hdr);
+    memcpy(be->pkt, &hdr, sizeof hdr);
+
+    *out_len = sizeof hdr + body_len;
+    return 0;
+}
+
+/**
+ * Sends a request, records its latency, and decodes the response's fields
+ * into the supplied attributes.
+ */
+static int
+bench_xchg(struct bench_run *run, const uint8_t *req, size_t req_len,
+           const struct cbor_attr_t *attrs)
+{
+    const uint8_t *rsp;
+    struct mgmt_hdr hdr;
+    uint64_t start_ns;
+    size_t rsp_len;
+    int rc;
+
+    if (run->num_reqs == run->max_reqs) {
+        run->max_reqs = run->max_reqs * 2 + 64;
+        run->lat_ns = realloc(run->lat_ns,
+                              run->max_reqs * sizeof *run->lat_ns);
+        run->svc_ns = realloc(run->svc_ns,
+                              run->max_reqs * sizeof *run->svc_ns);
+        if (run->lat_ns == NULL || run->svc_ns == NULL) {
+            return MGMT_ERR_ENOMEM;
+        }
+    }
+
+    start_ns = run->link.bl_now_ns;
+    rc = bench_link_xchg(&run->link, req, req_len, &rsp, &rsp_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    run->lat_ns[run->num_reqs] = run->link.bl_now_ns - start_ns;
+    run->svc_ns[run->num_reqs] = run->link.bl_service_ns;
+    run->num_reqs++;
+
+    memcpy(&hdr, rsp, sizeof hdr);
+    mgmt_ntoh_hdr(&hdr);
+
+    rc = cbor_read_flat_attrs(rsp + sizeof hdr, hdr.nh_len, attrs);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    return 0;
+}
+
+/**
+ * Builds an image with the specified amount of contents: a header,
+ * pseudo-random contents, and the TLVs of a signed image (hash, key hash, and
+ * signature).  The server doesn't verify signatures, so the key hash and
+ * signature are left zeroed.
+ */
+static uint8_t *
+bench_build_image(size_t img_size, size_t *out_len)
+{
+    struct image_tlv_info info;
+    struct image_header hdr;
+    struct image_tlv tlvs[3];
+    struct sha256_ctx sha;
+    uint8_t *img;
+    size_t len;
+    size_t off;
+    int i;
+
+    tlvs[0] = (struct image_tlv) {
+        .it_type = IMAGE_TLV_SHA256,
+        .it_len = IMAGE_HASH_LEN,
+    };
+    tlvs[1] = (struct image_tlv) {
+        .it_type = BENCH_TLV_KEYHASH,
+        .it_len = BENCH_KEYHASH_LEN,
+    };
+    tlvs[2] = (struct image_tlv) {
+        .it_type = BENCH_TLV_ECDSA256,
+        .it_len = BENCH_ECDSA256_LEN,
+    };
+
+    len = sizeof info;
+    for (i = 0; i < 3; i++) {
+        len += sizeof tlvs[i] + tlvs[i].it_len;
+    }
+    info = (struct image_tlv_info) {
+        .it_magic = IMAGE_TLV_INFO_MAGIC,
+        .it_tlv_tot = len,
+    };
+
+    len += sizeof hdr + img_size;
+    img = calloc(1, len);
+    if (img == NULL) {
+        return NULL;
+    }
+
+    hdr = (struct image_header) {
+        .ih_magic = IMAGE_MAGIC,
+        .ih_hdr_size = sizeof hdr,
+        .ih_img_size = img_size,
+        .ih_ver = { 1, 0, 0, 0 },
+    };
+
+    off = 0;
+    memcpy(img + off, &hdr, sizeof hdr);
+    off += sizeof hdr;
+    bench_fill(img + off, img_size, 1);
+    off += img_size;
+    memcpy(img + off, &info, sizeof info);
+    off += sizeof info;
+    for (i = 0; i < 3; i++) {
+        memcpy(img + off, &tlvs[i], sizeof tlvs[i]);
+        off += sizeof tlvs[i];
+        if (tlvs[i].it_type == IMAGE_TLV_SHA256) {
+            sha256_init(&sha);
+            sha256_update(&sha, img, sizeof hdr + img_size);
+            sha256_final(&sha, img + off);
+        }
+        off += tlvs[i].it_len;
+    }
+
+    *out_len = len;
+    return img;
+}
+
+/**
+ * Workload: uploads an image into slot 1, with each request filling as much
+ * of the MTU as the server's chunk size allows.
+ */
+static int
+bench_upload(struct bench_run *run)
+{
+    uint8_t req[MCUMGR_BUF_SIZE];
+    struct bench_enc be;
+    unsigned long long rsp_off;
+    long long int rsp_rc;
+    size_t chunk_len;
+    size_t req_max;
+    size_t req_len;
+    size_t img_len;
+    size_t excess;
+    size_t off;
+    uint8_t *img;
+    int rc;
+
+    const struct cbor_attr_t rsp_attrs[] = {
+        [0] = {
+            .attribute = "rc",
+            .type = CborAttrIntegerType,
+            .addr.integer = &rsp_rc,
+        },
+        [1] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &rsp_off,
+            .nodefault = true,
+        },
+        [2] = { 0 },
+    };
+
+    img = bench_build_image(bench_img_size, &img_len);
+    if (img == NULL) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    req_max = run->link.bl_cfg.mtu;
+    if (req_max > sizeof req) {
+        req_max = sizeof req;
+    }
+
+    rc = 0;
+    off = 0;
+    while (off < img_len) {
+        /* Shrink the chunk until the request fits. */
+        chunk_len = img_len - off;
+        if (chunk_len > IMG_MGMT_UL_CHUNK_SIZE) {
+            chunk_len = IMG_MGMT_UL_CHUNK_SIZE;
+        }
+        while (1) {
+            bench_enc_start(&be, req, sizeof req, off == 0 ? 3 : 2);
+            be.err |= cbor_encode_text_stringz(&be.map, "data");
+            be.err |= cbor_encode_byte_string(&be.map, img + off, chunk_len);
+            be.err |= cbor_encode_text_stringz(&be.map, "off");
+            be.err |= cbor_encode_uint(&be.map, off);
+            if (off == 0) {
+                be.err |= cbor_encode_text_stringz(&be.map, "len");
+                be.err |= cbor_encode_uint(&be.map, img_len);
+            }
+            rc = bench_enc_finish(&be, MGMT_OP_WRITE, MGMT_GROUP_ID_IMAGE,
+                                  IMG_MGMT_ID_UPLOAD, &req_len);
+            if (rc == 0 && req_len <= req_max) {
+                break;
+            }
+
+            excess = rc == 0 ? req_len - req_max : chunk_len / 2;
+            if (excess >= chunk_len) {
+                rc = MGMT_ERR_EMSGSIZE;
+                goto done;
+            }
+            chunk_len -= excess;
+        }
+
+        rsp_off = ULLONG_MAX;
+        rc = bench_xchg(run, req, req_len, rsp_attrs);
+        if (rc == 0) {
+            rc = rsp_rc;
+        }
+        if (rc == 0 && rsp_off == ULLONG_MAX) {
+            rc = MGMT_ERR_EINVAL;
+        }
+        if (rc != 0) {
+            goto done;
+        }
+
+        /* The server reports how much it has; resume from there. */
+        off = rsp_off;
+    }
+
+    run->payload_bytes = img_len;
+
+done:
+    free(img);
+    return rc;
+}
+
+/**
+ * Workload: downloads a file and checks its contents.
+ */
+static int
+bench_download(struct bench_run *run)
+{
+    uint8_t data[FS_MGMT_DL_CHUNK_SIZE];
+    uint8_t req[MCUMGR_BUF_SIZE];
+    char path[PATH_MAX + sizeof BENCH_FILE_NAME];
+    struct bench_enc be;
+    unsigned long long file_len;
+    unsigned long long rsp_off;
+    unsigned long long rsp_len;
+    long long int rsp_rc;
+    uint8_t *contents;
+    size_t data_len;
+    size_t req_len;
+    size_t off;
+    FILE *fp;
+    int rc;
+
+    const struct cbor_attr_t rsp_attrs[] = {
+        [0] = {
+            .attribute = "rc",
+            .type = CborAttrIntegerType,
+            .addr.integer = &rsp_rc,
+        },
+        [1] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &rsp_off,
+            .nodefault = true,
+        },
+        [2] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &rsp_len,
+            .nodefault = true,
+        },
+        [3] = {
+            .attribute = "data",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = data,
+            .addr.bytestring.len = &data_len,
+            .len = sizeof data,
+        },
+        [4] = { 0 },
+    };
+
+    contents = malloc(bench_file_size);
+    if (contents == NULL) {
+        return MGMT_ERR_ENOMEM;
+    }
+    bench_fill(contents, bench_file_size, 2);
+
+    snprintf(path, sizeof path, "%s/%s", bench_dir, BENCH_FILE_NAME);
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        free(contents);
+        return MGMT_ERR_EUNKNOWN;
+    }
+    rc = fwrite(contents, 1, bench_file_size, fp) == bench_file_size ?
+         0 : MGMT_ERR_EUNKNOWN;
+    if (fclose(fp) != 0) {
+        rc = MGMT_ERR_EUNKNOWN;
+    }
+    if (rc != 0) {
+        goto done;
+    }
+
+    file_len = ULLONG_MAX;
+    off = 0;
+    do {
+        bench_enc_start(&be, req, sizeof req, 2);
+        be.err |= cbor_encode_text_stringz(&be.map, "off");
+        be.err |= cbor_encode_uint(&be.map, off);
+        be.err |= cbor_encode_text_stringz(&be.map, "name");
+        be.err |= cbor_encode_text_stringz(&be.map, BENCH_FILE_NAME);
+        rc = bench_enc_finish(&be, MGMT_OP_READ, MGMT_GROUP_ID_FS,
+                              FS_MGMT_ID_FILE, &req_len);
+        if (rc != 0) {
+            goto done;
+        }
+
+        rsp_off = ULLONG_MAX;
+        rsp_len = ULLONG_MAX;
+        data_len = 0;
+        rc = bench_xchg(run, req, req_len, rsp_attrs);
+        if (rc == 0) {
+            rc = rsp_rc;
+        }
+        if (rc != 0) {
+            goto done;
+        }
+
+        /* Only the first response carries the file length. */
+        if (off == 0) {
+            file_len = rsp_len;
+        }
+
+        if (rsp_off != off || file_len != bench_file_size ||
+            (data_len == 0 && off < file_len) ||
+            off + data_len > file_len ||
+            memcmp(contents + off, data, data_len) != 0) {
+
+            rc = MGMT_ERR_EUNKNOWN;
+            goto done;
+        }
+
+        off += data_len;
+    } while (off < file_len);
+
+    run->payload_bytes = file_len;
+
+done:
+    unlink(path);
+    free(contents);
+    return rc;
+}
+
+/**
+ * Workload: echo ping-pong.
+ */
+static int
+bench_echo(struct bench_run *run)
+{
+    char echo[BENCH_ECHO_MAX + 1];
+    char rsp_echo[BENCH_ECHO_MAX + 1];
+    uint8_t req[MCUMGR_BUF_SIZE];
+    struct bench_enc be;
+    long long int rsp_rc;
+    size_t req_len;
+    size_t i;
+    int rc;
+
+    const struct cbor_attr_t rsp_attrs[] = {
+        [0] = {
+            .attribute = "rc",
+            .type = CborAttrIntegerType,
+            .addr.integer = &rsp_rc,
+        },
+        [1] = {
+            .attribute = "r",
+            .type = CborAttrTextStringType,
+            .addr.string = rsp_echo,
+            .len = sizeof rsp_echo,
+        },
+        [2] = { 0 },
+    };
+
+    for (i = 0; i < bench_echo_len; i++) {
+        echo[i] = 'a' + i % 26;
+    }
+    echo[i] = '\0';
+
+    for (i = 0; i < bench_num_polls; i++) {
+        bench_enc_start(&be, req, sizeof req, 1);
+        be.err |= cbor_encode_text_stringz(&be.map, "d");
+        be.err |= cbor_encode_text_stringz(&be.map, echo);
+        rc = bench_enc_finish(&be, MGMT_OP_WRITE, MGMT_GROUP_ID_OS,
+                              OS_MGMT_ID_ECHO, &req_len);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rsp_echo[0] = '\0';
+        rc = bench_xchg(run, req, req_len, rsp_attrs);
+        if (rc == 0) {
+            rc = rsp_rc;
+        }
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (strcmp(rsp_echo, echo) != 0) {
+            return MGMT_ERR_EUNKNOWN;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Workload: task statistics polling.
+ */
+static int
+bench_taskstat(struct bench_run *run)
+{
+    uint8_t req[MCUMGR_BUF_SIZE];
+    struct bench_enc be;
+    long long int rsp_rc;
+    size_t req_len;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t rsp_attrs[] = {
+        [0] = {
+            .attribute = "rc",
+            .type = CborAttrIntegerType,
+            .addr.integer = &rsp_rc,
+        },
+        [1] = { 0 },
+    };
+
+    for (i = 0; i < bench_num_polls; i++) {
+        bench_enc_start(&be, req, sizeof req, 0);
+        rc = bench_enc_finish(&be, MGMT_OP_READ, MGMT_GROUP_ID_OS,
+                              OS_MGMT_ID_TASKSTAT, &req_len);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rc = bench_xchg(run, req, req_len, rsp_attrs);
+        if (rc == 0) {
+            rc = rsp_rc;
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Workload: image state reads.  The image is placed in slot 1 directly, and
+ * the cached slot metadata is discarded before each request, so that every
+ * request parses both slots from flash.
+ */
+static int
+bench_state(struct bench_run *run)
+{
+    uint8_t req[MCUMGR_BUF_SIZE];
+    char path[PATH_MAX + 8];
+    struct bench_enc be;
+    long long int rsp_rc;
+    size_t req_len;
+    size_t img_len;
+    uint8_t *img;
+    FILE *fp;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t rsp_attrs[] = {
+        [0] = {
+            .attribute = "rc",
+            .type = CborAttrIntegerType,
+            .addr.integer = &rsp_rc,
+        },
+        [1] = { 0 },
+    };
+
+    img = bench_build_image(bench_img_size, &img_len);
+    if (img == NULL) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    snprintf(path, sizeof path, "%s/slot1", bench_dir);
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        free(img);
+        return MGMT_ERR_EUNKNOWN;
+    }
+    rc = fwrite(img, 1, img_len, fp) == img_len ? 0 : MGMT_ERR_EUNKNOWN;
+    if (fclose(fp) != 0) {
+        rc = MGMT_ERR_EUNKNOWN;
+    }
+    free(img);
+    if (rc != 0) {
+        return rc;
+    }
+
+    for (i = 0; i < bench_num_polls; i++) {
+        img_mgmt_cache_invalidate();
+
+        bench_enc_start(&be, req, sizeof req, 0);
+        rc = bench_enc_finish(&be, MGMT_OP_READ, MGMT_GROUP_ID_IMAGE,
+                              IMG_MGMT_ID_STATE, &req_len);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rc = bench_xchg(run, req, req_len, rsp_attrs);
+        if (rc == 0) {
+            rc = rsp_rc;
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+typedef int bench_workload_fn(struct bench_run *run);
+
+static const struct {
+    const char *name;
+    bench_workload_fn *fn;
+} bench_workloads[] = {
+    { "upload",     bench_upload },
+    { "download",   bench_download },
+    { "echo",       bench_echo },
+    { "taskstat",   bench_taskstat },
+    { "state",      bench_state },
+};
+
+#define BENCH_NUM_WORKLOADS \
+    (sizeof bench_workloads / sizeof bench_workloads[0])
+
+static int
+bench_find_workload(const char *name)
+{
+    int i;
+
+    for (i = 0; i < BENCH_NUM_WORKLOADS; i++) {
+        if (strcmp(bench_workloads[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+typedef int bench_test_fn(void);
+
+static int
+bench_test_dispatch(void)
+{
+    return bench_micro_dispatch(&bench_micro_cfg);
+}
+
+static int
+bench_test_ring(void)
+{
+    return bench_micro_ring(&bench_micro_cfg);
+}
+
+static int
+bench_test_pty(void)
+{
+    size_t img_size;
+    size_t img_len;
+    uint8_t *img;
+    int rc;
+
+    img_size = bench_img_size;
+    if (img_size > BENCH_PTY_IMG_MAX) {
+        img_size = BENCH_PTY_IMG_MAX;
+    }
+
+    /* On failure, the test reports it. */
+    img = bench_build_image(img_size, &img_len);
+    rc = bench_pty(img, img_len);
+    free(img);
+
+    return rc;
+}
+
+/**
+ * Tests that exercise one mechanism in isolation rather than a client
+ * workload.  Each prints its own results as a JSON object.
+ */
+static const struct {
+    const char *name;
+    bench_test_fn *fn;
+} bench_tests[] = {
+    { "dispatch",   bench_test_dispatch },
+    { "coalesce",   bench_smp_coalesce },
+    { "defer",      bench_smp_defer },
+    { "cache",      bench_smp_cache },
+    { "ring",       bench_test_ring },
+    { "pty",        bench_test_pty },
+};
+
+#define BENCH_NUM_TESTS \
+    (sizeof bench_tests / sizeof bench_tests[0])
+
+static int
+bench_find_test(const char *name)
+{
+    int i;
+
+    for (i = 0; i < BENCH_NUM_TESTS; i++) {
+        if (strcmp(bench_tests[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int
+bench_run(struct bench_run *run, int idx)
+{
+    unsigned long flash_reads;
+    uint64_t cpu_ns;
+    int rc;
+
+    memset(run, 0, sizeof *run);
+    run->name = bench_workloads[idx].name;
+
+    rc = bench_link_init(&run->link, &bench_link_cfg);
+    if (rc != 0) {
+        return rc;
+    }
+
+    mcumgr_buf_get_stats(&run->buf_start);
+    flash_reads = posix_img_mgmt_num_reads();
+    cpu_ns = bench_cpu_ns();
+
+    run->rc = bench_workloads[idx].fn(run);
+
+    run->cpu_ns = bench_cpu_ns() - cpu_ns;
+    run->flash_reads = posix_img_mgmt_num_reads() - flash_reads;
+    mcumgr_buf_get_stats(&run->buf_end);
+
+    bench_link_stop(&run->link);
+
+    return 0;
+}
+
+static int
+bench_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x;
+    uint64_t y;
+
+    x = *(const uint64_t *)a;
+    y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Retrieves a nearest-rank percentile, in microseconds, from sorted samples.
+ */
+static double
+bench_pctile_us(const uint64_t *samples, int num_samples, int pct)
+{
+    int idx;
+
+    if (num_samples == 0) {
+        return 0;
+    }
+
+    idx = (num_samples * pct + 99) / 100 - 1;
+    if (idx < 0) {
+        idx = 0;
+    }
+    return samples[idx] / 1000.0;
+}
+
+static void
+bench_print_run(struct bench_run *run, bool last)
+{
+    const struct bench_link_stats *ls;
+    uint64_t lat_sum_ns;
+    uint32_t allocs;
+    double sim_s;
+    int n;
+    int i;
+
+    n = run->num_reqs;
+    ls = &run->link.bl_stats;
+
+    qsort(run->lat_ns, n, sizeof *run->lat_ns, bench_cmp_u64);
+    qsort(run->svc_ns, n, sizeof *run->svc_ns, bench_cmp_u64);
+
+    lat_sum_ns = 0;
+    for (i = 0; i < n; i++) {
+        lat_sum_ns += run->lat_ns[i];
+    }
+
+    sim_s = run->link.bl_now_ns / 1e9;
+    allocs = run->buf_end.allocs - run->buf_start.allocs;
+
+    printf("    {\n");
+    printf("      \"name\": \"%s\",\n", run->name);
+    printf("      \"rc\": %d,\n", run->rc);
+    printf("      \"requests\": %d,\n", n);
+    printf("      \"payload_bytes\": %" PRIu64 ",\n", run->payload_bytes);
+    printf("      \"sim_time_s\": %.3f,\n", sim_s);
+    printf("      \"goodput_Bps\": %.0f,\n",
+           sim_s > 0 ? run->payload_bytes / sim_s : 0);
+    printf("      \"latency_us\": { \"p50\": %.1f, \"p99\": %.1f, "
+           "\"max\": %.1f, \"mean\": %.1f },\n",
+           bench_pctile_us(run->lat_ns, n, 50),
+           bench_pctile_us(run->lat_ns, n, 99),
+           bench_pctile_us(run->lat_ns, n, 100),
+           n > 0 ? lat_sum_ns / 1000.0 / n : 0);
+    printf("      \"service_us\": { \"p50\": %.1f, \"p99\": %.1f },\n",
+           bench_pctile_us(run->svc_ns, n, 50),
+           bench_pctile_us(run->svc_ns, n, 99));
+    printf("      \"wire\": { \"tx_bytes\": %" PRIu64 ", "
+           "\"rx_bytes\": %" PRIu64 ", \"tx_packets\": %" PRIu32 ", "
+           "\"rx_packets\": %" PRIu32 ", \"lost_packets\": %" PRIu32 ", "
+           "\"retransmits\": %" PRIu32 " },\n",
+           ls->tx_bytes, ls->rx_bytes, ls->tx_packets, ls->rx_packets,
+           ls->lost_packets, ls->retransmits);
+    printf("      \"buffers\": { \"allocs\": %" PRIu32 ", "
+           "\"allocs_per_req\": %.2f, \"alloc_fails\": %" PRIu32 ", "
+           "\"min_free\": %d },\n",
+           allocs, n > 0 ? (double)allocs / n : 0,
+           run->buf_end.alloc_fails - run->buf_start.alloc_fails,
+           run->buf_end.min_free);
+    printf("      \"flash_reads\": %lu,\n", run->flash_reads);
+    printf("      \"flash_reads_per_req\": %.2f,\n",
+           n > 0 ? (double)run->flash_reads / n : 0);
+    printf("      \"cpu_us_per_req\": %.2f\n",
+           n > 0 ? run->cpu_ns / 1000.0 / n : 0);
+    printf("    }%s\n", last ? "" : ",");
+
+    free(run->lat_ns);
+    free(run->svc_ns);
+}
+
+static void
+bench_print_cfg(void)
+{
+    const struct bench_link_cfg *cfg;
+
+    cfg = &bench_link_cfg;
+
+    printf("  \"config\": {\n");
+    printf("    \"mtu\": %d,\n", cfg->mtu);
+    printf("    \"overhead\": %d,\n", cfg->overhead);
+    printf("    \"latency_us\": %" PRIu32 ",\n", cfg->latency_us);
+    printf("    \"bandwidth_bps\": %" PRIu32 ",\n", cfg->bandwidth_bps);
+    printf("    \"loss_pct\": %g,\n", cfg->loss_pct);
+    printf("    \"rto_ms\": %" PRIu32 ",\n", cfg->rto_ms);
+    printf("    \"seed\": %" PRIu32 ",\n", cfg->seed);
+    printf("    \"image_bytes\": %zu,\n", bench_img_size);
+    printf("    \"file_bytes\": %zu,\n", bench_file_size);
+    printf("    \"polls\": %d,\n", bench_num_polls);
+    printf("    \"echo_len\": %zu\n", bench_echo_len);
+    printf("  },\n");
+}
+
+static void
+bench_cleanup_dir(void)
+{
+    static const char *names[] = { "slot0", "slot1", BENCH_FILE_NAME };
+    char path[PATH_MAX + 16];
+    int i;
+
+    for (i = 0; i < sizeof names / sizeof names[0]; i++) {
+        snprintf(path, sizeof path, "%s/%s", bench_dir, names[i]);
+        unlink(path);
+    }
+    rmdir(bench_dir);
+}
+
+int
+main(int argc, char **argv)
+{
+    int selected[BENCH_NUM_WORKLOADS];
+    int tests[BENCH_NUM_TESTS];
+    struct bench_run run;
+    bool tmp_dir;
+    int num_selected;
+    int num_tests;
+    int failed;
+    int idx;
+    int rc;
+    int ch;
+    int i;
+
+    tmp_dir = true;
+    num_tests = 0;
+
+    while ((ch = getopt(argc, argv, "m:o:l:b:p:r:s:i:f:n:e:d:t:h")) != -1) {
+        switch (ch) {
+        case 'm':
+            bench_link_cfg.mtu = atoi(optarg);
+            break;
+
+        case 'o':
+            bench_link_cfg.overhead = atoi(optarg);
+            break;
+
+        case 'l':
+            bench_link_cfg.latency_us = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'b':
+            bench_link_cfg.bandwidth_bps = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'p':
+            bench_link_cfg.loss_pct = atof(optarg);
+            break;
+
+        case 'r':
+            bench_link_cfg.rto_ms = strtoul(optarg, NULL, 10);
+            break;
+
+        case 's':
+            bench_link_cfg.seed = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'i':
+            bench_img_size = strtoul(optarg, NULL, 10) * 1024;
+            break;
+
+        case 'f':
+            bench_file_size = strtoul(optarg, NULL, 10) * 1024;
+            break;
+
+        case 'n':
+            bench_num_polls = atoi(optarg);
+            break;
+
+        case 'e':
+            bench_echo_len = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'd':
+            snprintf(bench_dir, sizeof bench_dir, "%s", optarg);
+            tmp_dir = false;
+            break;
+
+        case 't':
+            idx = bench_find_test(optarg);
+            if (idx == -1 || num_tests == BENCH_NUM_TESTS) {
+                usage(argv[0]);
+            }
+            tests[num_tests++] = idx;
+            break;
+
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (bench_link_cfg.mtu < sizeof (struct mgmt_hdr) + 1 ||
+        bench_echo_len > BENCH_ECHO_MAX) {
+
+        usage(argv[0]);
+    }
+
+    num_selected = 0;
+    if (optind == argc && num_tests == 0) {
+        for (i = 0; i < BENCH_NUM_WORKLOADS; i++) {
+            selected[num_selected++] = i;
+        }
+    } else {
+        for (i = optind; i < argc; i++) {
+            idx = bench_find_workload(argv[i]);
+            if (idx == -1 || num_selected == BENCH_NUM_WORKLOADS) {
+                usage(argv[0]);
+            }
+            selected[num_selected++] = idx;
+        }
+    }
+
+    if (tmp_dir) {
+        snprintf(bench_dir, sizeof bench_dir, "/tmp/smp_bench.XXXXXX");
+        if (mkdtemp(bench_dir) == NULL) {
+            perror("mkdtemp");
+            return 1;
+        }
+    }
+
+    /* Slot 1 has room for the image and its trailer. */
+    rc = posix_img_mgmt_init(bench_dir, bench_img_size + 4096);
+    if (rc == 0) {
+        rc = posix_fs_mgmt_init(bench_dir);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "failed to set up %s (rc %d)\n", bench_dir, rc);
+        return 1;
+    }
+
+    printf("{\n");
+    bench_print_cfg();
+    printf("  \"workloads\": [\n");
+
+    failed = 0;
+    for (i = 0; i < num_selected; i++) {
+        rc = bench_run(&run, selected[i]);
+        if (rc != 0) {
+            fprintf(stderr, "failed to start the link (rc %d)\n", rc);
+            return 1;
+        }
+        if (run.rc != 0) {
+            failed++;
+        }
+        bench_print_run(&run, i == num_selected - 1);
+    }
+
+    printf("  ]%s\n", num_tests > 0 ? "," : "");
+
+    if (num_tests > 0) {
+        printf("  \"tests\": [\n");
+        for (i = 0; i < num_tests; i++) {
+            if (bench_tests[tests[i]].fn() != 0) {
+                failed++;
+            }
+            printf("%s\n", i == num_tests - 1 ? "" : ",");
+        }
+        printf("  ]\n");
+    }
+
+    printf("}\n");
+
+    if (tmp_dir) {
+        bench_cleanup_dir();
+    }
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "mgmt/mgmt.h"
+#include "os_mgmt/os_mgmt.h"
+#include "img_mgmt/img_mgmt.h"
+#include "fs_mgmt/fs_mgmt.h"
+#include "posix_smp/posix_smp_uds.h"
+#include "posix_smp/posix_smp_udp.h"
+#include "posix_smp/posix_smp_serial.h"
+#include "posix_img_mgmt/posix_img_mgmt.h"
+#include "posix_fs_mgmt/posix_fs_mgmt.h"
+
+#define SMP_SVR_DFLT_SOCK       "/tmp/smp_svr.sock"
+#define SMP_SVR_SLOT_SIZE       (256 * 1024)
+#define SMP_SVR_TTY_BAUD        1000000
+
+static struct posix_smp_uds smp_svr_uds;
+static struct posix_smp_udp smp_svr_udp;
+static struct posix_smp_serial smp_svr_serial;
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-s <socket-path>] [-u <udp-port>] "
+                    "[-t <tty>] [-d <data-dir>]\n", prog);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *sock_path;
+    const char *data_dir;
+    const char *tty_path;
+    sigset_t sigs;
+    int udp_port;
+    int sig;
+    int rc;
+    int ch;
+
+    sock_path = SMP_SVR_DFLT_SOCK;
+    data_dir = ".";
+    udp_port = -1;
+    tty_path = NULL;
+
+    while ((ch = getopt(argc, argv, "s:u:t:d:")) != -1) {
+        switch (ch) {
+        case 's':
+            sock_path = optarg;
+            break;
+
+        case 'u':
+            udp_port = atoi(optarg);
+            break;
+
+        case 't':
+            tty_path = optarg;
+            break;
+
+        case 'd':
+            data_dir = optarg;
+            break;
+
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    /* Image slots and uploaded files live in the data directory. */
+    rc = posix_img_mgmt_init(data_dir, SMP_SVR_SLOT_SIZE);
+    if (rc != 0) {
+        fprintf(stderr, "image init failed (rc %d)\n", rc);
+        return 1;
+    }
+
+    rc = posix_fs_mgmt_init(data_dir);
+    if (rc != 0) {
+        fprintf(stderr, "fs init failed (rc %d)\n", rc);
+        return 1;
+    }
+
+    /* The built-in mcumgr command handlers are registered at link time. */
+
+    /* Block the termination signals before any threads are started so that
+     * only the main thread receives them.  A reset request raises SIGTERM.
+     */
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    rc = posix_smp_uds_init(&smp_svr_uds, sock_path);
+    if (rc != 0) {
+        fprintf(stderr, "failed to listen on %s (rc %d)\n", sock_path, rc);
+        return 1;
+    }
+
+    printf("Listening on %s\n", sock_path);
+
+    if (udp_port >= 0) {
+        rc = posix_smp_udp_init(&smp_svr_udp, udp_port);
+        if (rc != 0) {
+            fprintf(stderr, "failed to listen on UDP port %d (rc %d)\n",
+                    udp_port, rc);
+            posix_smp_uds_stop(&smp_svr_uds);
+            return 1;
+        }
+        printf("Listening on UDP port %d\n", posix_smp_udp_port(&smp_svr_udp));
+    }
+
+    if (tty_path != NULL) {
+        rc = posix_smp_serial_init(&smp_svr_serial, tty_path,
+                                   SMP_SVR_TTY_BAUD);
+        if (rc != 0) {
+            fprintf(stderr, "failed to open %s (rc %d)\n", tty_path, rc);
+            if (udp_port >= 0) {
+                posix_smp_udp_stop(&smp_svr_udp);
+            }
+            posix_smp_uds_stop(&smp_svr_uds);
+            return 1;
+        }
+        printf("Serving %s\n", tty_path);
+    }
+
+    fflush(stdout);
+
+    sigwait(&sigs, &sig);
+
+    if (tty_path != NULL) {
+        posix_smp_serial_stop(&smp_svr_serial);
+    }
+    if (udp_port >= 0) {
+        posix_smp_udp_stop(&smp_svr_udp);
+    }
+    posix_smp_uds_stop(&smp_svr_uds);
+    unlink(sock_path);
+
+    printf("Exiting\n");
+    return 0;
+}
@@ -11,11 +11,14 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/conn.h>
 #include <bluetooth/gatt.h>
-#include "fs_mgmt/fs_mgmt.h"
-#include "os_mgmt/os_mgmt.h"
-#include "img_mgmt/img_mgmt.h"
 #include "mgmt/smp_bt.h"
 #include "zephyr_mgmt/buf.h"
+#ifdef CONFIG_MCUMGR_SMP_UDP
+#include "zephyr_smp/zephyr_smp_udp.h"
+#endif
+#ifdef CONFIG_MCUMGR_SMP_UART
+#include "zephyr_smp/zephyr_smp_uart.h"
+#endif
  
 #define DEVICE_NAME         CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN     (sizeof(DEVICE_NAME) - 1)
@@ -83,10 +86,7 @@ void main(void)
 {
     int rc;
 
-    /* Register the built-in mcumgr command handlers. */
-    os_mgmt_register_group();
-    img_mgmt_register_group();
-    fs_mgmt_register_group();
+    /* The built-in mcumgr command handlers are registered at link time. */
 
     /* Enable Bluetooth. */
     rc = bt_enable(bt_ready);
@@ -99,6 +99,22 @@ void main(void)
     /* Initialize the Bluetooth mcumgr transport. */
     smp_bt_register();
 
+#ifdef CONFIG_MCUMGR_SMP_UDP
+    /* Also serve mcumgr requests over UDP. */
+    rc = zephyr_smp_udp_open();
+    if (rc != 0) {
+        printk("UDP transport failed to start (rc %d)\n", rc);
+    }
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_UART
+    /* Also serve mcumgr requests over a dedicated UART. */
+    rc = zephyr_smp_uart_open();
+    if (rc != 0) {
+        printk("UART transport failed to start (rc %d)\n", rc);
+    }
+#endif
+
     /* The system work queue handles all incoming mcumgr requests.  Let the
      * main thread idle while the mcumgr server runs.
      */
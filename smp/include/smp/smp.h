@@ -30,20 +30,54 @@
  * SMP request packets may contain multiple concatenated requests.  Each
  * request must start at an offset that is a multiple of 4, so padding shuold
  * be inserted between requests as necessary.  Requests are processed
- * sequentially from the start of the packet to the end.  Each response is sent
- * individually in its own packet.  If a request elicits an error response,
+ * sequentially from the start of the packet to the end.  By default, each
+ * response is sent individually in its own packet.  If the transport supports
+ * it, consecutive responses are instead coalesced into a single packet, with
+ * the same padding rules as requests.  If a request elicits an error response,
  * processing of the packet is aborted.
+ *
+ * If the streamer provides a response cache, recent responses to writes that
+ * their handlers mark as replayable (e.g., upload chunks) are retained.  A
+ * retransmitted request (same header and payload as a cached one) is
+ * answered from the cache without invoking its handler again.
+ *
+ * If the streamer provides storage for a deferred request, a command handler
+ * may defer its response (see mgmt_ctxt_defer()).  Processing of the packet is
+ * then suspended until the handler completes the request; subsequent requests
+ * are not processed in the meantime.
  */
 
 #ifndef H_SMP_
 #define H_SMP_
 
+#include <stdbool.h>
 #include "mgmt/mgmt.h"
+#include "mgmt/mgmt_stats.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** The largest possible error response: a header followed by {"rc": N}. */
+#define SMP_ERR_RSP_MAX_LEN     (MGMT_HDR_SIZE + 7)
+
+/** Counters in the "smp" stats group. */
+#define SMP_STAT_RX_PKTS        0   /* Request packets processed. */
+#define SMP_STAT_RX_REQS        1   /* Requests processed. */
+#define SMP_STAT_RX_DROPS       2   /* Packets dropped by a transport. */
+#define SMP_STAT_TX_PKTS        3   /* Response packets sent. */
+#define SMP_STAT_TX_ERRS        4   /* Response packets that failed to send. */
+#define SMP_STAT_ERR_RSPS       5   /* Error responses. */
+#define SMP_STAT_ALLOC_FAILS    6   /* Response buffer allocation failures. */
+#define SMP_STAT_CACHE_HITS     7   /* Requests answered from the cache. */
+#define SMP_STAT_INDEF_RSPS     8   /* Responses left indefinite-length. */
+#define SMP_STAT_COUNT          9
+
+extern uint32_t smp_stats[SMP_STAT_COUNT];
+
+/** Increments a counter in the "smp" stats group; for use by transports. */
+#define SMP_STATS_INC(idx_)     MGMT_STATS_INC(smp_stats, (idx_))
+
 struct smp_streamer;
 struct mgmt_hdr;
 
@@ -58,12 +92,175 @@ struct mgmt_hdr;
  */
 typedef int smp_tx_rsp_fn(struct smp_streamer *ss, void *buf, void *arg);
 
+/** @typedef smp_rsp_max_fn
+ * @brief Indicates the maximum size of a packet of coalesced responses.
+ *
+ * Typically, this is the lesser of the peer's MTU and the capacity of the
+ * supplied buffer.
+ *
+ * @param ss                    The streamer to transmit via.
+ * @param buf                   The buffer that responses would be coalesced
+ *                                  into.
+ * @param arg                   Optional streamer argument.
+ *
+ * @return                      The maximum packet size, in bytes;
+ *                              0 to send each response individually.
+ */
+typedef size_t smp_rsp_max_fn(struct smp_streamer *ss, const void *buf,
+                              void *arg);
+
+/** @typedef smp_resume_fn
+ * @brief Schedules a call to smp_resume_deferred() in the streamer's task.
+ *
+ * Called when a handler completes a deferred request.  This may occur in any
+ * task.
+ *
+ * @param ss                    The streamer to resume.
+ * @param arg                   Optional streamer argument.
+ */
+typedef void smp_resume_fn(struct smp_streamer *ss, void *arg);
+
+/** @typedef smp_err_buf_fn
+ * @brief Retrieves a transport's reserved error-response buffer.
+ *
+ * The reserved buffer lets an error response go out when no response buffer
+ * can be allocated.  It is consumed by the transmit function like any other
+ * response, so the transport must arrange for it to become available again
+ * once sent.
+ *
+ * @param ss                    The streamer that needs the buffer.
+ * @param req                   The request being answered; transports may
+ *                                  copy peer information from it.
+ * @param arg                   Optional streamer argument.
+ *
+ * @return                      An empty buffer with room for at least
+ *                                  SMP_ERR_RSP_MAX_LEN bytes;
+ *                              NULL if the reserved buffer is still in use.
+ */
+typedef void *smp_err_buf_fn(struct smp_streamer *ss, const void *req,
+                             void *arg);
+
+/**
+ * @brief Holds a request whose completion was deferred by its handler.
+ *
+ * Owned by the SMP layer; transports just provide the storage.
+ */
+struct smp_deferred {
+    /** Retained context that the handler completes the response with. */
+    struct mgmt_ctxt sd_ctxt;
+
+    /** The response's root map. */
+    struct CborEncoder sd_payload;
+
+    /** Header of the deferred request (host-byte order). */
+    struct mgmt_hdr sd_req_hdr;
+
+    /** When the handler was invoked; see mgmt/mgmt_handler_stats.h. */
+    uint32_t sd_start_cycles;
+
+    /** Remainder of the request packet. */
+    void *sd_req;
+
+    /** The partially-built response. */
+    void *sd_rsp;
+
+    int sd_status;
+    bool sd_pending;
+    volatile bool sd_done;
+};
+
+/**
+ * @brief Identifies a cached response.
+ */
+struct smp_rsp_cache_entry {
+    /** Header of the request that elicited the response (network-byte
+     *  order).
+     */
+    struct mgmt_hdr sce_req_hdr;
+
+    /** Hash of the request payload. */
+    uint32_t sce_req_hash;
+
+    /** Cache generation the response was built in; see smp_rsp_cache. */
+    uint32_t sce_gen;
+
+    /** Uptime, in milliseconds, when the response was cached. */
+    uint32_t sce_time_ms;
+
+    /** Length of the cached response; 0 if the entry is unused. */
+    uint16_t sce_rsp_len;
+};
+
+/**
+ * @brief Recently-sent responses, for answering retransmitted requests.
+ *
+ * Owned by the SMP layer; transports just provide the storage, zeroed.
+ * Only successful responses that their handlers mark as replayable (see
+ * struct mgmt_ctxt) are cached, and only if they fit in an entry; deferred
+ * responses never are.  Any other write request, on any transport, is assumed
+ * to change state that cached responses to its command group depend on,
+ * unless its handler marks it unchanged; it starts a new generation of the
+ * group in which no earlier entry from the group is used.  Entries also
+ * expire after the timeout.
+ */
+struct smp_rsp_cache {
+    /** Array of num_entries entries. */
+    struct smp_rsp_cache_entry *src_entries;
+
+    /** Response data; entry_size bytes per entry. */
+    uint8_t *src_data;
+
+    uint16_t src_entry_size;
+    uint8_t src_num_entries;
+
+    /** Index of the entry to replace next. */
+    uint8_t src_next;
+
+    /** Age, in milliseconds, after which an entry is not used; 0 for never. */
+    uint32_t src_timeout_ms;
+};
+
 /**
  * @brief Decodes, encodes, and transmits SMP packets.
  */
 struct smp_streamer {
     struct mgmt_streamer mgmt_stmr;
     smp_tx_rsp_fn *tx_rsp_cb;
+
+    /** Optional; if NULL, responses are never coalesced. */
+    smp_rsp_max_fn *rsp_max_cb;
+
+    /**
+     * Optional; if NULL, handlers cannot defer completion.  If set, the
+     * streamer's reader and writer must persist for as long as a request is
+     * deferred.
+     */
+    struct smp_deferred *deferred;
+
+    /**
+     * Optional; if NULL, a deferred request gets finished directly by
+     * mgmt_ctxt_complete(), which must then be called from the streamer's
+     * task after the handler has returned.
+     */
+    smp_resume_fn *resume_cb;
+
+    /** Optional; if NULL, retransmitted requests are processed again. */
+    struct smp_rsp_cache *rsp_cache;
+
+    /**
+     * Whether to re-encode responses with definite-length containers.  This
+     * costs an extra pass over each response and a second buffer, but saves
+     * a byte per container and lets the client decode without scanning for
+     * break markers.  Responses that can't be converted are sent as they are
+     * and counted in the "indef_rsps" stat.
+     */
+    bool definite_len;
+
+    /**
+     * Optional; if NULL, an error response that can't get a buffer of its
+     * own overwrites the request.
+     */
+    smp_err_buf_fn *err_buf_cb;
 };
 
 /**
@@ -72,18 +269,36 @@ struct smp_streamer {
  *
  * Processes all SMP requests in an incoming packet.  Requests are processed
  * sequentially from the start of the packet to the end.  Each response is sent
- * individually in its own packet.  If a request elicits an error response,
- * processing of the packet is aborted.  This function consumes the supplied
- * request buffer regardless of the outcome.
+ * individually in its own packet, unless the streamer supports coalescing
+ * responses.  If a request elicits an error response, processing of the
+ * packet is aborted.  This function consumes the supplied request buffer
+ * regardless of the outcome.
  *
  * @param streamer              The streamer providing the required SMP
  *                                  callbacks.
  * @param req                   The request packet to process.
  *
- * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ * @return                      0 on success;
+ *                              MGMT_DEFERRED if a handler deferred its
+ *                                  response.  The streamer must not process
+ *                                  other packets until smp_resume_deferred()
+ *                                  returns something else;
+ *                              Other MGMT_ERR_[...] code on failure.
  */
 int smp_process_request_packet(struct smp_streamer *streamer, void *req);
 
+/**
+ * @brief Finishes a completed deferred request and processes the remainder of
+ *        its packet.
+ *
+ * @param streamer              The streamer holding the deferred request.
+ *
+ * @return                      0 if no request is deferred, or on success;
+ *                              MGMT_DEFERRED if a request is still deferred;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int smp_resume_deferred(struct smp_streamer *streamer);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,181 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Framing of SMP packets for serial lines (mcumgr console format).
+ *
+ * A packet is prefixed with its length and followed by a CRC16, and the
+ * result is base64-encoded and split into lines of at most
+ * SMP_SERIAL_FRAME_MAX bytes.  The first line of a packet starts with the
+ * bytes 0x06 0x09; each continuation line starts with 0x04 0x14.  Because
+ * frames are ordinary text lines, they can share a UART with console
+ * output; lines without a delimiter are ignored.
+ *
+ *     [len (2, big endian)] [SMP packet] [CRC16 (2, big endian)]
+ *
+ * The length field counts the packet and the CRC.  The CRC is CRC-16-CCITT
+ * (polynomial 0x1021, initial value 0) over the SMP packet.
+ */
+
+#ifndef H_SMP_SERIAL_
+#define H_SMP_SERIAL_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "base64/base64.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum length of a frame, including delimiter and newline. */
+#define SMP_SERIAL_FRAME_MAX        127
+
+#define SMP_SERIAL_DELIM_PKT_1      0x06
+#define SMP_SERIAL_DELIM_PKT_2      0x09
+#define SMP_SERIAL_DELIM_FRAG_1     0x04
+#define SMP_SERIAL_DELIM_FRAG_2     0x14
+
+/**
+ * @brief Counts the frames and packets seen by a serial decoder.
+ */
+struct smp_serial_rx_stats {
+    /* Complete, valid packets. */
+    uint32_t pkts;
+
+    /* Packets discarded due to a CRC mismatch. */
+    uint32_t crc_errs;
+
+    /* Packets discarded due to malformed frames. */
+    uint32_t frame_errs;
+
+    /* Packets discarded because no buffer was available or the packet
+     * didn't fit.
+     */
+    uint32_t overflows;
+};
+
+/**
+ * @brief Decodes SMP packets from a serial byte stream.
+ *
+ * Bytes are decoded as they arrive, straight into the caller's packet
+ * buffer; no line is buffered.
+ */
+struct smp_serial_rx {
+    /* Destination for the packet being received; NULL if none. */
+    uint8_t *ssr_buf;
+    size_t ssr_buf_size;
+
+    /* Number of packet bytes decoded so far, including the CRC. */
+    uint16_t ssr_off;
+
+    /* Length field of the packet being received. */
+    uint16_t ssr_pkt_len;
+    uint8_t ssr_hdr_bytes;
+
+    uint16_t ssr_crc;
+    uint8_t ssr_state;
+
+    /* A packet has started and awaits continuation frames. */
+    uint8_t ssr_in_pkt;
+    struct base64_decoder ssr_b64;
+
+    struct smp_serial_rx_stats ssr_stats;
+};
+
+/** @typedef smp_serial_write_fn
+ * @brief Writes part of an encoded packet to a serial line.
+ *
+ * @param data                  The bytes to write.
+ * @param len                   The number of bytes to write.
+ * @param arg                   Optional argument.
+ *
+ * @return                      0 on success, nonzero on failure.
+ */
+typedef int smp_serial_write_fn(const void *data, int len, void *arg);
+
+/**
+ * @brief Initializes a serial decoder.
+ *
+ * @param ssr                   The decoder to initialize.
+ */
+void smp_serial_rx_init(struct smp_serial_rx *ssr);
+
+/**
+ * @brief Supplies the buffer that the next packet is decoded into.
+ *
+ * Call this after each completed packet, once the previous buffer has been
+ * handed off.  If no buffer is set when a packet starts, the packet is
+ * discarded.
+ *
+ * @param ssr                   The decoder to configure.
+ * @param buf                   The buffer to decode into; may be NULL.
+ * @param size                  The size of the buffer, in bytes.
+ */
+void smp_serial_rx_set_buf(struct smp_serial_rx *ssr, void *buf, size_t size);
+
+/**
+ * @brief Processes one byte received from a serial line.
+ *
+ * This function is suitable for calling from an interrupt handler.
+ *
+ * @param ssr                   The decoder to process the byte with.
+ * @param byte                  The received byte.
+ *
+ * @return                      The length of the SMP packet if this byte
+ *                                  completed one; the packet occupies the
+ *                                  start of the supplied buffer.
+ *                              0 otherwise.
+ */
+int smp_serial_rx_byte(struct smp_serial_rx *ssr, uint8_t byte);
+
+/**
+ * @brief Encodes an SMP packet and writes it to a serial line.
+ *
+ * The write function is called once per frame.
+ *
+ * @param data                  The SMP packet to send.
+ * @param len                   The length of the packet, in bytes.
+ * @param write_cb              Writes the encoded frames.
+ * @param arg                   Optional argument to pass to the write
+ *                                  function.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int smp_serial_tx_pkt(const void *data, int len,
+                      smp_serial_write_fn *write_cb, void *arg);
+
+/**
+ * @brief Calculates the CRC16 of a buffer, continuing from a previous
+ *        value.
+ *
+ * @param crc                   The CRC so far; 0 to start.
+ * @param data                  The data to process.
+ * @param len                   The length of the data, in bytes.
+ *
+ * @return                      The updated CRC.
+ */
+uint16_t smp_serial_crc16(uint16_t crc, const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -21,8 +21,13 @@
 #define H_MYNEWT_SMP_
 
 #include <inttypes.h>
+#include "syscfg/syscfg.h"
 #include "mgmt/mgmt.h"
 #include "os/os_mbuf.h"
+#include "os/os_mempool.h"
+#include "cbor_mbuf_reader.h"
+#include "cbor_mbuf_writer.h"
+#include "smp/smp.h"
 struct mynewt_smp_transport;
 
 #ifdef __cplusplus
@@ -57,6 +62,24 @@ typedef int mynewt_smp_transport_out_fn(struct mynewt_smp_transport *mst,
  */
 typedef uint16_t mynewt_smp_transport_get_mtu_fn(struct os_mbuf *om);
 
+/**
+ * @brief Records how long a transport occupies the event queue.
+ */
+struct mynewt_smp_work_stats {
+    /* Longest single processing run, in microseconds. */
+    uint32_t max_hold_us;
+
+    /* Number of times processing re-posted its event due to its budget. */
+    uint32_t yields;
+};
+
+#if MYNEWT_VAL(SMP_ERR_BUF)
+/** Size of the block holding a transport's reserved error-response mbuf. */
+#define MYNEWT_SMP_ERR_BLOCK_SIZE                                   \
+    (sizeof (struct os_mbuf) + sizeof (struct os_mbuf_pkthdr) +     \
+     MYNEWT_VAL(SMP_ERR_BUF_USRHDR_MAX) + SMP_ERR_RSP_MAX_LEN)
+#endif
+
 /**
  * @brief Provides Mynewt-specific functionality for sending SMP responses.
  */ 
@@ -64,6 +87,29 @@ struct mynewt_smp_transport {
     struct os_mqueue mst_imq;
     mynewt_smp_transport_out_fn *mst_output;
     mynewt_smp_transport_get_mtu_fn *mst_get_mtu;
+
+    /* Persist across events so that a handler can defer its response. */
+    struct cbor_mbuf_reader mst_reader;
+    struct cbor_mbuf_writer mst_writer;
+    struct smp_streamer mst_streamer;
+    struct smp_deferred mst_deferred;
+
+    struct mynewt_smp_work_stats mst_work_stats;
+
+#if MYNEWT_VAL(SMP_RSP_CACHE_COUNT) > 0
+    struct smp_rsp_cache mst_rsp_cache;
+    struct smp_rsp_cache_entry
+        mst_rsp_cache_entries[MYNEWT_VAL(SMP_RSP_CACHE_COUNT)];
+    uint8_t mst_rsp_cache_data[MYNEWT_VAL(SMP_RSP_CACHE_COUNT)]
+                              [MYNEWT_VAL(SMP_RSP_CACHE_SIZE)];
+#endif
+
+#if MYNEWT_VAL(SMP_ERR_BUF)
+    /* Single-mbuf pool reserved for error responses. */
+    struct os_mbuf_pool mst_err_mbuf_pool;
+    struct os_mempool mst_err_mempool;
+    os_membuf_t mst_err_mem[OS_MEMPOOL_SIZE(1, MYNEWT_SMP_ERR_BLOCK_SIZE)];
+#endif
 };
 
 /**
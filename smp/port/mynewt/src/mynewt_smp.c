@@ -19,6 +19,7 @@
 
 #include "sysinit/sysinit.h"
 #include "os/os.h"
+#include "os/os_cputime.h"
 #include "mynewt_mgmt/mynewt_mgmt.h"
 #include "smp/smp.h"
 #include "mgmt_os/mgmt_os.h"
@@ -38,6 +39,13 @@ static mgmt_init_reader_fn mynewt_smp_init_reader;
 static mgmt_init_writer_fn mynewt_smp_init_writer;
 static mgmt_free_buf_fn mynewt_smp_free_buf;
 static smp_tx_rsp_fn mynewt_smp_tx_rsp;
+static smp_resume_fn mynewt_smp_resume;
+#if MYNEWT_VAL(SMP_COALESCE_RSP)
+static smp_rsp_max_fn mynewt_smp_rsp_max;
+#endif
+#if MYNEWT_VAL(SMP_ERR_BUF)
+static smp_err_buf_fn mynewt_smp_err_buf;
+#endif
 
 static const struct mgmt_streamer_cfg mynewt_smp_cbor_cfg = {
     .alloc_rsp = mynewt_smp_alloc_rsp,
@@ -189,41 +197,136 @@ mynewt_smp_tx_rsp(struct smp_streamer *ss, void *rsp, void *arg)
     return MGMT_ERR_EOK;
 }
 
+#if MYNEWT_VAL(SMP_COALESCE_RSP)
+static size_t
+mynewt_smp_rsp_max(struct smp_streamer *ss, const void *buf, void *arg)
+{
+    struct mynewt_smp_transport *mst;
+
+    /* Mbuf chains grow as needed; only the MTU limits the packet size. */
+    mst = arg;
+    return mst->mst_get_mtu((struct os_mbuf *)buf);
+}
+#endif
+
+#if MYNEWT_VAL(SMP_ERR_BUF)
+/**
+ * Allocates the transport's reserved error mbuf.  Its pool holds a single
+ * mbuf, which returns to the pool once the error response has been sent.
+ */
+static void *
+mynewt_smp_err_buf(struct smp_streamer *ss, const void *req, void *arg)
+{
+    struct mynewt_smp_transport *mst;
+    const struct os_mbuf *om_req;
+    struct os_mbuf *om_rsp;
+
+    mst = arg;
+    om_req = req;
+
+    if (OS_MBUF_USRHDR_LEN(om_req) > MYNEWT_VAL(SMP_ERR_BUF_USRHDR_MAX)) {
+        return NULL;
+    }
+
+    om_rsp = os_mbuf_get_pkthdr(&mst->mst_err_mbuf_pool,
+                                OS_MBUF_USRHDR_LEN(om_req));
+    if (om_rsp == NULL) {
+        return NULL;
+    }
+
+    memcpy(OS_MBUF_USRHDR(om_rsp),
+           OS_MBUF_USRHDR(om_req),
+           OS_MBUF_USRHDR_LEN(om_req));
+
+    return om_rsp;
+}
+#endif
+
+static void
+mynewt_smp_resume(struct smp_streamer *ss, void *arg)
+{
+    struct mynewt_smp_transport *mst;
+
+    mst = arg;
+    os_eventq_put(mgmt_evq_get(), &mst->mst_imq.mq_ev);
+}
+
 static void
 mynewt_smp_free_buf(void *buf, void *arg)
 {
     os_mbuf_free_chain(buf);
 }
 
+static uint32_t
+mynewt_smp_elapsed_us(uint32_t start_ticks)
+{
+    return os_cputime_ticks_to_usecs(os_cputime_get32() - start_ticks);
+}
+
+/**
+ * Indicates whether a single processing run has used up its budget.
+ */
+static bool
+mynewt_smp_budget_spent(int num_pkts, uint32_t start_ticks)
+{
+    if (MYNEWT_VAL(SMP_WORK_MAX_REQS) > 0 &&
+        num_pkts >= MYNEWT_VAL(SMP_WORK_MAX_REQS)) {
+
+        return true;
+    }
+
+    if (MYNEWT_VAL(SMP_WORK_MAX_US) > 0 &&
+        mynewt_smp_elapsed_us(start_ticks) >= MYNEWT_VAL(SMP_WORK_MAX_US)) {
+
+        return true;
+    }
+
+    return false;
+}
+
 static void
 mynewt_smp_process(struct mynewt_smp_transport *mst)
 {
-    struct cbor_mbuf_reader reader;
-    struct cbor_mbuf_writer writer;
-    struct smp_streamer streamer;
     struct os_mbuf *req;
+    uint32_t start_ticks;
+    uint32_t hold_us;
+    int num_pkts;
     int rc;
 
-    streamer = (struct smp_streamer) {
-        .mgmt_stmr = {
-            .cfg = &mynewt_smp_cbor_cfg,
-            .reader = &reader.r,
-            .writer = &writer.enc,
-            .cb_arg = mst,
-        },
-        .tx_rsp_cb = mynewt_smp_tx_rsp,
-    };
-
-    while (1) {
-        req = os_mqueue_get(&mst->mst_imq);
-        if (req == NULL) {
-            break;
+    start_ticks = os_cputime_get32();
+    num_pkts = 0;
+
+    /* Don't process anything else while a response is deferred. */
+    rc = smp_resume_deferred(&mst->mst_streamer);
+    if (rc != MGMT_DEFERRED) {
+        while (1) {
+            req = os_mqueue_get(&mst->mst_imq);
+            if (req == NULL) {
+                break;
+            }
+
+            rc = smp_process_request_packet(&mst->mst_streamer, req);
+            if (rc != 0) {
+                break;
+            }
+
+            /* Once the budget is spent, let other events run before
+             * processing the rest of the queue.
+             */
+            num_pkts++;
+            if (mynewt_smp_budget_spent(num_pkts, start_ticks)) {
+                if (STAILQ_FIRST(&mst->mst_imq.mq_msg_list) != NULL) {
+                    mst->mst_work_stats.yields++;
+                    os_eventq_put(mgmt_evq_get(), &mst->mst_imq.mq_ev);
+                }
+                break;
+            }
         }
+    }
 
-        rc = smp_process_request_packet(&streamer, req);
-        if (rc != 0) {
-            break;
-        }
+    hold_us = mynewt_smp_elapsed_us(start_ticks);
+    if (hold_us > mst->mst_work_stats.max_hold_us) {
+        mst->mst_work_stats.max_hold_us = hold_us;
     }
 }
 
@@ -245,6 +348,51 @@ mynewt_smp_transport_init(struct mynewt_smp_transport *mst,
         .mst_get_mtu = get_mtu_func,
     };
 
+    mst->mst_streamer = (struct smp_streamer) {
+        .mgmt_stmr = {
+            .cfg = &mynewt_smp_cbor_cfg,
+            .reader = &mst->mst_reader.r,
+            .writer = &mst->mst_writer.enc,
+            .cb_arg = mst,
+        },
+        .tx_rsp_cb = mynewt_smp_tx_rsp,
+#if MYNEWT_VAL(SMP_COALESCE_RSP)
+        .rsp_max_cb = mynewt_smp_rsp_max,
+#endif
+        .deferred = &mst->mst_deferred,
+        .resume_cb = mynewt_smp_resume,
+#if MYNEWT_VAL(SMP_DEFINITE_LEN)
+        .definite_len = true,
+#endif
+    };
+
+#if MYNEWT_VAL(SMP_RSP_CACHE_COUNT) > 0
+    mst->mst_rsp_cache = (struct smp_rsp_cache) {
+        .src_entries = mst->mst_rsp_cache_entries,
+        .src_data = &mst->mst_rsp_cache_data[0][0],
+        .src_entry_size = MYNEWT_VAL(SMP_RSP_CACHE_SIZE),
+        .src_num_entries = MYNEWT_VAL(SMP_RSP_CACHE_COUNT),
+        .src_timeout_ms = MYNEWT_VAL(SMP_RSP_CACHE_TIMEOUT_MS),
+    };
+    mst->mst_streamer.rsp_cache = &mst->mst_rsp_cache;
+#endif
+
+#if MYNEWT_VAL(SMP_ERR_BUF)
+    rc = os_mempool_init(&mst->mst_err_mempool, 1, MYNEWT_SMP_ERR_BLOCK_SIZE,
+                         mst->mst_err_mem, "smp_err");
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = os_mbuf_pool_init(&mst->mst_err_mbuf_pool, &mst->mst_err_mempool,
+                           MYNEWT_SMP_ERR_BLOCK_SIZE, 1);
+    if (rc != 0) {
+        return rc;
+    }
+
+    mst->mst_streamer.err_buf_cb = mynewt_smp_err_buf;
+#endif
+
     rc = os_mqueue_init(&mst->mst_imq, mynewt_smp_event_data_in, mst);
     if (rc != 0) {
         return rc;
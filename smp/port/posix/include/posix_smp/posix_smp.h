@@ -0,0 +1,204 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_SMP_
+#define H_POSIX_SMP_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "posix_mgmt/buf.h"
+#include "smp/smp.h"
+
+/**
+ * Whether received requests are passed to the processing thread through a
+ * lock-free ring rather than a mutex-protected queue.  The ring requires
+ * each transport to call posix_smp_rx_req() from a single thread.
+ */
+#ifndef POSIX_SMP_RX_RING
+#define POSIX_SMP_RX_RING       0
+#endif
+
+/**
+ * Whether responses to packed requests are coalesced into a single packet, up
+ * to the transport's MTU.  The client must be able to parse several responses
+ * from one packet.
+ */
+#ifndef POSIX_SMP_COALESCE_RSP
+#define POSIX_SMP_COALESCE_RSP  0
+#endif
+
+/**
+ * The number of recent responses each transport retains for answering
+ * retransmitted requests; see struct smp_rsp_cache.  0 disables the cache.
+ */
+#ifndef POSIX_SMP_RSP_CACHE_COUNT
+#define POSIX_SMP_RSP_CACHE_COUNT       0
+#endif
+
+/** The maximum size, in bytes, of a cached response, including its header. */
+#ifndef POSIX_SMP_RSP_CACHE_SIZE
+#define POSIX_SMP_RSP_CACHE_SIZE        64
+#endif
+
+/** Age, in milliseconds, after which a cached response is not resent. */
+#ifndef POSIX_SMP_RSP_CACHE_TIMEOUT_MS
+#define POSIX_SMP_RSP_CACHE_TIMEOUT_MS  5000
+#endif
+
+#if POSIX_SMP_RX_RING
+#include <stdatomic.h>
+#include "posix_smp/posix_smp_ring.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct posix_smp_transport;
+
+/** @typedef posix_smp_transport_out_fn
+ * @brief SMP transmit function for POSIX.
+ *
+ * The supplied buffer is always consumed, regardless of return code.
+ *
+ * @param pst                   The transport to send via.
+ * @param mb                    The buffer to transmit.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int posix_smp_transport_out_fn(struct posix_smp_transport *pst,
+                                       struct mcumgr_buf *mb);
+
+/** @typedef posix_smp_transport_get_mtu_fn
+ * @brief SMP MTU query function for POSIX.
+ *
+ * @param pst                   The transport being queried.
+ * @param mb                    Contains a request from the relevant peer.
+ *
+ * @return                      The transport's MTU;
+ *                              0 if transmission is currently not possible.
+ */
+typedef uint16_t
+posix_smp_transport_get_mtu_fn(struct posix_smp_transport *pst,
+                               const struct mcumgr_buf *mb);
+
+/**
+ * @brief Provides POSIX-specific functionality for sending SMP responses.
+ *
+ * Each transport processes its requests in its own thread, which plays the
+ * role of the work queue in the embedded ports.
+ */
+struct posix_smp_transport {
+    posix_smp_transport_out_fn *pst_output;
+    posix_smp_transport_get_mtu_fn *pst_get_mtu;
+
+    /* Received request packets, waiting to be processed. */
+#if POSIX_SMP_RX_RING
+    struct posix_smp_ring pst_ring;
+
+    /* The thread is waiting, or about to wait, for the condition variable;
+     * a producer must signal it.
+     */
+    atomic_bool pst_waiting;
+#else
+    struct mcumgr_buf *pst_queue[MCUMGR_BUF_COUNT];
+    int pst_queue_head;
+    int pst_queue_len;
+#endif
+
+    pthread_t pst_thread;
+    pthread_mutex_t pst_mtx;
+    pthread_cond_t pst_cond;
+
+    /* A deferred response is outstanding; hold off on new requests. */
+    bool pst_blocked;
+
+    /* A deferred response has been completed. */
+    bool pst_resume;
+
+    /* The thread is processing a request packet. */
+    bool pst_busy;
+
+    /* The transport is being stopped.  Also read atomically, without the
+     * mutex, while the thread drains the ring.
+     */
+    bool pst_stop;
+
+    struct cbor_mb_reader pst_reader;
+    struct cbor_mb_writer pst_writer;
+    struct smp_streamer pst_streamer;
+    struct smp_deferred pst_deferred;
+
+#if POSIX_SMP_RSP_CACHE_COUNT > 0
+    struct smp_rsp_cache pst_rsp_cache;
+    struct smp_rsp_cache_entry
+        pst_rsp_cache_entries[POSIX_SMP_RSP_CACHE_COUNT];
+    uint8_t pst_rsp_cache_data[POSIX_SMP_RSP_CACHE_COUNT]
+                              [POSIX_SMP_RSP_CACHE_SIZE];
+#endif
+};
+
+/**
+ * @brief Initializes a POSIX SMP transport object and starts its processing
+ *        thread.
+ *
+ * @param pst                   The transport to construct.
+ * @param output_func           The transport's send function.
+ * @param get_mtu_func          The transport's get-MTU function.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int posix_smp_transport_init(struct posix_smp_transport *pst,
+                             posix_smp_transport_out_fn *output_func,
+                             posix_smp_transport_get_mtu_fn *get_mtu_func);
+
+/**
+ * @brief Stops a transport's processing thread and frees any queued
+ *        requests.
+ *
+ * @param pst                   The transport to stop.
+ */
+void posix_smp_transport_stop(struct posix_smp_transport *pst);
+
+/**
+ * @brief Enqueues an incoming SMP request packet for processing.
+ *
+ * This function always consumes the supplied buffer.  It may be called from
+ * any thread, but if POSIX_SMP_RX_RING is enabled, all calls for a given
+ * transport must come from the same thread.
+ *
+ * @param pst                   The transport to use to send the corresponding
+ *                                  response(s).
+ * @param mb                    The request packet to process.
+ */
+void posix_smp_rx_req(struct posix_smp_transport *pst, struct mcumgr_buf *mb);
+
+/**
+ * @brief Blocks until a transport has no queued requests, no outstanding
+ *        deferred response, and is idle.
+ *
+ * @param pst                   The transport to wait for.
+ */
+void posix_smp_transport_flush(struct posix_smp_transport *pst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
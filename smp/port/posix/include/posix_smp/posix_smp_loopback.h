@@ -0,0 +1,91 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_SMP_LOOPBACK_
+#define H_POSIX_SMP_LOOPBACK_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "posix_smp/posix_smp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @typedef posix_smp_loopback_rsp_fn
+ * @brief Receives a response packet sent over a loopback transport.
+ *
+ * Called in the transport's processing thread.
+ *
+ * @param data                  The response packet.
+ * @param len                   The length of the response packet, in bytes.
+ * @param arg                   Optional argument.
+ */
+typedef void posix_smp_loopback_rsp_fn(const void *data, size_t len,
+                                       void *arg);
+
+/**
+ * @brief An in-process SMP transport.
+ *
+ * Requests are injected with posix_smp_loopback_send(); responses are handed
+ * to a callback.  This lets tests and benchmarks exercise the full SMP stack
+ * without a real link.
+ */
+struct posix_smp_loopback {
+    /* Must be first so that a transport pointer can be cast to a loopback. */
+    struct posix_smp_transport psl_transport;
+
+    posix_smp_loopback_rsp_fn *psl_rsp_cb;
+    void *psl_arg;
+    uint16_t psl_mtu;
+};
+
+/**
+ * @brief Initializes a loopback transport and starts its processing thread.
+ *
+ * @param psl                   The loopback transport to initialize.
+ * @param mtu                   The largest response packet to emit; longer
+ *                                  responses are fragmented.
+ * @param rsp_cb                The callback to hand responses to.
+ * @param arg                   Optional argument to pass to the callback.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int posix_smp_loopback_init(struct posix_smp_loopback *psl, uint16_t mtu,
+                            posix_smp_loopback_rsp_fn *rsp_cb, void *arg);
+
+/**
+ * @brief Sends a request packet over a loopback transport.
+ *
+ * @param psl                   The loopback transport to send over.
+ * @param req                   The request packet.
+ * @param len                   The length of the request packet, in bytes.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOMEM if no buffer is available or
+ *                                  the request is too large.
+ */
+int posix_smp_loopback_send(struct posix_smp_loopback *psl, const void *req,
+                            size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
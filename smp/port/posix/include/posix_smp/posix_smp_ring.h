@@ -0,0 +1,102 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_SMP_RING_
+#define H_POSIX_SMP_RING_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "posix_mgmt/buf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of slots in a ring.  One slot is always left empty, and every
+ * buffer comes from the same pool, so a ring can never overflow.
+ */
+#define POSIX_SMP_RING_SIZE     (MCUMGR_BUF_COUNT + 1)
+
+/** Keeps the producer's and consumer's indices in separate cache lines. */
+#define POSIX_SMP_RING_ALIGN    64
+
+/**
+ * @brief A lock-free queue of buffers with a single producer and a single
+ *        consumer.
+ *
+ * Each index is written by only one side and published with release
+ * semantics, so neither side ever waits for the other.  Each side also keeps
+ * a private copy of the other side's index and only reloads it when the ring
+ * appears full or empty, which keeps the shared cache lines from bouncing
+ * on every operation.
+ */
+struct posix_smp_ring {
+    struct mcumgr_buf *psr_slots[POSIX_SMP_RING_SIZE];
+
+    /* Consumer side: next slot to read. */
+    _Alignas(POSIX_SMP_RING_ALIGN) atomic_uint psr_head;
+    unsigned int psr_tail_cache;
+
+    /* Producer side: next slot to write. */
+    _Alignas(POSIX_SMP_RING_ALIGN) atomic_uint psr_tail;
+    unsigned int psr_head_cache;
+};
+
+/**
+ * @brief Initializes an empty ring.
+ *
+ * @param psr                   The ring to initialize.
+ */
+void posix_smp_ring_init(struct posix_smp_ring *psr);
+
+/**
+ * @brief Appends a buffer to a ring.  Only the producer may call this.
+ *
+ * @param psr                   The ring to append to.
+ * @param mb                    The buffer to append.
+ *
+ * @return                      0 on success; -1 if the ring is full.
+ */
+int posix_smp_ring_put(struct posix_smp_ring *psr, struct mcumgr_buf *mb);
+
+/**
+ * @brief Removes the oldest buffer from a ring.  Only the consumer may call
+ *        this.
+ *
+ * @param psr                   The ring to remove from.
+ *
+ * @return                      The removed buffer; NULL if the ring is empty.
+ */
+struct mcumgr_buf *posix_smp_ring_get(struct posix_smp_ring *psr);
+
+/**
+ * @brief Indicates whether a ring is empty.  Either side may call this.
+ *
+ * @param psr                   The ring to query.
+ *
+ * @return                      true if the ring is empty.
+ */
+bool posix_smp_ring_is_empty(struct posix_smp_ring *psr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_SMP_SERIAL_
+#define H_POSIX_SMP_SERIAL_
+
+#include <pthread.h>
+#include "smp/smp_serial.h"
+#include "posix_smp/posix_smp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief An SMP transport over a serial line, such as a UART or a
+ *        pseudo-terminal.
+ *
+ * Packets are framed in the mcumgr console format (see smp/smp_serial.h).
+ * Received bytes are decoded as they are read, directly into an mcumgr
+ * buffer.
+ */
+struct posix_smp_serial {
+    /* Must be first so that a transport pointer can be cast to a serial
+     * transport.
+     */
+    struct posix_smp_transport pss_transport;
+
+    int pss_fd;
+    struct smp_serial_rx pss_rx;
+
+    /* Buffer that the packet being received is decoded into. */
+    struct mcumgr_buf *pss_mb;
+
+    /* Written to by posix_smp_serial_stop() to wake the receive thread. */
+    int pss_stop_pipe[2];
+    pthread_t pss_rx_thread;
+};
+
+/**
+ * @brief Opens a serial device and starts serving SMP requests on it.
+ *
+ * The device is put in raw mode.  If it is a terminal and a baud rate is
+ * specified, the line is set to that rate.
+ *
+ * @param pss                   The transport to initialize.
+ * @param path                  The path of the serial device.
+ * @param baud                  The baud rate to configure; 0 to leave the
+ *                                  line's rate unchanged.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int posix_smp_serial_init(struct posix_smp_serial *pss, const char *path,
+                          int baud);
+
+/**
+ * @brief Stops serving requests and closes the serial device.
+ *
+ * @param pss                   The transport to stop.
+ */
+void posix_smp_serial_stop(struct posix_smp_serial *pss);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
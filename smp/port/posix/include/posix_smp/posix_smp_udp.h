@@ -0,0 +1,116 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_SMP_UDP_
+#define H_POSIX_SMP_UDP_
+
+#include <pthread.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include "posix_smp/posix_smp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum number of peers tracked at once. */
+#ifndef POSIX_SMP_UDP_MAX_PEERS
+#define POSIX_SMP_UDP_MAX_PEERS     8
+#endif
+
+/**
+ * @brief A client of the UDP transport, identified by its address.
+ */
+struct posix_smp_udp_peer {
+    struct sockaddr_storage psp_addr;
+    socklen_t psp_addr_len;
+
+    /* Largest response datagram payload along the path to this peer. */
+    uint16_t psp_mtu;
+
+    /* Distinguishes this peer from earlier ones that used the same entry.
+     * 0 indicates an unused entry.
+     */
+    uint32_t psp_id;
+
+    /* Value of psu_clock when this peer last sent a request. */
+    uint32_t psp_last_rx;
+};
+
+/**
+ * @brief An SMP transport over UDP.
+ *
+ * Each datagram carries one SMP request or response fragment.  Each peer
+ * address gets an entry in a small table holding its path MTU; responses
+ * are routed by entry.  When the table is full, the least recently active
+ * peer is evicted, and any responses still queued for it are dropped.
+ */
+struct posix_smp_udp {
+    /* Must be first so that a transport pointer can be cast to a UDP. */
+    struct posix_smp_transport psu_transport;
+
+    struct posix_smp_udp_peer psu_peers[POSIX_SMP_UDP_MAX_PEERS];
+    uint32_t psu_next_id;
+    uint32_t psu_clock;
+    pthread_mutex_t psu_mtx;
+
+    /* IPv4 and IPv6 sockets; -1 if unavailable. */
+    int psu_fds[2];
+
+    /* Written to by posix_smp_udp_stop() to wake the receive thread. */
+    int psu_stop_pipe[2];
+    pthread_t psu_rx_thread;
+};
+
+/**
+ * @brief Binds UDP sockets to the specified port and starts serving SMP
+ *        requests on them.
+ *
+ * An IPv4 socket and an IPv6 socket are opened; the transport starts as long
+ * as at least one of them can be.
+ *
+ * @param psu                   The transport to initialize.
+ * @param port                  The UDP port to listen on; 0 to pick an
+ *                                  ephemeral port.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int posix_smp_udp_init(struct posix_smp_udp *psu, uint16_t port);
+
+/**
+ * @brief Retrieves the UDP port that a transport is listening on.
+ *
+ * @param psu                   The transport to query.
+ *
+ * @return                      The port, in host byte order.
+ */
+uint16_t posix_smp_udp_port(const struct posix_smp_udp *psu);
+
+/**
+ * @brief Stops serving requests and closes the transport's sockets.
+ *
+ * @param psu                   The transport to stop.
+ */
+void posix_smp_udp_stop(struct posix_smp_udp *psu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
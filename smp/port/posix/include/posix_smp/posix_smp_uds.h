@@ -0,0 +1,91 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_POSIX_SMP_UDS_
+#define H_POSIX_SMP_UDS_
+
+#include <pthread.h>
+#include <inttypes.h>
+#include "posix_smp/posix_smp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum number of simultaneous clients. */
+#ifndef POSIX_SMP_UDS_MAX_CONNS
+#define POSIX_SMP_UDS_MAX_CONNS     4
+#endif
+
+struct posix_smp_uds_conn {
+    int psc_fd;
+
+    /* Distinguishes this connection from earlier ones that used the same
+     * descriptor.  0 indicates an unused entry.
+     */
+    uint32_t psc_id;
+};
+
+/**
+ * @brief An SMP transport over a UNIX-domain socket.
+ *
+ * The server listens on a SOCK_SEQPACKET socket; each packet carries exactly
+ * one SMP request or response fragment.  Responses are routed to the
+ * connection that sent the corresponding request.
+ */
+struct posix_smp_uds {
+    /* Must be first so that a transport pointer can be cast to a UDS. */
+    struct posix_smp_transport psu_transport;
+
+    struct posix_smp_uds_conn psu_conns[POSIX_SMP_UDS_MAX_CONNS];
+    uint32_t psu_next_id;
+    pthread_mutex_t psu_mtx;
+
+    int psu_listen_fd;
+
+    /* Written to by posix_smp_uds_stop() to wake the receive thread. */
+    int psu_stop_pipe[2];
+    pthread_t psu_rx_thread;
+};
+
+/**
+ * @brief Creates a listening socket at the specified path and starts
+ *        serving SMP requests on it.
+ *
+ * Any existing file at the path is replaced.
+ *
+ * @param psu                   The transport to initialize.
+ * @param path                  The filesystem path to listen on.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int posix_smp_uds_init(struct posix_smp_uds *psu, const char *path);
+
+/**
+ * @brief Stops serving requests and closes all sockets.
+ *
+ * @param psu                   The transport to stop.
+ */
+void posix_smp_uds_stop(struct posix_smp_uds *psu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,524 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* For pthread_setname_np(). */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <string.h>
+#include "mgmt/mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "smp/smp.h"
+#include "posix_smp/posix_smp.h"
+
+static mgmt_alloc_rsp_fn posix_smp_alloc_rsp;
+static mgmt_trim_front_fn posix_smp_trim_front;
+static mgmt_reset_buf_fn posix_smp_reset_buf;
+static mgmt_write_at_fn posix_smp_write_at;
+static mgmt_init_reader_fn posix_smp_init_reader;
+static mgmt_init_writer_fn posix_smp_init_writer;
+static mgmt_free_buf_fn posix_smp_free_buf;
+static mgmt_session_key_fn posix_smp_session_key;
+static smp_tx_rsp_fn posix_smp_tx_rsp;
+static smp_resume_fn posix_smp_resume;
+#if POSIX_SMP_COALESCE_RSP
+static smp_rsp_max_fn posix_smp_rsp_max;
+#endif
+
+static const struct mgmt_streamer_cfg posix_smp_cbor_cfg = {
+    .alloc_rsp = posix_smp_alloc_rsp,
+    .trim_front = posix_smp_trim_front,
+    .reset_buf = posix_smp_reset_buf,
+    .write_at = posix_smp_write_at,
+    .init_reader = posix_smp_init_reader,
+    .init_writer = posix_smp_init_writer,
+    .free_buf = posix_smp_free_buf,
+    .session_key = posix_smp_session_key,
+};
+
+static void *
+posix_smp_alloc_rsp(const void *req, void *arg)
+{
+    const struct mcumgr_buf *req_mb;
+    struct mcumgr_buf *rsp_mb;
+
+    req_mb = req;
+
+    rsp_mb = mcumgr_buf_alloc();
+    if (rsp_mb == NULL) {
+        return NULL;
+    }
+
+    if (req_mb != NULL) {
+        memcpy(rsp_mb->user_data, req_mb->user_data, sizeof rsp_mb->user_data);
+    }
+
+    return rsp_mb;
+}
+
+static void
+posix_smp_trim_front(void *buf, size_t len, void *arg)
+{
+    mcumgr_buf_pull(buf, len);
+}
+
+static void
+posix_smp_reset_buf(void *buf, void *arg)
+{
+    mcumgr_buf_reset(buf);
+}
+
+static int
+posix_smp_write_at(struct cbor_encoder_writer *writer, size_t offset,
+                   const void *data, size_t len, void *arg)
+{
+    struct cbor_mb_writer *cmw;
+    struct mcumgr_buf *mb;
+
+    cmw = (struct cbor_mb_writer *)writer;
+    mb = cmw->mb;
+
+    if (offset > mb->len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (offset + len > mb->len + mcumgr_buf_tailroom(mb)) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    memcpy(mb->data + offset, data, len);
+    if (mb->len < offset + len) {
+        mb->len = offset + len;
+        writer->bytes_written = mb->len;
+    }
+
+    return 0;
+}
+
+static int
+posix_smp_init_reader(struct cbor_decoder_reader *reader, void *buf,
+                      void *arg)
+{
+    cbor_mb_reader_init((struct cbor_mb_reader *)reader, buf);
+    return 0;
+}
+
+static int
+posix_smp_init_writer(struct cbor_encoder_writer *writer, void *buf,
+                      void *arg)
+{
+    cbor_mb_writer_init((struct cbor_mb_writer *)writer, buf);
+    return 0;
+}
+
+static void
+posix_smp_free_buf(void *buf, void *arg)
+{
+    mcumgr_buf_free(buf);
+}
+
+static const void *
+posix_smp_session_key(const void *req, size_t *out_len, void *arg)
+{
+    const struct mcumgr_buf *mb;
+
+    mb = req;
+    *out_len = sizeof mb->user_data;
+    return mb->user_data;
+}
+
+/**
+ * Splits an MTU-sized fragment from the front of a response.  The fragment is
+ * copied into a new buffer; if the response fits in a single fragment, the
+ * response itself is returned and the supplied pointer is set to NULL.
+ */
+static struct mcumgr_buf *
+posix_smp_split_frag(struct mcumgr_buf **mb, uint16_t mtu)
+{
+    struct mcumgr_buf *frag;
+    struct mcumgr_buf *src;
+
+    src = *mb;
+
+    if (src->len <= mtu) {
+        *mb = NULL;
+        return src;
+    }
+
+    frag = posix_smp_alloc_rsp(src, NULL);
+    if (frag == NULL) {
+        return NULL;
+    }
+
+    mcumgr_buf_add(frag, src->data, mtu);
+    mcumgr_buf_pull(src, mtu);
+
+    return frag;
+}
+
+static int
+posix_smp_tx_rsp(struct smp_streamer *ss, void *rsp, void *arg)
+{
+    struct posix_smp_transport *pst;
+    struct mcumgr_buf *frag;
+    struct mcumgr_buf *mb;
+    uint16_t mtu;
+    int rc;
+
+    pst = arg;
+    mb = rsp;
+
+    mtu = pst->pst_get_mtu(pst, mb);
+    if (mtu == 0) {
+        /* The transport cannot support a transmission right now. */
+        mcumgr_buf_free(mb);
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    while (mb != NULL) {
+        frag = posix_smp_split_frag(&mb, mtu);
+        if (frag == NULL) {
+            mcumgr_buf_free(mb);
+            return MGMT_ERR_ENOMEM;
+        }
+
+        rc = pst->pst_output(pst, frag);
+        if (rc != 0) {
+            /* Output function already freed the fragment. */
+            mcumgr_buf_free(mb);
+            return MGMT_ERR_EUNKNOWN;
+        }
+    }
+
+    return 0;
+}
+
+#if POSIX_SMP_COALESCE_RSP
+static size_t
+posix_smp_rsp_max(struct smp_streamer *ss, const void *buf, void *arg)
+{
+    struct posix_smp_transport *pst;
+    const struct mcumgr_buf *mb;
+    size_t capacity;
+    uint16_t mtu;
+
+    pst = arg;
+    mb = buf;
+
+    mtu = pst->pst_get_mtu(pst, mb);
+    capacity = mb->len + mcumgr_buf_tailroom(mb);
+    if (mtu < capacity) {
+        return mtu;
+    }
+    return capacity;
+}
+#endif
+
+static void
+posix_smp_resume(struct smp_streamer *ss, void *arg)
+{
+    struct posix_smp_transport *pst;
+
+    pst = arg;
+
+    pthread_mutex_lock(&pst->pst_mtx);
+    pst->pst_resume = true;
+    pthread_cond_broadcast(&pst->pst_cond);
+    pthread_mutex_unlock(&pst->pst_mtx);
+}
+
+#if POSIX_SMP_RX_RING
+static struct mcumgr_buf *
+posix_smp_dequeue(struct posix_smp_transport *pst)
+{
+    return posix_smp_ring_get(&pst->pst_ring);
+}
+
+/**
+ * Processes queued requests until the ring is empty, a handler defers its
+ * response, or the transport is stopped.  Called and returns with the mutex
+ * held, but releases it for the whole run: only the worker takes requests
+ * out of the ring, so neither side takes the mutex unless the worker is
+ * about to sleep.
+ */
+static int
+posix_smp_process_queued(struct posix_smp_transport *pst)
+{
+    struct mcumgr_buf *mb;
+    int rc;
+
+    pthread_mutex_unlock(&pst->pst_mtx);
+
+    rc = 0;
+    while (!__atomic_load_n(&pst->pst_stop, __ATOMIC_RELAXED) &&
+           (mb = posix_smp_dequeue(pst)) != NULL) {
+
+        rc = smp_process_request_packet(&pst->pst_streamer, mb);
+        if (rc == MGMT_DEFERRED) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&pst->pst_mtx);
+
+    return rc;
+}
+
+static bool
+posix_smp_queue_is_empty(struct posix_smp_transport *pst)
+{
+    return posix_smp_ring_is_empty(&pst->pst_ring);
+}
+
+/**
+ * Waits for the condition variable unless a request arrived while the
+ * caller was deciding to wait.  The caller holds the mutex.  The flag and
+ * the ring are each written by one side and read by the other after a full
+ * fence, so at least one side sees the other's write: either the thread
+ * sees the new request, or the producer sees the flag and signals.
+ */
+static void
+posix_smp_wait(struct posix_smp_transport *pst)
+{
+    atomic_store(&pst->pst_waiting, true);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (posix_smp_ring_is_empty(&pst->pst_ring)) {
+        pthread_cond_wait(&pst->pst_cond, &pst->pst_mtx);
+    }
+
+    atomic_store(&pst->pst_waiting, false);
+}
+#else
+static struct mcumgr_buf *
+posix_smp_dequeue(struct posix_smp_transport *pst)
+{
+    struct mcumgr_buf *mb;
+
+    if (pst->pst_queue_len == 0) {
+        return NULL;
+    }
+
+    mb = pst->pst_queue[pst->pst_queue_head];
+    pst->pst_queue_head = (pst->pst_queue_head + 1) % MCUMGR_BUF_COUNT;
+    pst->pst_queue_len--;
+
+    return mb;
+}
+
+static bool
+posix_smp_queue_is_empty(struct posix_smp_transport *pst)
+{
+    return pst->pst_queue_len == 0;
+}
+
+/**
+ * Processes the oldest queued request.  Called and returns with the mutex
+ * held; the mutex is released while the request is processed.
+ */
+static int
+posix_smp_process_queued(struct posix_smp_transport *pst)
+{
+    struct mcumgr_buf *mb;
+    int rc;
+
+    mb = posix_smp_dequeue(pst);
+    pthread_mutex_unlock(&pst->pst_mtx);
+
+    rc = smp_process_request_packet(&pst->pst_streamer, mb);
+
+    pthread_mutex_lock(&pst->pst_mtx);
+
+    return rc;
+}
+
+static void
+posix_smp_wait(struct posix_smp_transport *pst)
+{
+    pthread_cond_wait(&pst->pst_cond, &pst->pst_mtx);
+}
+#endif
+
+/**
+ * Processes received SMP request packets until the transport is stopped.
+ * While a handler has a response deferred, only its completion is processed.
+ */
+static void *
+posix_smp_thread(void *arg)
+{
+    struct posix_smp_transport *pst;
+    int rc;
+
+    pst = arg;
+
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), "smp");
+#endif
+
+    pthread_mutex_lock(&pst->pst_mtx);
+    while (!pst->pst_stop) {
+        if (pst->pst_resume) {
+            pst->pst_resume = false;
+            pst->pst_busy = true;
+            pthread_mutex_unlock(&pst->pst_mtx);
+
+            rc = smp_resume_deferred(&pst->pst_streamer);
+
+            pthread_mutex_lock(&pst->pst_mtx);
+            pst->pst_blocked = rc == MGMT_DEFERRED;
+        } else if (!pst->pst_blocked && !posix_smp_queue_is_empty(pst)) {
+            pst->pst_busy = true;
+            rc = posix_smp_process_queued(pst);
+            pst->pst_blocked = rc == MGMT_DEFERRED;
+        } else {
+            pst->pst_busy = false;
+            pthread_cond_broadcast(&pst->pst_cond);
+            posix_smp_wait(pst);
+        }
+    }
+    pst->pst_busy = false;
+    pthread_cond_broadcast(&pst->pst_cond);
+    pthread_mutex_unlock(&pst->pst_mtx);
+
+    return NULL;
+}
+
+int
+posix_smp_transport_init(struct posix_smp_transport *pst,
+                         posix_smp_transport_out_fn *output_func,
+                         posix_smp_transport_get_mtu_fn *get_mtu_func)
+{
+    int rc;
+
+    *pst = (struct posix_smp_transport) {
+        .pst_output = output_func,
+        .pst_get_mtu = get_mtu_func,
+    };
+
+    pst->pst_streamer = (struct smp_streamer) {
+        .mgmt_stmr = {
+            .cfg = &posix_smp_cbor_cfg,
+            .reader = &pst->pst_reader.r,
+            .writer = &pst->pst_writer.enc,
+            .cb_arg = pst,
+        },
+        .tx_rsp_cb = posix_smp_tx_rsp,
+#if POSIX_SMP_COALESCE_RSP
+        .rsp_max_cb = posix_smp_rsp_max,
+#endif
+        .deferred = &pst->pst_deferred,
+        .resume_cb = posix_smp_resume,
+    };
+
+#if POSIX_SMP_RSP_CACHE_COUNT > 0
+    pst->pst_rsp_cache = (struct smp_rsp_cache) {
+        .src_entries = pst->pst_rsp_cache_entries,
+        .src_data = &pst->pst_rsp_cache_data[0][0],
+        .src_entry_size = POSIX_SMP_RSP_CACHE_SIZE,
+        .src_num_entries = POSIX_SMP_RSP_CACHE_COUNT,
+        .src_timeout_ms = POSIX_SMP_RSP_CACHE_TIMEOUT_MS,
+    };
+    pst->pst_streamer.rsp_cache = &pst->pst_rsp_cache;
+#endif
+
+    pthread_mutex_init(&pst->pst_mtx, NULL);
+    pthread_cond_init(&pst->pst_cond, NULL);
+#if POSIX_SMP_RX_RING
+    posix_smp_ring_init(&pst->pst_ring);
+    atomic_init(&pst->pst_waiting, false);
+#endif
+
+    rc = pthread_create(&pst->pst_thread, NULL, posix_smp_thread, pst);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+void
+posix_smp_transport_stop(struct posix_smp_transport *pst)
+{
+    struct mcumgr_buf *mb;
+
+    pthread_mutex_lock(&pst->pst_mtx);
+    __atomic_store_n(&pst->pst_stop, true, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&pst->pst_cond);
+    pthread_mutex_unlock(&pst->pst_mtx);
+
+    pthread_join(pst->pst_thread, NULL);
+
+    while ((mb = posix_smp_dequeue(pst)) != NULL) {
+        mcumgr_buf_free(mb);
+    }
+}
+
+#if POSIX_SMP_RX_RING
+void
+posix_smp_rx_req(struct posix_smp_transport *pst, struct mcumgr_buf *mb)
+{
+    int rc;
+
+    /* Every buffer comes from the same pool, so the ring can't overflow. */
+    rc = posix_smp_ring_put(&pst->pst_ring, mb);
+    assert(rc == 0);
+    (void)rc;
+
+    /* Only take the mutex if the thread might be waiting; see
+     * posix_smp_wait().
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&pst->pst_waiting)) {
+        pthread_mutex_lock(&pst->pst_mtx);
+        pthread_cond_broadcast(&pst->pst_cond);
+        pthread_mutex_unlock(&pst->pst_mtx);
+    }
+}
+#else
+void
+posix_smp_rx_req(struct posix_smp_transport *pst, struct mcumgr_buf *mb)
+{
+    int idx;
+
+    pthread_mutex_lock(&pst->pst_mtx);
+
+    /* Every buffer comes from the same pool, so the queue can't overflow. */
+    idx = (pst->pst_queue_head + pst->pst_queue_len) % MCUMGR_BUF_COUNT;
+    pst->pst_queue[idx] = mb;
+    pst->pst_queue_len++;
+
+    pthread_cond_broadcast(&pst->pst_cond);
+    pthread_mutex_unlock(&pst->pst_mtx);
+}
+#endif
+
+void
+posix_smp_transport_flush(struct posix_smp_transport *pst)
+{
+    pthread_mutex_lock(&pst->pst_mtx);
+    while (!pst->pst_stop &&
+           (pst->pst_busy || pst->pst_resume || pst->pst_blocked ||
+            !posix_smp_queue_is_empty(pst))) {
+
+        pthread_cond_wait(&pst->pst_cond, &pst->pst_mtx);
+    }
+    pthread_mutex_unlock(&pst->pst_mtx);
+}
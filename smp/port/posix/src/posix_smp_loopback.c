@@ -0,0 +1,83 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "mgmt/mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "posix_smp/posix_smp_loopback.h"
+
+static posix_smp_transport_out_fn posix_smp_loopback_out;
+static posix_smp_transport_get_mtu_fn posix_smp_loopback_get_mtu;
+
+static int
+posix_smp_loopback_out(struct posix_smp_transport *pst, struct mcumgr_buf *mb)
+{
+    struct posix_smp_loopback *psl;
+
+    psl = (struct posix_smp_loopback *)pst;
+
+    psl->psl_rsp_cb(mb->data, mb->len, psl->psl_arg);
+    mcumgr_buf_free(mb);
+
+    return 0;
+}
+
+static uint16_t
+posix_smp_loopback_get_mtu(struct posix_smp_transport *pst,
+                           const struct mcumgr_buf *mb)
+{
+    struct posix_smp_loopback *psl;
+
+    psl = (struct posix_smp_loopback *)pst;
+    return psl->psl_mtu;
+}
+
+int
+posix_smp_loopback_init(struct posix_smp_loopback *psl, uint16_t mtu,
+                        posix_smp_loopback_rsp_fn *rsp_cb, void *arg)
+{
+    psl->psl_rsp_cb = rsp_cb;
+    psl->psl_arg = arg;
+    psl->psl_mtu = mtu;
+
+    return posix_smp_transport_init(&psl->psl_transport,
+                                    posix_smp_loopback_out,
+                                    posix_smp_loopback_get_mtu);
+}
+
+int
+posix_smp_loopback_send(struct posix_smp_loopback *psl, const void *req,
+                        size_t len)
+{
+    struct mcumgr_buf *mb;
+    int rc;
+
+    mb = mcumgr_buf_alloc();
+    if (mb == NULL) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    rc = mcumgr_buf_add(mb, req, len);
+    if (rc != 0) {
+        mcumgr_buf_free(mb);
+        return rc;
+    }
+
+    posix_smp_rx_req(&psl->psl_transport, mb);
+    return 0;
+}
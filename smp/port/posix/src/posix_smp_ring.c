@@ -0,0 +1,98 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "posix_smp/posix_smp_ring.h"
+
+static unsigned int
+posix_smp_ring_next(unsigned int idx)
+{
+    idx++;
+    if (idx == POSIX_SMP_RING_SIZE) {
+        idx = 0;
+    }
+    return idx;
+}
+
+void
+posix_smp_ring_init(struct posix_smp_ring *psr)
+{
+    atomic_init(&psr->psr_head, 0);
+    atomic_init(&psr->psr_tail, 0);
+    psr->psr_head_cache = 0;
+    psr->psr_tail_cache = 0;
+}
+
+int
+posix_smp_ring_put(struct posix_smp_ring *psr, struct mcumgr_buf *mb)
+{
+    unsigned int tail;
+    unsigned int next;
+
+    tail = atomic_load_explicit(&psr->psr_tail, memory_order_relaxed);
+    next = posix_smp_ring_next(tail);
+
+    if (next == psr->psr_head_cache) {
+        /* Looks full; see how far the consumer has gotten. */
+        psr->psr_head_cache = atomic_load_explicit(&psr->psr_head,
+                                                   memory_order_acquire);
+        if (next == psr->psr_head_cache) {
+            return -1;
+        }
+    }
+
+    psr->psr_slots[tail] = mb;
+
+    /* Publish the slot contents along with the new tail. */
+    atomic_store_explicit(&psr->psr_tail, next, memory_order_release);
+
+    return 0;
+}
+
+struct mcumgr_buf *
+posix_smp_ring_get(struct posix_smp_ring *psr)
+{
+    struct mcumgr_buf *mb;
+    unsigned int head;
+
+    head = atomic_load_explicit(&psr->psr_head, memory_order_relaxed);
+
+    if (head == psr->psr_tail_cache) {
+        /* Looks empty; see whether the producer has added anything. */
+        psr->psr_tail_cache = atomic_load_explicit(&psr->psr_tail,
+                                                   memory_order_acquire);
+        if (head == psr->psr_tail_cache) {
+            return NULL;
+        }
+    }
+
+    mb = psr->psr_slots[head];
+
+    /* Release the slot back to the producer. */
+    atomic_store_explicit(&psr->psr_head, posix_smp_ring_next(head),
+                          memory_order_release);
+
+    return mb;
+}
+
+bool
+posix_smp_ring_is_empty(struct posix_smp_ring *psr)
+{
+    return atomic_load_explicit(&psr->psr_head, memory_order_acquire) ==
+           atomic_load_explicit(&psr->psr_tail, memory_order_acquire);
+}
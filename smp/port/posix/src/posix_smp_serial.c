@@ -0,0 +1,296 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* For pthread_setname_np(). */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "mgmt/mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "posix_smp/posix_smp_serial.h"
+
+/* Maximum number of bytes read from the device at once. */
+#define POSIX_SMP_SERIAL_READ_SIZE  512
+
+static int
+posix_smp_serial_write(const void *data, int len, void *arg)
+{
+    struct posix_smp_serial *pss;
+    const uint8_t *u8p;
+    ssize_t rc;
+
+    pss = arg;
+    u8p = data;
+
+    while (len > 0) {
+        rc = write(pss->pss_fd, u8p, len);
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return -1;
+        }
+
+        u8p += rc;
+        len -= rc;
+    }
+
+    return 0;
+}
+
+static int
+posix_smp_serial_out(struct posix_smp_transport *pst, struct mcumgr_buf *mb)
+{
+    int rc;
+
+    rc = smp_serial_tx_pkt(mb->data, mb->len, posix_smp_serial_write, pst);
+    mcumgr_buf_free(mb);
+
+    return rc;
+}
+
+static uint16_t
+posix_smp_serial_get_mtu(struct posix_smp_transport *pst,
+                         const struct mcumgr_buf *mb)
+{
+    return MCUMGR_BUF_SIZE;
+}
+
+static void
+posix_smp_serial_rx(struct posix_smp_serial *pss, const uint8_t *data,
+                    int len)
+{
+    struct mcumgr_buf *mb;
+    int pkt_len;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if (pss->pss_mb == NULL) {
+            /* If no buffer is available, the decoder discards the next
+             * packet.
+             */
+            pss->pss_mb = mcumgr_buf_alloc();
+            if (pss->pss_mb != NULL) {
+                smp_serial_rx_set_buf(&pss->pss_rx, pss->pss_mb->data,
+                                      mcumgr_buf_tailroom(pss->pss_mb));
+            }
+        }
+
+        pkt_len = smp_serial_rx_byte(&pss->pss_rx, data[i]);
+        if (pkt_len > 0) {
+            mb = pss->pss_mb;
+            pss->pss_mb = NULL;
+            smp_serial_rx_set_buf(&pss->pss_rx, NULL, 0);
+
+            mb->len = pkt_len;
+            posix_smp_rx_req(&pss->pss_transport, mb);
+        }
+    }
+}
+
+static void *
+posix_smp_serial_rx_thread(void *arg)
+{
+    uint8_t chunk[POSIX_SMP_SERIAL_READ_SIZE];
+    struct posix_smp_serial *pss;
+    struct pollfd fds[2];
+    ssize_t len;
+    int rc;
+
+    pss = arg;
+
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), "smp_serial_rx");
+#endif
+
+    fds[0] = (struct pollfd) {
+        .fd = pss->pss_stop_pipe[0],
+        .events = POLLIN,
+    };
+    fds[1] = (struct pollfd) {
+        .fd = pss->pss_fd,
+        .events = POLLIN,
+    };
+
+    while (1) {
+        rc = poll(fds, 2, -1);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[0].revents != 0) {
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            len = read(pss->pss_fd, chunk, sizeof chunk);
+            if (len > 0) {
+                posix_smp_serial_rx(pss, chunk, len);
+            } else if (len == 0 ||
+                       (errno != EINTR && errno != EAGAIN)) {
+                /* Device closed; e.g., the other end of a pty hung up. */
+                usleep(10000);
+            }
+        } else if (fds[1].revents != 0) {
+            usleep(10000);
+        }
+    }
+
+    return NULL;
+}
+
+static speed_t
+posix_smp_serial_speed(int baud)
+{
+    switch (baud) {
+    case 9600:      return B9600;
+    case 19200:     return B19200;
+    case 38400:     return B38400;
+    case 57600:     return B57600;
+    case 115200:    return B115200;
+    case 230400:    return B230400;
+#ifdef B460800
+    case 460800:    return B460800;
+#endif
+#ifdef B921600
+    case 921600:    return B921600;
+#endif
+#ifdef B1000000
+    case 1000000:   return B1000000;
+#endif
+    default:        return B0;
+    }
+}
+
+static int
+posix_smp_serial_configure(int fd, int baud)
+{
+    struct termios tio;
+    speed_t speed;
+    int rc;
+
+    if (!isatty(fd)) {
+        return 0;
+    }
+
+    rc = tcgetattr(fd, &tio);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+
+    if (baud != 0) {
+        speed = posix_smp_serial_speed(baud);
+        if (speed == B0) {
+            return MGMT_ERR_EINVAL;
+        }
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+    }
+
+    rc = tcsetattr(fd, TCSANOW, &tio);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+posix_smp_serial_init(struct posix_smp_serial *pss, const char *path,
+                      int baud)
+{
+    int rc;
+
+    pss->pss_mb = NULL;
+    smp_serial_rx_init(&pss->pss_rx);
+
+    pss->pss_fd = open(path, O_RDWR | O_NOCTTY);
+    if (pss->pss_fd < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = posix_smp_serial_configure(pss->pss_fd, baud);
+    if (rc != 0) {
+        close(pss->pss_fd);
+        return rc;
+    }
+
+    rc = pipe(pss->pss_stop_pipe);
+    if (rc != 0) {
+        goto err;
+    }
+
+    rc = posix_smp_transport_init(&pss->pss_transport, posix_smp_serial_out,
+                                  posix_smp_serial_get_mtu);
+    if (rc != 0) {
+        goto err_pipe;
+    }
+
+    rc = pthread_create(&pss->pss_rx_thread, NULL, posix_smp_serial_rx_thread,
+                        pss);
+    if (rc != 0) {
+        posix_smp_transport_stop(&pss->pss_transport);
+        goto err_pipe;
+    }
+
+    return 0;
+
+err_pipe:
+    close(pss->pss_stop_pipe[0]);
+    close(pss->pss_stop_pipe[1]);
+err:
+    close(pss->pss_fd);
+    return MGMT_ERR_EUNKNOWN;
+}
+
+void
+posix_smp_serial_stop(struct posix_smp_serial *pss)
+{
+    ssize_t rc;
+    uint8_t b;
+
+    b = 0;
+    rc = write(pss->pss_stop_pipe[1], &b, 1);
+    assert(rc == 1);
+    pthread_join(pss->pss_rx_thread, NULL);
+
+    posix_smp_transport_stop(&pss->pss_transport);
+
+    if (pss->pss_mb != NULL) {
+        mcumgr_buf_free(pss->pss_mb);
+        pss->pss_mb = NULL;
+    }
+
+    close(pss->pss_fd);
+    close(pss->pss_stop_pipe[0]);
+    close(pss->pss_stop_pipe[1]);
+}
@@ -0,0 +1,470 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* For pthread_setname_np(). */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include "mgmt/mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "smp/smp.h"
+#include "posix_smp/posix_smp_udp.h"
+
+/* Index of each protocol's socket. */
+#define POSIX_SMP_UDP_IPV4      0
+#define POSIX_SMP_UDP_IPV6      1
+
+/* Payload sizes that any path is guaranteed to support. */
+#define POSIX_SMP_UDP_MIN_MTU4  (576 - 20 - 8)
+#define POSIX_SMP_UDP_MIN_MTU6  (1280 - 40 - 8)
+
+/** Stored in each buffer's user data to identify the peer. */
+struct posix_smp_udp_ud {
+    uint32_t id;
+};
+
+static posix_smp_transport_out_fn posix_smp_udp_out;
+static posix_smp_transport_get_mtu_fn posix_smp_udp_get_mtu;
+
+static struct posix_smp_udp_peer *
+posix_smp_udp_find_id(struct posix_smp_udp *psu, uint32_t id)
+{
+    int i;
+
+    for (i = 0; i < POSIX_SMP_UDP_MAX_PEERS; i++) {
+        if (psu->psu_peers[i].psp_id == id) {
+            return &psu->psu_peers[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Determines the largest datagram payload that can reach the specified
+ * address without IP fragmentation.  The kernel's path MTU is used where
+ * available; otherwise, the protocol minimum.
+ */
+static uint16_t
+posix_smp_udp_path_mtu(const struct sockaddr *addr, socklen_t addr_len)
+{
+    socklen_t opt_len;
+    int path_mtu;
+    int hdr_len;
+    int mtu;
+    int fd;
+    int rc;
+
+    if (addr->sa_family == AF_INET6) {
+        mtu = POSIX_SMP_UDP_MIN_MTU6;
+        hdr_len = 40 + 8;
+    } else {
+        mtu = POSIX_SMP_UDP_MIN_MTU4;
+        hdr_len = 20 + 8;
+    }
+
+#if defined IP_MTU && defined IPV6_MTU
+    /* The MTU is only reported for connected sockets. */
+    fd = socket(addr->sa_family, SOCK_DGRAM, 0);
+    if (fd >= 0) {
+        rc = connect(fd, addr, addr_len);
+        if (rc == 0) {
+            opt_len = sizeof path_mtu;
+            if (addr->sa_family == AF_INET6) {
+                rc = getsockopt(fd, IPPROTO_IPV6, IPV6_MTU, &path_mtu,
+                                &opt_len);
+            } else {
+                rc = getsockopt(fd, IPPROTO_IP, IP_MTU, &path_mtu, &opt_len);
+            }
+            if (rc == 0 && path_mtu > hdr_len) {
+                mtu = path_mtu - hdr_len;
+            }
+        }
+        close(fd);
+    }
+#endif
+
+    if (mtu > MCUMGR_BUF_SIZE) {
+        mtu = MCUMGR_BUF_SIZE;
+    }
+
+    return mtu;
+}
+
+/**
+ * Finds the table entry for the specified peer address, creating one if
+ * necessary.  Must be called with the mutex held.
+ */
+static struct posix_smp_udp_peer *
+posix_smp_udp_lookup(struct posix_smp_udp *psu, const struct sockaddr *addr,
+                     socklen_t addr_len)
+{
+    struct posix_smp_udp_peer *oldest;
+    struct posix_smp_udp_peer *peer;
+    int i;
+
+    psu->psu_clock++;
+
+    oldest = NULL;
+    for (i = 0; i < POSIX_SMP_UDP_MAX_PEERS; i++) {
+        peer = &psu->psu_peers[i];
+        if (peer->psp_id != 0 &&
+            peer->psp_addr_len == addr_len &&
+            memcmp(&peer->psp_addr, addr, addr_len) == 0) {
+
+            peer->psp_last_rx = psu->psu_clock;
+            return peer;
+        }
+
+        /* Prefer an unused entry, then the least recently active one. */
+        if (oldest == NULL || oldest->psp_id != 0) {
+            if (peer->psp_id == 0 || oldest == NULL ||
+                psu->psu_clock - peer->psp_last_rx >
+                psu->psu_clock - oldest->psp_last_rx) {
+
+                oldest = peer;
+            }
+        }
+    }
+
+    /* New peer; take over the least recently active entry. */
+    peer = oldest;
+    memcpy(&peer->psp_addr, addr, addr_len);
+    peer->psp_addr_len = addr_len;
+    peer->psp_mtu = posix_smp_udp_path_mtu(addr, addr_len);
+    peer->psp_last_rx = psu->psu_clock;
+
+    if (++psu->psu_next_id == 0) {
+        psu->psu_next_id = 1;
+    }
+    peer->psp_id = psu->psu_next_id;
+
+    return peer;
+}
+
+static int
+posix_smp_udp_out(struct posix_smp_transport *pst, struct mcumgr_buf *mb)
+{
+    const struct posix_smp_udp_ud *ud;
+    struct posix_smp_udp_peer *peer;
+    struct posix_smp_udp *psu;
+    ssize_t rc;
+    int fd;
+
+    psu = (struct posix_smp_udp *)pst;
+    ud = (void *)mb->user_data;
+
+    pthread_mutex_lock(&psu->psu_mtx);
+
+    peer = posix_smp_udp_find_id(psu, ud->id);
+    if (peer == NULL) {
+        /* Peer was evicted. */
+        rc = -1;
+    } else {
+        if (peer->psp_addr.ss_family == AF_INET6) {
+            fd = psu->psu_fds[POSIX_SMP_UDP_IPV6];
+        } else {
+            fd = psu->psu_fds[POSIX_SMP_UDP_IPV4];
+        }
+        rc = sendto(fd, mb->data, mb->len, 0,
+                    (struct sockaddr *)&peer->psp_addr, peer->psp_addr_len);
+    }
+
+    pthread_mutex_unlock(&psu->psu_mtx);
+
+    mcumgr_buf_free(mb);
+
+    if (rc < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+static uint16_t
+posix_smp_udp_get_mtu(struct posix_smp_transport *pst,
+                      const struct mcumgr_buf *mb)
+{
+    const struct posix_smp_udp_ud *ud;
+    struct posix_smp_udp_peer *peer;
+    struct posix_smp_udp *psu;
+    uint16_t mtu;
+
+    psu = (struct posix_smp_udp *)pst;
+    ud = (const void *)mb->user_data;
+
+    pthread_mutex_lock(&psu->psu_mtx);
+
+    peer = posix_smp_udp_find_id(psu, ud->id);
+    if (peer == NULL) {
+        mtu = 0;
+    } else {
+        mtu = peer->psp_mtu;
+    }
+
+    pthread_mutex_unlock(&psu->psu_mtx);
+
+    return mtu;
+}
+
+static void
+posix_smp_udp_rx(struct posix_smp_udp *psu, int fd)
+{
+    struct sockaddr_storage addr;
+    struct posix_smp_udp_peer *peer;
+    struct posix_smp_udp_ud *ud;
+    struct mcumgr_buf *mb;
+    socklen_t addr_len;
+    uint8_t dummy;
+    ssize_t len;
+
+    mb = mcumgr_buf_alloc();
+    if (mb == NULL) {
+        /* Drop the datagram; the client will retransmit. */
+        recv(fd, &dummy, sizeof dummy, 0);
+        SMP_STATS_INC(SMP_STAT_RX_DROPS);
+        return;
+    }
+
+    addr_len = sizeof addr;
+    len = recvfrom(fd, mb->data, mcumgr_buf_tailroom(mb), 0,
+                   (struct sockaddr *)&addr, &addr_len);
+    if (len <= 0) {
+        mcumgr_buf_free(mb);
+        return;
+    }
+    mb->len = len;
+
+    pthread_mutex_lock(&psu->psu_mtx);
+    peer = posix_smp_udp_lookup(psu, (struct sockaddr *)&addr, addr_len);
+    ud = (void *)mb->user_data;
+    ud->id = peer->psp_id;
+    pthread_mutex_unlock(&psu->psu_mtx);
+
+    posix_smp_rx_req(&psu->psu_transport, mb);
+}
+
+static void *
+posix_smp_udp_rx_thread(void *arg)
+{
+    struct pollfd fds[3];
+    struct posix_smp_udp *psu;
+    int num_fds;
+    int rc;
+    int i;
+
+    psu = arg;
+
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), "smp_udp_rx");
+#endif
+
+    fds[0] = (struct pollfd) {
+        .fd = psu->psu_stop_pipe[0],
+        .events = POLLIN,
+    };
+    num_fds = 1;
+    for (i = 0; i < 2; i++) {
+        if (psu->psu_fds[i] >= 0) {
+            fds[num_fds] = (struct pollfd) {
+                .fd = psu->psu_fds[i],
+                .events = POLLIN,
+            };
+            num_fds++;
+        }
+    }
+
+    while (1) {
+        rc = poll(fds, num_fds, -1);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[0].revents != 0) {
+            break;
+        }
+
+        for (i = 1; i < num_fds; i++) {
+            if (fds[i].revents & POLLIN) {
+                posix_smp_udp_rx(psu, fds[i].fd);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int
+posix_smp_udp_create_socket(const struct sockaddr *addr, socklen_t addr_len)
+{
+    int opt;
+    int fd;
+    int rc;
+
+    fd = socket(addr->sa_family, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* Keep the IPv6 socket from claiming IPv4 traffic too. */
+    if (addr->sa_family == AF_INET6) {
+        opt = 1;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof opt);
+    }
+
+    rc = bind(fd, addr, addr_len);
+    if (rc != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int
+posix_smp_udp_init(struct posix_smp_udp *psu, uint16_t port)
+{
+    struct sockaddr_in6 addr6;
+    struct sockaddr_in addr4;
+    int rc;
+    int i;
+
+    memset(psu->psu_peers, 0, sizeof psu->psu_peers);
+    psu->psu_next_id = 0;
+    psu->psu_clock = 0;
+    pthread_mutex_init(&psu->psu_mtx, NULL);
+
+    addr4 = (struct sockaddr_in) {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    psu->psu_fds[POSIX_SMP_UDP_IPV4] =
+        posix_smp_udp_create_socket((struct sockaddr *)&addr4, sizeof addr4);
+
+    /* If an ephemeral port was requested, use the same one for IPv6. */
+    if (port == 0 && psu->psu_fds[POSIX_SMP_UDP_IPV4] >= 0) {
+        port = posix_smp_udp_port(psu);
+    }
+
+    addr6 = (struct sockaddr_in6) {
+        .sin6_family = AF_INET6,
+        .sin6_port = htons(port),
+        .sin6_addr = in6addr_any,
+    };
+    psu->psu_fds[POSIX_SMP_UDP_IPV6] =
+        posix_smp_udp_create_socket((struct sockaddr *)&addr6, sizeof addr6);
+
+    if (psu->psu_fds[POSIX_SMP_UDP_IPV4] < 0 &&
+        psu->psu_fds[POSIX_SMP_UDP_IPV6] < 0) {
+
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = pipe(psu->psu_stop_pipe);
+    if (rc != 0) {
+        goto err;
+    }
+
+    rc = posix_smp_transport_init(&psu->psu_transport, posix_smp_udp_out,
+                                  posix_smp_udp_get_mtu);
+    if (rc != 0) {
+        goto err_pipe;
+    }
+
+    rc = pthread_create(&psu->psu_rx_thread, NULL, posix_smp_udp_rx_thread,
+                        psu);
+    if (rc != 0) {
+        posix_smp_transport_stop(&psu->psu_transport);
+        goto err_pipe;
+    }
+
+    return 0;
+
+err_pipe:
+    close(psu->psu_stop_pipe[0]);
+    close(psu->psu_stop_pipe[1]);
+err:
+    for (i = 0; i < 2; i++) {
+        if (psu->psu_fds[i] >= 0) {
+            close(psu->psu_fds[i]);
+        }
+    }
+    return MGMT_ERR_EUNKNOWN;
+}
+
+uint16_t
+posix_smp_udp_port(const struct posix_smp_udp *psu)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    int fd;
+    int rc;
+
+    fd = psu->psu_fds[POSIX_SMP_UDP_IPV4];
+    if (fd < 0) {
+        fd = psu->psu_fds[POSIX_SMP_UDP_IPV6];
+    }
+
+    addr_len = sizeof addr;
+    rc = getsockname(fd, (struct sockaddr *)&addr, &addr_len);
+    if (rc != 0) {
+        return 0;
+    }
+
+    if (addr.ss_family == AF_INET6) {
+        return ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+    } else {
+        return ntohs(((struct sockaddr_in *)&addr)->sin_port);
+    }
+}
+
+void
+posix_smp_udp_stop(struct posix_smp_udp *psu)
+{
+    ssize_t rc;
+    uint8_t b;
+    int i;
+
+    b = 0;
+    rc = write(psu->psu_stop_pipe[1], &b, 1);
+    assert(rc == 1);
+    pthread_join(psu->psu_rx_thread, NULL);
+
+    posix_smp_transport_stop(&psu->psu_transport);
+
+    for (i = 0; i < 2; i++) {
+        if (psu->psu_fds[i] >= 0) {
+            close(psu->psu_fds[i]);
+        }
+    }
+
+    close(psu->psu_stop_pipe[0]);
+    close(psu->psu_stop_pipe[1]);
+}
@@ -0,0 +1,321 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* For pthread_setname_np(). */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "mgmt/mgmt.h"
+#include "posix_mgmt/buf.h"
+#include "posix_smp/posix_smp_uds.h"
+
+/** Stored in each buffer's user data to identify the peer. */
+struct posix_smp_uds_ud {
+    uint32_t id;
+};
+
+static posix_smp_transport_out_fn posix_smp_uds_out;
+static posix_smp_transport_get_mtu_fn posix_smp_uds_get_mtu;
+
+static struct posix_smp_uds_conn *
+posix_smp_uds_find_conn(struct posix_smp_uds *psu, uint32_t id)
+{
+    int i;
+
+    for (i = 0; i < POSIX_SMP_UDS_MAX_CONNS; i++) {
+        if (psu->psu_conns[i].psc_id == id) {
+            return &psu->psu_conns[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int
+posix_smp_uds_out(struct posix_smp_transport *pst, struct mcumgr_buf *mb)
+{
+    const struct posix_smp_uds_ud *ud;
+    struct posix_smp_uds_conn *conn;
+    struct posix_smp_uds *psu;
+    ssize_t rc;
+
+    psu = (struct posix_smp_uds *)pst;
+    ud = (void *)mb->user_data;
+
+    pthread_mutex_lock(&psu->psu_mtx);
+
+    conn = posix_smp_uds_find_conn(psu, ud->id);
+    if (conn == NULL) {
+        /* Peer disconnected. */
+        rc = -1;
+    } else {
+        rc = send(conn->psc_fd, mb->data, mb->len, MSG_NOSIGNAL);
+    }
+
+    pthread_mutex_unlock(&psu->psu_mtx);
+
+    mcumgr_buf_free(mb);
+
+    if (rc < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+static uint16_t
+posix_smp_uds_get_mtu(struct posix_smp_transport *pst,
+                      const struct mcumgr_buf *mb)
+{
+    return MCUMGR_BUF_SIZE;
+}
+
+static void
+posix_smp_uds_accept(struct posix_smp_uds *psu)
+{
+    struct posix_smp_uds_conn *conn;
+    int fd;
+
+    fd = accept(psu->psu_listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&psu->psu_mtx);
+
+    conn = posix_smp_uds_find_conn(psu, 0);
+    if (conn == NULL) {
+        /* Too many clients. */
+        close(fd);
+    } else {
+        if (++psu->psu_next_id == 0) {
+            psu->psu_next_id = 1;
+        }
+        conn->psc_fd = fd;
+        conn->psc_id = psu->psu_next_id;
+    }
+
+    pthread_mutex_unlock(&psu->psu_mtx);
+}
+
+static void
+posix_smp_uds_close(struct posix_smp_uds *psu, struct posix_smp_uds_conn *conn)
+{
+    pthread_mutex_lock(&psu->psu_mtx);
+    close(conn->psc_fd);
+    conn->psc_fd = -1;
+    conn->psc_id = 0;
+    pthread_mutex_unlock(&psu->psu_mtx);
+}
+
+static void
+posix_smp_uds_rx(struct posix_smp_uds *psu, struct posix_smp_uds_conn *conn)
+{
+    struct posix_smp_uds_ud *ud;
+    struct mcumgr_buf *mb;
+    ssize_t len;
+
+    mb = mcumgr_buf_alloc();
+    if (mb == NULL) {
+        /* Leave the packet in the socket until a buffer frees up. */
+        usleep(1000);
+        return;
+    }
+
+    len = recv(conn->psc_fd, mb->data, mcumgr_buf_tailroom(mb), 0);
+    if (len <= 0) {
+        mcumgr_buf_free(mb);
+        if (len == 0 || (errno != EINTR && errno != EAGAIN)) {
+            posix_smp_uds_close(psu, conn);
+        }
+        return;
+    }
+
+    mb->len = len;
+    ud = (void *)mb->user_data;
+    ud->id = conn->psc_id;
+
+    posix_smp_rx_req(&psu->psu_transport, mb);
+}
+
+static void *
+posix_smp_uds_rx_thread(void *arg)
+{
+    struct posix_smp_uds_conn *conns[POSIX_SMP_UDS_MAX_CONNS];
+    struct pollfd fds[POSIX_SMP_UDS_MAX_CONNS + 2];
+    struct posix_smp_uds *psu;
+    int num_conns;
+    int rc;
+    int i;
+
+    psu = arg;
+
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), "smp_uds_rx");
+#endif
+
+    while (1) {
+        fds[0] = (struct pollfd) {
+            .fd = psu->psu_stop_pipe[0],
+            .events = POLLIN,
+        };
+        fds[1] = (struct pollfd) {
+            .fd = psu->psu_listen_fd,
+            .events = POLLIN,
+        };
+
+        /* Only this thread adds or removes connections, so the table can be
+         * read without locking.
+         */
+        num_conns = 0;
+        for (i = 0; i < POSIX_SMP_UDS_MAX_CONNS; i++) {
+            if (psu->psu_conns[i].psc_id != 0) {
+                conns[num_conns] = &psu->psu_conns[i];
+                fds[num_conns + 2] = (struct pollfd) {
+                    .fd = psu->psu_conns[i].psc_fd,
+                    .events = POLLIN,
+                };
+                num_conns++;
+            }
+        }
+
+        rc = poll(fds, num_conns + 2, -1);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[0].revents != 0) {
+            break;
+        }
+
+        for (i = 0; i < num_conns; i++) {
+            if (fds[i + 2].revents & POLLIN) {
+                posix_smp_uds_rx(psu, conns[i]);
+            } else if (fds[i + 2].revents != 0) {
+                posix_smp_uds_close(psu, conns[i]);
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            posix_smp_uds_accept(psu);
+        }
+    }
+
+    return NULL;
+}
+
+int
+posix_smp_uds_init(struct posix_smp_uds *psu, const char *path)
+{
+    struct sockaddr_un addr;
+    int rc;
+    int i;
+
+    if (strlen(path) >= sizeof addr.sun_path) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    for (i = 0; i < POSIX_SMP_UDS_MAX_CONNS; i++) {
+        psu->psu_conns[i] = (struct posix_smp_uds_conn) { .psc_fd = -1 };
+    }
+    psu->psu_next_id = 0;
+    pthread_mutex_init(&psu->psu_mtx, NULL);
+
+    addr = (struct sockaddr_un) { .sun_family = AF_UNIX };
+    strcpy(addr.sun_path, path);
+
+    psu->psu_listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (psu->psu_listen_fd < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    unlink(path);
+    rc = bind(psu->psu_listen_fd, (struct sockaddr *)&addr, sizeof addr);
+    if (rc != 0) {
+        goto err;
+    }
+
+    rc = listen(psu->psu_listen_fd, POSIX_SMP_UDS_MAX_CONNS);
+    if (rc != 0) {
+        goto err;
+    }
+
+    rc = pipe(psu->psu_stop_pipe);
+    if (rc != 0) {
+        goto err;
+    }
+
+    rc = posix_smp_transport_init(&psu->psu_transport, posix_smp_uds_out,
+                                  posix_smp_uds_get_mtu);
+    if (rc != 0) {
+        goto err_pipe;
+    }
+
+    rc = pthread_create(&psu->psu_rx_thread, NULL, posix_smp_uds_rx_thread,
+                        psu);
+    if (rc != 0) {
+        posix_smp_transport_stop(&psu->psu_transport);
+        goto err_pipe;
+    }
+
+    return 0;
+
+err_pipe:
+    close(psu->psu_stop_pipe[0]);
+    close(psu->psu_stop_pipe[1]);
+err:
+    close(psu->psu_listen_fd);
+    return MGMT_ERR_EUNKNOWN;
+}
+
+void
+posix_smp_uds_stop(struct posix_smp_uds *psu)
+{
+    ssize_t rc;
+    uint8_t b;
+    int i;
+
+    b = 0;
+    rc = write(psu->psu_stop_pipe[1], &b, 1);
+    assert(rc == 1);
+    pthread_join(psu->psu_rx_thread, NULL);
+
+    posix_smp_transport_stop(&psu->psu_transport);
+
+    for (i = 0; i < POSIX_SMP_UDS_MAX_CONNS; i++) {
+        if (psu->psu_conns[i].psc_id != 0) {
+            posix_smp_uds_close(psu, &psu->psu_conns[i]);
+        }
+    }
+
+    close(psu->psu_listen_fd);
+    close(psu->psu_stop_pipe[0]);
+    close(psu->psu_stop_pipe[1]);
+}
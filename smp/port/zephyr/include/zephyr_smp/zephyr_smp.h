@@ -20,6 +20,12 @@
 #ifndef H_ZEPHYR_SMP_
 #define H_ZEPHYR_SMP_
 
+#include "zephyr_mgmt/buf.h"
+#include "smp/smp.h"
+#ifdef CONFIG_MCUMGR_SMP_RX_RING
+#include "zephyr_smp/zephyr_smp_ring.h"
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -56,6 +62,33 @@ typedef int zephyr_smp_transport_out_fn(struct zephyr_smp_transport *zst,
 typedef uint16_t
 zephyr_smp_transport_get_mtu_fn(const struct net_buf *nb);
 
+/**
+ * @brief Counts the work done by a transport when fragmenting responses.
+ */
+struct zephyr_smp_tx_stats {
+    /* Number of fragments passed to the output function. */
+    uint32_t frags;
+
+    /* Number of net_bufs allocated to hold fragments. */
+    uint32_t frag_allocs;
+
+    /* Number of payload bytes copied into fragments.  Nonzero only when
+     * buffer slices run out.
+     */
+    uint32_t frag_bytes_copied;
+};
+
+/**
+ * @brief Records how long a transport occupies the work queue.
+ */
+struct zephyr_smp_work_stats {
+    /* Longest single invocation of the work handler, in microseconds. */
+    uint32_t max_hold_us;
+
+    /* Number of times the handler resubmitted itself due to its budget. */
+    uint32_t yields;
+};
+
 /**
  * @brief Provides Zephyr-specific functionality for sending SMP responses.
  */ 
@@ -63,11 +96,37 @@ struct zephyr_smp_transport {
     /* Must be the first member. */
     struct k_work zst_work;
 
-    /* FIFO containing incoming requests to be processed. */
+    /* Incoming requests to be processed. */
+#ifdef CONFIG_MCUMGR_SMP_RX_RING
+    struct zephyr_smp_ring zst_ring;
+#else
     struct k_fifo zst_fifo;
+#endif
 
     zephyr_smp_transport_out_fn *zst_output;
     zephyr_smp_transport_get_mtu_fn *zst_get_mtu;
+
+    /* Persist across calls so that a handler can defer its response. */
+    struct cbor_nb_reader zst_reader;
+    struct cbor_nb_writer zst_writer;
+    struct smp_streamer zst_streamer;
+    struct smp_deferred zst_deferred;
+
+#if CONFIG_MCUMGR_SMP_RSP_CACHE_COUNT > 0
+    struct smp_rsp_cache zst_rsp_cache;
+    struct smp_rsp_cache_entry
+        zst_rsp_cache_entries[CONFIG_MCUMGR_SMP_RSP_CACHE_COUNT];
+    uint8_t zst_rsp_cache_data[CONFIG_MCUMGR_SMP_RSP_CACHE_COUNT]
+                              [CONFIG_MCUMGR_SMP_RSP_CACHE_SIZE];
+#endif
+
+    struct zephyr_smp_tx_stats zst_tx_stats;
+    struct zephyr_smp_work_stats zst_work_stats;
+
+#if CONFIG_MCUMGR_SMP_ERR_BUF_COUNT > 0
+    /* Reserved for error responses; NULL if none could be reserved. */
+    struct net_buf *zst_err_nb;
+#endif
 };
 
 /**
@@ -86,7 +145,9 @@ void zephyr_smp_transport_init(struct zephyr_smp_transport *zst,
 /**
  * @brief Enqueues an incoming SMP request packet for processing.
  *
- * This function always consumes the supplied net_buf.
+ * This function always consumes the supplied net_buf.  It may be called from
+ * an interrupt handler.  If CONFIG_MCUMGR_SMP_RX_RING is enabled, all calls
+ * for a given transport must come from the same thread or interrupt.
  *
  * @param mst                   The transport to use to send the corresponding
  *                                  response(s).
@@ -0,0 +1,97 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_ZEPHYR_SMP_RING_
+#define H_ZEPHYR_SMP_RING_
+
+#include <zephyr.h>
+#include <atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct net_buf;
+
+/**
+ * Number of slots in a ring.  One slot is always left empty, and every
+ * request comes from the mcumgr buffer pool, so a ring can never overflow.
+ */
+#define ZEPHYR_SMP_RING_SIZE    (CONFIG_MCUMGR_BUF_COUNT + 1)
+
+/**
+ * @brief A lock-free queue of net_bufs with a single producer and a single
+ *        consumer.
+ *
+ * Unlike a k_fifo, neither side locks the scheduler or masks interrupts.
+ * The producer may be an interrupt handler.  Each index is written by only
+ * one side.
+ */
+struct zephyr_smp_ring {
+    struct net_buf *zsr_slots[ZEPHYR_SMP_RING_SIZE];
+
+    /* Next slot to read; written by the consumer. */
+    atomic_t zsr_head;
+
+    /* Next slot to write; written by the producer. */
+    atomic_t zsr_tail;
+};
+
+/**
+ * @brief Initializes an empty ring.
+ *
+ * @param zsr                   The ring to initialize.
+ */
+void zephyr_smp_ring_init(struct zephyr_smp_ring *zsr);
+
+/**
+ * @brief Appends a net_buf to a ring.  Only the producer may call this.
+ *
+ * @param zsr                   The ring to append to.
+ * @param nb                    The net_buf to append.
+ *
+ * @return                      0 on success; -1 if the ring is full.
+ */
+int zephyr_smp_ring_put(struct zephyr_smp_ring *zsr, struct net_buf *nb);
+
+/**
+ * @brief Removes the oldest net_buf from a ring.  Only the consumer may call
+ *        this.
+ *
+ * @param zsr                   The ring to remove from.
+ *
+ * @return                      The removed net_buf; NULL if the ring is
+ *                                  empty.
+ */
+struct net_buf *zephyr_smp_ring_get(struct zephyr_smp_ring *zsr);
+
+/**
+ * @brief Indicates whether a ring is empty.  Either side may call this.
+ *
+ * @param zsr                   The ring to query.
+ *
+ * @return                      true if the ring is empty.
+ */
+bool zephyr_smp_ring_is_empty(struct zephyr_smp_ring *zsr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_ZEPHYR_SMP_UART_
+#define H_ZEPHYR_SMP_UART_
+
+#include "smp/smp_serial.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Starts serving SMP requests on the UART named by
+ *        CONFIG_MCUMGR_SMP_UART_DEV_NAME.
+ *
+ * Subsequent calls have no effect.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int zephyr_smp_uart_open(void);
+
+/**
+ * @brief Retrieves the UART transport's receive statistics.
+ *
+ * @return                      The receive statistics.
+ */
+const struct smp_serial_rx_stats *zephyr_smp_uart_rx_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_ZEPHYR_SMP_UDP_
+#define H_ZEPHYR_SMP_UDP_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Opens the UDP sockets that SMP requests are received on and starts
+ *        serving them.
+ *
+ * An IPv4 socket and an IPv6 socket are opened, according to which protocols
+ * are enabled, both bound to CONFIG_MCUMGR_SMP_UDP_PORT.  Call this once the
+ * network interface is up.  Subsequent calls have no effect.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int zephyr_smp_udp_open(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
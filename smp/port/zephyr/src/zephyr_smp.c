@@ -17,7 +17,9 @@
  * under the License.
  */
 
+#include <assert.h>
 #include <zephyr.h>
+#include <init.h>
 #include "net/buf.h"
 #include "mgmt/mgmt.h"
 #include "zephyr_mgmt/buf.h"
@@ -31,7 +33,29 @@ static mgmt_write_at_fn zephyr_smp_write_at;
 static mgmt_init_reader_fn zephyr_smp_init_reader;
 static mgmt_init_writer_fn zephyr_smp_init_writer;
 static mgmt_free_buf_fn zephyr_smp_free_buf;
+static mgmt_session_key_fn zephyr_smp_session_key;
 static smp_tx_rsp_fn zephyr_smp_tx_rsp;
+static smp_resume_fn zephyr_smp_resume;
+#ifdef CONFIG_MCUMGR_SMP_COALESCE_RSP
+static smp_rsp_max_fn zephyr_smp_rsp_max;
+#endif
+#ifdef CONFIG_MCUMGR_SMP_WORKQUEUE
+/* Requests are processed in their own thread so that they don't block the
+ * system work queue.
+ */
+static K_THREAD_STACK_DEFINE(zephyr_smp_wq_stack,
+                             CONFIG_MCUMGR_SMP_WORKQUEUE_STACK_SIZE);
+static struct k_work_q zephyr_smp_wq;
+#endif
+
+#if CONFIG_MCUMGR_SMP_ERR_BUF_COUNT > 0
+static smp_err_buf_fn zephyr_smp_err_buf;
+
+/* Each transport reserves one of these for error responses. */
+NET_BUF_POOL_DEFINE(err_pool, CONFIG_MCUMGR_SMP_ERR_BUF_COUNT,
+                    SMP_ERR_RSP_MAX_LEN, CONFIG_MCUMGR_BUF_USER_DATA_SIZE,
+                    NULL);
+#endif
 
 static const struct mgmt_streamer_cfg zephyr_smp_cbor_cfg = {
     .alloc_rsp = zephyr_smp_alloc_rsp,
@@ -41,8 +65,22 @@ static const struct mgmt_streamer_cfg zephyr_smp_cbor_cfg = {
     .init_reader = zephyr_smp_init_reader,
     .init_writer = zephyr_smp_init_writer,
     .free_buf = zephyr_smp_free_buf,
+    .session_key = zephyr_smp_session_key,
 };
 
+/**
+ * Schedules processing of a transport's received requests.
+ */
+static void
+zephyr_smp_submit(struct zephyr_smp_transport *zst)
+{
+#ifdef CONFIG_MCUMGR_SMP_WORKQUEUE
+    k_work_submit_to_queue(&zephyr_smp_wq, &zst->zst_work);
+#else
+    k_work_submit(&zst->zst_work);
+#endif
+}
+
 void *
 zephyr_smp_alloc_rsp(const void *req, void *arg)
 {
@@ -81,8 +119,10 @@ zephyr_smp_trim_front(void *buf, size_t len, void *arg)
 /**
  * Splits an appropriately-sized fragment from the front of a net_buf, as
  * neeeded.  If the length of the net_buf is greater than specified maximum
- * fragment size, a new net_buf is allocated, and data is moved from the source
- * net_buf to the new net_buf.  If the net_buf is small enough to fit in a
+ * fragment size, a slice referring to the front of the source net_buf is
+ * allocated, and the fragment data is trimmed from the source.  No payload is
+ * copied unless all slices are in use, in which case the fragment is copied
+ * into a new net_buf instead.  If the net_buf is small enough to fit in a
  * single fragment, the source net_buf is returned unmodified, and the supplied
  * pointer is set to NULL.
  *
@@ -93,14 +133,15 @@ zephyr_smp_trim_front(void *buf, size_t len, void *arg)
  *     struct net_buf *rsp;
  *     // [...]
  *     while (rsp != NULL) {
- *         frag = zephyr_smp_split_frag(&rsp, get_mtu());
+ *         frag = zephyr_smp_split_frag(zst, &rsp, get_mtu());
  *         if (frag == NULL) {
- *             net_buf_unref(nb);
+ *             net_buf_unref(rsp);
  *             return SYS_ENOMEM;
  *         }
  *         send_packet(frag)
  *     }
  *
+ * @param zst                   The transport whose statistics get updated.
  * @param nb                    The packet to fragment.  Upon fragmentation,
  *                                  this net_buf is adjusted such that the
  *                                  fragment data is removed.  If the packet
@@ -112,7 +153,8 @@ zephyr_smp_trim_front(void *buf, size_t len, void *arg)
  *                              NULL on failure.
  */
 static struct net_buf *
-zephyr_smp_split_frag(struct net_buf **nb, uint16_t mtu)
+zephyr_smp_split_frag(struct zephyr_smp_transport *zst, struct net_buf **nb,
+                      uint16_t mtu)
 {
     struct net_buf *frag;
     struct net_buf *src;
@@ -121,16 +163,26 @@ zephyr_smp_split_frag(struct net_buf **nb, uint16_t mtu)
 
     if (src->len <= mtu) {
         *nb = NULL;
-        frag = src;
-    } else {
+        return src;
+    }
+
+    frag = mcumgr_buf_slice(src, mtu);
+    if (frag == NULL) {
         frag = zephyr_smp_alloc_rsp(src, NULL);
+        if (frag == NULL) {
+            return NULL;
+        }
 
         /* Copy fragment payload into new buffer. */
         net_buf_add_mem(frag, src->data, mtu);
-
-        /* Remove fragment from total response. */
-        zephyr_smp_trim_front(src, mtu, NULL);
+        zst->zst_tx_stats.frag_bytes_copied += mtu;
     }
+    zst->zst_tx_stats.frag_allocs++;
+
+    /* Remove fragment from total response.  A slice still refers to the
+     * trimmed data, which remains intact until the slice is freed.
+     */
+    zephyr_smp_trim_front(src, mtu, NULL);
 
     return frag;
 }
@@ -176,7 +228,6 @@ zephyr_smp_tx_rsp(struct smp_streamer *ns, void *rsp, void *arg)
     struct net_buf *nb;
     uint16_t mtu;
     int rc;
-    int i;
 
     zst = arg;
     nb = rsp;
@@ -184,18 +235,24 @@ zephyr_smp_tx_rsp(struct smp_streamer *ns, void *rsp, void *arg)
     mtu = zst->zst_get_mtu(rsp);
     if (mtu == 0) {
         /* The transport cannot support a transmission right now. */
+        mcumgr_buf_free(nb);
         return MGMT_ERR_EUNKNOWN;
     }
 
-    i = 0;
     while (nb != NULL) {
-        frag = zephyr_smp_split_frag(&nb, mtu);
+        frag = zephyr_smp_split_frag(zst, &nb, mtu);
         if (frag == NULL) {
+            mcumgr_buf_free(nb);
             return MGMT_ERR_ENOMEM;
         }
 
+        zst->zst_tx_stats.frags++;
         rc = zst->zst_output(zst, frag);
         if (rc != 0) {
+            /* Output function already freed the fragment. */
+            if (nb != NULL) {
+                mcumgr_buf_free(nb);
+            }
             return MGMT_ERR_EUNKNOWN;
         }
     }
@@ -203,12 +260,90 @@ zephyr_smp_tx_rsp(struct smp_streamer *ns, void *rsp, void *arg)
     return 0;
 }
 
+#ifdef CONFIG_MCUMGR_SMP_COALESCE_RSP
+static size_t
+zephyr_smp_rsp_max(struct smp_streamer *ss, const void *buf, void *arg)
+{
+    struct zephyr_smp_transport *zst;
+    const struct net_buf *nb;
+    size_t capacity;
+    uint16_t mtu;
+
+    zst = arg;
+    nb = buf;
+
+    mtu = zst->zst_get_mtu(nb);
+    capacity = nb->len + net_buf_tailroom((struct net_buf *)nb);
+    if (mtu < capacity) {
+        return mtu;
+    }
+    return capacity;
+}
+#endif
+
+#if CONFIG_MCUMGR_SMP_ERR_BUF_COUNT > 0
+/**
+ * Retrieves the transport's reserved error buffer.  The transport keeps its
+ * own reference to the buffer, so transmitting the error response returns the
+ * buffer to the transport rather than to the pool.
+ */
+static void *
+zephyr_smp_err_buf(struct smp_streamer *ss, const void *req, void *arg)
+{
+    const struct net_buf_pool *pool;
+    const struct net_buf *req_nb;
+    struct zephyr_smp_transport *zst;
+    struct net_buf *nb;
+    size_t user_data_size;
+
+    zst = arg;
+    req_nb = req;
+    nb = zst->zst_err_nb;
+
+    /* Unavailable while a previous error response is still in flight. */
+    if (nb == NULL || nb->ref > 1) {
+        return NULL;
+    }
+
+    net_buf_reset(nb);
+
+    pool = net_buf_pool_get(req_nb->pool_id);
+    user_data_size = pool->user_data_size;
+    if (user_data_size > err_pool.user_data_size) {
+        user_data_size = err_pool.user_data_size;
+    }
+    memcpy(net_buf_user_data(nb), net_buf_user_data((void *)req_nb),
+           user_data_size);
+
+    return net_buf_ref(nb);
+}
+#endif
+
+static void
+zephyr_smp_resume(struct smp_streamer *ss, void *arg)
+{
+    struct zephyr_smp_transport *zst;
+
+    zst = arg;
+    zephyr_smp_submit(zst);
+}
+
 static void
 zephyr_smp_free_buf(void *buf, void *arg)
 {
     mcumgr_buf_free(buf);
 }
 
+static const void *
+zephyr_smp_session_key(const void *req, size_t *out_len, void *arg)
+{
+    const struct net_buf *nb;
+
+    nb = req;
+    *out_len = net_buf_pool_get(nb->pool_id)->user_data_size;
+    return net_buf_user_data((void *)nb);
+}
+
 static int
 zephyr_smp_init_reader(struct cbor_decoder_reader *reader, void *buf,
                         void *arg)
@@ -240,38 +375,112 @@ static int
 zephyr_smp_process_packet(struct zephyr_smp_transport *zst,
                           struct net_buf *nb)
 {
-    struct cbor_nb_reader reader;
-    struct cbor_nb_writer writer;
-    struct smp_streamer streamer;
     int rc;
 
-    streamer = (struct smp_streamer) {
-        .mgmt_stmr = {
-            .cfg = &zephyr_smp_cbor_cfg,
-            .reader = &reader.r,
-            .writer = &writer.enc,
-            .cb_arg = zst,
-        },
-        .tx_rsp_cb = zephyr_smp_tx_rsp,
-    };
-
-    rc = smp_process_request_packet(&streamer, nb);
+    rc = smp_process_request_packet(&zst->zst_streamer, nb);
     return rc;
 }
 
+static uint32_t
+zephyr_smp_elapsed_us(uint32_t start_cycles)
+{
+    uint32_t cycles;
+
+    cycles = k_cycle_get_32() - start_cycles;
+    return SYS_CLOCK_HW_CYCLES_TO_NS64(cycles) / 1000;
+}
+
+/**
+ * Indicates whether a single invocation of the work handler has used up its
+ * processing budget.
+ */
+static bool
+zephyr_smp_budget_spent(int num_pkts, uint32_t start_cycles)
+{
+    if (CONFIG_MCUMGR_SMP_WORK_MAX_REQS > 0 &&
+        num_pkts >= CONFIG_MCUMGR_SMP_WORK_MAX_REQS) {
+
+        return true;
+    }
+
+    if (CONFIG_MCUMGR_SMP_WORK_MAX_US > 0 &&
+        zephyr_smp_elapsed_us(start_cycles) >= CONFIG_MCUMGR_SMP_WORK_MAX_US) {
+
+        return true;
+    }
+
+    return false;
+}
+
+#ifdef CONFIG_MCUMGR_SMP_RX_RING
+static struct net_buf *
+zephyr_smp_dequeue(struct zephyr_smp_transport *zst)
+{
+    return zephyr_smp_ring_get(&zst->zst_ring);
+}
+
+static bool
+zephyr_smp_queue_is_empty(struct zephyr_smp_transport *zst)
+{
+    return zephyr_smp_ring_is_empty(&zst->zst_ring);
+}
+#else
+static struct net_buf *
+zephyr_smp_dequeue(struct zephyr_smp_transport *zst)
+{
+    return k_fifo_get(&zst->zst_fifo, K_NO_WAIT);
+}
+
+static bool
+zephyr_smp_queue_is_empty(struct zephyr_smp_transport *zst)
+{
+    return k_fifo_is_empty(&zst->zst_fifo);
+}
+#endif
+
 /**
- * Processes all received SNP request packets.
+ * Processes received SMP request packets.  Processing stops while a handler
+ * has a response deferred; the work item is resubmitted when the handler
+ * completes.  Processing also stops when the configured budget is spent, in
+ * which case the work item is resubmitted immediately so that other work
+ * items get a turn first.
  */
 static void
 zephyr_smp_handle_reqs(struct k_work *work)
 {
     struct zephyr_smp_transport *zst;
     struct net_buf *nb;
+    uint32_t start_cycles;
+    uint32_t hold_us;
+    int num_pkts;
+    int rc;
 
     zst = (void *)work;
+    start_cycles = k_cycle_get_32();
+    num_pkts = 0;
+
+    rc = smp_resume_deferred(&zst->zst_streamer);
+    if (rc != MGMT_DEFERRED) {
+        while ((nb = zephyr_smp_dequeue(zst)) != NULL) {
+            rc = zephyr_smp_process_packet(zst, nb);
+            if (rc == MGMT_DEFERRED) {
+                break;
+            }
+
+            num_pkts++;
+            if (zephyr_smp_budget_spent(num_pkts, start_cycles)) {
+                if (!zephyr_smp_queue_is_empty(zst)) {
+                    zst->zst_work_stats.yields++;
+                    zephyr_smp_submit(zst);
+                }
+                break;
+            }
+        }
+    }
 
-    while ((nb = k_fifo_get(&zst->zst_fifo, K_NO_WAIT)) != NULL) {
-        zephyr_smp_process_packet(zst, nb);
+    hold_us = zephyr_smp_elapsed_us(start_cycles);
+    if (hold_us > zst->zst_work_stats.max_hold_us) {
+        zst->zst_work_stats.max_hold_us = hold_us;
     }
 }
 
@@ -285,13 +494,83 @@ zephyr_smp_transport_init(struct zephyr_smp_transport *zst,
         .zst_get_mtu = get_mtu_func,
     };
 
+    zst->zst_streamer = (struct smp_streamer) {
+        .mgmt_stmr = {
+            .cfg = &zephyr_smp_cbor_cfg,
+            .reader = &zst->zst_reader.r,
+            .writer = &zst->zst_writer.enc,
+            .cb_arg = zst,
+        },
+        .tx_rsp_cb = zephyr_smp_tx_rsp,
+#ifdef CONFIG_MCUMGR_SMP_COALESCE_RSP
+        .rsp_max_cb = zephyr_smp_rsp_max,
+#endif
+        .deferred = &zst->zst_deferred,
+        .resume_cb = zephyr_smp_resume,
+#ifdef CONFIG_MCUMGR_SMP_DEFINITE_LEN
+        .definite_len = true,
+#endif
+    };
+
+#if CONFIG_MCUMGR_SMP_ERR_BUF_COUNT > 0
+    zst->zst_err_nb = net_buf_alloc(&err_pool, K_NO_WAIT);
+    if (zst->zst_err_nb != NULL) {
+        zst->zst_streamer.err_buf_cb = zephyr_smp_err_buf;
+    }
+#endif
+
+#if CONFIG_MCUMGR_SMP_RSP_CACHE_COUNT > 0
+    zst->zst_rsp_cache = (struct smp_rsp_cache) {
+        .src_entries = zst->zst_rsp_cache_entries,
+        .src_data = &zst->zst_rsp_cache_data[0][0],
+        .src_entry_size = CONFIG_MCUMGR_SMP_RSP_CACHE_SIZE,
+        .src_num_entries = CONFIG_MCUMGR_SMP_RSP_CACHE_COUNT,
+        .src_timeout_ms = CONFIG_MCUMGR_SMP_RSP_CACHE_TIMEOUT_MS,
+    };
+    zst->zst_streamer.rsp_cache = &zst->zst_rsp_cache;
+#endif
+
     k_work_init(&zst->zst_work, zephyr_smp_handle_reqs);
+#ifdef CONFIG_MCUMGR_SMP_RX_RING
+    zephyr_smp_ring_init(&zst->zst_ring);
+#else
     k_fifo_init(&zst->zst_fifo);
+#endif
 }
 
 void
 zephyr_smp_rx_req(struct zephyr_smp_transport *zst, struct net_buf *nb)
 {
+#ifdef CONFIG_MCUMGR_SMP_RX_RING
+    int rc;
+
+    /* Every request comes from the mcumgr pool, so the ring can't
+     * overflow.
+     */
+    rc = zephyr_smp_ring_put(&zst->zst_ring, nb);
+    assert(rc == 0);
+    ARG_UNUSED(rc);
+#else
     k_fifo_put(&zst->zst_fifo, nb);
-    k_work_submit(&zst->zst_work);
+#endif
+    zephyr_smp_submit(zst);
+}
+
+#ifdef CONFIG_MCUMGR_SMP_WORKQUEUE
+static int
+zephyr_smp_init(struct device *dev)
+{
+    ARG_UNUSED(dev);
+
+    k_work_q_start(&zephyr_smp_wq, zephyr_smp_wq_stack,
+                   K_THREAD_STACK_SIZEOF(zephyr_smp_wq_stack),
+                   CONFIG_MCUMGR_SMP_WORKQUEUE_THREAD_PRIO);
+#ifdef CONFIG_THREAD_NAME
+    k_thread_name_set(&zephyr_smp_wq.thread, "mcumgr smp");
+#endif
+
+    return 0;
 }
+
+SYS_INIT(zephyr_smp_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <zephyr.h>
+#include <atomic.h>
+#include "zephyr_smp/zephyr_smp_ring.h"
+
+/* atomic_get() and atomic_set() are sequentially consistent, so a slot's
+ * contents are visible to the other side before the index that hands it
+ * over.
+ */
+
+static atomic_val_t
+zephyr_smp_ring_next(atomic_val_t idx)
+{
+    idx++;
+    if (idx == ZEPHYR_SMP_RING_SIZE) {
+        idx = 0;
+    }
+    return idx;
+}
+
+void
+zephyr_smp_ring_init(struct zephyr_smp_ring *zsr)
+{
+    atomic_set(&zsr->zsr_head, 0);
+    atomic_set(&zsr->zsr_tail, 0);
+}
+
+int
+zephyr_smp_ring_put(struct zephyr_smp_ring *zsr, struct net_buf *nb)
+{
+    atomic_val_t tail;
+    atomic_val_t next;
+
+    tail = atomic_get(&zsr->zsr_tail);
+    next = zephyr_smp_ring_next(tail);
+    if (next == atomic_get(&zsr->zsr_head)) {
+        return -1;
+    }
+
+    zsr->zsr_slots[tail] = nb;
+    atomic_set(&zsr->zsr_tail, next);
+
+    return 0;
+}
+
+struct net_buf *
+zephyr_smp_ring_get(struct zephyr_smp_ring *zsr)
+{
+    struct net_buf *nb;
+    atomic_val_t head;
+
+    head = atomic_get(&zsr->zsr_head);
+    if (head == atomic_get(&zsr->zsr_tail)) {
+        return NULL;
+    }
+
+    nb = zsr->zsr_slots[head];
+    atomic_set(&zsr->zsr_head, zephyr_smp_ring_next(head));
+
+    return nb;
+}
+
+bool
+zephyr_smp_ring_is_empty(struct zephyr_smp_ring *zsr)
+{
+    return atomic_get(&zsr->zsr_head) == atomic_get(&zsr->zsr_tail);
+}
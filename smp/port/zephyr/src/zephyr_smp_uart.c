@@ -0,0 +1,153 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <uart.h>
+#include "net/buf.h"
+#include "mgmt/mgmt.h"
+#include "zephyr_mgmt/buf.h"
+#include "smp/smp.h"
+#include "smp/smp_serial.h"
+#include "zephyr_smp/zephyr_smp.h"
+#include "zephyr_smp/zephyr_smp_uart.h"
+
+static struct zephyr_smp_transport zephyr_smp_uart_transport;
+static struct smp_serial_rx zephyr_smp_uart_rx;
+static struct device *zephyr_smp_uart_dev;
+
+/* Buffer that the packet being received is decoded into; only accessed by
+ * the interrupt handler.
+ */
+static struct net_buf *zephyr_smp_uart_nb;
+
+static int
+zephyr_smp_uart_write(const void *data, int len, void *arg)
+{
+    const uint8_t *u8p;
+    int i;
+
+    u8p = data;
+    for (i = 0; i < len; i++) {
+        uart_poll_out(zephyr_smp_uart_dev, u8p[i]);
+    }
+
+    return 0;
+}
+
+static int
+zephyr_smp_uart_out(struct zephyr_smp_transport *zst, struct net_buf *nb)
+{
+    int rc;
+
+    rc = smp_serial_tx_pkt(nb->data, nb->len, zephyr_smp_uart_write, NULL);
+    mcumgr_buf_free(nb);
+
+    return rc;
+}
+
+static uint16_t
+zephyr_smp_uart_get_mtu(const struct net_buf *nb)
+{
+    return CONFIG_MCUMGR_BUF_SIZE;
+}
+
+/**
+ * Ensures the decoder has a buffer to decode the next packet into.  Buffers
+ * are allocated without waiting, so this is safe in interrupt context.  If
+ * none is available, the decoder discards the packet and counts an
+ * overflow.
+ */
+static void
+zephyr_smp_uart_ensure_buf(void)
+{
+    if (zephyr_smp_uart_nb != NULL) {
+        return;
+    }
+
+    zephyr_smp_uart_nb = mcumgr_buf_alloc();
+    if (zephyr_smp_uart_nb != NULL) {
+        smp_serial_rx_set_buf(&zephyr_smp_uart_rx, zephyr_smp_uart_nb->data,
+                              net_buf_tailroom(zephyr_smp_uart_nb));
+    }
+}
+
+static void
+zephyr_smp_uart_isr(struct device *dev)
+{
+    struct net_buf *nb;
+    uint8_t chunk[16];
+    int pkt_len;
+    int num;
+    int i;
+
+    while (uart_irq_update(dev) && uart_irq_rx_ready(dev)) {
+        num = uart_fifo_read(dev, chunk, sizeof chunk);
+        for (i = 0; i < num; i++) {
+            zephyr_smp_uart_ensure_buf();
+
+            pkt_len = smp_serial_rx_byte(&zephyr_smp_uart_rx, chunk[i]);
+            if (pkt_len > 0) {
+                nb = zephyr_smp_uart_nb;
+                zephyr_smp_uart_nb = NULL;
+                smp_serial_rx_set_buf(&zephyr_smp_uart_rx, NULL, 0);
+
+                net_buf_add(nb, pkt_len);
+                zephyr_smp_rx_req(&zephyr_smp_uart_transport, nb);
+            }
+        }
+    }
+}
+
+const struct smp_serial_rx_stats *
+zephyr_smp_uart_rx_stats(void)
+{
+    return &zephyr_smp_uart_rx.ssr_stats;
+}
+
+int
+zephyr_smp_uart_open(void)
+{
+    uint8_t dummy;
+
+    if (zephyr_smp_uart_dev != NULL) {
+        return 0;
+    }
+
+    zephyr_smp_uart_dev = device_get_binding(CONFIG_MCUMGR_SMP_UART_DEV_NAME);
+    if (zephyr_smp_uart_dev == NULL) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    zephyr_smp_transport_init(&zephyr_smp_uart_transport,
+                              zephyr_smp_uart_out, zephyr_smp_uart_get_mtu);
+    smp_serial_rx_init(&zephyr_smp_uart_rx);
+
+    uart_irq_rx_disable(zephyr_smp_uart_dev);
+    uart_irq_tx_disable(zephyr_smp_uart_dev);
+
+    /* Discard anything received before the transport was ready. */
+    while (uart_fifo_read(zephyr_smp_uart_dev, &dummy, 1) != 0) {
+    }
+
+    uart_irq_callback_set(zephyr_smp_uart_dev, zephyr_smp_uart_isr);
+    uart_irq_rx_enable(zephyr_smp_uart_dev);
+
+    return 0;
+}
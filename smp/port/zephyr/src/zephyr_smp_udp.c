@@ -0,0 +1,314 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+#include <zephyr.h>
+#include <net/socket.h>
+#include <net/net_if.h>
+#include "net/buf.h"
+#include "mgmt/mgmt.h"
+#include "zephyr_mgmt/buf.h"
+#include "smp/smp.h"
+#include "zephyr_smp/zephyr_smp.h"
+#include "zephyr_smp/zephyr_smp_udp.h"
+
+/* Index of each protocol's socket. */
+#define ZEPHYR_SMP_UDP_IPV4     0
+#define ZEPHYR_SMP_UDP_IPV6     1
+
+/**
+ * Stored in each request's user data to identify the peer.  The SMP layer
+ * copies it into the corresponding responses.
+ */
+struct zephyr_smp_udp_ud {
+    struct sockaddr addr;
+};
+
+BUILD_ASSERT_MSG(sizeof(struct zephyr_smp_udp_ud) <=
+                 CONFIG_MCUMGR_BUF_USER_DATA_SIZE,
+                 "MCUMGR_BUF_USER_DATA_SIZE too small for SMP UDP");
+
+static struct zephyr_smp_transport zephyr_smp_udp_transport;
+static int zephyr_smp_udp_fds[2] = { -1, -1 };
+static bool zephyr_smp_udp_started;
+
+static K_THREAD_STACK_DEFINE(zephyr_smp_udp_stack,
+                             CONFIG_MCUMGR_SMP_UDP_STACK_SIZE);
+static struct k_thread zephyr_smp_udp_thread;
+
+static socklen_t
+zephyr_smp_udp_addr_len(const struct sockaddr *addr)
+{
+    if (addr->sa_family == AF_INET6) {
+        return sizeof(struct sockaddr_in6);
+    } else {
+        return sizeof(struct sockaddr_in);
+    }
+}
+
+static int
+zephyr_smp_udp_out(struct zephyr_smp_transport *zst, struct net_buf *nb)
+{
+    const struct zephyr_smp_udp_ud *ud;
+    ssize_t rc;
+    int fd;
+
+    ud = net_buf_user_data(nb);
+    if (ud->addr.sa_family == AF_INET6) {
+        fd = zephyr_smp_udp_fds[ZEPHYR_SMP_UDP_IPV6];
+    } else {
+        fd = zephyr_smp_udp_fds[ZEPHYR_SMP_UDP_IPV4];
+    }
+
+    rc = sendto(fd, nb->data, nb->len, 0, &ud->addr,
+                zephyr_smp_udp_addr_len(&ud->addr));
+    mcumgr_buf_free(nb);
+
+    if (rc < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+/**
+ * Resolves the interface that datagrams to the specified peer leave by, as
+ * the stack selects it for the source address.
+ *
+ * @return                      The egress interface, or NULL if none could be
+ *                                  resolved.
+ */
+static struct net_if *
+zephyr_smp_udp_egress_iface(const struct sockaddr *addr)
+{
+#if defined(CONFIG_NET_IPV6)
+    if (addr->sa_family == AF_INET6) {
+        return net_if_ipv6_select_src_iface(&net_sin6(addr)->sin6_addr);
+    }
+#endif
+#if defined(CONFIG_NET_IPV4)
+    if (addr->sa_family == AF_INET) {
+        return net_if_ipv4_select_src_iface(&net_sin(addr)->sin_addr);
+    }
+#endif
+
+    return NULL;
+}
+
+/**
+ * Indicates whether the specified interface carries IPv6 over 6LoWPAN.
+ */
+static bool
+zephyr_smp_udp_is_6lo(struct net_if *iface)
+{
+#if defined(CONFIG_NET_L2_IEEE802154)
+    if (net_if_l2(iface) == &NET_L2_GET_NAME(IEEE802154)) {
+        return true;
+    }
+#endif
+#if defined(CONFIG_NET_L2_BT)
+    if (net_if_l2(iface) == &NET_L2_GET_NAME(BLUETOOTH)) {
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+/**
+ * Each response datagram must fit within the MTU of the interface it leaves
+ * by towards the peer, less the IP and UDP headers.  On 6LoWPAN, whose link
+ * fragments IPv6 packets, this is the IPv6 minimum MTU, which every path
+ * supports.  If no interface can be resolved, the protocol's minimum MTU is
+ * used, as the POSIX port does when the path MTU is unknown.
+ */
+static uint16_t
+zephyr_smp_udp_get_mtu(const struct net_buf *nb)
+{
+    const struct zephyr_smp_udp_ud *ud;
+    struct net_if *iface;
+    uint16_t hdr_len;
+    uint16_t mtu;
+
+    ud = net_buf_user_data((void *)nb);
+
+    if (ud->addr.sa_family == AF_INET6) {
+        hdr_len = NET_IPV6UDPH_LEN;
+        mtu = NET_IPV6_MTU;
+    } else {
+        hdr_len = NET_IPV4UDPH_LEN;
+        mtu = NET_IPV4_MTU;
+    }
+
+    iface = zephyr_smp_udp_egress_iface(&ud->addr);
+    if (iface != NULL && !zephyr_smp_udp_is_6lo(iface) &&
+        net_if_get_mtu(iface) != 0) {
+
+        mtu = net_if_get_mtu(iface);
+    }
+
+    if (mtu <= hdr_len) {
+        return 0;
+    }
+    mtu -= hdr_len;
+
+    if (mtu > CONFIG_MCUMGR_BUF_SIZE) {
+        mtu = CONFIG_MCUMGR_BUF_SIZE;
+    }
+
+    return mtu;
+}
+
+static void
+zephyr_smp_udp_rx(int fd)
+{
+    struct zephyr_smp_udp_ud *ud;
+    struct net_buf *nb;
+    socklen_t addr_len;
+    uint8_t dummy;
+    ssize_t len;
+
+    nb = mcumgr_buf_alloc();
+    if (nb == NULL) {
+        /* Drop the datagram; the client will retransmit. */
+        recv(fd, &dummy, sizeof dummy, 0);
+        SMP_STATS_INC(SMP_STAT_RX_DROPS);
+        return;
+    }
+
+    ud = net_buf_user_data(nb);
+    addr_len = sizeof ud->addr;
+    len = recvfrom(fd, nb->data, net_buf_tailroom(nb), 0, &ud->addr,
+                   &addr_len);
+    if (len <= 0) {
+        mcumgr_buf_free(nb);
+        return;
+    }
+
+    net_buf_add(nb, len);
+    zephyr_smp_rx_req(&zephyr_smp_udp_transport, nb);
+}
+
+static void
+zephyr_smp_udp_receive_thread(void *p1, void *p2, void *p3)
+{
+    struct pollfd fds[2];
+    int num_fds;
+    int rc;
+    int i;
+
+    num_fds = 0;
+    for (i = 0; i < 2; i++) {
+        if (zephyr_smp_udp_fds[i] >= 0) {
+            fds[num_fds].fd = zephyr_smp_udp_fds[i];
+            fds[num_fds].events = POLLIN;
+            num_fds++;
+        }
+    }
+
+    while (1) {
+        rc = poll(fds, num_fds, -1);
+        if (rc < 0) {
+            k_sleep(K_MSEC(100));
+            continue;
+        }
+
+        for (i = 0; i < num_fds; i++) {
+            if (fds[i].revents & POLLIN) {
+                zephyr_smp_udp_rx(fds[i].fd);
+            }
+        }
+    }
+}
+
+static int
+zephyr_smp_udp_create_socket(struct sockaddr *addr, socklen_t addr_len)
+{
+    int fd;
+    int rc;
+
+    fd = socket(addr->sa_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        return -1;
+    }
+
+    rc = bind(fd, addr, addr_len);
+    if (rc < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int
+zephyr_smp_udp_open(void)
+{
+#ifdef CONFIG_NET_IPV4
+    struct sockaddr_in addr4;
+#endif
+#ifdef CONFIG_NET_IPV6
+    struct sockaddr_in6 addr6;
+#endif
+
+    if (zephyr_smp_udp_started) {
+        return 0;
+    }
+
+#ifdef CONFIG_NET_IPV4
+    memset(&addr4, 0, sizeof addr4);
+    addr4.sin_family = AF_INET;
+    addr4.sin_port = htons(CONFIG_MCUMGR_SMP_UDP_PORT);
+    addr4.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    zephyr_smp_udp_fds[ZEPHYR_SMP_UDP_IPV4] =
+        zephyr_smp_udp_create_socket((struct sockaddr *)&addr4, sizeof addr4);
+#endif
+
+#ifdef CONFIG_NET_IPV6
+    memset(&addr6, 0, sizeof addr6);
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port = htons(CONFIG_MCUMGR_SMP_UDP_PORT);
+    addr6.sin6_addr = in6addr_any;
+
+    zephyr_smp_udp_fds[ZEPHYR_SMP_UDP_IPV6] =
+        zephyr_smp_udp_create_socket((struct sockaddr *)&addr6, sizeof addr6);
+#endif
+
+    if (zephyr_smp_udp_fds[ZEPHYR_SMP_UDP_IPV4] < 0 &&
+        zephyr_smp_udp_fds[ZEPHYR_SMP_UDP_IPV6] < 0) {
+
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    zephyr_smp_transport_init(&zephyr_smp_udp_transport, zephyr_smp_udp_out,
+                              zephyr_smp_udp_get_mtu);
+
+    k_thread_create(&zephyr_smp_udp_thread, zephyr_smp_udp_stack,
+                    K_THREAD_STACK_SIZEOF(zephyr_smp_udp_stack),
+                    zephyr_smp_udp_receive_thread, NULL, NULL, NULL,
+                    CONFIG_MCUMGR_SMP_UDP_THREAD_PRIO, 0, K_NO_WAIT);
+#ifdef CONFIG_THREAD_NAME
+    k_thread_name_set(&zephyr_smp_udp_thread, "mcumgr smp udp");
+#endif
+
+    zephyr_smp_udp_started = true;
+
+    return 0;
+}
@@ -24,9 +24,36 @@
 
 #include "mgmt/endian.h"
 #include "mgmt/mgmt.h"
+#include "mgmt/mgmt_handler_stats.h"
+#include "mgmt/mgmt_impl.h"
+#include "mgmt/mgmt_stats.h"
+#include "mgmt/mgmt_trace.h"
 #include "smp/smp.h"
 #include "cbor.h"
 
+/**
+ * Limits on the structure of responses that get definite-length encoding.
+ * These are documented with the SMP_DEFINITE_LEN settings; keep them in sync.
+ */
+#define SMP_DEFINITE_MAX_CONTAINERS     32
+#define SMP_DEFINITE_MAX_DEPTH          8
+
+uint32_t smp_stats[SMP_STAT_COUNT];
+
+static const char * const smp_stat_names[SMP_STAT_COUNT] = {
+    [SMP_STAT_RX_PKTS] = "rx_pkts",
+    [SMP_STAT_RX_REQS] = "rx_reqs",
+    [SMP_STAT_RX_DROPS] = "rx_drops",
+    [SMP_STAT_TX_PKTS] = "tx_pkts",
+    [SMP_STAT_TX_ERRS] = "tx_errs",
+    [SMP_STAT_ERR_RSPS] = "err_rsps",
+    [SMP_STAT_ALLOC_FAILS] = "alloc_fails",
+    [SMP_STAT_CACHE_HITS] = "cache_hits",
+    [SMP_STAT_INDEF_RSPS] = "indef_rsps",
+};
+
+static MGMT_STATS_DEFINE(smp_stat_group, "smp", smp_stat_names, smp_stats);
+
 static int
 smp_align4(int x)
 {
@@ -91,52 +118,693 @@ smp_write_hdr(struct smp_streamer *streamer, const struct mgmt_hdr *src_hdr)
     return mgmt_err_from_cbor(rc);
 }
 
+/**
+ * Fixes up the header of a fully-encoded response with the correct length.
+ */
+static int
+smp_fixup_rsp_hdr(struct smp_streamer *streamer,
+                  const struct mgmt_hdr *req_hdr,
+                  struct CborEncoder *encoder)
+{
+    struct mgmt_hdr rsp_hdr;
+
+    smp_init_rsp_hdr(req_hdr, &rsp_hdr);
+    rsp_hdr.nh_len = cbor_encode_bytes_written(encoder) - MGMT_HDR_SIZE;
+    mgmt_hton_hdr(&rsp_hdr);
+    return smp_write_hdr(streamer, &rsp_hdr);
+}
+
+/**
+ * The payload of an error response, {"rc": N}, with the status as the final
+ * byte.  The map is closed with a break unless definite lengths are in use.
+ */
+static const uint8_t smp_err_rsp_tmpl[] = {
+    0xbf,                   /* Map (indefinite length). */
+    0x62, 'r', 'c',         /* Text string: "rc". */
+    0x00,                   /* Unsigned int: status. */
+};
+
+/**
+ * Writes an error response into the streamer's writer.  Rather than running
+ * the CBOR encoder, this patches the status into a precomputed template, so
+ * it completes in constant time and never allocates.
+ */
 static int
 smp_build_err_rsp(struct smp_streamer *streamer,
                   const struct mgmt_hdr *req_hdr,
                   int status)
 {
-    struct CborEncoder map;
-    struct mgmt_ctxt cbuf;
+    struct cbor_encoder_writer *writer;
     struct mgmt_hdr rsp_hdr;
+    uint8_t buf[SMP_ERR_RSP_MAX_LEN];
+    uint8_t *payload;
+    int len;
     int rc;
 
-    rc = mgmt_ctxt_init(&cbuf, &streamer->mgmt_stmr);
-    if (rc != 0) {
-        return rc;
+    if (status < 0 || status > UINT8_MAX) {
+        status = MGMT_ERR_EUNKNOWN;
+    }
+
+    payload = buf + MGMT_HDR_SIZE;
+    memcpy(payload, smp_err_rsp_tmpl, sizeof smp_err_rsp_tmpl);
+    len = sizeof smp_err_rsp_tmpl;
+
+    if (streamer->definite_len) {
+        payload[0] = 0xa1;
+    }
+
+    /* Statuses of 24 and above need a one-byte argument. */
+    if (status < 24) {
+        payload[len - 1] = status;
+    } else {
+        payload[len - 1] = 0x18;
+        payload[len++] = status;
+    }
+
+    if (!streamer->definite_len) {
+        payload[len++] = 0xff;
     }
 
     smp_init_rsp_hdr(req_hdr, &rsp_hdr);
-    rc = smp_write_hdr(streamer, &rsp_hdr);
-    if (rc != 0) {
-        return rc;
+    rsp_hdr.nh_len = len;
+    mgmt_hton_hdr(&rsp_hdr);
+    memcpy(buf, &rsp_hdr, sizeof rsp_hdr);
+
+    writer = streamer->mgmt_stmr.writer;
+    rc = writer->write(writer, (const char *)buf, MGMT_HDR_SIZE + len);
+    return mgmt_err_from_cbor(rc);
+}
+
+/**
+ * Copies a range of encoded CBOR from a reader to a writer.
+ */
+static int
+smp_copy_cbor(struct cbor_decoder_reader *reader, size_t off, size_t end,
+              struct cbor_encoder_writer *out)
+{
+    uint8_t chunk[64];
+    size_t chunk_len;
+    int rc;
+
+    while (off < end) {
+        chunk_len = end - off;
+        if (chunk_len > sizeof chunk) {
+            chunk_len = sizeof chunk;
+        }
+
+        reader->cpy(reader, (char *)chunk, off, chunk_len);
+        rc = out->write(out, (const char *)chunk, chunk_len);
+        if (rc != 0) {
+            return rc;
+        }
+
+        off += chunk_len;
     }
 
-    rc = cbor_encoder_create_map(&cbuf.encoder, &map, CborIndefiniteLength);
-    if (rc != 0) {
-        return rc;
+    return 0;
+}
+
+/**
+ * Walks the encoded CBOR at the specified range of the reader.  In the
+ * counting pass (out == NULL), the items in each indefinite-length container
+ * are counted; containers are numbered in order of appearance.  In the
+ * emitting pass, the CBOR is re-encoded into the supplied writer, with each
+ * container that holds fewer than 256 items given a definite length and its
+ * break byte dropped.  The re-encoded CBOR is therefore never larger.
+ * Everything other than container headers and breaks is copied verbatim.
+ *
+ * @param reader                The reader containing the encoded CBOR.
+ * @param off                   The offset of the first item.
+ * @param end                   The offset just past the last item.
+ * @param counts                Item counts, indexed by container number.
+ *                                  Written by the counting pass; read by the
+ *                                  emitting pass.
+ * @param out_num               On success, the number of indefinite-length
+ *                                  containers (counting pass) or the number
+ *                                  of them converted (emitting pass) gets
+ *                                  written here.
+ * @param out                   The writer to re-encode into, or NULL for the
+ *                                  counting pass.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if the CBOR contains
+ *                                  something this function can't convert
+ *                                  (e.g., indefinite-length strings, or too
+ *                                  many containers);
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+static int
+smp_walk_cbor(struct cbor_decoder_reader *reader, size_t off, size_t end,
+              uint16_t *counts, int *out_num, struct cbor_encoder_writer *out)
+{
+    struct {
+        /* Items left in a definite-length container. */
+        uint64_t remaining;
+
+        /* Number of an indefinite-length container; -1 if definite. */
+        int num;
+
+        /* Whether the container's break byte gets dropped. */
+        bool converted;
+    } stack[SMP_DEFINITE_MAX_DEPTH];
+    uint64_t count;
+    uint64_t arg;
+    uint8_t hdr[2];
+    size_t copy_off;
+    size_t arg_len;
+    uint8_t major;
+    uint8_t ib;
+    uint8_t ai;
+    bool tagged;
+    bool done;
+    int depth;
+    int conv;
+    int num;
+    int rc;
+
+    depth = 0;
+    conv = 0;
+    num = 0;
+    tagged = false;
+    copy_off = off;
+    rc = 0;
+
+    while (off < end) {
+        ib = reader->get8(reader, off);
+        major = ib >> 5;
+        ai = ib & 0x1f;
+
+        if (ib == 0xff) {
+            /* Break; ends the innermost indefinite-length container. */
+            if (depth == 0 || stack[depth - 1].num < 0) {
+                return MGMT_ERR_EINVAL;
+            }
+            depth--;
+            off++;
+            if (out != NULL && stack[depth].converted) {
+                rc = smp_copy_cbor(reader, copy_off, off - 1, out);
+                copy_off = off;
+            }
+            done = true;
+        } else if ((major == 4 || major == 5) && ai == 31) {
+            /* Indefinite-length array or map. */
+            if (depth >= SMP_DEFINITE_MAX_DEPTH ||
+                num >= SMP_DEFINITE_MAX_CONTAINERS) {
+
+                return MGMT_ERR_ENOTSUP;
+            }
+
+            if (out == NULL && !tagged &&
+                depth > 0 && stack[depth - 1].num >= 0 &&
+                counts[stack[depth - 1].num] < UINT16_MAX) {
+
+                counts[stack[depth - 1].num]++;
+            }
+
+            stack[depth].num = num;
+            stack[depth].converted = false;
+            if (out != NULL) {
+                count = counts[num];
+                if (major == 5) {
+                    count /= 2;
+                }
+                if (count < 256) {
+                    stack[depth].converted = true;
+                    conv++;
+                    rc = smp_copy_cbor(reader, copy_off, off, out);
+                    copy_off = off + 1;
+
+                    if (rc == 0) {
+                        if (count < 24) {
+                            hdr[0] = (major << 5) | count;
+                            rc = out->write(out, (const char *)hdr, 1);
+                        } else {
+                            hdr[0] = (major << 5) | 24;
+                            hdr[1] = count;
+                            rc = out->write(out, (const char *)hdr, 2);
+                        }
+                    }
+                }
+            }
+            depth++;
+            num++;
+            off++;
+            tagged = false;
+            done = false;
+        } else {
+            /* Any other item; only its extent matters. */
+            if (out == NULL && !tagged &&
+                depth > 0 && stack[depth - 1].num >= 0 &&
+                counts[stack[depth - 1].num] < UINT16_MAX) {
+
+                counts[stack[depth - 1].num]++;
+            }
+            tagged = false;
+
+            if (ai < 24) {
+                arg = ai;
+                arg_len = 0;
+            } else if (ai <= 27) {
+                arg_len = 1 << (ai - 24);
+                if (off + 1 + arg_len > end) {
+                    return MGMT_ERR_EINVAL;
+                }
+                switch (arg_len) {
+                case 1:
+                    arg = reader->get8(reader, off + 1);
+                    break;
+                case 2:
+                    arg = reader->get16(reader, off + 1);
+                    break;
+                case 4:
+                    arg = reader->get32(reader, off + 1);
+                    break;
+                default:
+                    arg = reader->get64(reader, off + 1);
+                    break;
+                }
+            } else {
+                /* Reserved, or an indefinite-length string. */
+                return MGMT_ERR_ENOTSUP;
+            }
+            off += 1 + arg_len;
+
+            switch (major) {
+            case 2:
+            case 3:
+                /* Byte or text string. */
+                if (arg > end - off) {
+                    return MGMT_ERR_EINVAL;
+                }
+                off += arg;
+                done = true;
+                break;
+
+            case 4:
+            case 5:
+                /* Definite-length array or map. */
+                count = major == 5 ? arg * 2 : arg;
+                if (count == 0) {
+                    done = true;
+                } else if (depth >= SMP_DEFINITE_MAX_DEPTH) {
+                    return MGMT_ERR_ENOTSUP;
+                } else {
+                    stack[depth].remaining = count;
+                    stack[depth].num = -1;
+                    depth++;
+                    done = false;
+                }
+                break;
+
+            case 6:
+                /* Tag; it and the following item count as one. */
+                tagged = true;
+                done = false;
+                break;
+
+            default:
+                done = true;
+                break;
+            }
+        }
+
+        if (rc != 0) {
+            return mgmt_err_from_cbor(rc);
+        }
+
+        /* Close any definite-length containers that this item completes. */
+        while (done && depth > 0 && stack[depth - 1].num < 0) {
+            if (--stack[depth - 1].remaining > 0) {
+                break;
+            }
+            depth--;
+        }
+    }
+
+    if (depth != 0) {
+        return MGMT_ERR_EINVAL;
     }
 
-    rc = mgmt_write_rsp_status(&cbuf, status);
+    if (out != NULL) {
+        rc = smp_copy_cbor(reader, copy_off, end, out);
+        if (rc != 0) {
+            return mgmt_err_from_cbor(rc);
+        }
+        num = conv;
+    }
+
+    *out_num = num;
+    return 0;
+}
+
+/**
+ * Re-encodes a response with definite-length containers, if it has any
+ * indefinite-length ones.  This is a best-effort operation; on failure, the
+ * response is left as is.  Responses that keep any indefinite-length
+ * container are counted in the "indef_rsps" stat.
+ *
+ * @param streamer              The SMP streamer to use.
+ * @param rsp                   The response to convert.  On success, this is
+ *                                  replaced with the converted response.
+ * @param spare                 An empty buffer to convert into, or NULL to
+ *                                  allocate one.  If a buffer ends up unused,
+ *                                  it gets written here (empty).
+ */
+static void
+smp_make_definite(struct smp_streamer *streamer, void **rsp, void **spare)
+{
+    uint16_t counts[SMP_DEFINITE_MAX_CONTAINERS];
+    struct cbor_decoder_reader *reader;
+    struct cbor_encoder_writer *writer;
+    struct mgmt_hdr hdr;
+    size_t len;
+    void *dst;
+    int conv;
+    int num;
+    int rc;
+
+    rc = mgmt_streamer_init_reader(&streamer->mgmt_stmr, *rsp);
     if (rc != 0) {
-        return rc;
+        return;
+    }
+    reader = streamer->mgmt_stmr.reader;
+    len = reader->message_size;
+    if (len < MGMT_HDR_SIZE) {
+        return;
     }
 
-    rc = cbor_encoder_close_container(&cbuf.encoder, &map);
+    /* Pass 1: count the items in each container. */
+    memset(counts, 0, sizeof counts);
+    rc = smp_walk_cbor(reader, MGMT_HDR_SIZE, len, counts, &num, NULL);
     if (rc != 0) {
-        return rc;
+        SMP_STATS_INC(SMP_STAT_INDEF_RSPS);
+        return;
+    }
+    if (num == 0) {
+        return;
     }
 
-    rsp_hdr.nh_len = cbor_encode_bytes_written(&cbuf.encoder) - MGMT_HDR_SIZE;
-    mgmt_hton_hdr(&rsp_hdr);
-    rc = smp_write_hdr(streamer, &rsp_hdr);
+    if (*spare != NULL) {
+        dst = *spare;
+        *spare = NULL;
+    } else {
+        dst = mgmt_streamer_alloc_rsp(&streamer->mgmt_stmr, *rsp);
+        if (dst == NULL) {
+            SMP_STATS_INC(SMP_STAT_INDEF_RSPS);
+            return;
+        }
+    }
+
+    rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, dst);
+    if (rc == 0) {
+        writer = streamer->mgmt_stmr.writer;
+        reader->cpy(reader, (char *)&hdr, 0, sizeof hdr);
+        rc = writer->write(writer, (const char *)&hdr, sizeof hdr);
+        rc = mgmt_err_from_cbor(rc);
+    }
+
+    /* Pass 2: re-encode with definite lengths. */
+    if (rc == 0) {
+        rc = smp_walk_cbor(reader, MGMT_HDR_SIZE, len, counts, &conv,
+                           writer);
+    }
+    if (rc == 0) {
+        hdr.nh_len = htons(writer->bytes_written - MGMT_HDR_SIZE);
+        rc = smp_write_hdr(streamer, &hdr);
+    }
+
+    if (rc == 0) {
+        /* Swap the buffers. */
+        mgmt_streamer_reset_buf(&streamer->mgmt_stmr, *rsp);
+        *spare = *rsp;
+        *rsp = dst;
+        if (conv < num) {
+            /* Containers of 256 or more items keep their break markers. */
+            SMP_STATS_INC(SMP_STAT_INDEF_RSPS);
+        }
+    } else {
+        mgmt_streamer_reset_buf(&streamer->mgmt_stmr, dst);
+        *spare = dst;
+        SMP_STATS_INC(SMP_STAT_INDEF_RSPS);
+    }
+}
+
+/**
+ * Computes a 32-bit hash of the request payload at the front of the streamer's
+ * reader.  This is FNV-1a applied to 32-bit words rather than bytes, which is
+ * four times cheaper and sufficient for telling retransmits apart.  The
+ * session key is folded in so that identical requests from different peers
+ * are not mistaken for retransmits.
+ */
+static uint32_t
+smp_hash_req(struct smp_streamer *streamer, size_t len,
+             const uint8_t *key, size_t key_len)
+{
+    struct cbor_decoder_reader *reader;
+    uint32_t chunk[8];
+    size_t chunk_len;
+    size_t off;
+    uint32_t hash;
+    int i;
+
+    reader = streamer->mgmt_stmr.reader;
+    if (len > reader->message_size) {
+        len = reader->message_size;
+    }
+
+    hash = 2166136261u;
+    for (i = 0; i < key_len; i++) {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+
+    for (off = 0; off < len; off += chunk_len) {
+        chunk_len = len - off;
+        if (chunk_len > sizeof chunk) {
+            chunk_len = sizeof chunk;
+        } else {
+            /* Zero-pad the final partial word. */
+            memset(chunk, 0, sizeof chunk);
+        }
+
+        reader->cpy(reader, (char *)chunk, off, chunk_len);
+        for (i = 0; i < (chunk_len + 3) / 4; i++) {
+            hash = (hash ^ chunk[i]) * 16777619u;
+        }
+    }
+
+    return hash ^ len;
+}
+
+/** Number of response cache generations; group IDs share them modulo this. */
+#define SMP_CACHE_GENS          16
+
+/**
+ * The current response cache generation of each command group, shared by all
+ * transports.  A group's generation is advanced by every write to it that is
+ * neither replayable nor marked unchanged, since such a request may change
+ * what a cached request to the group would elicit.  Groups that share a
+ * generation just invalidate each other's entries.
+ */
+static uint32_t smp_cache_gens[SMP_CACHE_GENS];
+
+#define SMP_CACHE_GEN(group_id_) \
+    (&smp_cache_gens[(group_id_) % SMP_CACHE_GENS])
+
+/**
+ * Looks up the cached response to a retransmitted request.  Entries from an
+ * earlier generation of the request's group, or older than the cache's
+ * timeout, are ignored.
+ *
+ * @return                      The matching cache entry, or NULL if there is
+ *                                  none.
+ */
+static const struct smp_rsp_cache_entry *
+smp_cache_find(const struct smp_rsp_cache *cache,
+               const struct mgmt_hdr *raw_hdr, uint32_t hash, uint32_t gen)
+{
+    const struct smp_rsp_cache_entry *entry;
+    uint32_t now;
+    int i;
+
+    now = 0;
+    if (cache->src_timeout_ms != 0) {
+        now = mgmt_impl_uptime_ms();
+    }
+
+    for (i = 0; i < cache->src_num_entries; i++) {
+        entry = &cache->src_entries[i];
+        if (entry->sce_rsp_len != 0 &&
+            entry->sce_gen == gen &&
+            entry->sce_req_hash == hash &&
+            memcmp(&entry->sce_req_hdr, raw_hdr, sizeof *raw_hdr) == 0) {
+
+            if (cache->src_timeout_ms != 0 &&
+                now - entry->sce_time_ms > cache->src_timeout_ms) {
+
+                return NULL;
+            }
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Writes a cached response into an empty response buffer.
+ */
+static int
+smp_cache_write_rsp(struct smp_streamer *streamer,
+                    const struct smp_rsp_cache_entry *entry)
+{
+    const struct smp_rsp_cache *cache;
+    int idx;
+
+    cache = streamer->rsp_cache;
+    idx = entry - cache->src_entries;
+
+    return mgmt_streamer_write_at(&streamer->mgmt_stmr, 0,
+                                  cache->src_data + idx * cache->src_entry_size,
+                                  entry->sce_rsp_len);
+}
+
+/**
+ * Copies a freshly-built response into the cache, replacing the oldest entry.
+ * Responses too large for an entry are not cached.
+ */
+static void
+smp_cache_store(struct smp_streamer *streamer, const struct mgmt_hdr *raw_hdr,
+                uint32_t hash, uint32_t gen, void *rsp)
+{
+    struct smp_rsp_cache_entry *entry;
+    struct smp_rsp_cache *cache;
+    struct cbor_decoder_reader *reader;
+    int rc;
+
+    cache = streamer->rsp_cache;
+
+    rc = mgmt_streamer_init_reader(&streamer->mgmt_stmr, rsp);
     if (rc != 0) {
-        return rc;
+        return;
     }
+    reader = streamer->mgmt_stmr.reader;
 
-    return 0;
+    if (reader->message_size > cache->src_entry_size) {
+        return;
+    }
+
+    entry = &cache->src_entries[cache->src_next];
+    reader->cpy(reader,
+                (char *)cache->src_data +
+                    cache->src_next * cache->src_entry_size,
+                0, reader->message_size);
+    entry->sce_req_hdr = *raw_hdr;
+    entry->sce_req_hash = hash;
+    entry->sce_gen = gen;
+    entry->sce_time_ms = mgmt_impl_uptime_ms();
+    entry->sce_rsp_len = reader->message_size;
+
+    cache->src_next = (cache->src_next + 1) % cache->src_num_entries;
+}
+
+#if MGMT_HANDLER_STATS_COUNT > 0
+/**
+ * Indicates the length of the response payload encoded so far; 0 if the
+ * request failed, in which case an error response replaces it.
+ */
+static uint32_t
+smp_rsp_payload_len(struct mgmt_ctxt *cbuf, int status)
+{
+    if (status != 0) {
+        return 0;
+    }
+
+    return cbor_encode_bytes_written(&cbuf->encoder) - MGMT_HDR_SIZE;
+}
+#endif
+
+/**
+ * Hands a complete response to the transport.  This function consumes the
+ * supplied buffer.
+ */
+static int
+smp_tx_rsp(struct smp_streamer *streamer, void *rsp)
+{
+    int rc;
+
+#if MGMT_TRACE_COUNT > 0
+    if (mgmt_streamer_init_reader(&streamer->mgmt_stmr, rsp) == 0) {
+        MGMT_TRACE(MGMT_TRACE_TX, NULL,
+                   streamer->mgmt_stmr.reader->message_size);
+    }
+#endif
+
+    rc = streamer->tx_rsp_cb(streamer, rsp, streamer->mgmt_stmr.cb_arg);
+    MGMT_TRACE(MGMT_TRACE_TX_DONE, NULL, rc);
+    if (rc == 0) {
+        SMP_STATS_INC(SMP_STAT_TX_PKTS);
+    } else {
+        SMP_STATS_INC(SMP_STAT_TX_ERRS);
+    }
+
+    return rc;
 }
 
+/**
+ * Retains the context of the request being handled so that its handler can
+ * complete it later.
+ */
+static struct mgmt_ctxt *
+smp_defer(struct mgmt_ctxt *cbuf, void *arg)
+{
+    struct smp_streamer *streamer;
+    struct smp_deferred *sd;
+
+    streamer = arg;
+    sd = streamer->deferred;
+
+    if (sd->sd_pending) {
+        return NULL;
+    }
+
+    sd->sd_ctxt = *cbuf;
+    sd->sd_ctxt.finish = NULL;
+    sd->sd_req = NULL;
+    sd->sd_rsp = NULL;
+    sd->sd_status = 0;
+    sd->sd_done = false;
+    sd->sd_pending = true;
+
+    return &sd->sd_ctxt;
+}
+
+static void
+smp_complete(struct mgmt_ctxt *cbuf, int status, void *arg)
+{
+    struct smp_streamer *streamer;
+    struct smp_deferred *sd;
+
+    streamer = arg;
+    sd = streamer->deferred;
+
+    assert(cbuf == &sd->sd_ctxt);
+    assert(sd->sd_pending);
+
+    sd->sd_status = status;
+    sd->sd_done = true;
+
+    if (streamer->resume_cb != NULL) {
+        streamer->resume_cb(streamer, streamer->mgmt_stmr.cb_arg);
+    } else {
+        smp_resume_deferred(streamer);
+    }
+}
+
+static const struct mgmt_defer_cfg smp_defer_cfg = {
+    .defer = smp_defer,
+    .complete = smp_complete,
+};
+
 /**
  * Processes a single SMP request and generates a response payload (i.e.,
  * everything after the management header).  On success, the response payload
@@ -144,21 +812,29 @@ smp_build_err_rsp(struct smp_streamer *streamer,
  * response gets written; the caller is expected to build an error response
  * from the return code.
  *
+ * @param streamer              The SMP streamer being processed.
  * @param cbuf                  A cbuf containing the request and response
  *                                  buffer.
  * @param req_hdr               The management header belonging to the incoming
  *                                  request (host-byte order).
  *
- * @return                      A MGMT_ERR_[...] error code.
+ * @return                      A MGMT_ERR_[...] error code;
+ *                              MGMT_DEFERRED if the handler deferred the
+ *                                  response.
  */
 static int
-smp_handle_single_payload(struct mgmt_ctxt *cbuf,
+smp_handle_single_payload(struct smp_streamer *streamer,
+                          struct mgmt_ctxt *cbuf,
                           const struct mgmt_hdr *req_hdr)
 {
     const struct mgmt_handler *handler;
     struct CborEncoder payload_encoder;
+    uint32_t start;
     int rc;
 
+    /* Nothing changes unless a write handler runs. */
+    cbuf->unchanged = true;
+
     handler = mgmt_find_handler(req_hdr->nh_group, req_hdr->nh_id);
     if (handler == NULL) {
         return MGMT_ERR_ENOTSUP;
@@ -174,6 +850,9 @@ smp_handle_single_payload(struct mgmt_ctxt *cbuf,
         return rc;
     }
 
+    MGMT_TRACE(MGMT_TRACE_HANDLER, req_hdr, 0);
+    start = MGMT_HANDLER_STATS_NOW();
+
     switch (req_hdr->nh_op) {
     case MGMT_OP_READ:
         if (handler->mh_read != NULL) {
@@ -185,6 +864,7 @@ smp_handle_single_payload(struct mgmt_ctxt *cbuf,
 
     case MGMT_OP_WRITE:
         if (handler->mh_write != NULL) {
+            cbuf->unchanged = false;
             rc = handler->mh_write(cbuf);
         } else {
             rc = MGMT_ERR_ENOTSUP;
@@ -195,13 +875,34 @@ smp_handle_single_payload(struct mgmt_ctxt *cbuf,
         rc = MGMT_ERR_EINVAL;
         break;
     }
-    if (rc != 0) {
-        return rc;
+
+    MGMT_TRACE(MGMT_TRACE_HANDLER_DONE, req_hdr, rc);
+
+    if (streamer->deferred != NULL && streamer->deferred->sd_pending) {
+        if (rc == MGMT_DEFERRED) {
+            /* Retain what is needed to finish the response later. */
+            streamer->deferred->sd_payload = payload_encoder;
+            streamer->deferred->sd_req_hdr = *req_hdr;
+            streamer->deferred->sd_start_cycles = start;
+            return MGMT_DEFERRED;
+        }
+
+        /* The handler changed its mind. */
+        streamer->deferred->sd_pending = false;
     }
 
-    /* End response payload. */
-    rc = cbor_encoder_close_container(&cbuf->encoder, &payload_encoder);
-    return mgmt_err_from_cbor(rc);
+    if (rc == MGMT_DEFERRED) {
+        /* Nothing was deferred. */
+        rc = MGMT_ERR_EUNKNOWN;
+    }
+    if (rc == 0) {
+        /* End response payload. */
+        rc = cbor_encoder_close_container(&cbuf->encoder, &payload_encoder);
+        rc = mgmt_err_from_cbor(rc);
+    }
+
+    MGMT_HANDLER_STATS_REC(req_hdr, rc, smp_rsp_payload_len(cbuf, rc), start);
+    return rc;
 }
 
 /**
@@ -214,22 +915,43 @@ smp_handle_single_payload(struct mgmt_ctxt *cbuf,
  *                                  and writing the response.
  * @param req_hdr               The management header belonging to the incoming
  *                                  request (host-byte order).
+ * @param session_key           Identifies the peer that sent the request;
+ *                                  NULL if unknown.
+ * @param session_key_len       The length of the session key, in bytes.
+ * @param out_replayable        Indicates whether the handler marked its
+ *                                  response as replayable.
+ * @param out_unchanged         Indicates whether the request is known to
+ *                                  have changed no state, even if it failed.
  *
- * @return                      A MGMT_ERR_[...] error code.
+ * @return                      A MGMT_ERR_[...] error code;
+ *                              MGMT_DEFERRED if the handler deferred the
+ *                                  response.
  */
 static int
 smp_handle_single_req(struct smp_streamer *streamer,
-                      const struct mgmt_hdr *req_hdr)
+                      const struct mgmt_hdr *req_hdr,
+                      const void *session_key, size_t session_key_len,
+                      bool *out_replayable, bool *out_unchanged)
 {
     struct mgmt_ctxt cbuf;
     struct mgmt_hdr rsp_hdr;
     int rc;
 
+    *out_replayable = false;
+    *out_unchanged = true;
+
     rc = mgmt_ctxt_init(&cbuf, &streamer->mgmt_stmr);
     if (rc != 0) {
         return rc;
     }
 
+    if (streamer->deferred != NULL) {
+        cbuf.defer_cfg = &smp_defer_cfg;
+        cbuf.defer_arg = streamer;
+    }
+    cbuf.session_key = session_key;
+    cbuf.session_key_len = session_key_len;
+
     /* Write a dummy header to the beginning of the response buffer.  Some
      * fields will need to be fixed up later.
      */
@@ -240,20 +962,15 @@ smp_handle_single_req(struct smp_streamer *streamer,
     }
 
     /* Process the request and write the response payload. */
-    rc = smp_handle_single_payload(&cbuf, req_hdr);
+    rc = smp_handle_single_payload(streamer, &cbuf, req_hdr);
+    *out_unchanged = cbuf.unchanged;
     if (rc != 0) {
         return rc;
     }
+    *out_replayable = cbuf.replayable;
 
     /* Fix up the response header with the correct length. */
-    rsp_hdr.nh_len = cbor_encode_bytes_written(&cbuf.encoder) - MGMT_HDR_SIZE;
-    mgmt_hton_hdr(&rsp_hdr);
-    rc = smp_write_hdr(streamer, &rsp_hdr);
-    if (rc != 0) {
-        return rc;
-    }
-
-    return 0;
+    return smp_fixup_rsp_hdr(streamer, req_hdr, &cbuf.encoder);
 }
 
 /**
@@ -275,9 +992,15 @@ smp_on_err(struct smp_streamer *streamer, const struct mgmt_hdr *req_hdr,
 {
     int rc;
 
+    SMP_STATS_INC(SMP_STAT_ERR_RSPS);
+
     /* Prefer the response buffer for holding the error response.  If no
-     * response buffer was allocated, use the request buffer instead.
+     * response buffer was allocated, use the transport's reserved error
+     * buffer, or failing that, the request buffer.
      */
+    if (rsp == NULL && streamer->err_buf_cb != NULL) {
+        rsp = streamer->err_buf_cb(streamer, req, streamer->mgmt_stmr.cb_arg);
+    }
     if (rsp == NULL) {
         rsp = req;
         req = NULL;
@@ -290,7 +1013,7 @@ smp_on_err(struct smp_streamer *streamer, const struct mgmt_hdr *req_hdr,
     /* Build and transmit the error response. */
     rc = smp_build_err_rsp(streamer, req_hdr, status);
     if (rc == 0) {
-        streamer->tx_rsp_cb(streamer, rsp, streamer->mgmt_stmr.cb_arg);
+        smp_tx_rsp(streamer, rsp);
         rsp = NULL;
     }
 
@@ -299,30 +1022,200 @@ smp_on_err(struct smp_streamer *streamer, const struct mgmt_hdr *req_hdr,
     mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
 }
 
+/**
+ * Appends a complete response to a packet of coalesced responses.  The
+ * response is padded to a 4-byte boundary, mirroring the layout of packed
+ * requests.  Neither buffer is consumed.
+ *
+ * @param streamer              The SMP streamer to use for copying.
+ * @param batch                 The packet of coalesced responses.
+ * @param batch_len             The length of the coalesced packet.  On
+ *                                  success, this gets updated to reflect the
+ *                                  appended response.
+ * @param rsp                   The response to append.
+ * @param rsp_len               The length of the response to append.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_EMSGSIZE if the response does not fit;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+static int
+smp_append_rsp(struct smp_streamer *streamer, void *batch, size_t *batch_len,
+               void *rsp, size_t rsp_len)
+{
+    static const uint8_t pad_bytes[3];
+    struct cbor_decoder_reader *reader;
+    uint8_t chunk[32];
+    size_t chunk_len;
+    size_t off;
+    size_t pad;
+    size_t max;
+    int rc;
+
+    pad = smp_align4(*batch_len) - *batch_len;
+
+    max = streamer->rsp_max_cb(streamer, batch, streamer->mgmt_stmr.cb_arg);
+    if (*batch_len + pad + rsp_len > max) {
+        return MGMT_ERR_EMSGSIZE;
+    }
+
+    rc = mgmt_streamer_init_reader(&streamer->mgmt_stmr, rsp);
+    if (rc != 0) {
+        return rc;
+    }
+    reader = streamer->mgmt_stmr.reader;
+
+    rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, batch);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (pad > 0) {
+        rc = mgmt_streamer_write_at(&streamer->mgmt_stmr, *batch_len,
+                                    pad_bytes, pad);
+        if (rc != 0) {
+            return rc;
+        }
+        *batch_len += pad;
+    }
+
+    for (off = 0; off < rsp_len; off += chunk_len) {
+        chunk_len = rsp_len - off;
+        if (chunk_len > sizeof chunk) {
+            chunk_len = sizeof chunk;
+        }
+
+        reader->cpy(reader, (char *)chunk, off, chunk_len);
+        rc = mgmt_streamer_write_at(&streamer->mgmt_stmr, *batch_len + off,
+                                    chunk, chunk_len);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    *batch_len += rsp_len;
+
+    return 0;
+}
+
+/**
+ * Sends a complete response, or holds it for coalescing with subsequent
+ * responses if the streamer supports it.  This function consumes the supplied
+ * response buffer.
+ *
+ * @param streamer              The SMP streamer to transmit via.
+ * @param batch                 The packet of held responses, or NULL if none
+ *                                  are held.  This gets updated if the held
+ *                                  packet is sent or replaced.
+ * @param batch_len             The length of the held packet.
+ * @param spare                 If the response gets copied into the held
+ *                                  packet, its emptied buffer gets written
+ *                                  here for reuse by the next response.
+ * @param rsp                   The response to send.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+static int
+smp_send_rsp(struct smp_streamer *streamer, void **batch, size_t *batch_len,
+             void **spare, void *rsp)
+{
+    size_t rsp_len;
+    int rc;
+
+    if (streamer->rsp_max_cb == NULL) {
+        return smp_tx_rsp(streamer, rsp);
+    }
+
+    rc = mgmt_streamer_init_reader(&streamer->mgmt_stmr, rsp);
+    if (rc != 0) {
+        mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
+        return rc;
+    }
+    rsp_len = streamer->mgmt_stmr.reader->message_size;
+
+    if (*batch != NULL) {
+        rc = smp_append_rsp(streamer, *batch, batch_len, rsp, rsp_len);
+        if (rc == 0) {
+            if (*spare == NULL) {
+                mgmt_streamer_reset_buf(&streamer->mgmt_stmr, rsp);
+                *spare = rsp;
+            } else {
+                mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
+            }
+            return 0;
+        }
+
+        /* The response doesn't fit; send the held packet and start a new
+         * one.
+         */
+        rc = smp_tx_rsp(streamer, *batch);
+        *batch = NULL;
+        if (rc != 0) {
+            mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
+            return rc;
+        }
+    }
+
+    *batch = rsp;
+    *batch_len = rsp_len;
+    return 0;
+}
+
 /**
  * Processes all SMP requests in an incoming packet.  Requests are processed
  * sequentially from the start of the packet to the end.  Each response is sent
  * individually in its own packet.  If a request elicits an error response,
- * processing of the packet is aborted.  This function consumes the supplied
- * request buffer regardless of the outcome.
+ * processing of the packet is aborted.  If a handler defers its response, the
+ * remainder of the packet is retained until the handler completes.  This
+ * function consumes the supplied request buffer regardless of the outcome.
  *
  * @param streamer              The streamer to use for reading, writing, and
  *                                  transmitting.
  * @param req                   A buffer containing the request packet.
  *
- * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ * @return                      0 on success;
+ *                              MGMT_DEFERRED if a response was deferred;
+ *                              Other MGMT_ERR_[...] code on failure.
  */
 int
 smp_process_request_packet(struct smp_streamer *streamer, void *req)
 {
+    const struct smp_rsp_cache_entry *cached;
+    struct mgmt_hdr raw_hdr;
     struct mgmt_hdr req_hdr;
+    const void *session_key;
+    size_t session_key_len;
+    uint32_t cache_gen;
+    uint32_t req_hash;
+    size_t batch_len;
+    void *batch;
+    void *spare;
     void *rsp;
+    bool replayable;
+    bool unchanged;
     bool valid_hdr;
+    int batch_rc;
     int rc;
 
     rsp = NULL;
+    batch = NULL;
+    batch_len = 0;
+    spare = NULL;
+    req_hash = 0;
     valid_hdr = true;
 
+    SMP_STATS_INC(SMP_STAT_RX_PKTS);
+
+#if MGMT_TRACE_COUNT > 0
+    if (mgmt_streamer_init_reader(&streamer->mgmt_stmr, req) == 0) {
+        MGMT_TRACE(MGMT_TRACE_PKT, NULL,
+                   streamer->mgmt_stmr.reader->message_size);
+    }
+#endif
+
+    /* All requests in a packet come from the same peer. */
+    session_key = mgmt_streamer_session_key(&streamer->mgmt_stmr, req,
+                                            &session_key_len);
+
     while (1) {
         rc = mgmt_streamer_init_reader(&streamer->mgmt_stmr, req);
         if (rc != 0) {
@@ -336,13 +1229,41 @@ smp_process_request_packet(struct smp_streamer *streamer, void *req)
             valid_hdr = false;
             break;
         }
+        raw_hdr = req_hdr;
         mgmt_ntoh_hdr(&req_hdr);
         mgmt_streamer_trim_front(&streamer->mgmt_stmr, req, MGMT_HDR_SIZE);
+        MGMT_TRACE(MGMT_TRACE_REQ, &req_hdr, req_hdr.nh_len);
+        SMP_STATS_INC(SMP_STAT_RX_REQS);
 
-        rsp = mgmt_streamer_alloc_rsp(&streamer->mgmt_stmr, req);
-        if (rsp == NULL) {
-            rc = MGMT_ERR_ENOMEM;
-            break;
+        /* Read before the request is handled, so that a response built
+         * while another transport changes state is never used.
+         */
+        cache_gen = __atomic_load_n(SMP_CACHE_GEN(req_hdr.nh_group),
+                                    __ATOMIC_ACQUIRE);
+
+        cached = NULL;
+        if (streamer->rsp_cache != NULL && req_hdr.nh_op == MGMT_OP_WRITE) {
+            /* Re-initialize the reader so that it excludes the header. */
+            rc = mgmt_streamer_init_reader(&streamer->mgmt_stmr, req);
+            if (rc != 0) {
+                break;
+            }
+            req_hash = smp_hash_req(streamer, req_hdr.nh_len, session_key,
+                                    session_key_len);
+            cached = smp_cache_find(streamer->rsp_cache, &raw_hdr, req_hash,
+                                    cache_gen);
+        }
+
+        if (spare != NULL) {
+            rsp = spare;
+            spare = NULL;
+        } else {
+            rsp = mgmt_streamer_alloc_rsp(&streamer->mgmt_stmr, req);
+            if (rsp == NULL) {
+                SMP_STATS_INC(SMP_STAT_ALLOC_FAILS);
+                rc = MGMT_ERR_ENOMEM;
+                break;
+            }
         }
 
         rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, rsp);
@@ -350,14 +1271,44 @@ smp_process_request_packet(struct smp_streamer *streamer, void *req)
             break;
         }
 
-        /* Process the request payload and build the response. */
-        rc = smp_handle_single_req(streamer, &req_hdr);
+        if (cached != NULL) {
+            /* Retransmitted request; resend the original response. */
+            SMP_STATS_INC(SMP_STAT_CACHE_HITS);
+            rc = smp_cache_write_rsp(streamer, cached);
+            if (rc != 0) {
+                break;
+            }
+        } else {
+            /* Process the request payload and build the response. */
+            rc = smp_handle_single_req(streamer, &req_hdr, session_key,
+                                       session_key_len, &replayable,
+                                       &unchanged);
+            if (req_hdr.nh_op == MGMT_OP_WRITE && !replayable && !unchanged) {
+                /* Whether or not it succeeded, the request may have changed
+                 * its group's state; no cached response from the group is
+                 * safe to resend.
+                 */
+                __atomic_fetch_add(SMP_CACHE_GEN(req_hdr.nh_group), 1,
+                                   __ATOMIC_RELEASE);
+            }
+            if (rc == 0 && streamer->definite_len) {
+                smp_make_definite(streamer, &rsp, &spare);
+            }
+            if (rc == 0 && replayable && streamer->rsp_cache != NULL) {
+                smp_cache_store(streamer, &raw_hdr, req_hash, cache_gen, rsp);
+            }
+        }
+        if (rc == MGMT_DEFERRED) {
+            mgmt_streamer_trim_front(&streamer->mgmt_stmr, req,
+                                     smp_align4(req_hdr.nh_len));
+            break;
+        }
         if (rc != 0) {
             break;
         }
 
         /* Send the response. */
-        rc = streamer->tx_rsp_cb(streamer, rsp, streamer->mgmt_stmr.cb_arg);
+        rc = smp_send_rsp(streamer, &batch, &batch_len, &spare, rsp);
         rsp = NULL;
         if (rc != 0) {
             break;
@@ -368,12 +1319,93 @@ smp_process_request_packet(struct smp_streamer *streamer, void *req)
                                  smp_align4(req_hdr.nh_len));
     }
 
+    /* Send any held responses.  This happens before an error response is
+     * sent so that responses arrive in request order.
+     */
+    batch_rc = 0;
+    if (batch != NULL) {
+        batch_rc = smp_tx_rsp(streamer, batch);
+    }
+    if (spare != NULL) {
+        mgmt_streamer_free_buf(&streamer->mgmt_stmr, spare);
+    }
+
+    if (rc == MGMT_DEFERRED) {
+        /* Hold on to both buffers until the handler completes. */
+        streamer->deferred->sd_req = req;
+        streamer->deferred->sd_rsp = rsp;
+        MGMT_TRACE(MGMT_TRACE_PKT_DONE, NULL, rc);
+        return MGMT_DEFERRED;
+    }
+
     if (rc != 0 && valid_hdr) {
         smp_on_err(streamer, &req_hdr, req, rsp, rc);
+        MGMT_TRACE(MGMT_TRACE_PKT_DONE, NULL, rc);
         return rc;
     }
 
     mgmt_streamer_free_buf(&streamer->mgmt_stmr, req);
     mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
-    return 0;
+    MGMT_TRACE(MGMT_TRACE_PKT_DONE, NULL, batch_rc);
+    return batch_rc;
+}
+
+int
+smp_resume_deferred(struct smp_streamer *streamer)
+{
+    struct smp_deferred *sd;
+    void *spare;
+    void *req;
+    void *rsp;
+    int rc;
+
+    sd = streamer->deferred;
+    if (sd == NULL || !sd->sd_pending) {
+        return 0;
+    }
+
+    if (!sd->sd_done) {
+        return MGMT_DEFERRED;
+    }
+
+    req = sd->sd_req;
+    rsp = sd->sd_rsp;
+    sd->sd_pending = false;
+
+    rc = sd->sd_status;
+    if (sd->sd_ctxt.finish != NULL) {
+        /* The handler encodes its response in this task. */
+        rc = sd->sd_ctxt.finish(&sd->sd_ctxt, rc);
+    }
+    MGMT_HANDLER_STATS_REC(&sd->sd_req_hdr, rc,
+                           smp_rsp_payload_len(&sd->sd_ctxt, rc),
+                           sd->sd_start_cycles);
+    if (rc == 0) {
+        /* End response payload. */
+        rc = cbor_encoder_close_container(&sd->sd_ctxt.encoder,
+                                          &sd->sd_payload);
+        rc = mgmt_err_from_cbor(rc);
+    }
+    if (rc == 0) {
+        rc = smp_fixup_rsp_hdr(streamer, &sd->sd_req_hdr,
+                               &sd->sd_ctxt.encoder);
+    }
+    if (rc == 0 && streamer->definite_len) {
+        spare = NULL;
+        smp_make_definite(streamer, &rsp, &spare);
+        if (spare != NULL) {
+            mgmt_streamer_free_buf(&streamer->mgmt_stmr, spare);
+        }
+    }
+    if (rc == 0) {
+        rc = smp_tx_rsp(streamer, rsp);
+        rsp = NULL;
+    }
+    if (rc != 0) {
+        smp_on_err(streamer, &sd->sd_req_hdr, req, rsp, rc);
+        return rc;
+    }
+
+    /* Process the requests that followed the deferred one. */
+    return smp_process_request_packet(streamer, req);
 }
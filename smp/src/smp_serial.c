@@ -0,0 +1,322 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "mgmt/mgmt.h"
+#include "smp/smp.h"
+#include "smp/smp_serial.h"
+
+/* Most packet bytes that fit in one frame: the frame's base64 characters,
+ * less delimiter and newline, decode to this many bytes.
+ */
+#define SMP_SERIAL_FRAME_RAW_MAX    (((SMP_SERIAL_FRAME_MAX - 3) / 4) * 3)
+
+#define SMP_SERIAL_STATE_LINE_START 0
+#define SMP_SERIAL_STATE_DELIM_PKT  1
+#define SMP_SERIAL_STATE_DELIM_FRAG 2
+#define SMP_SERIAL_STATE_BODY       3
+#define SMP_SERIAL_STATE_SKIP       4
+
+/* CRC-16-CCITT, four bits at a time. */
+static const uint16_t smp_serial_crc16_tbl[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+static uint16_t
+smp_serial_crc16_byte(uint16_t crc, uint8_t byte)
+{
+    crc = (crc << 4) ^ smp_serial_crc16_tbl[((crc >> 12) ^ (byte >> 4)) & 0xf];
+    crc = (crc << 4) ^ smp_serial_crc16_tbl[((crc >> 12) ^ byte) & 0xf];
+    return crc;
+}
+
+uint16_t
+smp_serial_crc16(uint16_t crc, const void *data, size_t len)
+{
+    const uint8_t *u8p;
+    size_t i;
+
+    u8p = data;
+    for (i = 0; i < len; i++) {
+        crc = smp_serial_crc16_byte(crc, u8p[i]);
+    }
+
+    return crc;
+}
+
+void
+smp_serial_rx_init(struct smp_serial_rx *ssr)
+{
+    *ssr = (struct smp_serial_rx) { 0 };
+}
+
+void
+smp_serial_rx_set_buf(struct smp_serial_rx *ssr, void *buf, size_t size)
+{
+    ssr->ssr_buf = buf;
+    ssr->ssr_buf_size = size;
+}
+
+/**
+ * Abandons the packet being received.  The rest of the current line is
+ * ignored.
+ */
+static void
+smp_serial_rx_fail(struct smp_serial_rx *ssr, uint32_t *counter,
+                   uint8_t byte)
+{
+    (*counter)++;
+    ssr->ssr_in_pkt = 0;
+
+    if (byte == '\n') {
+        ssr->ssr_state = SMP_SERIAL_STATE_LINE_START;
+    } else {
+        ssr->ssr_state = SMP_SERIAL_STATE_SKIP;
+    }
+}
+
+/**
+ * Processes one decoded byte of a packet.
+ *
+ * @return                      0 on success; -1 if the packet was abandoned.
+ */
+static int
+smp_serial_rx_decoded(struct smp_serial_rx *ssr, uint8_t byte)
+{
+    if (ssr->ssr_hdr_bytes < 2) {
+        ssr->ssr_pkt_len = (ssr->ssr_pkt_len << 8) | byte;
+        ssr->ssr_hdr_bytes++;
+
+        if (ssr->ssr_hdr_bytes == 2) {
+            if (ssr->ssr_pkt_len < 2) {
+                smp_serial_rx_fail(ssr, &ssr->ssr_stats.frame_errs, 0);
+                return -1;
+            }
+
+            if (ssr->ssr_buf == NULL ||
+                ssr->ssr_pkt_len - 2 > ssr->ssr_buf_size) {
+
+                smp_serial_rx_fail(ssr, &ssr->ssr_stats.overflows, 0);
+                SMP_STATS_INC(SMP_STAT_RX_DROPS);
+                return -1;
+            }
+        }
+
+        return 0;
+    }
+
+    if (ssr->ssr_off >= ssr->ssr_pkt_len) {
+        smp_serial_rx_fail(ssr, &ssr->ssr_stats.frame_errs, 0);
+        return -1;
+    }
+
+    /* The CRC isn't stored; it is only needed for the running check. */
+    if (ssr->ssr_off < ssr->ssr_pkt_len - 2) {
+        ssr->ssr_buf[ssr->ssr_off] = byte;
+    }
+    ssr->ssr_crc = smp_serial_crc16_byte(ssr->ssr_crc, byte);
+    ssr->ssr_off++;
+
+    return 0;
+}
+
+/**
+ * Processes the newline that ends a frame.
+ *
+ * @return                      The packet length if the packet is complete;
+ *                              0 otherwise.
+ */
+static int
+smp_serial_rx_eol(struct smp_serial_rx *ssr)
+{
+    ssr->ssr_state = SMP_SERIAL_STATE_LINE_START;
+
+    if (!base64_decoder_done(&ssr->ssr_b64)) {
+        smp_serial_rx_fail(ssr, &ssr->ssr_stats.frame_errs, '\n');
+        return 0;
+    }
+
+    if (ssr->ssr_hdr_bytes < 2 || ssr->ssr_off < ssr->ssr_pkt_len) {
+        /* More frames to come. */
+        return 0;
+    }
+
+    ssr->ssr_in_pkt = 0;
+
+    /* Running the CRC over the data and its big-endian CRC yields 0. */
+    if (ssr->ssr_crc != 0) {
+        ssr->ssr_stats.crc_errs++;
+        return 0;
+    }
+
+    ssr->ssr_stats.pkts++;
+    return ssr->ssr_pkt_len - 2;
+}
+
+int
+smp_serial_rx_byte(struct smp_serial_rx *ssr, uint8_t byte)
+{
+    uint8_t decoded[3];
+    char c;
+    int rc;
+    int i;
+
+    switch (ssr->ssr_state) {
+    case SMP_SERIAL_STATE_LINE_START:
+        if (byte == SMP_SERIAL_DELIM_PKT_1) {
+            ssr->ssr_state = SMP_SERIAL_STATE_DELIM_PKT;
+        } else if (byte == SMP_SERIAL_DELIM_FRAG_1) {
+            ssr->ssr_state = SMP_SERIAL_STATE_DELIM_FRAG;
+        } else if (byte != '\n') {
+            /* Console text. */
+            ssr->ssr_state = SMP_SERIAL_STATE_SKIP;
+        }
+        return 0;
+
+    case SMP_SERIAL_STATE_DELIM_PKT:
+        if (byte != SMP_SERIAL_DELIM_PKT_2) {
+            ssr->ssr_state = SMP_SERIAL_STATE_SKIP;
+            return 0;
+        }
+
+        /* A new packet replaces any incomplete one. */
+        if (ssr->ssr_in_pkt) {
+            ssr->ssr_stats.frame_errs++;
+        }
+        ssr->ssr_in_pkt = 1;
+        ssr->ssr_off = 0;
+        ssr->ssr_pkt_len = 0;
+        ssr->ssr_hdr_bytes = 0;
+        ssr->ssr_crc = 0;
+        base64_decoder_init(&ssr->ssr_b64);
+        ssr->ssr_state = SMP_SERIAL_STATE_BODY;
+        return 0;
+
+    case SMP_SERIAL_STATE_DELIM_FRAG:
+        if (byte != SMP_SERIAL_DELIM_FRAG_2 || !ssr->ssr_in_pkt) {
+            ssr->ssr_state = SMP_SERIAL_STATE_SKIP;
+            return 0;
+        }
+
+        base64_decoder_init(&ssr->ssr_b64);
+        ssr->ssr_state = SMP_SERIAL_STATE_BODY;
+        return 0;
+
+    case SMP_SERIAL_STATE_BODY:
+        if (byte == '\n') {
+            return smp_serial_rx_eol(ssr);
+        }
+        if (byte == '\r') {
+            return 0;
+        }
+
+        c = byte;
+        rc = base64_decoder_feed(&ssr->ssr_b64, &c, 1, decoded);
+        if (rc < 0) {
+            smp_serial_rx_fail(ssr, &ssr->ssr_stats.frame_errs, byte);
+            return 0;
+        }
+
+        for (i = 0; i < rc; i++) {
+            if (smp_serial_rx_decoded(ssr, decoded[i]) != 0) {
+                return 0;
+            }
+        }
+        return 0;
+
+    case SMP_SERIAL_STATE_SKIP:
+    default:
+        if (byte == '\n') {
+            ssr->ssr_state = SMP_SERIAL_STATE_LINE_START;
+        }
+        return 0;
+    }
+}
+
+/**
+ * Retrieves the byte at the specified offset of a packet's unencoded frame
+ * data: the length field, the packet, and the CRC.
+ */
+static uint8_t
+smp_serial_tx_byte(const uint8_t *data, int len, uint16_t crc, int off)
+{
+    if (off < 2) {
+        return (len + 2) >> (off == 0 ? 8 : 0);
+    }
+
+    off -= 2;
+    if (off < len) {
+        return data[off];
+    }
+
+    off -= len;
+    return crc >> (off == 0 ? 8 : 0);
+}
+
+int
+smp_serial_tx_pkt(const void *data, int len, smp_serial_write_fn *write_cb,
+                  void *arg)
+{
+    /* One extra byte for base64_encode()'s null terminator. */
+    char frame[SMP_SERIAL_FRAME_MAX + 1];
+    uint8_t raw[SMP_SERIAL_FRAME_RAW_MAX];
+    uint16_t crc;
+    int raw_len;
+    int enc_len;
+    int total;
+    int off;
+    int rc;
+
+    if (len < 0 || len + 2 > UINT16_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    crc = smp_serial_crc16(0, data, len);
+    total = len + 4;
+
+    for (off = 0; off < total; off += raw_len) {
+        for (raw_len = 0;
+             raw_len < sizeof raw && off + raw_len < total;
+             raw_len++) {
+
+            raw[raw_len] = smp_serial_tx_byte(data, len, crc, off + raw_len);
+        }
+
+        if (off == 0) {
+            frame[0] = SMP_SERIAL_DELIM_PKT_1;
+            frame[1] = SMP_SERIAL_DELIM_PKT_2;
+        } else {
+            frame[0] = SMP_SERIAL_DELIM_FRAG_1;
+            frame[1] = SMP_SERIAL_DELIM_FRAG_2;
+        }
+
+        enc_len = base64_encode(raw, raw_len, frame + 2, 1);
+        assert(enc_len + 3 <= SMP_SERIAL_FRAME_MAX);
+        frame[enc_len + 2] = '\n';
+
+        rc = write_cb(frame, enc_len + 3, arg);
+        if (rc != 0) {
+            return MGMT_ERR_EUNKNOWN;
+        }
+    }
+
+    return 0;
+}